@@ -0,0 +1,80 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file angle_trigger.cpp
+/// @brief Class that detects when an axis reaches trigger angles (microstep indices within a revolution).
+
+#include "angle_trigger.h"
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+AngleTrigger::AngleTrigger() {}
+
+AngleTrigger::~AngleTrigger() {}
+
+bool AngleTrigger::Add(int32_t angle_microsteps) {
+  int32_t remainder = angle_microsteps % kMicrostepsPerRevolution;
+  uint16_t index = static_cast<uint16_t>(remainder < 0 ? remainder + kMicrostepsPerRevolution : remainder);
+
+  hal::InterruptGuard guard; // Shared with the interrupt.
+  uint16_t insert_at = 0;
+  while (insert_at < size_ && indices_[insert_at] < index) insert_at++;
+  if (insert_at < size_ && indices_[insert_at] == index) return true;
+  if (size_ == kMaxIndices) return false;
+
+  for (uint16_t i = size_; i > insert_at; i--) indices_[i] = indices_[i - 1];
+  indices_[insert_at] = index;
+  size_++;
+  if (index <= index_) cursor_++;
+  return true;
+}
+
+void AngleTrigger::Clear() {
+  hal::InterruptGuard guard; // Shared with the interrupt.
+  size_ = 0;
+  cursor_ = 0;
+}
+
+uint16_t AngleTrigger::size() const {
+  return size_;
+}
+
+bool AngleTrigger::Advance(int32_t position) {
+  bool reached = false;
+  while (position_ < position) {
+    position_++;
+    if (++index_ == kMicrostepsPerRevolution) {
+      index_ = 0;
+      cursor_ = 0;
+    }
+
+    if (cursor_ < size_ && indices_[cursor_] == index_) {
+      cursor_++;
+      reached = true;
+    }
+  }
+
+  while (position_ > position) {
+    position_--;
+    if (cursor_ > 0 && indices_[cursor_ - 1] == index_) cursor_--; // Leaving an index.
+    if (index_ == 0) {
+      index_ = kMicrostepsPerRevolution - 1;
+      cursor_ = size_;
+    }
+    else {
+      index_--;
+    }
+
+    if (cursor_ > 0 && indices_[cursor_ - 1] == index_) reached = true;
+  }
+
+  return reached;
+}
+
+} // namespace mtspin
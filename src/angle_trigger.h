@@ -0,0 +1,77 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file angle_trigger.h
+/// @brief Class that detects when an axis reaches trigger angles (microstep indices within a revolution).
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "motion_math.h"
+
+namespace mtspin {
+
+/// @brief The Angle Trigger class.
+/// Trigger angles are converted once (when added) into microstep indices within a revolution, and kept sorted. The
+/// step timer interrupt passes every new position of the axis to Advance(), which tracks the index of the position
+/// within a revolution and a cursor into the sorted indices incrementally, so detecting a trigger needs no division,
+/// however many indices there are. An index is reached whenever the axis arrives at it, in either direction, on any
+/// revolution.
+class AngleTrigger {
+ public:
+
+#if defined(ARDUINO_ARCH_AVR)
+  inline static constexpr uint16_t kMaxIndices = 36; ///< Largest no. of trigger indices (e.g., every 10 degrees).
+#else
+  inline static constexpr uint16_t kMaxIndices = 360; ///< Largest no. of trigger indices (e.g., every degree).
+#endif
+
+  /// @brief No. of microsteps per revolution (the range of the trigger indices).
+  inline static constexpr uint16_t kMicrostepsPerRevolution = static_cast<uint16_t>(mtspin::kMicrostepsPerRevolution);
+
+  static_assert(mtspin::kMicrostepsPerRevolution <= UINT16_MAX
+                && static_cast<float>(kMicrostepsPerRevolution) == mtspin::kMicrostepsPerRevolution,
+                "Angle triggers need a whole no. of microsteps (up to 65535) per revolution; check the gear ratio.");
+
+  /// @brief Construct an Angle Trigger object.
+  AngleTrigger();
+
+  /// @brief Destroy the Angle Trigger object.
+  ~AngleTrigger();
+
+  /// @brief Add a trigger angle.
+  /// @param angle_microsteps The angle (microsteps, relative to the startup position); any whole no. of revolutions is
+  /// ignored.
+  /// @return True if added (or already present), false if the maximum no. of indices is reached.
+  bool Add(int32_t angle_microsteps);
+
+  /// @brief Remove all trigger angles.
+  void Clear();
+
+  /// @brief Get the no. of trigger indices.
+  /// @return The no. of trigger indices.
+  uint16_t size() const;
+
+  // Interrupt context.
+
+  /// @brief Follow the axis to a new position (interrupt context).
+  /// @param position The position (microsteps) after the latest step; at most a few microsteps from the previous one.
+  /// @return True if a trigger index was reached on the way.
+  bool Advance(int32_t position);
+
+ private:
+
+  // Indices (shared with the control loop; changed with interrupts disabled).
+  uint16_t indices_[kMaxIndices] = {}; ///< Trigger indices (microsteps within a revolution), in ascending order.
+  uint16_t size_ = 0; ///< No. of trigger indices.
+
+  // Tracking state (owned by the step timer interrupt).
+  int32_t position_ = 0; ///< The position (microsteps) of the axis.
+  uint16_t index_ = 0; ///< The position within a revolution (0 to kMicrostepsPerRevolution - 1).
+  uint16_t cursor_ = 0; ///< No. of trigger indices at or below index_.
+};
+
+} // namespace mtspin
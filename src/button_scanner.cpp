@@ -0,0 +1,118 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file button_scanner.cpp
+/// @brief Class to scan and debounce a group of momentary buttons together, and detect short/long presses.
+
+#include "button_scanner.h"
+
+#include <Arduino.h>
+#include <momentary_button.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+ButtonScanner::ButtonScanner(const uint8_t* pins, uint8_t count, mt::MomentaryButton::PinState unpressed_pin_state,
+                             uint16_t debounce_period_ms, uint16_t short_press_period_ms,
+                             uint16_t long_press_period_ms)
+    : pin_bank_(pins, count) {
+  uint8_t all_buttons = static_cast<uint8_t>((1U << pin_bank_.count()) - 1);
+  unpressed_states_ = unpressed_pin_state == mt::MomentaryButton::PinState::kHigh ? all_buttons : 0;
+
+  // A state change takes 4 samples to get through the 2-bit vertical counters; at a quarter of the debounce period
+  // (rounded down) apart, 4 samples always fall within a press of the debounce period plus the scan period jitter.
+  uint16_t tick_ms = debounce_period_ms / 4;
+  tick_ms_ = tick_ms == 0 ? 1 : (tick_ms > UINT8_MAX ? UINT8_MAX : static_cast<uint8_t>(tick_ms));
+  short_press_ticks_ = (short_press_period_ms + tick_ms_ / 2) / tick_ms_;
+  long_press_ticks_ = (long_press_period_ms + tick_ms_ / 2) / tick_ms_;
+}
+
+ButtonScanner::~ButtonScanner() {}
+
+void ButtonScanner::Begin() {
+  pin_bank_.Begin();
+  last_tick_time_ms_ = hal::Millis();
+}
+
+void ButtonScanner::Scan() {
+  uint32_t time_ms = hal::Millis();
+  if (time_ms - last_tick_time_ms_ < tick_ms_) return;
+
+  // Keep to the tick schedule, however late this scan is (so the tick is not stretched to a multiple of the scan
+  // period), unless a whole tick behind (e.g., after sleeping).
+  last_tick_time_ms_ += tick_ms_;
+  if (time_ms - last_tick_time_ms_ >= tick_ms_) last_tick_time_ms_ = time_ms;
+  tick_count_++;
+
+  // Debounce all buttons at once: count (per bit) consecutive samples that differ from the debounced state, and
+  // toggle the debounced state when a counter wraps; an agreeing sample clears the counter.
+  uint8_t differing_buttons = (pin_bank_.Read() ^ unpressed_states_) ^ pressed_buttons_;
+  uint8_t changed_buttons = differing_buttons & counter_low_bits_ & counter_high_bits_;
+  counter_high_bits_ = (counter_high_bits_ ^ counter_low_bits_) & differing_buttons;
+  counter_low_bits_ = ~counter_low_bits_ & differing_buttons;
+  pressed_buttons_ ^= changed_buttons;
+
+  // Only buttons that are held, or have just been released, need timing.
+  if ((changed_buttons | pressed_buttons_) != 0) DetectPresses(changed_buttons);
+}
+
+bool ButtonScanner::IsIdle() const {
+  return (pressed_buttons_ | counter_low_bits_ | counter_high_bits_ | short_presses_ | long_presses_) == 0;
+}
+
+mt::MomentaryButton::PressType ButtonScanner::TakePressType(uint8_t button) {
+  uint8_t button_bit = static_cast<uint8_t>(1U << button);
+  if (short_presses_ & button_bit) {
+    short_presses_ &= ~button_bit;
+    return mt::MomentaryButton::PressType::kShortPress;
+  }
+
+  if (long_presses_ & button_bit) {
+    long_presses_ &= ~button_bit;
+    return mt::MomentaryButton::PressType::kLongPress;
+  }
+
+  return mt::MomentaryButton::PressType::kNotApplicable;
+}
+
+void ButtonScanner::set_long_press_option(mt::MomentaryButton::LongPressOption long_press_option) {
+  long_press_option_ = long_press_option;
+}
+
+void ButtonScanner::DetectPresses(uint8_t changed_buttons) {
+  uint8_t button_bit = 1;
+  for (uint8_t button = 0; button < pin_bank_.count(); button++, button_bit <<= 1) {
+    if (!((changed_buttons | pressed_buttons_) & button_bit)) continue;
+
+    if (changed_buttons & pressed_buttons_ & button_bit) {
+      // Pressed.
+      press_start_tick_[button] = tick_count_;
+      long_presses_reported_ &= ~button_bit;
+      continue;
+    }
+
+    uint16_t press_ticks = tick_count_ - press_start_tick_[button];
+    bool long_press_due = press_ticks >= long_press_ticks_ && !(long_presses_reported_ & button_bit);
+    if (pressed_buttons_ & button_bit) {
+      // Held.
+      if (long_press_due && long_press_option_ == mt::MomentaryButton::LongPressOption::kDetectWhileHolding) {
+        long_presses_ |= button_bit;
+        long_presses_reported_ |= button_bit;
+      }
+    }
+    else {
+      // Released.
+      if (press_ticks < short_press_ticks_) {
+        short_presses_ |= button_bit;
+      }
+      else if (long_press_due && long_press_option_ == mt::MomentaryButton::LongPressOption::kDetectAfterRelease) {
+        long_presses_ |= button_bit;
+      }
+    }
+  }
+}
+
+} // namespace mtspin
@@ -0,0 +1,89 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file button_scanner.h
+/// @brief Class to scan and debounce a group of momentary buttons together, and detect short/long presses.
+
+#pragma once
+
+#include <Arduino.h>
+#include <momentary_button.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+/// @brief The Button Scanner class.
+/// All buttons are sampled together (see hal::InputPinBank) on a fixed tick, and debounced in parallel with 2-bit
+/// vertical counters (one bit of each counter per button), so a button state only changes after 4 consecutive
+/// samples (i.e., the debounce period) disagree with it. Presses are then timed per button with the same semantics as
+/// mt::MomentaryButton:
+/// - short press: released before the short press period.
+/// - long press: held for at least the long press period; detected while holding or after release (see
+///   set_long_press_option()).
+class ButtonScanner {
+ public:
+
+  /// @brief Construct a Button Scanner object.
+  /// @param pins The button GPIO pins (button n is on pins[n]).
+  /// @param count The no. of buttons (up to hal::InputPinBank::kMaxPins).
+  /// @param unpressed_pin_state The pin state when a button is not pressed.
+  /// @param debounce_period_ms The debounce period (ms).
+  /// @param short_press_period_ms The short press period (ms).
+  /// @param long_press_period_ms The long press period (ms).
+  ButtonScanner(const uint8_t* pins, uint8_t count, mt::MomentaryButton::PinState unpressed_pin_state,
+                uint16_t debounce_period_ms, uint16_t short_press_period_ms, uint16_t long_press_period_ms);
+
+  /// @brief Destroy the Button Scanner object.
+  ~ButtonScanner();
+
+  /// @brief Initialise the scanner (the button pins must already be configured as inputs).
+  void Begin(); ///< This must be called only once.
+
+  /// @brief Sample and debounce the buttons if a tick is due, and detect presses.
+  void Scan(); ///< This must be called repeatedly.
+
+  /// @brief Check if all buttons are released and settled, with no presses waiting to be taken.
+  /// @return True if idle.
+  bool IsIdle() const;
+
+  /// @brief Take (i.e., get and clear) the press detected for a button.
+  /// @param button The button (index of its pin).
+  /// @return The press type; kNotApplicable if no press has been detected since the last call.
+  mt::MomentaryButton::PressType TakePressType(uint8_t button);
+
+  /// @brief Set the long press option for all buttons.
+  /// @param long_press_option The long press option.
+  void set_long_press_option(mt::MomentaryButton::LongPressOption long_press_option);
+
+ private:
+
+  /// @brief Time the presses of buttons that are held or have just changed state.
+  /// @param changed_buttons The buttons (bits) whose debounced state has just changed.
+  void DetectPresses(uint8_t changed_buttons);
+
+  hal::InputPinBank pin_bank_; ///< The button pins.
+  uint8_t unpressed_states_ = 0; ///< Pin states (bits) of the buttons when not pressed.
+  uint8_t tick_ms_ = 1; ///< Sample period (ms); a quarter of the debounce period (rounded down).
+  uint16_t short_press_ticks_ = 0; ///< The short press period (ticks).
+  uint16_t long_press_ticks_ = 0; ///< The long press period (ticks).
+  mt::MomentaryButton::LongPressOption long_press_option_
+      = mt::MomentaryButton::LongPressOption::kDetectWhileHolding; ///< The long press option.
+
+  // Debouncing state (one bit per button).
+  uint32_t last_tick_time_ms_ = 0; ///< Time (ms) of the last sample.
+  uint16_t tick_count_ = 0; ///< No. of samples taken (wraps).
+  uint8_t counter_low_bits_ = 0; ///< Low bits of the vertical counters.
+  uint8_t counter_high_bits_ = 0; ///< High bits of the vertical counters.
+  uint8_t pressed_buttons_ = 0; ///< Debounced states; set while a button is pressed.
+
+  // Press detection state.
+  uint16_t press_start_tick_[hal::InputPinBank::kMaxPins] = {}; ///< Tick each (pressed) button was pressed at.
+  uint8_t long_presses_reported_ = 0; ///< Buttons (bits) whose current press has been reported as a long press.
+  uint8_t short_presses_ = 0; ///< Buttons (bits) with a short press waiting to be taken.
+  uint8_t long_presses_ = 0; ///< Buttons (bits) with a long press waiting to be taken.
+};
+
+} // namespace mtspin
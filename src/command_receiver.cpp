@@ -0,0 +1,196 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file command_receiver.cpp
+/// @brief Class that receives and parses serial commands (framed binary protocol and legacy single characters).
+
+#include "command_receiver.h"
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+CommandReceiver::CommandReceiver() {}
+
+CommandReceiver::~CommandReceiver() {}
+
+void CommandReceiver::Poll() {
+  // Empty the serial port receive buffer, so it never overflows while commands wait to be parsed (bytes that do not
+  // fit stay in the serial port receive buffer until the next poll).
+  while (!rx_buffer_.IsFull() && hal::SerialAvailable() > 0) rx_buffer_.Push(static_cast<uint8_t>(hal::SerialRead()));
+
+  // Parse as many buffered bytes as there is space for the resulting commands (and their acknowledgements).
+  uint8_t byte = 0;
+  while (!commands_.IsFull() && CanAcknowledge() && rx_buffer_.Pop(byte)) Parse(byte);
+}
+
+bool CommandReceiver::Read(Command& command) {
+  return commands_.Pop(command);
+}
+
+void CommandReceiver::Acknowledge(const Command& command, Status status) {
+  if (!command.framed) return;
+
+  if (unacknowledged_count_ > 0) unacknowledged_count_--;
+  QueueAcknowledgement(command.sequence, static_cast<uint8_t>(command.type), status);
+}
+
+bool CommandReceiver::SendAcknowledgements() {
+  const Acknowledgement* acknowledgement = nullptr;
+  while ((acknowledgement = acknowledgements_.Peek()) != nullptr) {
+    if (hal::SerialAvailableForWrite() < kAcknowledgementSize_) return false;
+
+    uint8_t frame[kAcknowledgementSize_] = {kStartByte, acknowledgement->sequence,
+                                            static_cast<uint8_t>(kAcknowledgementFlag_ | acknowledgement->type), 1,
+                                            static_cast<uint8_t>(acknowledgement->status), 0};
+    uint8_t crc = 0;
+    for (uint8_t i = 1; i < sizeof(frame) - 1; i++) crc = UpdateCrc(crc, frame[i]);
+    frame[sizeof(frame) - 1] = crc;
+    hal::SerialWrite(frame, sizeof(frame));
+    Acknowledgement sent;
+    acknowledgements_.Pop(sent);
+  }
+
+  return true;
+}
+
+void CommandReceiver::Parse(uint8_t byte) {
+  uint32_t time_ms = hal::Millis();
+  if (parser_state_ != ParserState::kStart && (time_ms - last_byte_time_ms_) > kFrameTimeout_ms_) {
+    parser_state_ = ParserState::kStart; // Discard a stale partial frame.
+  }
+
+  last_byte_time_ms_ = time_ms;
+  switch (parser_state_) {
+    case ParserState::kStart: {
+      if (byte == kStartByte) {
+        crc_ = 0;
+        parser_state_ = ParserState::kSequence;
+      }
+      else {
+        // Legacy single character control action.
+        commands_.Push({CommandType::kAction, {byte}, 0, 0, false});
+      }
+
+      break;
+    }
+    case ParserState::kSequence: {
+      sequence_ = byte;
+      crc_ = UpdateCrc(crc_, byte);
+      parser_state_ = ParserState::kType;
+      break;
+    }
+    case ParserState::kType: {
+      type_ = byte;
+      crc_ = UpdateCrc(crc_, byte);
+      parser_state_ = ParserState::kLength;
+      break;
+    }
+    case ParserState::kLength: {
+      length_ = byte;
+      payload_index_ = 0;
+      crc_ = UpdateCrc(crc_, byte);
+      if (length_ > kMaxPayloadSize_) {
+        QueueAcknowledgement(sequence_, type_, Status::kInvalidLength);
+        parser_state_ = ParserState::kStart;
+      }
+      else {
+        parser_state_ = length_ == 0 ? ParserState::kCrc : ParserState::kPayload;
+      }
+
+      break;
+    }
+    case ParserState::kPayload: {
+      payload_[payload_index_++] = byte;
+      crc_ = UpdateCrc(crc_, byte);
+      if (payload_index_ == length_) parser_state_ = ParserState::kCrc;
+      break;
+    }
+    case ParserState::kCrc: {
+      if (byte == crc_) {
+        DecodeFrame();
+      }
+      else {
+        QueueAcknowledgement(sequence_, type_, Status::kInvalidCrc);
+      }
+
+      parser_state_ = ParserState::kStart;
+      break;
+    }
+  }
+}
+
+void CommandReceiver::DecodeFrame() {
+  Command command = {static_cast<CommandType>(type_), {}, 0, sequence_, true};
+  uint8_t expected_length = 0;
+  switch (command.type) {
+    case CommandType::kAction: {
+      expected_length = 1;
+      break;
+    }
+    case CommandType::kSetSpeed:
+    case CommandType::kSetSweepAngle:
+    case CommandType::kSetVelocity:
+    case CommandType::kAddTriggerAngle: {
+      expected_length = 4;
+      break;
+    }
+    case CommandType::kQueueSegment: {
+      expected_length = 12;
+      break;
+    }
+    case CommandType::kClearTriggerAngles: {
+      expected_length = 0;
+      break;
+    }
+    default: {
+      QueueAcknowledgement(sequence_, type_, Status::kInvalidType);
+      return;
+    }
+  }
+
+  if (length_ == expected_length + 1) {
+    command.axis = payload_[expected_length]; // Trailing axis byte.
+  }
+  else if (length_ != expected_length) {
+    QueueAcknowledgement(sequence_, type_, Status::kInvalidLength);
+    return;
+  }
+
+  // Little-endian values of up to 4 bytes each.
+  for (uint8_t i = expected_length; i > 0; i--) {
+    int32_t& value = command.values[(i - 1) / 4];
+    value = static_cast<int32_t>((static_cast<uint32_t>(value) << 8) | payload_[i - 1]);
+  }
+
+  if (!commands_.Push(command)) {
+    QueueAcknowledgement(sequence_, type_, Status::kBusy);
+    return;
+  }
+
+  unacknowledged_count_++;
+}
+
+void CommandReceiver::QueueAcknowledgement(uint8_t sequence, uint8_t type, Status status) {
+  acknowledgements_.Push({sequence, type, status}); // Never full, as parsing waits for space (see CanAcknowledge()).
+}
+
+bool CommandReceiver::CanAcknowledge() const {
+  // Each parsed byte completes at most one frame, which is either acknowledged straight away or becomes a command.
+  return unacknowledged_count_ + acknowledgements_.Size() < kAcknowledgementQueueSize_;
+}
+
+uint8_t CommandReceiver::UpdateCrc(uint8_t crc, uint8_t byte) {
+  crc ^= byte;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+  }
+
+  return crc;
+}
+
+} // namespace mtspin
@@ -0,0 +1,155 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file command_receiver.h
+/// @brief Class that receives and parses serial commands (framed binary protocol and legacy single characters).
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "spsc_queue.h"
+
+namespace mtspin {
+
+/// @brief The Command Receiver class.
+/// Received bytes are buffered in a ring buffer and parsed into commands, either legacy single-character control
+/// actions or binary frames of the form:
+///
+///   [0x7E][sequence][type][length][payload (length bytes)][CRC-8 of sequence..payload]
+///
+/// Multi-byte payload values are little-endian. The payload may end with one extra byte, the index of the axis the
+/// command applies to (axis 0 if omitted, and for legacy characters). Each frame is acknowledged (see Acknowledge())
+/// with a frame of the same form, of type (0x80 | request type), carrying the request sequence no. and a one byte
+/// status. Acknowledgements are queued, and written by SendAcknowledgements() once the serial port can take them
+/// without blocking; parsing pauses while the queue has no space left for the acknowledgement of a further frame.
+class CommandReceiver {
+ public:
+
+  /// @brief Enum of frame/command types.
+  enum class CommandType : uint8_t {
+    kAction = 0x01, ///< Payload: control action character (1 byte).
+    kSetSpeed = 0x02, ///< Payload: speed (RPM, Q16.16, 4 bytes).
+    kSetSweepAngle = 0x03, ///< Payload: sweep angle (degrees, Q16.16, 4 bytes).
+    kQueueSegment = 0x04, ///< Payload: target angle (degrees, Q16.16), speed (RPM, Q16.16), dwell (ms) (4 bytes each).
+    kSetVelocity = 0x05, ///< Payload: signed velocity (RPM, Q16.16, 4 bytes; positive for CW).
+    kAddTriggerAngle = 0x06, ///< Payload: trigger angle (degrees, Q16.16, 4 bytes).
+    kClearTriggerAngles = 0x07, ///< Payload: none.
+  };
+
+  /// @brief Enum of acknowledgement status.
+  enum class Status : uint8_t {
+    kOk = 0,
+    kInvalidCrc,
+    kInvalidType,
+    kInvalidLength,
+    kInvalidCommand,
+    kBusy,
+  };
+
+  inline static constexpr uint8_t kStartByte = 0x7E; ///< Frame start byte ('~'); also used by frames sent unprompted.
+  inline static constexpr uint8_t kMaxCommandValues = 3; ///< Largest no. of parameters of a command.
+
+  /// @brief Received command.
+  struct Command {
+    CommandType type; ///< The command type.
+    int32_t values[kMaxCommandValues]; ///< The command parameters (the control action character for kAction).
+    uint8_t axis; ///< The axis the command applies to.
+    uint8_t sequence; ///< The frame sequence no. (framed commands only).
+    bool framed; ///< True if received in a frame (and so must be acknowledged), false for legacy characters.
+  };
+
+  /// @brief Construct a Command Receiver object.
+  CommandReceiver();
+
+  /// @brief Destroy the Command Receiver object.
+  ~CommandReceiver();
+
+  /// @brief Move received bytes from the serial port into the ring buffer, and parse them into commands.
+  void Poll(); ///< This must be called repeatedly.
+
+  /// @brief Get the oldest received command.
+  /// @param command The command.
+  /// @return True if a command was available.
+  bool Read(Command& command);
+
+  /// @brief Acknowledge a framed command (queue its acknowledgement, see SendAcknowledgements()).
+  /// @param command The command.
+  /// @param status The acknowledgement status.
+  void Acknowledge(const Command& command, Status status);
+
+  /// @brief Write queued acknowledgements to serial, as far as the serial transmit buffer takes whole frames without
+  /// blocking. This must be called repeatedly, and only between log lines, so frames never land inside one.
+  /// @return True if no acknowledgement is left queued.
+  bool SendAcknowledgements();
+
+  /// @brief Update a CRC-8 (polynomial 0x07) with a byte.
+  /// @param crc The CRC.
+  /// @param byte The byte.
+  /// @return The updated CRC.
+  static uint8_t UpdateCrc(uint8_t crc, uint8_t byte);
+
+ private:
+
+  /// @brief Enum of frame parser states.
+  enum class ParserState : uint8_t {
+    kStart = 0,
+    kSequence,
+    kType,
+    kLength,
+    kPayload,
+    kCrc,
+  };
+
+  /// @brief Parse a received byte.
+  /// @param byte The byte.
+  void Parse(uint8_t byte);
+
+  /// @brief Decode a complete frame into a command.
+  void DecodeFrame();
+
+  /// @brief Queued acknowledgement.
+  struct Acknowledgement {
+    uint8_t sequence; ///< The request sequence no.
+    uint8_t type; ///< The request type.
+    Status status; ///< The acknowledgement status.
+  };
+
+  /// @brief Queue an acknowledgement frame (see SendAcknowledgements()).
+  /// @param sequence The request sequence no.
+  /// @param type The request type.
+  /// @param status The acknowledgement status.
+  void QueueAcknowledgement(uint8_t sequence, uint8_t type, Status status);
+
+  /// @brief Check if the acknowledgement queue has space for a further frame's acknowledgement, besides those of the
+  /// framed commands not yet acknowledged.
+  /// @return True if a further byte may be parsed.
+  bool CanAcknowledge() const;
+
+  inline static constexpr uint8_t kAcknowledgementFlag_ = 0x80; ///< Flag added to the type of acknowledgements.
+  inline static constexpr uint8_t kAcknowledgementSize_ = 6; ///< Size of an acknowledgement frame (bytes).
+  inline static constexpr uint8_t kAcknowledgementQueueSize_ = 8; ///< No. of acknowledgements that can be pending.
+  inline static constexpr uint8_t kMaxPayloadSize_ = 4 * kMaxCommandValues + 1; ///< Largest frame payload (bytes).
+  inline static constexpr uint16_t kFrameTimeout_ms_ = 50; ///< Gap (ms) after which a partial frame is discarded.
+  inline static constexpr uint8_t kRxBufferSize_ = 64; ///< Receive ring buffer size (bytes).
+  inline static constexpr uint8_t kCommandQueueSize_ = 4; ///< No. of parsed commands that can be pending (before queuing as input events).
+
+  SpscQueue<uint8_t, kRxBufferSize_> rx_buffer_; ///< Receive ring buffer.
+  SpscQueue<Command, kCommandQueueSize_> commands_; ///< Parsed commands.
+  SpscQueue<Acknowledgement, kAcknowledgementQueueSize_> acknowledgements_; ///< Acknowledgements waiting to be sent.
+  uint8_t unacknowledged_count_ = 0; ///< No. of framed commands parsed but not yet acknowledged.
+
+  // Frame parser state.
+  ParserState parser_state_ = ParserState::kStart; ///< The parser state.
+  uint32_t last_byte_time_ms_ = 0; ///< Time (ms) the last byte was parsed.
+  uint8_t sequence_ = 0; ///< Sequence no. of the frame being parsed.
+  uint8_t type_ = 0; ///< Type of the frame being parsed.
+  uint8_t length_ = 0; ///< Payload length of the frame being parsed.
+  uint8_t payload_[kMaxPayloadSize_] = {}; ///< Payload of the frame being parsed.
+  uint8_t payload_index_ = 0; ///< No. of payload bytes parsed.
+  uint8_t crc_ = 0; ///< CRC of the frame being parsed.
+};
+
+} // namespace mtspin
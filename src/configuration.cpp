@@ -8,12 +8,23 @@
 
 #include "configuration.h"
 
-#include <ArduinoLog.h>
-
+#include "event_log.h"
+#include "hal.h"
+#include "step_axis.h"
 #include "version.h"
 
 namespace mtspin {
 
+namespace {
+
+/// @brief Firmware name and version text (in flash), so reporting it needs no RAM (or heap) at all.
+const char kVersionText[] PROGMEM = MTSPIN_VERSION_TEXT;
+
+/// @brief Firmware version suffix (in flash), or empty.
+const char kVersionSuffix[] PROGMEM = MTSPIN_VERSION_SUFFIX;
+
+} // namespace
+
 Configuration& Configuration::GetInstance() {
   static Configuration instance;
   return instance;
@@ -21,55 +32,52 @@ Configuration& Configuration::GetInstance() {
 
 void Configuration::BeginHardware() {
   // Initialise the serial port.
-  MTSPIN_SERIAL.begin(kBaudRate_);
+  hal::BeginSerial(kBaudRate_);
 
-  // Enable (LOG_LEVEL_VERBOSE) logging for all initial setup messages.
-  ToggleLogs(); // Assumes default set in configuration.h is LOG_LEVEL_SILENT.
+  // Enable logging for all initial setup messages.
+  ToggleLogs(); // Assumes logging is disabled by default (see EventLog).
 
   // Initialise the input pins.
-  pinMode(kDirectionButtonPin_, INPUT);
-  pinMode(kAngleButtonPin_, INPUT);
-  pinMode(kSpeedButtonPin_, INPUT);
-
-  // Initialise the output pins.
-  pinMode(kPulPin_, OUTPUT);
-  pinMode(kDirPin_, OUTPUT);
-  pinMode(kEnaPin_, OUTPUT);
-
-  // Delay for the startup time.
-  delay(kStartupDelay_ms_);
-
-  Log.noticeln(F("...Setup complete...\n"));
+  hal::SetPinMode(kDirectionButtonPin_, hal::PinMode::kInput);
+  hal::SetPinMode(kAngleButtonPin_, hal::PinMode::kInput);
+  hal::SetPinMode(kSpeedButtonPin_, hal::PinMode::kInput);
+
+  // Initialise the output pins (of all axes); the trigger pins are set as outputs once trigger angles are added (see
+  // StepEngine::BeginTriggerOutput()).
+  for (uint8_t axis = 0; axis < kSizeOfAxes_; axis++) {
+    hal::SetPinMode(kPulPins_[axis], hal::PinMode::kOutput);
+    hal::SetPinMode(kDirPins_[axis], hal::PinMode::kOutput);
+    hal::SetPinMode(kEnaPins_[axis], hal::PinMode::kOutput);
+#if MTSPIN_MICROSTEP_SWITCHING
+    for (uint8_t pin : kMicrostepSelectPins_[axis]) hal::SetPinMode(pin, hal::PinMode::kOutput);
+#endif
+  }
 
-  // Disable logging.
-  ToggleLogs();  
+  // Logging is disabled once startup completes; the startup time is waited for by the control system, without
+  // blocking.
 }
 
 void Configuration::ToggleLogs() {
-  // Toggle log messages.
-  if (log_level_ == LOG_LEVEL_SILENT) {
-    log_level_ = LOG_LEVEL_VERBOSE;
+  // Toggle log messages (recorded messages are written to serial by EventLog::Drain()).
+  EventLog& event_log = EventLog::GetInstance();
+  if (event_log.enabled()) {
+    event_log.Record(EventLog::Message::kLogsDisabled);
+    event_log.set_enabled(false);
   }
   else {
-    Log.noticeln(F("Log messages disabled"));
-    log_level_ = LOG_LEVEL_SILENT;
+    event_log.set_enabled(true);
+    event_log.Record(EventLog::Message::kLogsEnabled);
   }
-
-  Log.begin(log_level_, &MTSPIN_SERIAL);
-  if (log_level_ == LOG_LEVEL_VERBOSE) Log.noticeln(F("Log messages enabled"));
 }
 
-void Configuration::ReportFirmwareVersion() {
-  String version = kName;
-  version += F("-");
-  version += String(kMajor);
-  version += F(".");
-  version += String(kMinor);
-  version += F(".");
-  version += String(kPatch);
-  if (strlen(kSuffix) > 0) version += F("-");
-  version += kSuffix;
-  MTSPIN_SERIAL.println(version);
+void Configuration::ReportFirmwareVersion(Print& output) {
+  output.print(reinterpret_cast<const __FlashStringHelper*>(kVersionText));
+  if (sizeof(kVersionSuffix) > 1) {
+    output.print('-');
+    output.print(reinterpret_cast<const __FlashStringHelper*>(kVersionSuffix));
+  }
+
+  output.println();
 }
 
 Configuration::Configuration() {}
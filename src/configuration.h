@@ -9,13 +9,24 @@
 #pragma once
 
 #include <Arduino.h>
-#include <ArduinoLog.h>
 #include <momentary_button.h>
 #include <stepper_driver.h>
 
-/// @brief Macro to define Serial port.
-#ifndef MTSPIN_SERIAL
-#define MTSPIN_SERIAL Serial // "Serial" for programming port, "SerialUSB" for native port (Due and Zero only).
+#include "hal.h"
+#include "step_output.h"
+
+/// @brief Macro to select fixed-point motion maths (integer microsteps and Q16.16 rates) instead of floating-point.
+#ifndef MTSPIN_FIXED_POINT_MOTION
+#if defined(ARDUINO_ARCH_AVR)
+#define MTSPIN_FIXED_POINT_MOTION 1 // No FPU; avoid soft-float on the hot path.
+#else
+#define MTSPIN_FIXED_POINT_MOTION 0
+#endif
+#endif
+
+/// @brief Macro to define the serial communication speed.
+#ifndef MTSPIN_BAUD_RATE
+#define MTSPIN_BAUD_RATE 115200
 #endif
 
 namespace mtspin {
@@ -28,6 +39,13 @@ class Configuration {
   enum class ControlMode : uint8_t {
     kContinuous = 1,
     kOscillate,
+    kProgram, ///< Run motion segments received via serial.
+  };
+
+  /// @brief Enum of acceleration profiles.
+  enum class AccelerationProfile : uint8_t {
+    kTrapezoidal = 0, ///< Constant acceleration (instantaneous changes of acceleration).
+    kSCurve, ///< Jerk-limited acceleration (acceleration ramps up/down smoothly).
   };
 
   /// @brief Enum of control actions.
@@ -40,6 +58,10 @@ class Configuration {
     kToggleLogReport = 'r',
     kLogGeneralStatus = 'l',
     kReportFirmwareVersion = 'v',
+    kReportStatistics = 'p',
+    kDumpStepTrace = 'c',
+    kToggleTelemetry = 'b',
+    kReportTaskStatistics = 'k',
     kIdle = '0',
   };
 
@@ -60,22 +82,34 @@ class Configuration {
   void ToggleLogs();
 
   /// @brief Report the firmware version.
-  void ReportFirmwareVersion();
+  /// @param output The output to print the version line to.
+  void ReportFirmwareVersion(Print& output);
 
   // GPIO pins.
   const uint8_t kDirectionButtonPin_ = 9; ///< Input pin for the button controlling motor direction.
   const uint8_t kAngleButtonPin_ = 10; ///< Input pin for the button controlling motor angle.
   const uint8_t kSpeedButtonPin_ = 11; ///< Input pin for the button controlling motor speed.
-  const uint8_t kPulPin_ = 4; ///< Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
-  const uint8_t kDirPin_ = 7; ///< Output pin for the stepper driver DIR/CW (direction) interface.
-  const uint8_t kEnaPin_ = 8; ///< Output pin for the stepper driver ENA/EN (enable) interface.
+
+  // Axes (stepper motors/drivers), each driven by its own stepper driver; the pin tables below have one entry per axis.
+  inline static constexpr uint8_t kSizeOfAxes_ = 1; ///< No. of axes (1-8).
+  inline static constexpr uint8_t kPulPins_[kSizeOfAxes_] = {4}; ///< Output pins for the stepper driver PUL/STP/CLK (pulse/step) interfaces.
+  inline static constexpr uint8_t kDirPins_[kSizeOfAxes_] = {7}; ///< Output pins for the stepper driver DIR/CW (direction) interfaces.
+  inline static constexpr uint8_t kEnaPins_[kSizeOfAxes_] = {8}; ///< Output pins for the stepper driver ENA/EN (enable) interfaces.
+  inline static constexpr uint8_t kTriggerPins_[kSizeOfAxes_] = {2}; ///< Output pins for the angle trigger (e.g., camera shutter) interfaces; each is left as an input until a trigger angle is added to its axis.
+  inline static constexpr uint8_t kSizeOfMicrostepSelectPins_ = 3; ///< No. of stepper driver microstep select pins per axis.
+  inline static constexpr uint8_t kMicrostepSelectPins_[kSizeOfAxes_][kSizeOfMicrostepSelectPins_] = {{5, 6, 12}}; ///< Output pins for the stepper driver MS1-MS3/MODE0-MODE2 (microstep select) interfaces; used with MTSPIN_MICROSTEP_SWITCHING.
 
   // Control system properties.
-  const ControlMode kDefaultControlMode_ = ControlMode::kContinuous; ///< The default/initial control mode. 
+  inline static constexpr ControlMode kDefaultControlMode_ = ControlMode::kContinuous; ///< The default/initial control mode. 
 
   // Serial properties.
-  const int kBaudRate_ = 9600; ///< The serial communication speed.
+  const uint32_t kBaudRate_ = MTSPIN_BAUD_RATE; ///< The serial communication speed.
+  inline static constexpr uint16_t kTelemetryPeriod_ms_ = 100; ///< Time (ms) between telemetry frames of each axis.
  
+  // Angle trigger properties.
+  inline static constexpr hal::PinState kTriggerActivePinState_ = hal::PinState::kHigh; ///< The trigger pin state while a trigger pulse is active.
+  inline static constexpr uint32_t kTriggerPulseWidth_us_ = 5000; ///< Minimum duration (us) of a trigger pulse (e.g., as required by the camera).
+
   // Button properties.
   const mt::MomentaryButton::PinState kUnpressedPinState_ = mt::MomentaryButton::PinState::kLow; ///< Button unpressed pin states.
   const uint16_t kDebouncePeriod_ms_ = 70; ///< Button debounce periods (ms).
@@ -84,32 +118,46 @@ class Configuration {
   const mt::MomentaryButton::LongPressOption kLongPressOption_ = mt::MomentaryButton::LongPressOption::kDetectWhileHolding; ///< Button long press options.
 
   // Stepper motor/drive system properties.
-  const float kFullStepAngle_degrees_ = 1.8F; ///< The stepper motor full step angle (degrees).
-  const float kGearRatio_ = 1.0F; ///< The system/stepper motor gear ratio.
+  inline static constexpr float kFullStepAngle_degrees_ = 1.8F; ///< The stepper motor full step angle (degrees).
+  inline static constexpr float kGearRatio_ = 1.0F; ///< The system/stepper motor gear ratio.
 
   // Stepper driver properties.
-  const uint16_t kMicrostepMode_ = 8; ///< Stepper driver microstep mode.
-  const float kPulDelay_us_ = 1.0; ///< Minimum delay (us) for the stepper driver PUL pin.
-  const float kDirDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Dir pin.
-  const float kEnaDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Ena pin.
-  const mt::StepperDriver::PinState kEnergisedPinState_ = mt::StepperDriver::PinState::kLow; ///< The stepper driver ENA/EN pin state when the motor is energised/enabled.
-  const mt::StepperDriver::PinState kPositiveDirectionPinState = mt::StepperDriver::PinState::kLow; ///< The stepper driver DIR pin state for positive (Clockwise (CW)) motion.
-  const mt::StepperDriver::MotionDirection kDefaultMotionDirection_ = mt::StepperDriver::MotionDirection::kPositive; ///< Initial/default motion direction (CW).
+  inline static constexpr uint16_t kMicrostepMode_ = 8; ///< Stepper driver microstep mode (the finest, with MTSPIN_MICROSTEP_SWITCHING); positions and speeds are in microsteps of this mode.
+  inline static constexpr uint8_t kSizeOfMicrostepBands_ = 2; ///< No. of microstep resolution speed bands (MTSPIN_MICROSTEP_SWITCHING).
+  inline static constexpr uint16_t kMicrostepBandModes_[kSizeOfMicrostepBands_] = {kMicrostepMode_, 2}; ///< Lookup table for the stepper driver microstep mode of each speed band, from the finest (kMicrostepMode_) to the coarsest.
+  inline static constexpr float kMicrostepBandSpeeds_RPM_[kSizeOfMicrostepBands_] = {0.0F, 30.0F}; ///< Lookup table for the speed (RPM) from which each speed band is used (normal speeds in the finest mode, turbo speeds coarser).
+  inline static constexpr uint8_t kMicrostepBandPinStates_[kSizeOfMicrostepBands_] = {0b011, 0b001}; ///< Lookup table for the microstep select pin states of each speed band (bit n high for pin n); A4988/DRV8825: 1/8 = MS1, MS2 high, 1/2 = MS1 high.
+  inline static constexpr float kPulDelay_us_ = 1.0; ///< Minimum delay (us) for the stepper driver PUL pin.
+  inline static constexpr float kDirDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Dir pin.
+  inline static constexpr float kEnaDelay_us_ = 5.0F; ///< Minimum delay (us) for the stepper driver Ena pin.
+  inline static constexpr mt::StepperDriver::PinState kEnergisedPinState_ = mt::StepperDriver::PinState::kLow; ///< The stepper driver ENA/EN pin state when the motor is energised/enabled.
+  inline static constexpr mt::StepperDriver::PinState kPositiveDirectionPinState = mt::StepperDriver::PinState::kLow; ///< The stepper driver DIR pin state for positive (Clockwise (CW)) motion.
+  /// @brief Step/direction outputs of the step engine, by axis (delays rounded up to whole microseconds).
+  inline static constexpr StepOutputConfiguration kStepOutputConfigurations_[kSizeOfAxes_] = {
+    {kPulPins_[0],
+     kDirPins_[0],
+     kPositiveDirectionPinState == mt::StepperDriver::PinState::kHigh ? hal::PinState::kHigh : hal::PinState::kLow,
+     static_cast<uint16_t>(kPulDelay_us_ + 0.999F),
+     static_cast<uint16_t>(kDirDelay_us_ + 0.999F)}};
+  inline static constexpr mt::StepperDriver::MotionDirection kDefaultMotionDirection_ = mt::StepperDriver::MotionDirection::kPositive; ///< Initial/default motion direction (CW).
   inline static constexpr uint8_t kSizeOfSweepAngles_ = 4; ///< No. of sweep angles in the lookup table.
-  const float kSweepAngles_degrees_[kSizeOfSweepAngles_] = {45.0F, 90.0F, 180.0F, 360.0F}; ///< Lookup table for sweep angles (degrees) during oscillation.
-  const uint8_t kDefaultSweepAngleIndex_ = 0; ///< Index of initial/default sweep angle.
+  inline static constexpr float kSweepAngles_degrees_[kSizeOfSweepAngles_] = {45.0F, 90.0F, 180.0F, 360.0F}; ///< Lookup table for sweep angles (degrees) during oscillation.
+  inline static constexpr uint8_t kDefaultSweepAngleIndex_ = 0; ///< Index of initial/default sweep angle.
   inline static constexpr uint8_t kSizeOfSpeeds_ = 4; ///< No. of speeds in the lookup table.
   /// @brief Lookup table for rotation speeds (RPM).
-  const float kSpeeds_RPM_[2][kSizeOfSpeeds_] = {{5.0F,  10.0F, 15.0F, 20.0F},  // Row 0: Normal speeds: S, 2S, 3S, 4S.
-                                                 {35.0F, 50.0F, 65.0F, 80.0F}}; // Row 1: Turbo speeds: 7S, 10S, 13S, 16S.
+  inline static constexpr float kSpeeds_RPM_[2][kSizeOfSpeeds_] = {{5.0F,  10.0F, 15.0F, 20.0F},  // Row 0: Normal speeds: S, 2S, 3S, 4S.
+                                                                  {35.0F, 50.0F, 65.0F, 80.0F}}; // Row 1: Turbo speeds: 7S, 10S, 13S, 16S.
   //                                        Index: 0       1      2      3
-  const uint8_t kDefaultSpeedRow_ = 0; // Row of initial/default speed state.
-  const uint8_t kDefaultSpeedIndex_ = 0; // Index of initial/default speed.
-  const float kAcceleration_microsteps_per_s_per_s_ = 6000.0; //8000.0; ///< Acceleration (microsteps per second-squared).
-  const mt::StepperDriver::AccelerationAlgorithm kAccelerationAlgorithm_ = mt::StepperDriver::AccelerationAlgorithm::kMorgridge24; ///< Acceleration algorithm.
+  inline static constexpr uint8_t kDefaultSpeedRow_ = 0; // Row of initial/default speed state.
+  inline static constexpr uint8_t kDefaultSpeedIndex_ = 0; // Index of initial/default speed.
+  inline static constexpr AccelerationProfile kAccelerationProfile_ = AccelerationProfile::kTrapezoidal; ///< The acceleration profile.
+  inline static constexpr float kAcceleration_microsteps_per_s_per_s_ = 6000.0; //8000.0; ///< Acceleration (microsteps per second-squared).
+  inline static constexpr float kSCurveAcceleration_microsteps_per_s_per_s_ = 12000.0F; ///< Peak acceleration (microsteps per second-squared) of the S-curve profile.
+  inline static constexpr float kSCurveJerk_microsteps_per_s_per_s_per_s_ = 120000.0F; ///< Jerk (microsteps per second-cubed) of the S-curve profile.
 
   // Other properties.
-  const uint16_t kStartupDelay_ms_ = 1000; ///< Minimum startup/boot delay in milliseconds (ms); based on the stepper driver.
+  const uint16_t kIdleSleepDelay_ms_ = 5000; ///< Time in milliseconds (ms) without input, while the motor is stopped, before sleeping between interrupts; 0 to never sleep.
+  const uint16_t kStartupDelay_ms_ = 1000; ///< Minimum startup/boot time in milliseconds (ms) before the stepper driver can be enabled; based on the stepper driver.
 
  private:
 
@@ -118,9 +166,6 @@ class Configuration {
 
   /// @brief Private destructor so objects cannot be manually instantiated. 
   ~Configuration();
-
-  // Debug helpers and logger properties (for debugging and system reporting).
-  int log_level_ =  LOG_LEVEL_SILENT; ///< The log level.
 };
 
 } // namespace mtspin
\ No newline at end of file
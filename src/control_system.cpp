@@ -9,275 +9,728 @@
 #include "control_system.h"
 
 #include <Arduino.h>
-#include <ArduinoLog.h>
 #include <momentary_button.h>
 #include <stepper_driver.h>
 
+#include "angle_trigger.h"
 #include "configuration.h"
+#include "event_log.h"
+#include "hal.h"
+#include "motion_math.h"
+#include "ramp_table.h"
 
 namespace mtspin {
 
+namespace {
+
+// Task names (in flash).
+const char kMotionServiceTaskName[] PROGMEM = "Motion service";
+const char kInputScanTaskName[] PROGMEM = "Input scan";
+const char kSerialParseTaskName[] PROGMEM = "Serial parse";
+const char kLogDrainTaskName[] PROGMEM = "Log drain";
+const char kTelemetryTaskName[] PROGMEM = "Telemetry";
+
+} // namespace
+
+const ControlSystem::TaskScheduler::Task ControlSystem::kTasks_[kSizeOfTasks_] PROGMEM = {
+  // Name, task, period (us), budget (us); for equal deadlines, the task listed first runs first.
+  {kMotionServiceTaskName, &ControlSystem::ServiceMotion, 1000, 500},
+  {kInputScanTaskName, &ControlSystem::ScanInputs, 5000, 500},
+  {kSerialParseTaskName, &ControlSystem::ParseSerial, 2000, kInputEventBudget_us_ + 500},
+  {kLogDrainTaskName, &ControlSystem::DrainLog, 2000, 500},
+  {kTelemetryTaskName, &ControlSystem::SendTelemetry, 5000, 500},
+};
+
+const ControlSystem::ControlActionHandler ControlSystem::kControlActionHandlers_[] PROGMEM = {
+  {Configuration::ControlAction::kToggleDirection, &ControlSystem::ToggleDirection},
+  {Configuration::ControlAction::kCycleAngle, &ControlSystem::CycleAngle},
+  {Configuration::ControlAction::kCycleSpeed, &ControlSystem::CycleSpeed},
+  {Configuration::ControlAction::kToggleMotion, &ControlSystem::ToggleMotion},
+  {Configuration::ControlAction::kToggleTurbo, &ControlSystem::ToggleTurbo},
+  {Configuration::ControlAction::kToggleLogReport, &ControlSystem::ToggleLogReport},
+  {Configuration::ControlAction::kLogGeneralStatus, &ControlSystem::ReportGeneralStatus},
+  {Configuration::ControlAction::kReportFirmwareVersion, &ControlSystem::ReportFirmwareVersion},
+#if MTSPIN_INSTRUMENTATION
+  {Configuration::ControlAction::kReportStatistics, &ControlSystem::ReportStatistics},
+#endif
+#if MTSPIN_STEP_TRACE
+  {Configuration::ControlAction::kDumpStepTrace, &ControlSystem::DumpStepTrace},
+#endif
+  {Configuration::ControlAction::kToggleTelemetry, &ControlSystem::ToggleTelemetry},
+  {Configuration::ControlAction::kReportTaskStatistics, &ControlSystem::ReportTaskStatistics},
+};
+
+const uint8_t ControlSystem::kSizeOfControlActionHandlers_ = sizeof(kControlActionHandlers_)
+                                                             / sizeof(kControlActionHandlers_[0]);
+
+const ControlSystem::ButtonActions ControlSystem::kButtonActions_[kSizeOfButtons_] PROGMEM = {
+  // kDirectionButton_.
+  {Configuration::ControlAction::kToggleDirection, EventLog::Message::kDirectionButtonShortPress,
+   Configuration::ControlAction::kToggleMotion, EventLog::Message::kDirectionOrAngleButtonLongPress},
+  // kAngleButton_.
+  {Configuration::ControlAction::kCycleAngle, EventLog::Message::kAngleButtonShortPress,
+   Configuration::ControlAction::kToggleMotion, EventLog::Message::kDirectionOrAngleButtonLongPress},
+  // kSpeedButton_.
+  {Configuration::ControlAction::kCycleSpeed, EventLog::Message::kSpeedButtonShortPress,
+   Configuration::ControlAction::kToggleTurbo, EventLog::Message::kSpeedButtonLongPress},
+};
+
 ControlSystem::ControlSystem() {}
 
 ControlSystem::~ControlSystem() {}
 
 void ControlSystem::Begin() {
   configuration_.BeginHardware();
-  direction_button_.set_long_press_option(configuration_.kLongPressOption_);
-  angle_button_.set_long_press_option(configuration_.kLongPressOption_);
-  speed_button_.set_long_press_option(configuration_.kLongPressOption_);
-  stepper_driver_.set_pul_delay_us(configuration_.kPulDelay_us_);
-  stepper_driver_.set_dir_delay_us(configuration_.kDirDelay_us_);
-  stepper_driver_.set_ena_delay_us(configuration_.kEnaDelay_us_);
-  stepper_driver_.set_ena_pin_enabled_state(configuration_.kEnergisedPinState_);
-  stepper_driver_.set_dir_pin_positive_direction_state(configuration_.kPositiveDirectionPinState);
-  stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_row_][speed_index_],
-                           mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-  stepper_driver_.SetAcceleration(configuration_.kAcceleration_microsteps_per_s_per_s_,
-                                  mt::StepperDriver::AccelerationUnits::kMicrostepsPerSecondPerSecond);
-  stepper_driver_.set_acceleration_algorithm(configuration_.kAccelerationAlgorithm_);
-  stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
-  LogGeneralStatus(); // Log initial status of control system.
+  startup_time_ms_ = hal::Millis();
+  startup_state_ = StartupState::kSettling;
+  buttons_.set_long_press_option(configuration_.kLongPressOption_);
+  buttons_.Begin();
+  for (uint8_t pin : button_pins_) hal::EnableWakeOnPinChange(pin);
+  for (uint8_t axis = 0; axis < configuration_.kSizeOfAxes_; axis++) {
+    SetPowerState(axis, mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
+  }
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  step_engine_.Begin(configuration_.kStepOutputConfigurations_, kRampTable.intervals_us, kRampDirectory.ramps,
+                     kMicrostepBandTable.bands);
+#else
+  step_engine_.Begin(configuration_.kStepOutputConfigurations_, kRampTable.intervals_us, kRampDirectory.ramps);
+#endif
+  for (uint8_t axis = 0; axis < configuration_.kSizeOfAxes_; axis++) {
+    PublishSpeed(axis);
+    LogGeneralStatus(axis); // Log initial status of control system.
+  }
+
+  scheduler_.Begin();
 }
 
 void ControlSystem::CheckAndProcess() {
-  // Check and process button presses, and serial input; one character at a time.
-  using PressType = mt::MomentaryButton::PressType;
+#if MTSPIN_INSTRUMENTATION
+  instrumentation_.RecordLoop();
+#endif
+  // Run the most urgent task released (see kTasks_); only once none is released may the MCU sleep.
+  if (!scheduler_.RunNext(*this)) SleepIfIdle();
+}
 
-  if (PressType direction_button_press_type = direction_button_.DetectPressType();
-      direction_button_press_type == PressType::kShortPress) {
-    control_action_ = Configuration::ControlAction::kToggleDirection;
-    Log.noticeln(F("Direction button short press"));
-  }
-  else if (PressType angle_button_press_type = angle_button_.DetectPressType();
-           angle_button_press_type == PressType::kShortPress) {
-    control_action_ = Configuration::ControlAction::kCycleAngle;
-    Log.noticeln(F("Angle button short press"));
+void ControlSystem::ServiceMotion() {
+  // Publish motion to the step engine; the step pulses themselves are generated by the step timer interrupt.
+  CheckStartup();
+  for (uint8_t axis = 0; axis < configuration_.kSizeOfAxes_; axis++) PublishMotion(axis);
+}
+
+void ControlSystem::ScanInputs() {
+  buttons_.Scan();
+  QueueButtonEvents();
+}
+
+void ControlSystem::ParseSerial() {
+  // Process the input events (from all inputs) straight after queuing the serial commands, so commands are not
+  // delayed by another task period.
+  command_receiver_.Poll();
+  QueueSerialEvents();
+  ProcessInputEvents();
+}
+
+void ControlSystem::DrainLog() {
+  // Write pending log messages, as far as the serial port can take them without blocking; held back while a telemetry
+  // frame waits for space, so heavy logging cannot starve telemetry.
+  if (telemetry_.IsFramePending()) return;
+
+  // Command acknowledgements are written once the line in progress is out (never inside a line), ahead of further log
+  // messages and report lines, which wait until all acknowledgements are sent.
+  if (!event_log_.DrainLine() || !command_receiver_.SendAcknowledgements()) return;
+
+  // Reports are written through the log line buffer, a line per run, so they never block either, however long they
+  // are; they go ahead of log messages, which wait meanwhile (and are dropped and counted if the log fills up).
+  if (report_ == Report::kNone && pending_reports_ != 0) {
+    uint8_t report = 0;
+    while ((pending_reports_ & (1U << report)) == 0) report++;
+    pending_reports_ &= static_cast<uint8_t>(~(1U << report));
+    report_ = static_cast<Report>(report);
   }
-  else if (PressType speed_button_press_type = speed_button_.DetectPressType();
-           speed_button_press_type == PressType::kShortPress) {
-    control_action_ = Configuration::ControlAction::kCycleSpeed;
-    Log.noticeln(F("Speed button short press"));
+
+  if (report_ == Report::kNone) {
+    event_log_.Drain();
+    return;
   }
-  else if (direction_button_press_type == PressType::kLongPress 
-           || angle_button_press_type == PressType::kLongPress) {
-    control_action_ = Configuration::ControlAction::kToggleMotion;
-    Log.noticeln(F("Direction or angle button long press"));
+
+  if (event_log_.DrainLine() && !WriteReportLine(report_, event_log_.line_output())) report_ = Report::kNone;
+  event_log_.DrainLine();
+}
+
+void ControlSystem::RequestReport(Report report) {
+  pending_reports_ |= static_cast<uint8_t>(1U << static_cast<uint8_t>(report));
+}
+
+bool ControlSystem::WriteReportLine(Report report, Print& output) {
+  switch (report) {
+    case Report::kFirmwareVersion: {
+      configuration_.ReportFirmwareVersion(output);
+      return false;
+    }
+#if MTSPIN_INSTRUMENTATION
+    case Report::kStatistics: {
+      return instrumentation_.ReportNextLine(output);
+    }
+#endif
+#if MTSPIN_STEP_TRACE
+    case Report::kStepTrace: {
+      return step_engine_.DumpStepTraceLine(output);
+    }
+#endif
+    case Report::kTaskStatistics: {
+      return scheduler_.ReportNextLine(output);
+    }
+    default: {
+      return false;
+    }
   }
-  else if (speed_button_press_type == PressType::kLongPress) {
-    control_action_ = Configuration::ControlAction::kToggleTurbo;
-    Log.noticeln(F("Speed button long press"));
+}
+
+void ControlSystem::SendTelemetry() {
+  // Send a telemetry frame when due, once the serial port can take it without blocking.
+  uint8_t axis = 0;
+  if (telemetry_.TakeFrameToSend(hal::Millis(), axis)) telemetry_.Send(MakeTelemetrySample(axis));
+}
+
+void ControlSystem::CheckStartup() {
+  if (startup_state_ == StartupState::kReady) return;
+  if ((hal::Millis() - startup_time_ms_) < configuration_.kStartupDelay_ms_) return;
+
+  startup_state_ = StartupState::kReady;
+  for (uint8_t axis = 0; axis < configuration_.kSizeOfAxes_; axis++) {
+    if (axes_[axis].motion_start_pending) {
+      axes_[axis].motion_start_pending = false;
+      SetPowerState(axis, mt::StepperDriver::PowerState::kEnabled); // Restore power to allow motion.
+    }
   }
-  else if (MTSPIN_SERIAL.available() > 0) {
-    char serial_input = MTSPIN_SERIAL.read();
-    control_action_ = static_cast<Configuration::ControlAction>(serial_input);
-    Log.noticeln(F("Serial input: %c"), serial_input);
+
+  event_log_.Record(EventLog::Message::kSetupComplete);
+  if (event_log_.enabled()) configuration_.ToggleLogs(); // Disable logging (enabled for the startup messages).
+}
+
+bool ControlSystem::IsMotionStarted(uint8_t axis) const {
+  return axes_[axis].power_state == mt::StepperDriver::PowerState::kEnabled || axes_[axis].motion_start_pending;
+}
+
+void ControlSystem::SetPowerState(uint8_t axis, mt::StepperDriver::PowerState power_state) {
+  using PinState = mt::StepperDriver::PinState;
+  PinState energised_pin_state = configuration_.kEnergisedPinState_;
+  PinState pin_state = energised_pin_state;
+  if (power_state == mt::StepperDriver::PowerState::kDisabled) {
+    pin_state = energised_pin_state == PinState::kHigh ? PinState::kLow : PinState::kHigh;
   }
-  else {
-    control_action_ = Configuration::ControlAction::kIdle;
-  }
-
-  // Process control actions.
-  switch(control_action_) {
-    case Configuration::ControlAction::kToggleDirection: {
-      // Start motor, change motor direction, or change to continuous mode.
-      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
-        // Fall through to start motor.
-        [[fallthrough]];
-      }
-      else {
-        // change motor direction, or change to continuous mode.
-        if (control_mode_ == Configuration::ControlMode::kContinuous) {
-          // Change motor direction.
-          if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kNegative;
-            Log.noticeln(F("Motion direction: counter-clockwise (CCW)"));
-          }
-          else {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kPositive;
-            Log.noticeln(F("Motion direction: clockwise (CW)"));
-          }
-        }
-        else {
-          // Change to continuous mode.
-          control_mode_ = Configuration::ControlMode::kContinuous;
-          Log.noticeln(F("Control mode: continuous"));
-        }
-
-        motion_type_ = mt::StepperDriver::MotionType::kStopAndReset;
-        break;
-      }
-    }
-    case Configuration::ControlAction::kCycleAngle: {
-      // Start motor, cycle through sweep angles, or change to oscillation mode.
-      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
-        // Fall through to start motor.
-        [[fallthrough]];
-      }
-      else {
-        // Change sweep angles, or change to oscillation mode.
-        if (control_mode_ == Configuration::ControlMode::kOscillate) {
-          // Change sweep angle.
-          if (sweep_angle_index_ == (configuration_.kSizeOfSweepAngles_ - 1)) {
-            sweep_angle_index_ = 0;
-          }
-          else {
-            sweep_angle_index_++;
-          }
-
-          Log.noticeln(F("Sweep angle (degrees): %F"), configuration_.kSweepAngles_degrees_[sweep_angle_index_]);
-        }
-        else {
-          // Change to oscillation mode.
-          control_mode_ = Configuration::ControlMode::kOscillate;
-          Log.noticeln(F("Control mode: oscillate"));
-        }
-
-        motion_type_ = mt::StepperDriver::MotionType::kStopAndReset;
-        break;
-      }
+
+  hal::WritePin(configuration_.kEnaPins_[axis], pin_state == PinState::kHigh ? hal::PinState::kHigh
+                                                                             : hal::PinState::kLow);
+  hal::DelayUs(static_cast<uint16_t>(configuration_.kEnaDelay_us_ + 0.999F));
+  axes_[axis].power_state = power_state;
+}
+
+void ControlSystem::PublishMotion(uint8_t axis) {
+  AxisState& state = axes_[axis];
+  StepAxis& step_axis = step_engine_.axis(axis);
+  if (state.power_state != mt::StepperDriver::PowerState::kEnabled || !step_axis.IsIdle()) return;
+
+  // Motor started (or motion completed).
+  switch (state.control_mode) {
+    case Configuration::ControlMode::kContinuous: {
+      // Accelerate to constant speed and continue indefinitely (unless a zero velocity is held).
+      if (!state.velocity_hold) step_axis.Jog(static_cast<int8_t>(state.motion_direction));
+      break;
     }
-    case Configuration::ControlAction::kCycleSpeed: {
-      //  Start motor, or cycle through motor speed settings.
-      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
-        // Fall through to start motor.          
-        [[fallthrough]];
-      }
-      else {
-        // Change speed.
-        if (speed_index_ == (configuration_.kSizeOfSpeeds_ - 1)) {
-          speed_index_ = 0;
-        }
-        else {
-          speed_index_++;
-        }
-        
-        stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_row_][speed_index_],
-                                 mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-        Log.noticeln(F("Speed (RPM): %F"), configuration_.kSpeeds_RPM_[speed_row_][speed_index_]);
-        break;
-      }
+    case Configuration::ControlMode::kOscillate: {
+      // Oscillate indefinitely; the step engine plans each reversal.
+      PublishOscillation(axis, true);
+      break;
     }
-    case Configuration::ControlAction::kToggleMotion: {
-      // Toggle (start/stop) the motor.
-      if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kDisabled) {
-        // Allow movement.
-        stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kEnabled); // Restore power to allow motion.
-        Log.noticeln(F("Motion status: started"));     
-      }
-      else {
-        // Disallow movement.
-        stepper_driver_.set_power_state(mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
-        speed_row_ = configuration_.kDefaultSpeedRow_;
-        speed_index_ = configuration_.kDefaultSpeedIndex_;
-        stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_row_][speed_index_],
-                                 mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-        LogGeneralStatus();
-        Log.noticeln(F("Motion status: stopped"));       
-      }
-      
+    case Configuration::ControlMode::kProgram: {
+      // Segments are published as they are received.
       break;
     }
-    case Configuration::ControlAction::kToggleTurbo: {
-      // Toggle between (0) normal and (1) turbo (faster speeds) state.
-      speed_row_ = speed_row_ == 0 ? 1 : 0;
-      speed_index_ = configuration_.kDefaultSpeedIndex_;
-      stepper_driver_.SetSpeed(configuration_.kSpeeds_RPM_[speed_row_][speed_index_],
-                               mt::StepperDriver::SpeedUnits::kRevolutionsPerMinute);
-      Log.noticeln(F("Speed (RPM): %F"), configuration_.kSpeeds_RPM_[speed_row_][speed_index_]);
+  }
+}
+
+void ControlSystem::SleepIfIdle() {
+  uint32_t time_ms = hal::Millis();
+  bool motion_started = false;
+  for (uint8_t axis = 0; axis < configuration_.kSizeOfAxes_; axis++) {
+    motion_started = motion_started || IsMotionStarted(axis);
+  }
+
+  if (startup_state_ != StartupState::kReady || motion_started || !buttons_.IsIdle()
+      || !input_events_.IsEmpty() || hal::SerialAvailable() > 0) {
+    last_activity_time_ms_ = time_ms;
+    return;
+  }
+
+  if (configuration_.kIdleSleepDelay_ms_ == 0) return;
+  if ((time_ms - last_activity_time_ms_) < configuration_.kIdleSleepDelay_ms_) return;
+
+  // Each wake runs one loop, so presses are debounced/timed (and serial input parsed) exactly as when awake.
+#if MTSPIN_INSTRUMENTATION
+  uint32_t start_time_us = hal::Micros();
+  hal::Sleep();
+  instrumentation_.RecordSleep(hal::Micros() - start_time_us);
+#else
+  hal::Sleep();
+#endif
+}
+
+void ControlSystem::QueueButtonEvents() {
+  using PressType = mt::MomentaryButton::PressType;
+  for (uint8_t button = 0; button < kSizeOfButtons_; button++) {
+    if (input_events_.IsFull()) return;
+
+    PressType press_type = buttons_.TakePressType(button);
+    if (press_type != PressType::kShortPress && press_type != PressType::kLongPress) continue;
+
+    ButtonActions actions = hal::ReadFlashObject(&kButtonActions_[button]);
+    bool short_press = press_type == PressType::kShortPress;
+    event_log_.Record(short_press ? actions.short_press_message : actions.long_press_message);
+    Configuration::ControlAction control_action = short_press ? actions.short_press_action
+                                                              : actions.long_press_action;
+    input_events_.Push({CommandReceiver::CommandType::kAction, {static_cast<int32_t>(control_action)}, kButtonAxis_,
+                        0, false});
+  }
+}
+
+void ControlSystem::QueueSerialEvents() {
+  CommandReceiver::Command command;
+  while (!input_events_.IsFull() && command_receiver_.Read(command)) {
+    if (command.type == CommandReceiver::CommandType::kAction) {
+      event_log_.Record(EventLog::Message::kSerialInput, command.values[0]);
+    }
+
+    input_events_.Push(command);
+  }
+}
+
+void ControlSystem::ProcessInputEvents() {
+  // Bursts are spread over several runs, so the other tasks (e.g., motion) still run at a steady rate.
+  uint32_t start_time_us = hal::Micros();
+  CommandReceiver::Command command;
+  while (input_events_.Pop(command)) {
+    ProcessCommand(command);
+    if ((hal::Micros() - start_time_us) >= kInputEventBudget_us_) return;
+  }
+}
+
+bool ControlSystem::ProcessControlAction(Configuration::ControlAction control_action, uint8_t axis) {
+#if MTSPIN_INSTRUMENTATION
+  uint32_t start_time_us = hal::Micros();
+  bool valid = ExecuteControlAction(control_action, axis);
+  instrumentation_.RecordControlAction(control_action, hal::Micros() - start_time_us);
+  return valid;
+#else
+  return ExecuteControlAction(control_action, axis);
+#endif
+}
+
+bool ControlSystem::ExecuteControlAction(Configuration::ControlAction control_action, uint8_t axis) {
+  if (control_action == Configuration::ControlAction::kIdle) return true; // No action.
+
+  for (uint8_t index = 0; index < kSizeOfControlActionHandlers_; index++) {
+    ControlActionHandler entry = hal::ReadFlashObject(&kControlActionHandlers_[index]);
+    if (entry.control_action == control_action) return (this->*entry.handler)(axis);
+  }
+
+  event_log_.Record(EventLog::Message::kInvalidControlAction);
+  return false;
+}
+
+void ControlSystem::ProcessCommand(const CommandReceiver::Command& command) {
+  last_activity_time_ms_ = hal::Millis(); // Input keeps the system awake (see SleepIfIdle()).
+  if (command.axis >= configuration_.kSizeOfAxes_) {
+    command_receiver_.Acknowledge(command, CommandReceiver::Status::kInvalidCommand);
+    return;
+  }
+
+  if (configuration_.kSizeOfAxes_ > 1) event_log_.Record(EventLog::Message::kAxis, command.axis);
+  bool valid = false;
+  switch (command.type) {
+    case CommandReceiver::CommandType::kAction: {
+      valid = ProcessControlAction(static_cast<Configuration::ControlAction>(command.values[0]), command.axis);
       break;
     }
-    case Configuration::ControlAction::kToggleLogReport: {
-      // Toggle reporting/output of log messages over serial.
-      configuration_.ToggleLogs();
+    case CommandReceiver::CommandType::kSetSpeed: {
+      valid = SetSpeed(command.axis, command.values[0]);
       break;
     }
-    case Configuration::ControlAction::kLogGeneralStatus: {
-      // Log/report the general status of the control system.
-      LogGeneralStatus();
+    case CommandReceiver::CommandType::kSetSweepAngle: {
+      valid = SetSweepAngle(command.axis, command.values[0]);
       break;
     }
-    case Configuration::ControlAction::kReportFirmwareVersion: {
-      // Log/report the firmware version.
-      configuration_.ReportFirmwareVersion();
+    case CommandReceiver::CommandType::kSetVelocity: {
+      valid = SetVelocity(command.axis, command.values[0]);
+      break;
     }
-    case Configuration::ControlAction::kIdle: {
-      // No action.
-      //Log.noticeln(F("Idle: no action."));
+    case CommandReceiver::CommandType::kAddTriggerAngle: {
+      valid = AddTriggerAngle(command.axis, command.values[0]);
       break;
     }
-    default: {
-      Log.errorln(F("Invalid control action"));
+    case CommandReceiver::CommandType::kClearTriggerAngles: {
+      valid = ClearTriggerAngles(command.axis);
       break;
     }
+    case CommandReceiver::CommandType::kQueueSegment: {
+      command_receiver_.Acknowledge(command, QueueSegment(command.axis, command.values[0], command.values[1],
+                                                          command.values[2]));
+      return;
+    }
   }
 
-  switch (control_mode_) {
-    case Configuration::ControlMode::kContinuous: {      
-      if (motion_status_ != mt::StepperDriver::MotionStatus::kConstantSpeed 
-          || motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-        // Accelerate to constant speed.
-        motion_status_ = stepper_driver_.MoveByAngle(static_cast<float>(motion_direction_) * 360.0,
-                                                     mt::StepperDriver::AngleUnits::kDegrees, motion_type_);
-        if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-          // Stop and reset issued by user changing direction, restart motion.
-          motion_type_ = mt::StepperDriver::MotionType::kRelative;
-        }
-      }
-      else {
-        // Continue constant speed motion indefinitely.
-        stepper_driver_.MoveByJogging(motion_direction_);
-      }
+  command_receiver_.Acknowledge(command, valid ? CommandReceiver::Status::kOk
+                                               : CommandReceiver::Status::kInvalidCommand);
+}
 
-      break;
+bool ControlSystem::ToggleDirection(uint8_t axis) {
+  if (!IsMotionStarted(axis)) return ToggleMotion(axis);
+
+  AxisState& state = axes_[axis];
+  if (state.control_mode == Configuration::ControlMode::kContinuous) {
+    // Change motor direction.
+    if (state.motion_direction == mt::StepperDriver::MotionDirection::kPositive) {
+      state.motion_direction = mt::StepperDriver::MotionDirection::kNegative;
+      event_log_.Record(EventLog::Message::kMotionDirectionCcw);
     }
-    case Configuration::ControlMode::kOscillate: {
-      mt::StepperDriver::MotionStatus motion_status = stepper_driver_.MoveByAngle(
-                                                      sweep_direction_ *
-                                                      configuration_.kSweepAngles_degrees_[sweep_angle_index_],
-                                                      mt::StepperDriver::AngleUnits::kDegrees, motion_type_);
-      if (motion_status == mt::StepperDriver::MotionStatus::kIdle) {
-        // Motion completed OR stop and reset issued.
-        if (motion_type_ == mt::StepperDriver::MotionType::kStopAndReset) {
-          // Stop and reset issued by user changing sweep angle, restart motion.
-          motion_type_ = mt::StepperDriver::MotionType::kRelative;
-        }
-        else if (stepper_driver_.power_state() == mt::StepperDriver::PowerState::kEnabled) {
-          // Change sweep direction.
-          if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kNegative; 
-          }
-          else {
-            motion_direction_ = mt::StepperDriver::MotionDirection::kPositive;
-          }
-
-          sweep_direction_ = static_cast<float>(motion_direction_);
-        }
-      }
+    else {
+      state.motion_direction = mt::StepperDriver::MotionDirection::kPositive;
+      event_log_.Record(EventLog::Message::kMotionDirectionCw);
+    }
+  }
+  else {
+    // Change to continuous mode.
+    state.control_mode = Configuration::ControlMode::kContinuous;
+    state.velocity_hold = false;
+    event_log_.Record(EventLog::Message::kControlModeContinuous);
+  }
 
-      break;
+  PublishVelocity(axis); // Ramp to the new velocity (reversing through zero) without stopping.
+  return true;
+}
+
+bool ControlSystem::CycleAngle(uint8_t axis) {
+  if (!IsMotionStarted(axis)) return ToggleMotion(axis);
+
+  AxisState& state = axes_[axis];
+  if (state.control_mode == Configuration::ControlMode::kOscillate) {
+    // Change sweep angle.
+    if (state.sweep_angle_index == (configuration_.kSizeOfSweepAngles_ - 1)) {
+      state.sweep_angle_index = 0;
     }
+    else {
+      state.sweep_angle_index++;
+    }
+
+#if MTSPIN_FIXED_POINT_MOTION
+    state.sweep_angle = kSweepAngles.microsteps[state.sweep_angle_index];
+#else
+    state.sweep_angle = configuration_.kSweepAngles_degrees_[state.sweep_angle_index];
+#endif
+    event_log_.Record(EventLog::Message::kSweepAngle, SweepAngleCentidegrees(axis));
+    PublishOscillation(axis, false); // Change the sweep angle mid-cycle, about the same centre.
+  }
+  else {
+    // Change to oscillation mode, from the current position.
+    state.control_mode = Configuration::ControlMode::kOscillate;
+    event_log_.Record(EventLog::Message::kControlModeOscillate);
+    PublishOscillation(axis, true);
   }
+
+  return true;
 }
 
-void ControlSystem::LogGeneralStatus() const {
-  Log.noticeln(F("General Status"));
-  if (control_mode_ == Configuration::ControlMode::kContinuous) {
-    Log.noticeln(F("Control mode: continuous"));
+bool ControlSystem::CycleSpeed(uint8_t axis) {
+  if (!IsMotionStarted(axis)) return ToggleMotion(axis);
+
+  AxisState& state = axes_[axis];
+  if (state.speed_index == (configuration_.kSizeOfSpeeds_ - 1)) {
+    state.speed_index = 0;
   }
   else {
-    Log.noticeln(F("Control mode: oscillate"));
+    state.speed_index++;
   }
 
-  if (motion_direction_ == mt::StepperDriver::MotionDirection::kPositive) {
-    Log.noticeln(F("Motion direction: clockwise (CW)"));
+  state.explicit_speed_RPM = 0;
+  PublishSpeed(axis);
+  event_log_.Record(EventLog::Message::kSpeed, SpeedCentiRpm(axis));
+  return true;
+}
+
+bool ControlSystem::ToggleMotion(uint8_t axis) {
+  AxisState& state = axes_[axis];
+  if (!IsMotionStarted(axis)) {
+    // Allow movement (once the stepper driver has started up).
+    if (startup_state_ == StartupState::kReady) {
+      SetPowerState(axis, mt::StepperDriver::PowerState::kEnabled); // Restore power to allow motion.
+    }
+    else {
+      state.motion_start_pending = true;
+    }
+
+    event_log_.Record(EventLog::Message::kMotionStarted);
   }
   else {
-    Log.noticeln(F("Motion direction: counter-clockwise (CCW)"));
+    // Disallow movement.
+    state.motion_start_pending = false;
+    step_engine_.axis(axis).Halt();
+    SetPowerState(axis, mt::StepperDriver::PowerState::kDisabled); // Save power when idle.
+    state.speed_row = configuration_.kDefaultSpeedRow_;
+    state.speed_index = configuration_.kDefaultSpeedIndex_;
+    state.explicit_speed_RPM = 0;
+    state.velocity_hold = false;
+    PublishSpeed(axis);
+    LogGeneralStatus(axis);
+    event_log_.Record(EventLog::Message::kMotionStopped);
+  }
+
+  return true;
+}
+
+bool ControlSystem::ToggleTurbo(uint8_t axis) {
+  // Toggle between (0) normal and (1) turbo (faster speeds) state.
+  AxisState& state = axes_[axis];
+  state.speed_row = state.speed_row == 0 ? 1 : 0;
+  state.speed_index = configuration_.kDefaultSpeedIndex_;
+  state.explicit_speed_RPM = 0;
+  PublishSpeed(axis);
+  event_log_.Record(EventLog::Message::kSpeed, SpeedCentiRpm(axis));
+  return true;
+}
+
+bool ControlSystem::ToggleLogReport(uint8_t) {
+  configuration_.ToggleLogs();
+  return true;
+}
+
+bool ControlSystem::ReportGeneralStatus(uint8_t axis) {
+  LogGeneralStatus(axis);
+  return true;
+}
+
+bool ControlSystem::ReportFirmwareVersion(uint8_t) {
+  RequestReport(Report::kFirmwareVersion);
+  return true;
+}
+
+#if MTSPIN_INSTRUMENTATION
+bool ControlSystem::ReportStatistics(uint8_t) {
+  RequestReport(Report::kStatistics);
+  return true;
+}
+#endif
+
+#if MTSPIN_STEP_TRACE
+bool ControlSystem::DumpStepTrace(uint8_t) {
+  RequestReport(Report::kStepTrace);
+  return true;
+}
+#endif
+
+bool ControlSystem::ToggleTelemetry(uint8_t) {
+  telemetry_.Toggle();
+  event_log_.Record(telemetry_.enabled() ? EventLog::Message::kTelemetryEnabled
+                                         : EventLog::Message::kTelemetryDisabled);
+  return true;
+}
+
+bool ControlSystem::ReportTaskStatistics(uint8_t) {
+  RequestReport(Report::kTaskStatistics);
+  return true;
+}
+
+bool ControlSystem::SetSpeed(uint8_t axis, Q16 speed_RPM) {
+  if (speed_RPM <= 0 || speed_RPM > kMaxExplicitSpeed_RPM) return false;
+  axes_[axis].explicit_speed_RPM = speed_RPM;
+  PublishSpeed(axis);
+  event_log_.Record(EventLog::Message::kSpeed, SpeedCentiRpm(axis));
+  return true;
+}
+
+bool ControlSystem::SetVelocity(uint8_t axis, Q16 velocity_RPM) {
+  if (velocity_RPM > kMaxExplicitSpeed_RPM || velocity_RPM < -kMaxExplicitSpeed_RPM) return false;
+  if (!IsMotionStarted(axis)) return false; // Motion must be started first.
+  AxisState& state = axes_[axis];
+  if (velocity_RPM != 0) {
+    state.motion_direction = velocity_RPM > 0 ? mt::StepperDriver::MotionDirection::kPositive
+                                              : mt::StepperDriver::MotionDirection::kNegative;
+    state.explicit_speed_RPM = velocity_RPM > 0 ? velocity_RPM : -velocity_RPM;
+  }
+
+  state.velocity_hold = velocity_RPM == 0;
+  if (state.control_mode != Configuration::ControlMode::kContinuous) {
+    state.control_mode = Configuration::ControlMode::kContinuous;
+    event_log_.Record(EventLog::Message::kControlModeContinuous);
+  }
+
+  PublishVelocity(axis);
+  event_log_.Record(velocity_RPM < 0 ? EventLog::Message::kMotionDirectionCcw : EventLog::Message::kMotionDirectionCw);
+  event_log_.Record(EventLog::Message::kSpeed, state.velocity_hold ? 0 : SpeedCentiRpm(axis));
+  return true;
+}
+
+bool ControlSystem::SetSweepAngle(uint8_t axis, Q16 sweep_angle_degrees) {
+  if (sweep_angle_degrees <= 0) return false;
+#if MTSPIN_FIXED_POINT_MOTION
+  axes_[axis].sweep_angle = DegreesQ16ToMicrosteps(sweep_angle_degrees);
+#else
+  axes_[axis].sweep_angle = static_cast<float>(sweep_angle_degrees) / (1L << kQ16FractionalBits);
+#endif
+  event_log_.Record(EventLog::Message::kSweepAngle, SweepAngleCentidegrees(axis));
+  if (axes_[axis].control_mode == Configuration::ControlMode::kOscillate) PublishOscillation(axis, false);
+  return true;
+}
+
+bool ControlSystem::AddTriggerAngle(uint8_t axis, Q16 angle_degrees) {
+  // Converted once, so the step timer interrupt only compares microstep indices. The trigger pin is set as an output
+  // first, so it is driven before the first trigger angle can be reached.
+  step_engine_.BeginTriggerOutput(axis);
+  AngleTrigger& angle_trigger = step_engine_.angle_trigger(axis);
+  if (!angle_trigger.Add(DegreesQ16ToMicrosteps(angle_degrees))) return false;
+  event_log_.Record(EventLog::Message::kTriggerAngles, angle_trigger.size());
+  return true;
+}
+
+bool ControlSystem::ClearTriggerAngles(uint8_t axis) {
+  step_engine_.angle_trigger(axis).Clear();
+  event_log_.Record(EventLog::Message::kTriggerAngles, 0);
+  return true;
+}
+
+CommandReceiver::Status ControlSystem::QueueSegment(uint8_t axis, Q16 target_angle_degrees, Q16 speed_RPM,
+                                                    int32_t dwell_ms) {
+  if (speed_RPM <= 0 || speed_RPM > kMaxExplicitSpeed_RPM || dwell_ms < 0 || dwell_ms > UINT16_MAX) {
+    return CommandReceiver::Status::kInvalidCommand;
+  }
+
+  if (!IsMotionStarted(axis)) return CommandReceiver::Status::kInvalidCommand; // Motion must be started first.
+  AxisState& state = axes_[axis];
+  if (state.motion_start_pending) return CommandReceiver::Status::kBusy; // The stepper driver is still starting up.
+
+  StepAxis& step_axis = step_engine_.axis(axis);
+  if (state.control_mode != Configuration::ControlMode::kProgram) {
+    // Change to program mode; the segments run once the current motion has decelerated to rest.
+    state.control_mode = Configuration::ControlMode::kProgram;
+    step_axis.Stop();
+    event_log_.Record(EventLog::Message::kControlModeProgram);
+  }
+
+#if MTSPIN_FIXED_POINT_MOTION
+  int32_t target_position = DegreesQ16ToMicrosteps(target_angle_degrees);
+#else
+  int32_t target_position = DegreesToMicrosteps(static_cast<float>(target_angle_degrees) / (1L << kQ16FractionalBits));
+#endif
+  StepAxis::Segment segment = {target_position, MakeExplicitSpeedProfile(speed_RPM), static_cast<uint16_t>(dwell_ms)};
+  if (!step_axis.QueueSegment(segment)) return CommandReceiver::Status::kBusy;
+  return CommandReceiver::Status::kOk;
+}
+
+void ControlSystem::LogGeneralStatus(uint8_t axis) const {
+  const AxisState& state = axes_[axis];
+  event_log_.Record(EventLog::Message::kGeneralStatus);
+  if (configuration_.kSizeOfAxes_ > 1) event_log_.Record(EventLog::Message::kAxis, axis);
+  if (state.control_mode == Configuration::ControlMode::kContinuous) {
+    event_log_.Record(EventLog::Message::kControlModeContinuous);
+  }
+  else if (state.control_mode == Configuration::ControlMode::kOscillate) {
+    event_log_.Record(EventLog::Message::kControlModeOscillate);
+  }
+  else {
+    event_log_.Record(EventLog::Message::kControlModeProgram);
+  }
+
+  if (state.motion_direction == mt::StepperDriver::MotionDirection::kPositive) {
+    event_log_.Record(EventLog::Message::kMotionDirectionCw);
+  }
+  else {
+    event_log_.Record(EventLog::Message::kMotionDirectionCcw);
   }
   
-  Log.noticeln(F("Sweep angle (degrees): %F"), configuration_.kSweepAngles_degrees_[sweep_angle_index_]);
-  Log.noticeln(F("Speed (RPM): %F"), configuration_.kSpeeds_RPM_[speed_row_][speed_index_]);
+  event_log_.Record(EventLog::Message::kSweepAngle, SweepAngleCentidegrees(axis));
+  event_log_.Record(EventLog::Message::kSpeed, SpeedCentiRpm(axis));
+}
+
+Telemetry::Sample ControlSystem::MakeTelemetrySample(uint8_t axis) const {
+  const AxisState& state = axes_[axis];
+  const StepAxis& step_axis = step_engine_.axis(axis);
+  Telemetry::Sample sample = {};
+  sample.time_ms = hal::Millis();
+  sample.axis = axis;
+  sample.control_mode = state.control_mode;
+  sample.direction = static_cast<int8_t>(state.motion_direction);
+  sample.motion_status = step_axis.motion_status();
+  if (state.power_state == mt::StepperDriver::PowerState::kEnabled) sample.flags |= Telemetry::kFlagDriverEnabled;
+  if (state.motion_start_pending) sample.flags |= Telemetry::kFlagMotionStartPending;
+  sample.position = step_axis.position();
+  sample.velocity_centi_RPM = MicrostepsPerSecondToCentiRpm(step_axis.velocity());
+  sample.speed_centi_RPM = state.velocity_hold ? 0 : SpeedCentiRpm(axis);
+  sample.log_messages_dropped = event_log_.dropped_count();
+#if MTSPIN_INSTRUMENTATION
+  StepEngine::StepTimingCounts step_timing_counts = step_engine_.step_timing_counts();
+  sample.late_steps = step_timing_counts.late_steps;
+  sample.missed_steps = step_timing_counts.missed_steps;
+#endif
+  return sample;
+}
+
+int32_t ControlSystem::SweepAngleCentidegrees(uint8_t axis) const {
+#if MTSPIN_FIXED_POINT_MOTION
+  return MicrostepsToCentidegrees(axes_[axis].sweep_angle);
+#else
+  return lroundf(axes_[axis].sweep_angle * 100.0F);
+#endif
+}
+
+int32_t ControlSystem::SpeedCentiRpm(uint8_t axis) const {
+  const AxisState& state = axes_[axis];
+  if (state.explicit_speed_RPM > 0) return Q16ToHundredths(state.explicit_speed_RPM);
+  return kSpeedReports.centi_RPM[state.speed_row][state.speed_index];
+}
+
+StepAxis::SpeedProfile ControlSystem::MakeExplicitSpeedProfile(Q16 speed_RPM) const {
+#if MTSPIN_FIXED_POINT_MOTION
+  return MakeSpeedProfileQ16(RpmQ16ToMicrostepsPerSecondQ16(speed_RPM));
+#else
+  float speed_microsteps_per_s = RpmToMicrostepsPerSecond(static_cast<float>(speed_RPM) / (1L << kQ16FractionalBits));
+  return MakeSpeedProfileAtRuntime(speed_microsteps_per_s);
+#endif
+}
+
+StepAxis::SpeedProfile ControlSystem::SpeedProfileOf(uint8_t axis) const {
+  const AxisState& state = axes_[axis];
+  if (state.explicit_speed_RPM > 0) return MakeExplicitSpeedProfile(state.explicit_speed_RPM);
+  return kSpeedProfiles.profiles[state.speed_row][state.speed_index];
+}
+
+void ControlSystem::PublishSpeed(uint8_t axis) {
+  step_engine_.axis(axis).SetSpeed(SpeedProfileOf(axis));
+}
+
+void ControlSystem::PublishVelocity(uint8_t axis) {
+  const AxisState& state = axes_[axis];
+  if (state.power_state != mt::StepperDriver::PowerState::kEnabled) return; // Published by PublishMotion() instead.
+
+  StepAxis& step_axis = step_engine_.axis(axis);
+  step_axis.ClearProgram(); // Leaving program mode discards any segments not yet run.
+  step_axis.SetVelocity(state.velocity_hold ? 0 : static_cast<int8_t>(state.motion_direction), SpeedProfileOf(axis));
+}
+
+void ControlSystem::PublishOscillation(uint8_t axis, bool new_centre) {
+  AxisState& state = axes_[axis];
+  StepAxis& step_axis = step_engine_.axis(axis);
+#if MTSPIN_FIXED_POINT_MOTION
+  int32_t amplitude = state.sweep_angle / 2;
+#else
+  int32_t amplitude = DegreesToMicrosteps(state.sweep_angle) / 2;
+#endif
+  if (amplitude < 1) amplitude = 1;
+  int8_t direction = static_cast<int8_t>(state.motion_direction);
+  if (new_centre) state.oscillation_centre = step_axis.position() + direction * amplitude; // Start at one end.
+  if (state.power_state != mt::StepperDriver::PowerState::kEnabled) return; // Published by PublishMotion() instead.
+
+  step_axis.ClearProgram(); // Leaving program mode discards any segments not yet run.
+  step_axis.Oscillate(state.oscillation_centre, direction * amplitude);
 }
 
-} // namespace mtspin
\ No newline at end of file
+} // namespace mtspin
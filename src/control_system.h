@@ -12,7 +12,16 @@
 #include <momentary_button.h>
 #include <stepper_driver.h>
 
+#include "button_scanner.h"
+#include "command_receiver.h"
 #include "configuration.h"
+#include "event_log.h"
+#include "instrumentation.h"
+#include "motion_math.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
+#include "step_engine.h"
+#include "telemetry.h"
 
 namespace mtspin {
 
@@ -29,52 +38,347 @@ class ControlSystem {
   /// @brief Initialise the hardware (Serial port, logging, pins, etc.).
   void Begin();
 
-  /// @brief Check inputs and trigger outputs/actions.
+  /// @brief Run the next task due (checking inputs, triggering outputs/actions, etc.), or sleep if idle.
   void CheckAndProcess(); ///< This must be called repeatedly.
 
  private:
 
-  /// @brief Log/report the general status of the control system.
-  void LogGeneralStatus() const;
+  /// @brief Enum of startup states.
+  enum class StartupState : uint8_t {
+    kSettling = 0, ///< Waiting for the stepper driver to start up; inputs are processed, but motion is held off.
+    kReady, ///< Startup complete.
+  };
+
+  /// @brief Enum of reports, written a line per log drain task run (see DrainLog()).
+  enum class Report : uint8_t {
+    kFirmwareVersion = 0, ///< The firmware version (see Configuration::ReportFirmwareVersion()).
+    kStatistics, ///< The loop and step timing statistics (with MTSPIN_INSTRUMENTATION; see Instrumentation).
+    kStepTrace, ///< The step/direction trace (with MTSPIN_STEP_TRACE; see StepTrace).
+    kTaskStatistics, ///< The timing statistics of each task (see Scheduler).
+    kNone, ///< No report.
+  };
+
+  /// @brief Control state of an axis.
+  struct AxisState {
+    mt::StepperDriver::PowerState power_state = mt::StepperDriver::PowerState::kDisabled; ///< Variable to keep track of the stepper driver power state.
+    bool motion_start_pending = false; ///< Flag to keep track of whether motion was started while settling.
+    Configuration::ControlMode control_mode = Configuration::kDefaultControlMode_; ///< Variable to keep track of the control system mode.
+    mt::StepperDriver::MotionDirection motion_direction = Configuration::kDefaultMotionDirection_; ///< Variable to keep track of the motion direction (for continuous operation).
+    uint8_t sweep_angle_index = Configuration::kDefaultSweepAngleIndex_; ///< Index to keep track of the sweep angle set from the lookup table.
+#if MTSPIN_FIXED_POINT_MOTION
+    int32_t sweep_angle = kSweepAngles.microsteps[Configuration::kDefaultSweepAngleIndex_]; ///< Variable to keep track of the sweep angle (microsteps).
+#else
+    float sweep_angle = Configuration::kSweepAngles_degrees_[Configuration::kDefaultSweepAngleIndex_]; ///< Variable to keep track of the sweep angle (degrees).
+#endif
+    int32_t oscillation_centre = 0; ///< Variable to keep track of the oscillation centre position (microsteps).
+    uint8_t speed_index = Configuration::kDefaultSpeedIndex_; ///< Index to keep track of the motor speed set from the lookup table.
+    uint8_t speed_row = Configuration::kDefaultSpeedRow_; ///< Row to keep track of the motor speed state set from the lookup table.
+    Q16 explicit_speed_RPM = 0; ///< Variable to keep track of an explicit speed (RPM, Q16.16) set via serial; 0 if the lookup table is in use.
+    bool velocity_hold = false; ///< Flag to keep track of whether a zero velocity is held (continuous mode).
+  };
+
+  // Tasks (see kTasks_).
+
+  /// @brief Motion service task: advance the startup state machine, and publish the next motion of each axis.
+  void ServiceMotion();
+
+  /// @brief Input scan task: scan the buttons, and queue the presses detected.
+  void ScanInputs();
+
+  /// @brief Serial parse task: parse the serial input, queue the commands received, and process the queued input
+  /// events.
+  void ParseSerial();
+
+  /// @brief Log drain task: write pending log messages.
+  void DrainLog();
+
+  /// @brief Telemetry task: send a telemetry frame when due.
+  void SendTelemetry();
+
+  /// @brief Request a report, to be written once the reports requested before it are complete.
+  /// @param report The report.
+  void RequestReport(Report report);
+
+  /// @brief Write the next line of a report.
+  /// @param report The report.
+  /// @param output The output to print the line to.
+  /// @return True if the report continues (call again for the next line), false if it is complete.
+  bool WriteReportLine(Report report, Print& output);
+
+  /// @brief Advance the startup state machine, enabling the stepper drivers once the startup time has elapsed (of the
+  /// axes where motion was started while settling).
+  void CheckStartup();
+
+  /// @brief Check if motion has been started on an axis (including if the stepper driver is yet to be enabled after
+  /// startup).
+  /// @param axis The axis.
+  /// @return True if motion has been started.
+  bool IsMotionStarted(uint8_t axis) const;
+
+  /// @brief Enable/disable the stepper driver of an axis.
+  /// @param axis The axis.
+  /// @param power_state The power state.
+  void SetPowerState(uint8_t axis, mt::StepperDriver::PowerState power_state);
+
+  /// @brief Publish the next motion of an axis to the step engine, once the previous motion has completed.
+  /// @param axis The axis.
+  void PublishMotion(uint8_t axis);
+
+  /// @brief Sleep until the next interrupt if the motors are stopped and no input has arrived for the idle sleep delay.
+  void SleepIfIdle();
+
+  /// @brief Queue the presses detected on all buttons as input events (presses stay with the button scanner while the
+  /// queue is full).
+  void QueueButtonEvents();
+
+  /// @brief Queue the commands received over serial as input events (commands stay with the command receiver while
+  /// the queue is full).
+  void QueueSerialEvents();
+
+  /// @brief Process queued input events in the order they were queued, until the queue is empty or the processing
+  /// budget of the task run is used up (at least one event is processed per run).
+  void ProcessInputEvents();
+
+  /// @brief Process a control action (from a button press or serial command).
+  /// @param control_action The control action.
+  /// @param axis The axis the control action applies to (ignored by actions that apply to the whole system).
+  /// @return True if the control action is valid.
+  bool ProcessControlAction(Configuration::ControlAction control_action, uint8_t axis);
+
+  /// @brief Execute a control action with its handler from the dispatch table (see ProcessControlAction()).
+  /// @param control_action The control action.
+  /// @param axis The axis the control action applies to.
+  /// @return True if the control action is valid.
+  bool ExecuteControlAction(Configuration::ControlAction control_action, uint8_t axis);
+
+  /// @brief Process an input event (a button press or serial command), and acknowledge it if framed.
+  /// @param command The command.
+  void ProcessCommand(const CommandReceiver::Command& command);
+
+  // Control action handlers (see kControlActionHandlers_); each returns true if the control action is valid.
+
+  /// @brief Change the motion direction, or change to continuous mode (starts motion if stopped).
+  /// @param axis The axis.
+  /// @return True.
+  bool ToggleDirection(uint8_t axis);
+
+  /// @brief Cycle through the sweep angles, or change to oscillation mode (starts motion if stopped).
+  /// @param axis The axis.
+  /// @return True.
+  bool CycleAngle(uint8_t axis);
+
+  /// @brief Cycle through the speeds (starts motion if stopped).
+  /// @param axis The axis.
+  /// @return True.
+  bool CycleSpeed(uint8_t axis);
+
+  /// @brief Start/stop motion.
+  /// @param axis The axis.
+  /// @return True.
+  bool ToggleMotion(uint8_t axis);
+
+  /// @brief Toggle between the normal and turbo speeds.
+  /// @param axis The axis.
+  /// @return True.
+  bool ToggleTurbo(uint8_t axis);
+
+  /// @brief Toggle reporting of log messages over serial.
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool ToggleLogReport(uint8_t axis);
+
+  /// @brief Log/report the general status of an axis.
+  /// @param axis The axis.
+  /// @return True.
+  bool ReportGeneralStatus(uint8_t axis);
+
+  /// @brief Report the firmware version (see RequestReport()).
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool ReportFirmwareVersion(uint8_t axis);
+
+#if MTSPIN_INSTRUMENTATION
+  /// @brief Report (and reset) the loop and step timing statistics (see RequestReport()).
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool ReportStatistics(uint8_t axis);
+#endif
+
+#if MTSPIN_STEP_TRACE
+  /// @brief Write (and clear) the step/direction trace (see RequestReport()).
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool DumpStepTrace(uint8_t axis);
+#endif
+
+  /// @brief Toggle streaming of telemetry frames over serial.
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool ToggleTelemetry(uint8_t axis);
+
+  /// @brief Report (and reset) the timing statistics of each task (see RequestReport()).
+  /// @param axis Unused (applies to the whole system).
+  /// @return True.
+  bool ReportTaskStatistics(uint8_t axis);
+
+  /// @brief Set an explicit speed, outside of the speed lookup table.
+  /// @param axis The axis.
+  /// @param speed_RPM The speed (RPM, Q16.16), up to kMaxExplicitSpeed_RPM.
+  /// @return True if the speed is valid.
+  bool SetSpeed(uint8_t axis, Q16 speed_RPM);
+
+  /// @brief Set a signed velocity, changing to continuous mode if required; the motor ramps to it from its current
+  /// velocity without stopping (see StepAxis::SetVelocity()).
+  /// @param axis The axis.
+  /// @param velocity_RPM The velocity (RPM, Q16.16, up to kMaxExplicitSpeed_RPM either way); positive for CW, negative
+  /// for CCW, 0 to hold at rest.
+  /// @return True if the velocity is valid.
+  bool SetVelocity(uint8_t axis, Q16 velocity_RPM);
+
+  /// @brief Set an explicit sweep angle, outside of the sweep angle lookup table.
+  /// @param axis The axis.
+  /// @param sweep_angle_degrees The sweep angle (degrees, Q16.16).
+  /// @return True if the sweep angle is valid.
+  bool SetSweepAngle(uint8_t axis, Q16 sweep_angle_degrees);
+
+  /// @brief Add a trigger angle; the trigger output pulses whenever the axis reaches it (see AngleTrigger).
+  /// @param axis The axis.
+  /// @param angle_degrees The angle (degrees, Q16.16, relative to the startup position; modulo one revolution).
+  /// @return True if the trigger angle was added, false if the maximum no. of trigger angles is reached.
+  bool AddTriggerAngle(uint8_t axis, Q16 angle_degrees);
+
+  /// @brief Remove all trigger angles.
+  /// @param axis The axis.
+  /// @return True (always valid).
+  bool ClearTriggerAngles(uint8_t axis);
+
+  /// @brief Queue a motion segment, changing to program mode if required.
+  /// @param axis The axis.
+  /// @param target_angle_degrees The target angle (degrees, Q16.16), relative to the startup position.
+  /// @param speed_RPM The speed (RPM, Q16.16), up to kMaxExplicitSpeed_RPM.
+  /// @param dwell_ms The time (ms) to wait at the target angle before the next segment.
+  /// @return The acknowledgement status.
+  CommandReceiver::Status QueueSegment(uint8_t axis, Q16 target_angle_degrees, Q16 speed_RPM, int32_t dwell_ms);
+
+  /// @brief Log/report the general status of an axis of the control system.
+  /// @param axis The axis.
+  void LogGeneralStatus(uint8_t axis) const;
+
+  /// @brief Make a telemetry sample of the state of an axis.
+  /// @param axis The axis.
+  /// @return The telemetry sample.
+  Telemetry::Sample MakeTelemetrySample(uint8_t axis) const;
+
+  /// @brief Get the sweep angle set (for logging).
+  /// @param axis The axis.
+  /// @return The sweep angle (hundredths of a degree).
+  int32_t SweepAngleCentidegrees(uint8_t axis) const;
+
+  /// @brief Get the speed set (for logging).
+  /// @param axis The axis.
+  /// @return The speed (hundredths of an RPM).
+  int32_t SpeedCentiRpm(uint8_t axis) const;
+
+  /// @brief Make the speed profile for an explicit speed.
+  /// @param speed_RPM The speed (RPM, Q16.16).
+  /// @return The speed profile.
+  StepAxis::SpeedProfile MakeExplicitSpeedProfile(Q16 speed_RPM) const;
+
+  /// @brief Get the speed profile of the speed set (explicitly, or from the lookup table).
+  /// @param axis The axis.
+  /// @return The speed profile.
+  StepAxis::SpeedProfile SpeedProfileOf(uint8_t axis) const;
+
+  /// @brief Publish the speed set (explicitly, or from the lookup table) to the step engine.
+  /// @param axis The axis.
+  void PublishSpeed(uint8_t axis);
+
+  /// @brief Publish the velocity set (direction and speed, continuous mode) to the step engine, to ramp to it from the
+  /// current motion without stopping.
+  /// @param axis The axis.
+  void PublishVelocity(uint8_t axis);
+
+  /// @brief Publish the oscillation set (sweep angle, from one end) to the step engine, to change to it from the
+  /// current motion without stopping.
+  /// @param axis The axis.
+  /// @param new_centre True to start a new oscillation from the current position (sweeping in the motion direction),
+  /// false to keep the current centre (e.g., when only the sweep angle changes).
+  void PublishOscillation(uint8_t axis, bool new_centre);
+
+  /// @brief Entry of the control action dispatch table.
+  struct ControlActionHandler {
+    Configuration::ControlAction control_action; ///< The control action.
+    bool (ControlSystem::*handler)(uint8_t axis); ///< The member function that executes it.
+  };
+
+  /// @brief Control actions triggered by the presses of a button, and the log messages recorded for them.
+  struct ButtonActions {
+    Configuration::ControlAction short_press_action; ///< The control action of a short press.
+    EventLog::Message short_press_message; ///< The log message of a short press.
+    Configuration::ControlAction long_press_action; ///< The control action of a long press.
+    EventLog::Message long_press_message; ///< The log message of a long press.
+  };
+
+  inline static constexpr uint8_t kSizeOfTasks_ = 5; ///< No. of tasks.
+  using TaskScheduler = Scheduler<ControlSystem, kSizeOfTasks_>; ///< Scheduler of the tasks.
+  static const TaskScheduler::Task kTasks_[kSizeOfTasks_]; ///< Task table (in flash).
+  static const ControlActionHandler kControlActionHandlers_[]; ///< Control action dispatch table (in flash).
+  static const uint8_t kSizeOfControlActionHandlers_; ///< No. of entries in the control action dispatch table.
 
   /// @brief Configuration settings.
   Configuration& configuration_ = Configuration::GetInstance();
 
-  // Buttons to control the motor.
-  mt::MomentaryButton direction_button_{configuration_.kDirectionButtonPin_,
-                        configuration_.kUnpressedPinState_,
-                        configuration_.kDebouncePeriod_ms_,
-                        configuration_.kShortPressPeriod_ms_,
-                        configuration_.kLongPressPeriod_ms_}; ///< Button to control motor direction.
-  mt::MomentaryButton angle_button_{configuration_.kAngleButtonPin_,
-                    configuration_.kUnpressedPinState_,
-                    configuration_.kDebouncePeriod_ms_,
-                    configuration_.kShortPressPeriod_ms_,
-                    configuration_.kLongPressPeriod_ms_}; ///< Button to control motor rotation angles.
-  mt::MomentaryButton speed_button_{configuration_.kSpeedButtonPin_,
-                    configuration_.kUnpressedPinState_,
-                    configuration_.kDebouncePeriod_ms_,
-                    configuration_.kShortPressPeriod_ms_,
-                    configuration_.kLongPressPeriod_ms_}; ///< Button to control motor speed.
-
-  // Stepper motor driver.
-  mt::StepperDriver stepper_driver_{configuration_.kPulPin_,
-                      configuration_.kDirPin_,
-                      configuration_.kEnaPin_,
-                      configuration_.kMicrostepMode_,
-                      configuration_.kFullStepAngle_degrees_,
-                      configuration_.kGearRatio_}; ///< Stepper motor driver to control the stepper motor.
+  /// @brief Log of events (for debugging and system reporting).
+  EventLog& event_log_ = EventLog::GetInstance();
+
+#if MTSPIN_INSTRUMENTATION
+  /// @brief Loop and control action timing (for performance analysis).
+  Instrumentation instrumentation_;
+#endif
+
+  // Buttons to control the motor (of the first axis), scanned together.
+  inline static constexpr uint8_t kDirectionButton_ = 0; ///< Button to control motor direction.
+  inline static constexpr uint8_t kAngleButton_ = 1; ///< Button to control motor rotation angles.
+  inline static constexpr uint8_t kSpeedButton_ = 2; ///< Button to control motor speed.
+  inline static constexpr uint8_t kSizeOfButtons_ = 3; ///< No. of buttons.
+  inline static constexpr uint8_t kButtonAxis_ = 0; ///< Axis controlled by the buttons (and legacy serial characters).
+  static const ButtonActions kButtonActions_[kSizeOfButtons_]; ///< Control actions of each button (in flash).
+  const uint8_t button_pins_[kSizeOfButtons_] = {configuration_.kDirectionButtonPin_,
+                                                 configuration_.kAngleButtonPin_,
+                                                 configuration_.kSpeedButtonPin_}; ///< Button pins, by button index.
+  ButtonScanner buttons_{button_pins_,
+                         kSizeOfButtons_,
+                         configuration_.kUnpressedPinState_,
+                         configuration_.kDebouncePeriod_ms_,
+                         configuration_.kShortPressPeriod_ms_,
+                         configuration_.kLongPressPeriod_ms_}; ///< Scanner for the buttons.
+
+  // Step pulse generator (for all axes); the stepper drivers are enabled/disabled directly (see SetPowerState()).
+  StepEngine& step_engine_ = StepEngine::GetInstance(); ///< Step engine to generate step pulses (interrupt driven).
+
+  // Serial command receiver.
+  CommandReceiver command_receiver_; ///< Receiver for serial commands.
+
+  // Telemetry streamer.
+  Telemetry telemetry_; ///< Streamer for periodic telemetry frames.
+
+  // Input events (button presses and serial commands), from all input sources.
+  inline static constexpr uint8_t kInputEventQueueSize_ = 8; ///< No. of input events that can be pending.
+  inline static constexpr uint16_t kInputEventBudget_us_ = 1000; ///< Time (us) per serial parse run for processing input events.
+  SpscQueue<CommandReceiver::Command, kInputEventQueueSize_> input_events_; ///< Input events, in arrival order.
+
+  // Task scheduler.
+  TaskScheduler scheduler_{kTasks_}; ///< Scheduler of the tasks (run from CheckAndProcess()).
+
+  // Reports.
+  Report report_ = Report::kNone; ///< The report being written.
+  uint8_t pending_reports_ = 0; ///< Reports requested and not yet started (bit n set for Report n).
 
   // Control flags and indicator variables.
-  Configuration::ControlMode control_mode_ = configuration_.kDefaultControlMode_; ///< Variable to keep track of the control system mode.
-  Configuration::ControlAction control_action_ = Configuration::ControlAction::kIdle; ///< Variable to keep track of the control actions from button presses/serial messages.
-  mt::StepperDriver::MotionDirection motion_direction_ = configuration_.kDefaultMotionDirection_; ///< Variable to keep track of the motion direction (for continuous operation).
-  mt::StepperDriver::MotionType motion_type_ = mt::StepperDriver::MotionType::kRelative; ///< Variable to keep track of the motion type (for oscillation).
-  float sweep_direction_ = static_cast<float>(motion_direction_); ///< Variable to keep track of the sweep direction.
-  uint8_t sweep_angle_index_ = configuration_.kDefaultSweepAngleIndex_; ///< Index to keep track of the sweep angle set from the lookup table.
-  uint8_t speed_index_ = configuration_.kDefaultSpeedIndex_; ///< Index to keep track of the motor speed set from the lookup table.
-  uint8_t speed_row_ = configuration_.kDefaultSpeedRow_; ///< Row to keep track of the motor speed state set from the lookup table.
-  mt::StepperDriver::MotionStatus motion_status_ = mt::StepperDriver::MotionStatus::kIdle; ///< Variable to keep track of the motion status.
+  StartupState startup_state_ = StartupState::kSettling; ///< Variable to keep track of the startup state.
+  uint32_t startup_time_ms_ = 0; ///< Time (ms) the hardware was initialised.
+  uint32_t last_activity_time_ms_ = 0; ///< Time (ms) of the last input or motion (for idle sleep).
+  AxisState axes_[Configuration::kSizeOfAxes_]; ///< Control state, by axis.
 };
 
-} // namespace mtspin
\ No newline at end of file
+} // namespace mtspin
@@ -0,0 +1,216 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file event_log.cpp
+/// @brief Class to record compact log events in RAM and write them to serial without ever blocking.
+
+#include "event_log.h"
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+namespace {
+
+/// @brief Enum of ways to format the value reported with a message.
+enum class ValueFormat : uint8_t {
+  kNone = 0,
+  kInteger,
+  kHundredths,
+  kCharacter,
+};
+
+/// @brief Text and value format of a message.
+struct MessageFormat {
+  const char* text; ///< The text (in flash).
+  ValueFormat value_format; ///< The value format.
+};
+
+// Message texts (in flash).
+const char kSetupCompleteText[] PROGMEM = "...Setup complete...\r\n";
+const char kLogsEnabledText[] PROGMEM = "Log messages enabled";
+const char kLogsDisabledText[] PROGMEM = "Log messages disabled";
+const char kMessagesDroppedText[] PROGMEM = "Log messages dropped: ";
+const char kGeneralStatusText[] PROGMEM = "General Status";
+const char kAxisText[] PROGMEM = "Axis: ";
+const char kDirectionButtonShortPressText[] PROGMEM = "Direction button short press";
+const char kAngleButtonShortPressText[] PROGMEM = "Angle button short press";
+const char kSpeedButtonShortPressText[] PROGMEM = "Speed button short press";
+const char kDirectionOrAngleButtonLongPressText[] PROGMEM = "Direction or angle button long press";
+const char kSpeedButtonLongPressText[] PROGMEM = "Speed button long press";
+const char kSerialInputText[] PROGMEM = "Serial input: ";
+const char kInvalidControlActionText[] PROGMEM = "Invalid control action";
+const char kControlModeContinuousText[] PROGMEM = "Control mode: continuous";
+const char kControlModeOscillateText[] PROGMEM = "Control mode: oscillate";
+const char kControlModeProgramText[] PROGMEM = "Control mode: program";
+const char kMotionDirectionCwText[] PROGMEM = "Motion direction: clockwise (CW)";
+const char kMotionDirectionCcwText[] PROGMEM = "Motion direction: counter-clockwise (CCW)";
+const char kSweepAngleText[] PROGMEM = "Sweep angle (degrees): ";
+const char kSpeedText[] PROGMEM = "Speed (RPM): ";
+const char kMotionStartedText[] PROGMEM = "Motion status: started";
+const char kMotionStoppedText[] PROGMEM = "Motion status: stopped";
+const char kTelemetryEnabledText[] PROGMEM = "Telemetry enabled";
+const char kTelemetryDisabledText[] PROGMEM = "Telemetry disabled";
+const char kTriggerAnglesText[] PROGMEM = "Trigger angles: ";
+
+/// @brief Message formats (in flash), in the order of EventLog::Message.
+const MessageFormat kMessageFormats[] PROGMEM = {
+  {kSetupCompleteText, ValueFormat::kNone},
+  {kLogsEnabledText, ValueFormat::kNone},
+  {kLogsDisabledText, ValueFormat::kNone},
+  {kMessagesDroppedText, ValueFormat::kInteger},
+  {kGeneralStatusText, ValueFormat::kNone},
+  {kAxisText, ValueFormat::kInteger},
+  {kDirectionButtonShortPressText, ValueFormat::kNone},
+  {kAngleButtonShortPressText, ValueFormat::kNone},
+  {kSpeedButtonShortPressText, ValueFormat::kNone},
+  {kDirectionOrAngleButtonLongPressText, ValueFormat::kNone},
+  {kSpeedButtonLongPressText, ValueFormat::kNone},
+  {kSerialInputText, ValueFormat::kCharacter},
+  {kInvalidControlActionText, ValueFormat::kNone},
+  {kControlModeContinuousText, ValueFormat::kNone},
+  {kControlModeOscillateText, ValueFormat::kNone},
+  {kControlModeProgramText, ValueFormat::kNone},
+  {kMotionDirectionCwText, ValueFormat::kNone},
+  {kMotionDirectionCcwText, ValueFormat::kNone},
+  {kSweepAngleText, ValueFormat::kHundredths},
+  {kSpeedText, ValueFormat::kHundredths},
+  {kMotionStartedText, ValueFormat::kNone},
+  {kMotionStoppedText, ValueFormat::kNone},
+  {kTelemetryEnabledText, ValueFormat::kNone},
+  {kTelemetryDisabledText, ValueFormat::kNone},
+  {kTriggerAnglesText, ValueFormat::kInteger},
+};
+
+static_assert(sizeof(kMessageFormats) / sizeof(kMessageFormats[0])
+              == static_cast<uint8_t>(EventLog::Message::kTriggerAngles) + 1,
+              "kMessageFormats must have an entry for every EventLog::Message.");
+
+} // namespace
+
+EventLog& EventLog::GetInstance() {
+  static EventLog instance;
+  return instance;
+}
+
+void EventLog::Record(Message message, int32_t value) {
+  if (!enabled_) return;
+  if (!events_.Push({message, value})) dropped_count_++;
+}
+
+void EventLog::Drain() {
+  while (DrainLine() && FormatNextEvent()) {}
+}
+
+bool EventLog::DrainLine() {
+  while (line_written_ != line_length_) {
+    int space = hal::SerialAvailableForWrite();
+    if (space <= 0) return false;
+
+    uint8_t size = line_length_ - line_written_;
+    if (static_cast<int>(size) > space) size = static_cast<uint8_t>(space);
+    line_written_ += hal::SerialWrite(reinterpret_cast<const uint8_t*>(&line_[line_written_]), size);
+  }
+
+  return true;
+}
+
+Print& EventLog::line_output() {
+  line_length_ = 0;
+  line_written_ = 0;
+  return line_output_;
+}
+
+void EventLog::set_enabled(bool enabled) {
+  enabled_ = enabled;
+}
+
+bool EventLog::enabled() const {
+  return enabled_;
+}
+
+uint16_t EventLog::dropped_count() const {
+  return dropped_count_;
+}
+
+EventLog::EventLog() {}
+
+EventLog::~EventLog() {}
+
+bool EventLog::FormatNextEvent() {
+  Event event;
+  if (dropped_reported_count_ != dropped_count_) {
+    // Report drops before the events that follow them.
+    event = {Message::kMessagesDropped, static_cast<int32_t>(dropped_count_ - dropped_reported_count_)};
+    dropped_reported_count_ = dropped_count_;
+  }
+  else if (!events_.Pop(event)) {
+    return false;
+  }
+
+  const MessageFormat* format = &kMessageFormats[static_cast<uint8_t>(event.message)];
+  line_length_ = 0;
+  line_written_ = 0;
+  AppendText(hal::ReadFlashPointer(&format->text));
+  switch (static_cast<ValueFormat>(hal::ReadFlashByte(reinterpret_cast<const uint8_t*>(&format->value_format)))) {
+    case ValueFormat::kNone: {
+      break;
+    }
+    case ValueFormat::kInteger: {
+      AppendNumber(event.value, 0);
+      break;
+    }
+    case ValueFormat::kHundredths: {
+      AppendNumber(event.value, 2);
+      break;
+    }
+    case ValueFormat::kCharacter: {
+      AppendCharacter(static_cast<char>(event.value));
+      break;
+    }
+  }
+
+  AppendCharacter('\r');
+  AppendCharacter('\n');
+  return true;
+}
+
+void EventLog::AppendText(const char* text) {
+  while (char character = static_cast<char>(hal::ReadFlashByte(reinterpret_cast<const uint8_t*>(text++)))) {
+    AppendCharacter(character);
+  }
+}
+
+void EventLog::AppendNumber(int32_t value, uint8_t decimal_places) {
+  char digits[12];
+  uint8_t count = 0;
+  uint32_t magnitude = value < 0 ? 0U - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+  do {
+    digits[count++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0 || count <= decimal_places);
+
+  if (value < 0) AppendCharacter('-');
+  while (count > 0) {
+    if (count == decimal_places) AppendCharacter('.');
+    AppendCharacter(digits[--count]);
+  }
+}
+
+size_t EventLog::LineOutput::write(uint8_t character) {
+  event_log_.AppendCharacter(static_cast<char>(character));
+  return 1;
+}
+
+void EventLog::AppendCharacter(char character) {
+  // Truncate (rather than overflow) over-long lines; the line ending always fits.
+  if (line_length_ < kLineBufferSize_ - 2 || character == '\r' || character == '\n') {
+    if (line_length_ < kLineBufferSize_) line_[line_length_++] = character;
+  }
+}
+
+} // namespace mtspin
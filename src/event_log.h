@@ -0,0 +1,160 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file event_log.h
+/// @brief Class to record compact log events in RAM and write them to serial without ever blocking.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "spsc_queue.h"
+
+namespace mtspin {
+
+/// @brief The Event Log class using the singleton pattern i.e., only a single instance can exist.
+/// Log messages are recorded as a message ID plus a numeric value in a fixed size ring buffer, and are only formatted
+/// and written to serial (see Drain()) as space becomes available in the serial transmit buffer. Messages recorded
+/// while the ring buffer is full are dropped and counted. Reports longer than the serial transmit buffer are written
+/// the same way, a line at a time, through the line buffer (see line_output()).
+class EventLog {
+ public:
+
+  /// @brief Enum of log messages.
+  enum class Message : uint8_t {
+    kSetupComplete = 0,
+    kLogsEnabled,
+    kLogsDisabled,
+    kMessagesDropped,
+    kGeneralStatus,
+    kAxis,
+    kDirectionButtonShortPress,
+    kAngleButtonShortPress,
+    kSpeedButtonShortPress,
+    kDirectionOrAngleButtonLongPress,
+    kSpeedButtonLongPress,
+    kSerialInput,
+    kInvalidControlAction,
+    kControlModeContinuous,
+    kControlModeOscillate,
+    kControlModeProgram,
+    kMotionDirectionCw,
+    kMotionDirectionCcw,
+    kSweepAngle,
+    kSpeed,
+    kMotionStarted,
+    kMotionStopped,
+    kTelemetryEnabled,
+    kTelemetryDisabled,
+    kTriggerAngles,
+  };
+
+  /// @brief Static method to get the single instance.
+  /// @return The Event Log instance.
+  static EventLog& GetInstance();
+
+  /// @brief Delete the copy constructor to prevent copying of the single instance.
+  EventLog(const EventLog&) = delete;
+
+  /// @brief Delete the assignment operator to prevent copying of the single instance.
+  EventLog& operator=(const EventLog&) = delete;
+
+  /// @brief Record a log message (if logging is enabled).
+  /// @param message The message.
+  /// @param value The value reported with the message (if the message has one).
+  void Record(Message message, int32_t value = 0);
+
+  /// @brief Write recorded messages to serial, as far as the serial transmit buffer allows without blocking.
+  void Drain(); ///< This must be called repeatedly.
+
+  /// @brief Write the rest of the line in the line buffer (log message or report line) to serial, as far as the serial
+  /// transmit buffer allows without blocking, but no further recorded messages.
+  /// @return True if the line buffer is free, i.e., the line is written out.
+  bool DrainLine();
+
+  /// @brief Get an output that prints a report line into the line buffer, to be written out by DrainLine() or Drain()
+  /// (whether or not logging is enabled). The line buffer must be free (see DrainLine()); a line longer than the line
+  /// buffer is truncated.
+  /// @return The output.
+  Print& line_output();
+
+  /// @brief Enable/disable the recording of log messages.
+  /// @param enabled True to enable.
+  void set_enabled(bool enabled);
+
+  /// @brief Check if the recording of log messages is enabled.
+  /// @return True if enabled.
+  bool enabled() const;
+
+  /// @brief Get the no. of messages dropped (since startup) because the ring buffer was full.
+  /// @return The no. of messages dropped.
+  uint16_t dropped_count() const;
+
+ private:
+
+  /// @brief Output that appends to the line buffer (see line_output()).
+  class LineOutput : public Print {
+   public:
+
+    /// @brief Construct a Line Output object.
+    /// @param event_log The event log the line buffer belongs to.
+    explicit LineOutput(EventLog& event_log) : event_log_(event_log) {}
+
+    /// @brief Append a character to the line buffer.
+    /// @param character The character.
+    /// @return The no. of characters written (always 1; characters beyond the line buffer are discarded).
+    size_t write(uint8_t character) override;
+
+    using Print::write;
+
+   private:
+
+    EventLog& event_log_; ///< The event log the line buffer belongs to.
+  };
+
+  /// @brief Log event.
+  struct Event {
+    Message message; ///< The message.
+    int32_t value; ///< The value reported with the message.
+  };
+
+  /// @brief Private constructor so objects cannot be manually instantiated.
+  EventLog();
+
+  /// @brief Private destructor so objects cannot be manually instantiated.
+  ~EventLog();
+
+  /// @brief Format the next event into the line buffer.
+  /// @return True if an event was formatted, false if there are no events to write.
+  bool FormatNextEvent();
+
+  /// @brief Append text from flash to the line buffer.
+  /// @param text The text (in flash).
+  void AppendText(const char* text);
+
+  /// @brief Append a decimal number to the line buffer.
+  /// @param value The number.
+  /// @param decimal_places No. of decimal places the number is scaled by (e.g., 2 for hundredths).
+  void AppendNumber(int32_t value, uint8_t decimal_places);
+
+  /// @brief Append a character to the line buffer.
+  /// @param character The character.
+  void AppendCharacter(char character);
+
+  inline static constexpr uint8_t kEventBufferSize_ = 16; ///< No. of events the ring buffer can hold.
+  inline static constexpr uint8_t kLineBufferSize_ = 72; ///< Longest formatted line (characters), e.g., a report line.
+
+  SpscQueue<Event, kEventBufferSize_> events_; ///< Recorded events.
+  bool enabled_ = false; ///< Flag to keep track of whether recording is enabled.
+  uint16_t dropped_count_ = 0; ///< No. of events dropped since startup.
+  uint16_t dropped_reported_count_ = 0; ///< No. of dropped events already reported.
+
+  char line_[kLineBufferSize_] = {}; ///< Formatted line waiting to be written.
+  uint8_t line_length_ = 0; ///< Length of the formatted line.
+  uint8_t line_written_ = 0; ///< No. of characters of the formatted line written so far.
+  LineOutput line_output_{*this}; ///< Output that prints report lines into the line buffer.
+};
+
+} // namespace mtspin
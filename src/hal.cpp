@@ -0,0 +1,284 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file hal.cpp
+/// @brief Thin hardware abstraction layer (GPIO, clock and serial) between the firmware and the Arduino core.
+
+#include "hal.h"
+
+#include <Arduino.h>
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#elif defined(ARDUINO_ARCH_RENESAS)
+#include <FspTimer.h>
+#endif
+
+namespace mtspin {
+
+namespace hal {
+
+void SetPinMode(uint8_t pin, PinMode mode) {
+  pinMode(pin, mode == PinMode::kOutput ? OUTPUT : INPUT);
+}
+
+PinState ReadPin(uint8_t pin) {
+  return digitalRead(pin) == HIGH ? PinState::kHigh : PinState::kLow;
+}
+
+void WritePin(uint8_t pin, PinState state) {
+  digitalWrite(pin, state == PinState::kHigh ? HIGH : LOW);
+}
+
+InputPinBank::InputPinBank(const uint8_t* pins, uint8_t count) : count_(count > kMaxPins ? kMaxPins : count) {
+  for (uint8_t index = 0; index < count_; index++) pins_[index] = pins[index];
+}
+
+InputPinBank::~InputPinBank() {}
+
+void InputPinBank::Begin() {
+#if defined(ARDUINO_ARCH_AVR)
+  if (count_ == 0) return;
+  uint8_t port = digitalPinToPort(pins_[0]);
+  uint8_t first_bit_mask = digitalPinToBitMask(pins_[0]);
+  for (uint8_t index = 1; index < count_; index++) {
+    if (digitalPinToPort(pins_[index]) != port
+        || digitalPinToBitMask(pins_[index]) != static_cast<uint8_t>(first_bit_mask << index)) {
+      return; // Not consecutive bits of one port; read the pins one by one.
+    }
+  }
+
+  shift_ = 0;
+  while ((first_bit_mask >> shift_) != 1) shift_++;
+  input_register_ = portInputRegister(port);
+#endif
+}
+
+uint8_t InputPinBank::Read() const {
+#if defined(ARDUINO_ARCH_AVR)
+  if (input_register_ != nullptr) return static_cast<uint8_t>(*input_register_ >> shift_) & ((1U << count_) - 1);
+#endif
+  uint8_t states = 0;
+  for (uint8_t index = 0; index < count_; index++) {
+    if (ReadPin(pins_[index]) == PinState::kHigh) states |= static_cast<uint8_t>(1U << index);
+  }
+
+  return states;
+}
+
+uint8_t InputPinBank::count() const {
+  return count_;
+}
+
+uint32_t Millis() {
+  return millis();
+}
+
+uint32_t Micros() {
+  return micros();
+}
+
+void DelayMs(uint32_t period_ms) {
+  delay(period_ms);
+}
+
+void DelayUs(uint16_t period_us) {
+  delayMicroseconds(period_us);
+}
+
+void BeginSerial(uint32_t baud_rate) {
+  MTSPIN_SERIAL.begin(baud_rate);
+}
+
+int SerialAvailable() {
+  return MTSPIN_SERIAL.available();
+}
+
+int SerialRead() {
+  return MTSPIN_SERIAL.read();
+}
+
+int SerialAvailableForWrite() {
+  return MTSPIN_SERIAL.availableForWrite();
+}
+
+size_t SerialWrite(const uint8_t* data, size_t size) {
+  return MTSPIN_SERIAL.write(data, size);
+}
+
+Print& SerialPort() {
+  return MTSPIN_SERIAL;
+}
+
+#if defined(ARDUINO_ARCH_AVR)
+
+void EnableWakeOnPinChange(uint8_t pin) {
+  volatile uint8_t* mask_register = digitalPinToPCMSK(pin);
+  // Without a (claimed) pin change interrupt, the clock tick still wakes the CPU (every ~1 ms).
+  if (mask_register == nullptr || (MTSPIN_WAKE_PIN_CHANGE_VECTORS & _BV(digitalPinToPCICRbit(pin))) == 0) return;
+  *mask_register |= _BV(digitalPinToPCMSKbit(pin));
+  *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+
+void Sleep() {
+  // Idle mode halts the CPU only; the UART, Timer0 (millis()) and pin change interrupts all wake it.
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
+}
+
+#elif defined(ARDUINO_ARCH_RENESAS)
+
+void EnableWakeOnPinChange(uint8_t /*pin*/) {
+  // The buttons are polled; the clock tick (SysTick, every 1 ms) wakes the CPU to sample them.
+}
+
+void Sleep() {
+  __WFI(); // Sleep mode halts the CPU only; any interrupt (SysTick, serial, step timer) wakes it.
+}
+
+#else
+
+void EnableWakeOnPinChange(uint8_t /*pin*/) {}
+
+void Sleep() {}
+
+#endif
+
+namespace {
+
+StepTimerCallback step_timer_callback = nullptr; ///< The step timer callback.
+
+/// @brief Clamp a step timer interval to the range supported by the timer.
+/// @param interval_us The requested interval (us).
+/// @return The clamped interval (us).
+uint32_t ClampStepTimerInterval(uint32_t interval_us) {
+  if (interval_us < kMinStepTimerInterval_us) return kMinStepTimerInterval_us;
+  if (interval_us > kMaxStepTimerInterval_us) return kMaxStepTimerInterval_us;
+  return interval_us;
+}
+
+} // namespace
+
+#if defined(ARDUINO_ARCH_AVR)
+
+InterruptGuard::InterruptGuard() : state_(SREG) {
+  cli();
+}
+
+InterruptGuard::~InterruptGuard() {
+  SREG = static_cast<uint8_t>(state_);
+}
+
+namespace {
+
+inline constexpr uint32_t kStepTimerTicksPerUs = F_CPU / 8000000UL; ///< Timer1 ticks per us (clk/8 prescaler).
+inline constexpr uint16_t kStepTimerLeadTicks = 4; ///< Fewest Timer1 ticks from writing a compare value to its match.
+
+/// @brief Convert a step timer interval to Timer1 ticks.
+/// @param interval_us The interval (us).
+/// @return The no. of ticks.
+uint16_t StepTimerTicks(uint32_t interval_us) {
+  return static_cast<uint16_t>(ClampStepTimerInterval(interval_us) * kStepTimerTicksPerUs);
+}
+
+} // namespace
+
+void BeginStepTimer(StepTimerCallback callback, uint32_t interval_us) {
+  InterruptGuard guard;
+  step_timer_callback = callback;
+  TCCR1A = 0;
+  // Normal (free running) mode, clk/8 prescaler; each compare value is set relative to the previous one (see the ISR).
+  TCCR1B = _BV(CS11);
+  TCNT1 = 0;
+  OCR1A = StepTimerTicks(interval_us);
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+#elif defined(ARDUINO_ARCH_RENESAS)
+
+InterruptGuard::InterruptGuard() : state_(__get_PRIMASK()) {
+  __disable_irq();
+}
+
+InterruptGuard::~InterruptGuard() {
+  __set_PRIMASK(state_);
+}
+
+namespace {
+
+FspTimer step_timer; ///< The general purpose timer used for step generation.
+uint32_t step_timer_period_counts = 0; ///< Timer counts for the longest step timer interval.
+
+/// @brief Convert a step timer interval to a timer period.
+/// @param interval_us The interval (us).
+/// @return The period (timer counts).
+uint32_t StepTimerPeriod(uint32_t interval_us) {
+  return static_cast<uint32_t>(static_cast<uint64_t>(ClampStepTimerInterval(interval_us)) * step_timer_period_counts
+                               / kMaxStepTimerInterval_us);
+}
+
+/// @brief Timer overflow interrupt; runs the step timer callback and schedules the next interrupt.
+void StepTimerIsr(timer_callback_args_t* /*args*/) {
+  step_timer.set_period(StepTimerPeriod(step_timer_callback()));
+}
+
+} // namespace
+
+void BeginStepTimer(StepTimerCallback callback, uint32_t interval_us) {
+  step_timer_callback = callback;
+  uint8_t timer_type = GPT_TIMER;
+  int8_t timer_channel = FspTimer::get_available_timer(timer_type);
+  // Open the timer at the longest interval so the clock divider chosen can represent every interval.
+  step_timer.begin(TIMER_MODE_PERIODIC, timer_type, timer_channel, 1000000.0F / kMaxStepTimerInterval_us, 0.0F,
+                   StepTimerIsr);
+  step_timer.set_period_buffer(false); // Apply new periods immediately (from within the interrupt).
+  step_timer.setup_overflow_irq();
+  step_timer.open();
+  step_timer_period_counts = step_timer.get_period_raw();
+  step_timer.set_period(StepTimerPeriod(interval_us));
+  step_timer.start();
+}
+
+#else
+#error "Unsupported architecture: no step timer implementation."
+#endif
+
+} // namespace hal
+
+} // namespace mtspin
+
+#if defined(ARDUINO_ARCH_AVR)
+
+// Pin change interrupts only wake the CPU from sleep (see hal::EnableWakeOnPinChange()); there is nothing to handle.
+// Only the vectors selected are claimed, leaving the others to other code (e.g., libraries using pin change interrupts).
+#if MTSPIN_WAKE_PIN_CHANGE_VECTORS & 1
+EMPTY_INTERRUPT(PCINT0_vect);
+#endif
+#if MTSPIN_WAKE_PIN_CHANGE_VECTORS & 2
+EMPTY_INTERRUPT(PCINT1_vect);
+#endif
+#if MTSPIN_WAKE_PIN_CHANGE_VECTORS & 4
+EMPTY_INTERRUPT(PCINT2_vect);
+#endif
+
+/// @brief Timer1 compare match interrupt; runs the step timer callback and schedules the next interrupt.
+/// The next match is scheduled from this one (not from when the callback returns), so interrupt latency does not
+/// accumulate. If the callback ran past the next match, the match is brought forward to just after now; otherwise, the
+/// counter would have to wrap around (~32 ms) to reach it.
+ISR(TIMER1_COMPA_vect) {
+  uint16_t compare_value = OCR1A;
+  uint16_t ticks = mtspin::hal::StepTimerTicks(mtspin::hal::step_timer_callback());
+  uint16_t elapsed_ticks = TCNT1 - compare_value;
+  if (static_cast<uint16_t>(elapsed_ticks + mtspin::hal::kStepTimerLeadTicks) >= ticks) {
+    ticks = elapsed_ticks + mtspin::hal::kStepTimerLeadTicks;
+  }
+
+  OCR1A = compare_value + ticks;
+}
+
+#endif
\ No newline at end of file
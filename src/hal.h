@@ -0,0 +1,293 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file hal.h
+/// @brief Thin hardware abstraction layer (GPIO, clock and serial) between the firmware and the Arduino core.
+
+#pragma once
+
+#include <Arduino.h>
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/pgmspace.h>
+#endif
+
+#ifndef PROGMEM
+#define PROGMEM // Flash is directly addressable; constant data is placed in flash without an attribute.
+#endif
+
+/// @brief Macro to define Serial port.
+#ifndef MTSPIN_SERIAL
+#define MTSPIN_SERIAL Serial // "Serial" for programming port, "SerialUSB" for native port (Due and Zero only).
+#endif
+
+/// @brief Macro to select the pin change interrupt vectors claimed to wake from sleep on a button press (AVR; bit n
+/// for PCINTn_vect, i.e., 1 for D8-D13, 2 for A0-A5, 4 for D0-D7). Buttons on other ports wake on the clock tick only.
+#ifndef MTSPIN_WAKE_PIN_CHANGE_VECTORS
+#define MTSPIN_WAKE_PIN_CHANGE_VECTORS 1 // The port of the button pins (D9-D11, see Configuration); 0 to claim none.
+#endif
+
+namespace mtspin {
+
+namespace hal {
+
+/// @brief Enum of GPIO pin modes.
+enum class PinMode : uint8_t {
+  kInput = 0,
+  kOutput,
+};
+
+/// @brief Enum of GPIO pin states.
+enum class PinState : uint8_t {
+  kLow = 0,
+  kHigh,
+};
+
+// GPIO.
+
+/// @brief Configure the mode of a GPIO pin.
+/// @param pin The GPIO pin.
+/// @param mode The pin mode.
+void SetPinMode(uint8_t pin, PinMode mode);
+
+/// @brief Read the state of a GPIO pin.
+/// @param pin The GPIO pin.
+/// @return The pin state.
+PinState ReadPin(uint8_t pin);
+
+/// @brief Write the state of a GPIO pin.
+/// @param pin The GPIO pin.
+/// @param state The pin state.
+void WritePin(uint8_t pin, PinState state);
+
+/// @brief The Output Pin class template; a GPIO output pin fixed at compile time.
+/// On the UNO R3 (ATmega328P), the pin number folds into its port register and bit, so a write is a single
+/// instruction (instead of the pin lookups of digitalWrite()); the pin must not be in use as a PWM output. On other
+/// boards it is written through the Arduino core.
+/// @tparam kPin The GPIO pin.
+template <uint8_t kPin>
+class OutputPin {
+ public:
+
+  /// @brief Write the state of the pin.
+  /// @param state The pin state.
+  static inline void Write(PinState state) {
+#if defined(__AVR_ATmega328P__)
+    volatile uint8_t& port_register = *reinterpret_cast<volatile uint8_t*>(kPortAddress_);
+    if (state == PinState::kHigh) {
+      port_register |= kBitMask_;
+    }
+    else {
+      port_register &= static_cast<uint8_t>(~kBitMask_);
+    }
+#else
+    WritePin(kPin, state);
+#endif
+  }
+
+ private:
+
+#if defined(__AVR_ATmega328P__)
+  static_assert(kPin < 20, "OutputPin supports digital pins D0-D13 and A0-A5 (D14-D19) on the ATmega328P.");
+  inline static constexpr uint16_t kPortAddress_ = kPin < 8 ? 0x2B : (kPin < 14 ? 0x25 : 0x28); ///< PORTD/B/C.
+  inline static constexpr uint8_t kBitMask_ = 1U << (kPin < 8 ? kPin : (kPin < 14 ? kPin - 8 : kPin - 14)); ///< Pin bit.
+#endif
+};
+
+/// @brief The Input Pin Bank class.
+/// Reads a group of (up to 8) input pins together. If the pins are consecutive bits of the same port (e.g., pins 9-11
+/// on the UNO R3), they are read with a single port register read; otherwise they are read one by one.
+class InputPinBank {
+ public:
+
+  inline static constexpr uint8_t kMaxPins = 8; ///< Largest no. of pins in a bank.
+
+  /// @brief Construct an Input Pin Bank object.
+  /// @param pins The GPIO pins (copied); pin n is read into bit n.
+  /// @param count The no. of pins (up to kMaxPins).
+  InputPinBank(const uint8_t* pins, uint8_t count);
+
+  /// @brief Destroy the Input Pin Bank object.
+  ~InputPinBank();
+
+  /// @brief Resolve the port register (if any) to read the pins from.
+  void Begin(); ///< This must be called only once, after the Arduino core is initialised.
+
+  /// @brief Read the pin states.
+  /// @return The pin states; bit n is set if pin n is high.
+  uint8_t Read() const;
+
+  /// @brief Get the no. of pins.
+  /// @return The no. of pins.
+  uint8_t count() const;
+
+ private:
+
+  uint8_t pins_[kMaxPins] = {}; ///< The GPIO pins.
+  uint8_t count_ = 0; ///< The no. of pins.
+#if defined(ARDUINO_ARCH_AVR)
+  volatile uint8_t* input_register_ = nullptr; ///< Port input register, if all pins are consecutive bits of it.
+  uint8_t shift_ = 0; ///< Bit position of the first pin in the port input register.
+#endif
+};
+
+// Clock.
+
+/// @brief Get the time elapsed since startup.
+/// @return The time (ms) elapsed since startup.
+uint32_t Millis();
+
+/// @brief Get the time elapsed since startup.
+/// @return The time (us) elapsed since startup.
+uint32_t Micros();
+
+/// @brief Block for a period of time.
+/// @param period_ms The period (ms) to block for.
+void DelayMs(uint32_t period_ms);
+
+/// @brief Block for a (short) period of time.
+/// @param period_us The period (us) to block for.
+void DelayUs(uint16_t period_us);
+
+/// @brief Block for a (short) period of time known at compile time; exact to the cycle on AVR.
+/// @tparam kPeriod_us The period (us) to block for.
+template <uint16_t kPeriod_us>
+inline void DelayUs() {
+#if defined(ARDUINO_ARCH_AVR)
+  __builtin_avr_delay_cycles(static_cast<uint32_t>(F_CPU / 1000000UL) * kPeriod_us);
+#else
+  DelayUs(kPeriod_us);
+#endif
+}
+
+// Serial.
+
+/// @brief Initialise the serial port.
+/// @param baud_rate The serial communication speed.
+void BeginSerial(uint32_t baud_rate);
+
+/// @brief Get the no. of bytes waiting in the serial receive buffer.
+/// @return The no. of bytes available to read.
+int SerialAvailable();
+
+/// @brief Read a byte from the serial receive buffer.
+/// @return The byte read, or -1 if none is available.
+int SerialRead();
+
+/// @brief Get the free space in the serial transmit buffer.
+/// @return The no. of bytes that can be written without blocking.
+int SerialAvailableForWrite();
+
+/// @brief Write bytes to the serial port.
+/// @param data The bytes to write.
+/// @param size The no. of bytes to write.
+/// @return The no. of bytes written.
+size_t SerialWrite(const uint8_t* data, size_t size);
+
+/// @brief Get the serial port as a print target (for text output and logging).
+/// @return The serial port.
+Print& SerialPort();
+
+// Flash.
+
+/// @brief Read a word from constant data placed in flash (PROGMEM).
+/// @param address The address of the word.
+/// @return The word.
+inline uint16_t ReadFlashWord(const uint16_t* address) {
+#if defined(ARDUINO_ARCH_AVR)
+  return pgm_read_word(address);
+#else
+  return *address;
+#endif
+}
+
+/// @brief Read a byte from constant data placed in flash (PROGMEM).
+/// @param address The address of the byte.
+/// @return The byte.
+inline uint8_t ReadFlashByte(const uint8_t* address) {
+#if defined(ARDUINO_ARCH_AVR)
+  return pgm_read_byte(address);
+#else
+  return *address;
+#endif
+}
+
+/// @brief Read a pointer from constant data placed in flash (PROGMEM).
+/// @param address The address of the pointer.
+/// @return The pointer.
+template <typename T>
+inline const T* ReadFlashPointer(const T* const* address) {
+#if defined(ARDUINO_ARCH_AVR)
+  return reinterpret_cast<const T*>(pgm_read_ptr(address));
+#else
+  return *address;
+#endif
+}
+
+/// @brief Read an object (of a trivially copyable type, e.g., a table entry) from constant data placed in flash
+/// (PROGMEM).
+/// @param address The address of the object.
+/// @return The object.
+template <typename T>
+inline T ReadFlashObject(const T* address) {
+#if defined(ARDUINO_ARCH_AVR)
+  T object;
+  memcpy_P(&object, address, sizeof(T));
+  return object;
+#else
+  return *address;
+#endif
+}
+
+// Interrupts.
+
+/// @brief Class that disables interrupts for its lifetime (restoring the previous interrupt state on destruction).
+class InterruptGuard {
+ public:
+
+  /// @brief Construct an Interrupt Guard object; interrupts are disabled.
+  InterruptGuard();
+
+  /// @brief Destroy the Interrupt Guard object; the previous interrupt state is restored.
+  ~InterruptGuard();
+
+  /// @brief Delete the copy constructor; a guard must not be duplicated.
+  InterruptGuard(const InterruptGuard&) = delete;
+
+  /// @brief Delete the assignment operator; a guard must not be duplicated.
+  InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+ private:
+
+  uint32_t state_; ///< The interrupt state before the guard was constructed.
+};
+
+// Power.
+
+/// @brief Enable waking from sleep (see Sleep()) on a change of state of an input pin, if the pin change interrupt
+/// vector of its port is claimed (see MTSPIN_WAKE_PIN_CHANGE_VECTORS).
+/// @param pin The GPIO pin.
+void EnableWakeOnPinChange(uint8_t pin);
+
+/// @brief Sleep until the next interrupt (e.g., a wake pin change, a serial byte received, or the clock tick).
+/// Only the CPU is halted; the clock, serial port and timers keep running, so no time or input is lost.
+void Sleep();
+
+// Step timer.
+
+/// @brief Step timer callback; called from interrupt context and returns the interval (us) to the next call.
+using StepTimerCallback = uint32_t (*)();
+
+inline constexpr uint32_t kMinStepTimerInterval_us = 20; ///< Shortest step timer interval (us).
+inline constexpr uint32_t kMaxStepTimerInterval_us = 32767; ///< Longest step timer interval (us).
+
+/// @brief Start the step timer (a hardware timer compare/overflow interrupt).
+/// @param callback The function to call on every timer interrupt.
+/// @param interval_us The interval (us) to the first call.
+void BeginStepTimer(StepTimerCallback callback, uint32_t interval_us); ///< This must be called only once.
+
+} // namespace hal
+
+} // namespace mtspin
@@ -0,0 +1,59 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file index_sequence.h
+/// @brief Compile-time index sequences, to generate lookup tables in constant expressions.
+/// The Arduino AVR core compiles with -std=gnu++11 and has no standard library, so constexpr functions are single
+/// return statements; a table is generated by expanding an index sequence into its initialiser list instead of filling
+/// it in a loop.
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief Sequence of indices, e.g., IndexSequence<0, 1, 2>.
+/// @tparam kIndices The indices.
+template <uint16_t... kIndices>
+struct IndexSequence {};
+
+/// @brief Concatenation of two index sequences, with the second offset by the size of the first.
+/// @tparam First The first index sequence.
+/// @tparam Second The second index sequence.
+template <typename First, typename Second>
+struct ConcatenatedIndexSequence;
+
+template <uint16_t... kFirstIndices, uint16_t... kSecondIndices>
+struct ConcatenatedIndexSequence<IndexSequence<kFirstIndices...>, IndexSequence<kSecondIndices...>> {
+  using Type = IndexSequence<kFirstIndices..., (sizeof...(kFirstIndices) + kSecondIndices)...>; ///< The sequence.
+};
+
+/// @brief Index sequence from 0 up to (not including) a size; built by halves, so the template nesting depth is only
+/// logarithmic in the size.
+/// @tparam kSize The size.
+template <uint16_t kSize>
+struct IndexSequenceOfSize {
+  /// The sequence.
+  using Type = typename ConcatenatedIndexSequence<typename IndexSequenceOfSize<kSize / 2>::Type,
+                                                  typename IndexSequenceOfSize<kSize - kSize / 2>::Type>::Type;
+};
+
+template <>
+struct IndexSequenceOfSize<0> {
+  using Type = IndexSequence<>; ///< The sequence.
+};
+
+template <>
+struct IndexSequenceOfSize<1> {
+  using Type = IndexSequence<0>; ///< The sequence.
+};
+
+/// @brief Index sequence from 0 up to (not including) a size, e.g., MakeIndexSequence<3> is IndexSequence<0, 1, 2>.
+/// @tparam kSize The size.
+template <uint16_t kSize>
+using MakeIndexSequence = typename IndexSequenceOfSize<kSize>::Type;
+
+} // namespace mtspin
@@ -0,0 +1,135 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file instrumentation.cpp
+/// @brief Class to measure control loop and control action timing (optional; for performance analysis).
+
+#include "instrumentation.h"
+
+#if MTSPIN_INSTRUMENTATION
+
+#include <Arduino.h>
+
+#include "hal.h"
+#include "step_engine.h"
+
+namespace mtspin {
+
+Instrumentation::Instrumentation() {}
+
+Instrumentation::~Instrumentation() {}
+
+void Instrumentation::RecordLoop() {
+  uint32_t time_us = hal::Micros();
+  if (loop_started_) {
+    uint32_t loop_time_us = time_us - loop_start_time_us_ - loop_sleep_time_us_;
+    // Bin by bit width (i.e., floor(log2) + 1), which is a single count-leading-zeros instruction on most targets.
+    uint8_t bin = loop_time_us == 0 ? 0 : static_cast<uint8_t>(8 * sizeof(unsigned long) - __builtin_clzl(loop_time_us));
+    if (bin >= kSizeOfLoopHistogram_) bin = kSizeOfLoopHistogram_ - 1;
+    if (loop_histogram_[bin] != UINT16_MAX) loop_histogram_[bin]++;
+    if (loop_time_us > max_loop_time_us_) max_loop_time_us_ = loop_time_us;
+  }
+
+  loop_start_time_us_ = time_us;
+  loop_sleep_time_us_ = 0;
+  loop_started_ = true;
+}
+
+void Instrumentation::RecordSleep(uint32_t duration_us) {
+  loop_sleep_time_us_ += duration_us;
+  sleep_time_us_ += duration_us;
+}
+
+void Instrumentation::RecordControlAction(Configuration::ControlAction control_action, uint32_t duration_us) {
+  for (uint8_t index = 0; index < kSizeOfTimedActions_; index++) {
+    if (kTimedActions_[index] != control_action) continue;
+    ControlActionTiming& timing = control_action_timings_[index];
+    if (timing.count != UINT16_MAX) timing.count++;
+    if (duration_us > timing.max_us) timing.max_us = duration_us;
+    timing.total_us += duration_us;
+    return;
+  }
+}
+
+bool Instrumentation::ReportNextLine(Print& output) {
+  while (report_line_ >= kFirstBinLine_ && report_line_ < kSleepLine_
+         && loop_histogram_[report_line_ - kFirstBinLine_] == 0) {
+    report_line_++;
+  }
+
+  while (report_line_ >= kFirstActionLine_ && report_line_ < kEndLine_
+         && control_action_timings_[report_line_ - kFirstActionLine_].count == 0) {
+    report_line_++;
+  }
+
+  if (report_line_ == kMaxLoopTimeLine_) {
+    output.print(F("Loop time max (us): "));
+    output.println(max_loop_time_us_);
+    max_loop_time_us_ = 0;
+  }
+  else if (report_line_ == kHistogramHeadingLine_) {
+    output.println(F("Loop time histogram (us): count"));
+  }
+  else if (report_line_ < kSleepLine_) {
+    uint8_t bin = report_line_ - kFirstBinLine_;
+    if (bin == kSizeOfLoopHistogram_ - 1) {
+      output.print(F(">= "));
+      output.print(1UL << (bin - 1));
+    }
+    else {
+      output.print(F("< "));
+      output.print(1UL << bin);
+    }
+
+    output.print(F(": "));
+    output.println(loop_histogram_[bin]);
+    loop_histogram_[bin] = 0;
+  }
+  else if (report_line_ == kSleepLine_) {
+    uint32_t time_us = hal::Micros();
+    uint32_t report_time_us = time_us - report_start_time_us_;
+    output.print(F("Time asleep (%): "));
+    output.println(report_time_us == 0 ? 0UL
+                                       : static_cast<unsigned long>((100ULL * sleep_time_us_) / report_time_us));
+    report_start_time_us_ = time_us;
+    sleep_time_us_ = 0;
+  }
+  else if (report_line_ == kLateStepsLine_) {
+    StepEngine::StepTimingCounts step_timing_counts = StepEngine::GetInstance().TakeStepTimingCounts();
+    missed_steps_ = step_timing_counts.missed_steps;
+    output.print(F("Late steps: "));
+    output.println(step_timing_counts.late_steps);
+  }
+  else if (report_line_ == kMissedStepsLine_) {
+    output.print(F("Missed steps: "));
+    output.println(missed_steps_);
+  }
+  else if (report_line_ == kActionHeadingLine_) {
+    output.println(F("Control action: count, max (us), total (us)"));
+  }
+  else if (report_line_ < kEndLine_) {
+    uint8_t index = report_line_ - kFirstActionLine_;
+    ControlActionTiming& timing = control_action_timings_[index];
+    output.print(static_cast<char>(kTimedActions_[index]));
+    output.print(F(": "));
+    output.print(timing.count);
+    output.print(F(", "));
+    output.print(timing.max_us);
+    output.print(F(", "));
+    output.println(timing.total_us);
+    timing = {};
+  }
+  else {
+    report_line_ = kMaxLoopTimeLine_;
+    return false;
+  }
+
+  report_line_++;
+  return true;
+}
+
+} // namespace mtspin
+
+#endif
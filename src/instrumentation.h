@@ -0,0 +1,106 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file instrumentation.h
+/// @brief Class to measure control loop and control action timing (optional; for performance analysis).
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "configuration.h"
+
+/// @brief Macro to compile in loop and step timing instrumentation (0 compiles it out completely).
+#ifndef MTSPIN_INSTRUMENTATION
+#define MTSPIN_INSTRUMENTATION 0
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+
+namespace mtspin {
+
+/// @brief The Instrumentation class.
+/// Records a log2 histogram of control loop times (excluding time asleep), the longest loop time, the time spent
+/// processing each control action, and the time spent asleep. Step timing (late/missed steps) is recorded by the step
+/// engine and reported alongside.
+class Instrumentation {
+ public:
+
+  /// @brief Construct an Instrumentation object.
+  Instrumentation();
+
+  /// @brief Destroy the Instrumentation object.
+  ~Instrumentation();
+
+  /// @brief Record the time since the previous call as one loop iteration.
+  void RecordLoop(); ///< This must be called once per loop.
+
+  /// @brief Record the time taken to process a control action.
+  /// @param control_action The control action.
+  /// @param duration_us The processing time (us).
+  void RecordControlAction(Configuration::ControlAction control_action, uint32_t duration_us);
+
+  /// @brief Record time spent asleep (see hal::Sleep()).
+  /// @param duration_us The time (us) asleep.
+  void RecordSleep(uint32_t duration_us);
+
+  /// @brief Report all timing statistics (including the step engine's), a line per call, resetting each statistic as
+  /// it is printed.
+  /// @param output The output to print the line to.
+  /// @return True if the report continues (call again for the next line), false if it is complete.
+  bool ReportNextLine(Print& output);
+
+ private:
+
+  /// @brief Timing statistics for a control action.
+  struct ControlActionTiming {
+    uint16_t count; ///< No. of times the control action was processed.
+    uint32_t max_us; ///< Longest processing time (us).
+    uint32_t total_us; ///< Total processing time (us).
+  };
+
+  inline static constexpr uint8_t kSizeOfLoopHistogram_ = 16; ///< No. of loop time histogram bins.
+  inline static constexpr uint8_t kSizeOfTimedActions_ = 9; ///< No. of timed control actions.
+  /// @brief Control actions timed (the report itself is excluded, so it does not skew the statistics).
+  inline static constexpr Configuration::ControlAction kTimedActions_[kSizeOfTimedActions_] = {
+    Configuration::ControlAction::kToggleDirection,
+    Configuration::ControlAction::kCycleAngle,
+    Configuration::ControlAction::kCycleSpeed,
+    Configuration::ControlAction::kToggleMotion,
+    Configuration::ControlAction::kToggleTurbo,
+    Configuration::ControlAction::kToggleLogReport,
+    Configuration::ControlAction::kLogGeneralStatus,
+    Configuration::ControlAction::kReportFirmwareVersion,
+    Configuration::ControlAction::kToggleTelemetry,
+  };
+
+  // Lines of the report (see ReportNextLine()); empty histogram bins and control actions not processed are skipped.
+  inline static constexpr uint8_t kMaxLoopTimeLine_ = 0; ///< Report line of the longest loop time.
+  inline static constexpr uint8_t kHistogramHeadingLine_ = 1; ///< Report line of the loop time histogram heading.
+  inline static constexpr uint8_t kFirstBinLine_ = 2; ///< Report line of the first loop time histogram bin.
+  inline static constexpr uint8_t kSleepLine_ = kFirstBinLine_ + kSizeOfLoopHistogram_; ///< Report line of time asleep.
+  inline static constexpr uint8_t kLateStepsLine_ = kSleepLine_ + 1; ///< Report line of the late steps.
+  inline static constexpr uint8_t kMissedStepsLine_ = kLateStepsLine_ + 1; ///< Report line of the missed steps.
+  inline static constexpr uint8_t kActionHeadingLine_ = kMissedStepsLine_ + 1; ///< Report line of the action heading.
+  inline static constexpr uint8_t kFirstActionLine_ = kActionHeadingLine_ + 1; ///< Report line of the first action.
+  inline static constexpr uint8_t kEndLine_ = kFirstActionLine_ + kSizeOfTimedActions_; ///< End of the report.
+
+  bool loop_started_ = false; ///< Flag to keep track of whether the previous loop start time is valid.
+  uint32_t loop_start_time_us_ = 0; ///< Time (us) the previous loop started.
+  uint32_t max_loop_time_us_ = 0; ///< Longest loop time (us).
+  uint32_t loop_sleep_time_us_ = 0; ///< Time (us) asleep during the current loop.
+  uint32_t report_start_time_us_ = 0; ///< Time (us) the statistics were last reset.
+  uint32_t sleep_time_us_ = 0; ///< Total time (us) asleep since the statistics were last reset.
+  /// @brief Loop time histogram; bin n counts loop times below 2^n us (and at least 2^(n-1) us), the last bin counts
+  /// all longer loop times.
+  uint16_t loop_histogram_[kSizeOfLoopHistogram_] = {};
+  ControlActionTiming control_action_timings_[kSizeOfTimedActions_] = {}; ///< Timing of each control action.
+  uint8_t report_line_ = kMaxLoopTimeLine_; ///< The next line of the report.
+  uint16_t missed_steps_ = 0; ///< Missed steps taken from the step engine (with the late steps) for the report.
+};
+
+} // namespace mtspin
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_math.h
+/// @brief Motion unit conversions (degrees/RPM to microsteps), in floating-point and fixed-point (Q16.16) forms.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "index_sequence.h"
+
+namespace mtspin {
+
+/// @brief Signed fixed-point number with 16 integer and 16 fractional bits.
+using Q16 = int32_t;
+
+inline constexpr uint8_t kQ16FractionalBits = 16; ///< No. of fractional bits in a Q16.16 number.
+
+/// @brief Convert a number to Q16.16 (at compile time).
+/// @param value The number.
+/// @return The Q16.16 number.
+constexpr Q16 ToQ16(float value) {
+  return static_cast<Q16>(value * (1L << kQ16FractionalBits) + (value < 0.0F ? -0.5F : 0.5F));
+}
+
+/// @brief No. of microsteps per revolution of the system (i.e., after the gear ratio).
+inline constexpr float kMicrostepsPerRevolution = 360.0F / Configuration::kFullStepAngle_degrees_
+                                                  * Configuration::kMicrostepMode_ * Configuration::kGearRatio_;
+
+/// @brief Convert an angle to microsteps.
+/// @param angle_degrees The angle (degrees).
+/// @return The no. of microsteps (rounded to nearest).
+constexpr int32_t DegreesToMicrosteps(float angle_degrees) {
+  return static_cast<int32_t>(angle_degrees * kMicrostepsPerRevolution / 360.0F
+                              + (angle_degrees < 0.0F ? -0.5F : 0.5F));
+}
+
+/// @brief Convert a speed to microsteps per second.
+/// @param speed_RPM The speed (RPM).
+/// @return The speed (microsteps per second).
+constexpr float RpmToMicrostepsPerSecond(float speed_RPM) {
+  return speed_RPM / 60.0F * kMicrostepsPerRevolution;
+}
+
+/// @brief Convert an angle to microsteps, using integer maths only.
+/// The whole and fractional degrees are scaled separately, so the products fit in 64 bits for any Q16.16 angle.
+/// @param angle_degrees The angle (degrees, Q16.16).
+/// @return The no. of microsteps (rounded to nearest).
+inline int32_t DegreesQ16ToMicrosteps(Q16 angle_degrees) {
+  constexpr int64_t kMicrostepsPerDegree_q32 = static_cast<int64_t>(kMicrostepsPerRevolution / 360.0 * 4294967296.0
+                                                                    + 0.5);
+  int64_t whole_degrees = angle_degrees >> kQ16FractionalBits; // Rounded down, so the fraction is never negative.
+  int64_t fraction_q16 = angle_degrees & ((1L << kQ16FractionalBits) - 1);
+  int64_t microsteps_q32 = whole_degrees * kMicrostepsPerDegree_q32
+                           + ((fraction_q16 * kMicrostepsPerDegree_q32 + (1LL << 47)) >> kQ16FractionalBits);
+  return static_cast<int32_t>(microsteps_q32 >> 32);
+}
+
+/// @brief Convert a speed to microsteps per second, using integer maths only.
+/// @param speed_RPM The speed (RPM, Q16.16).
+/// @return The speed (microsteps per second, Q16.16).
+inline Q16 RpmQ16ToMicrostepsPerSecondQ16(Q16 speed_RPM) {
+  constexpr int64_t kMicrostepsPerSecondPerRpm_q16 = ToQ16(kMicrostepsPerRevolution / 60.0F);
+  return static_cast<Q16>((speed_RPM * kMicrostepsPerSecondPerRpm_q16 + (1LL << 15)) >> kQ16FractionalBits);
+}
+
+/// @brief Convert microsteps to an angle, using integer maths only.
+/// @param microsteps The no. of microsteps.
+/// @return The angle (hundredths of a degree, rounded to nearest).
+inline int32_t MicrostepsToCentidegrees(int32_t microsteps) {
+  constexpr int64_t kCentidegreesPerMicrostep_q16 = ToQ16(36000.0F / kMicrostepsPerRevolution);
+  return static_cast<int32_t>((microsteps * kCentidegreesPerMicrostep_q16 + (1LL << 15)) >> kQ16FractionalBits);
+}
+
+/// @brief Convert a speed in microsteps per second to RPM, using integer maths only.
+/// @param speed_microsteps_per_s The speed (microsteps per second).
+/// @return The speed (hundredths of an RPM, rounded to nearest).
+inline int32_t MicrostepsPerSecondToCentiRpm(int32_t speed_microsteps_per_s) {
+  constexpr int64_t kCentiRpmPerMicrostepPerSecond_q16 = ToQ16(6000.0F / kMicrostepsPerRevolution);
+  return static_cast<int32_t>((speed_microsteps_per_s * kCentiRpmPerMicrostepPerSecond_q16 + (1LL << 15))
+                              >> kQ16FractionalBits);
+}
+
+/// @brief Convert a Q16.16 number to hundredths, using integer maths only.
+/// @param value The number (Q16.16).
+/// @return The number (hundredths, rounded to nearest).
+inline int32_t Q16ToHundredths(Q16 value) {
+  return static_cast<int32_t>((value * 100LL + (1LL << 15)) >> kQ16FractionalBits);
+}
+
+/// @brief Speeds converted to hundredths of an RPM (for reporting without floating-point formatting).
+struct SpeedReportTable {
+  int16_t centi_RPM[2][Configuration::kSizeOfSpeeds_]; ///< Speeds (hundredths of an RPM), by speed row and index.
+};
+
+/// @brief Convert a speed of the speed lookup table to hundredths of an RPM (at compile time).
+/// @param row The speed row.
+/// @param index The speed index.
+/// @return The speed (hundredths of an RPM).
+constexpr int16_t SpeedToCentiRpm(uint8_t row, uint16_t index) {
+  return static_cast<int16_t>(Configuration::kSpeeds_RPM_[row][index] * 100.0F + 0.5F);
+}
+
+/// @brief Convert the speed lookup table to hundredths of an RPM (at compile time).
+/// @tparam kIndices The speed indices (0 to Configuration::kSizeOfSpeeds_ - 1).
+/// @return The speeds (hundredths of an RPM).
+template <uint16_t... kIndices>
+constexpr SpeedReportTable MakeSpeedReportTable(IndexSequence<kIndices...>) {
+  return {{{SpeedToCentiRpm(0, kIndices)...}, {SpeedToCentiRpm(1, kIndices)...}}};
+}
+
+/// @brief Speeds (hundredths of an RPM) for the speed lookup table (constant-folded).
+inline constexpr SpeedReportTable kSpeedReports
+    = MakeSpeedReportTable(MakeIndexSequence<Configuration::kSizeOfSpeeds_>());
+
+/// @brief Sweep angles converted to microsteps.
+struct SweepAngleTable {
+  int32_t microsteps[Configuration::kSizeOfSweepAngles_]; ///< Sweep angles (microsteps), by sweep angle index.
+};
+
+/// @brief Convert the sweep angle lookup table to microsteps (at compile time).
+/// @tparam kIndices The sweep angle indices (0 to Configuration::kSizeOfSweepAngles_ - 1).
+/// @return The sweep angles (microsteps).
+template <uint16_t... kIndices>
+constexpr SweepAngleTable MakeSweepAngleTable(IndexSequence<kIndices...>) {
+  return {{DegreesToMicrosteps(Configuration::kSweepAngles_degrees_[kIndices])...}};
+}
+
+/// @brief Sweep angles (microsteps) for the sweep angle lookup table (constant-folded).
+inline constexpr SweepAngleTable kSweepAngles
+    = MakeSweepAngleTable(MakeIndexSequence<Configuration::kSizeOfSweepAngles_>());
+
+} // namespace mtspin
@@ -0,0 +1,83 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file ramp_table.cpp
+/// @brief Compile-time generation of the acceleration ramp (step interval) lookup table and speed profiles.
+
+#include "ramp_table.h"
+
+#include "configuration.h"
+#include "hal.h"
+#include "index_sequence.h"
+#include "motion_math.h"
+#include "step_axis.h"
+
+namespace mtspin {
+
+// Defined constexpr so the table is guaranteed to be generated at compile time (never initialised at runtime).
+constexpr RampTable<kRampTableSize> kRampTable PROGMEM = MakeRampTable(MakeIndexSequence<kRampTableSize>());
+
+constexpr RampDirectory kRampDirectory PROGMEM = kRamps;
+
+#if MTSPIN_MICROSTEP_SWITCHING
+constexpr MicrostepBandTable kMicrostepBandTable PROGMEM
+    = MakeMicrostepBandTable(MakeIndexSequence<Configuration::kSizeOfMicrostepBands_>());
+#endif
+
+namespace {
+
+/// @brief Prepare the speed profile for a step interval, along its S-curve ramp (looked up in the ramp table).
+/// @param interval_us The step interval (us).
+/// @return The speed profile.
+StepAxis::SpeedProfile MakeSCurveSpeedProfile(uint16_t interval_us) {
+  // Select the ramp to the slowest top speed at or above the speed (see SelectRamp()).
+  uint8_t ramp = 0;
+  while (ramp + 1 < kSizeOfRamps && hal::ReadFlashWord(&kRampDirectory.top_intervals_us[ramp]) > interval_us) ramp++;
+
+  StepAxis::Ramp extent = hal::ReadFlashObject(&kRampDirectory.ramps[ramp]);
+  uint16_t ramp_steps = StepAxis::FindRampStep(&kRampTable.intervals_us[extent.offset], extent.size - 1,
+                                               interval_us);
+  return {ramp_steps, interval_us, ramp};
+}
+
+} // namespace
+
+StepAxis::SpeedProfile MakeSpeedProfileAtRuntime(float speed_microsteps_per_s) {
+  if (Configuration::kAccelerationProfile_ != Configuration::AccelerationProfile::kSCurve) {
+    return MakeSpeedProfile(speed_microsteps_per_s);
+  }
+
+  StepAxis::SpeedProfile speed = {0, static_cast<uint16_t>(hal::kMaxStepTimerInterval_us), 0};
+  if (speed_microsteps_per_s <= 0.0F) return speed;
+
+  return MakeSCurveSpeedProfile(StepInterval_us(speed_microsteps_per_s));
+}
+
+StepAxis::SpeedProfile MakeSpeedProfileQ16(Q16 speed_microsteps_per_s) {
+  StepAxis::SpeedProfile speed = {0, static_cast<uint16_t>(hal::kMaxStepTimerInterval_us), 0};
+  if (speed_microsteps_per_s <= 0) return speed;
+
+  // Interval = 1 / v.
+  uint64_t interval_us = ((1000000ULL << kQ16FractionalBits) + (speed_microsteps_per_s >> 1))
+                         / static_cast<uint32_t>(speed_microsteps_per_s);
+  if (interval_us < hal::kMinStepTimerInterval_us) interval_us = hal::kMinStepTimerInterval_us;
+  if (interval_us > hal::kMaxStepTimerInterval_us) interval_us = hal::kMaxStepTimerInterval_us;
+  speed.interval_us = static_cast<uint16_t>(interval_us);
+
+  if (Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve) {
+    return MakeSCurveSpeedProfile(speed.interval_us);
+  }
+
+  // Ramp steps = v^2 / 2a.
+  constexpr uint32_t kDoubleAcceleration = static_cast<uint32_t>(2.0F
+                                           * Configuration::kAcceleration_microsteps_per_s_per_s_);
+  uint64_t speed_squared = (static_cast<uint64_t>(speed_microsteps_per_s) * speed_microsteps_per_s)
+                           >> (2 * kQ16FractionalBits);
+  uint64_t ramp_steps = speed_squared / kDoubleAcceleration;
+  speed.ramp_steps = ramp_steps >= kRampTableSize ? kRampTableSize - 1 : static_cast<uint16_t>(ramp_steps);
+  return speed;
+}
+
+} // namespace mtspin
@@ -0,0 +1,522 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file ramp_table.h
+/// @brief Compile-time generation of the acceleration ramp (step interval) lookup table and speed profiles.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "hal.h"
+#include "index_sequence.h"
+#include "motion_math.h"
+#include "step_axis.h"
+
+namespace mtspin {
+
+/// @brief Acceleration ramp lookup table; entry n is the step interval (us) after n microsteps of acceleration.
+/// @tparam kSize The no. of entries.
+template <uint16_t kSize>
+struct RampTable {
+  static_assert(kSize > 0, "RampTable must have at least one entry.");
+  uint16_t intervals_us[kSize]; ///< Step intervals (us).
+};
+
+/// @brief Iterate towards a square root (Newton-Raphson, converging from above).
+/// @param value The value (positive).
+/// @param root The estimate of the root (at or above it).
+/// @param iterations The most iterations left.
+/// @return The square root.
+constexpr double SqrtIteration(double value, double root, uint8_t iterations) {
+  return iterations == 0 || 0.5 * (root + value / root) >= root
+         ? root
+         : SqrtIteration(value, 0.5 * (root + value / root), iterations - 1);
+}
+
+/// @brief Square root for constant expressions (Newton-Raphson iteration).
+/// @param value The value (non-negative).
+/// @return The square root.
+constexpr double ConstexprSqrt(double value) {
+  return value <= 0.0 ? 0.0 : SqrtIteration(value, value > 1.0 ? value : 1.0, 100);
+}
+
+/// @brief Iterate towards a cube root (Newton-Raphson, converging from above).
+/// @param value The value (positive).
+/// @param root The estimate of the root (at or above it).
+/// @param iterations The most iterations left.
+/// @return The cube root.
+constexpr double CbrtIteration(double value, double root, uint8_t iterations) {
+  return iterations == 0 || (2.0 * root + value / (root * root)) / 3.0 >= root
+         ? root
+         : CbrtIteration(value, (2.0 * root + value / (root * root)) / 3.0, iterations - 1);
+}
+
+/// @brief Cube root for constant expressions (Newton-Raphson iteration).
+/// @param value The value (non-negative).
+/// @return The cube root.
+constexpr double ConstexprCbrt(double value) {
+  return value <= 0.0 ? 0.0 : CbrtIteration(value, value > 1.0 ? value : 1.0, 200);
+}
+
+/// @brief Get the no. of microsteps needed to accelerate from rest to a speed.
+/// @param speed_microsteps_per_s The speed (microsteps per second).
+/// @param acceleration_microsteps_per_s_per_s The acceleration (microsteps per second-squared).
+/// @return The no. of microsteps.
+constexpr uint16_t RampSteps(float speed_microsteps_per_s, float acceleration_microsteps_per_s_per_s) {
+  return static_cast<uint16_t>(speed_microsteps_per_s * speed_microsteps_per_s
+                               / (2.0F * acceleration_microsteps_per_s_per_s));
+}
+
+/// @brief Round a step interval for the ramp lookup table (longer intervals are clamped to the step timer range).
+/// @param interval_us The step interval (us).
+/// @return The step interval (us).
+constexpr uint16_t RoundRampInterval_us(double interval_us) {
+  return static_cast<uint16_t>((interval_us > hal::kMaxStepTimerInterval_us ? hal::kMaxStepTimerInterval_us
+                                                                             : interval_us) + 0.5);
+}
+
+/// @brief Get the step interval along the constant acceleration ramp: the interval before microstep n+1 is the exact
+/// travel time sqrt(2/a) * (sqrt(n+1) - sqrt(n)).
+/// @param acceleration_microsteps_per_s_per_s The acceleration (microsteps per second-squared).
+/// @param step The no. of microsteps (n) taken.
+/// @return The step interval (us).
+constexpr double TrapezoidalRampInterval_us(float acceleration_microsteps_per_s_per_s, uint16_t step) {
+  return ConstexprSqrt(2.0 / acceleration_microsteps_per_s_per_s) * 1000000.0
+         * (ConstexprSqrt(step + 1.0) - ConstexprSqrt(step));
+}
+
+/// @brief Jerk-limited (S-curve) acceleration ramp, from rest to a top speed, at the configured S-curve peak
+/// acceleration and jerk.
+/// The acceleration rises at the jerk limit from zero to the peak acceleration, and falls at the jerk limit to zero
+/// on reaching the top speed, i.e., a(v) = min(peak acceleration, sqrt(2 * jerk * v), sqrt(2 * jerk * (top - v))).
+/// The ramp depends on the velocity only, so (like the trapezoidal ramp) decelerating retraces it in reverse. The
+/// motion has a closed form in each phase (rising, constant and falling acceleration), so the time each microstep is
+/// reached is found directly, rather than by stepping through the ramp.
+class SCurveRamp {
+ public:
+
+  /// @brief Construct an S-Curve Ramp object.
+  /// @param top_speed_microsteps_per_s The top speed (microsteps per second).
+  constexpr explicit SCurveRamp(double top_speed_microsteps_per_s)
+      : top_speed_(top_speed_microsteps_per_s),
+        jerk_time_s_(kAcceleration_ / kJerk_ < ConstexprSqrt(top_speed_microsteps_per_s / kJerk_)
+                     ? kAcceleration_ / kJerk_
+                     : ConstexprSqrt(top_speed_microsteps_per_s / kJerk_)) {}
+
+  /// @brief Get the no. of microsteps needed to reach the top speed.
+  /// @return The no. of microsteps (rounded up).
+  constexpr uint16_t Steps() const {
+    return static_cast<uint16_t>(Distance()) + (Distance() > static_cast<uint16_t>(Distance()) ? 1 : 0);
+  }
+
+  /// @brief Get the step interval along the ramp (at the top speed, past the end of the ramp).
+  /// @param step The no. of microsteps taken.
+  /// @return The interval (us) before the next microstep.
+  constexpr double Interval_us(uint16_t step) const { return (Time_s(step + 1.0) - Time_s(step)) * 1000000.0; }
+
+ private:
+
+  /// @brief Get the peak acceleration, reached at the end of the rising jerk phase.
+  /// @return The acceleration (microsteps per second-squared).
+  constexpr double PeakAcceleration() const { return kJerk_ * jerk_time_s_; }
+
+  /// @brief Get the speed at the end of the rising jerk phase.
+  /// @return The speed (microsteps per second).
+  constexpr double JerkPhaseSpeed() const { return PeakAcceleration() * jerk_time_s_ / 2.0; }
+
+  /// @brief Get the distance travelled in the rising jerk phase (jerk * t^3 / 6).
+  /// @return The distance (microsteps).
+  constexpr double JerkPhaseDistance() const { return JerkPhaseSpeed() * jerk_time_s_ / 3.0; }
+
+  /// @brief Get the duration of the constant acceleration phase (zero if the peak acceleration is never reached).
+  /// @return The duration (s).
+  constexpr double ConstantPhaseTime_s() const {
+    return top_speed_ > 2.0 * JerkPhaseSpeed() ? (top_speed_ - 2.0 * JerkPhaseSpeed()) / PeakAcceleration() : 0.0;
+  }
+
+  /// @brief Get the distance travelled by the end of the constant acceleration phase.
+  /// @return The distance (microsteps).
+  constexpr double ConstantPhaseEndDistance() const {
+    return JerkPhaseDistance()
+           + (JerkPhaseSpeed() + PeakAcceleration() * ConstantPhaseTime_s() / 2.0) * ConstantPhaseTime_s();
+  }
+
+  /// @brief Get the distance travelled to reach the top speed (the falling jerk phase mirrors the rising one).
+  /// @return The distance (microsteps).
+  constexpr double Distance() const {
+    return ConstantPhaseEndDistance() + top_speed_ * jerk_time_s_ - JerkPhaseDistance();
+  }
+
+  /// @brief Get the time taken to reach the top speed.
+  /// @return The time (s).
+  constexpr double Duration_s() const { return 2.0 * jerk_time_s_ + ConstantPhaseTime_s(); }
+
+  /// @brief Get the time from rest at which a distance is reached.
+  /// @param distance The distance (microsteps).
+  /// @return The time (s).
+  constexpr double Time_s(double distance) const {
+    return distance <= JerkPhaseDistance()
+           ? ConstexprCbrt(6.0 * distance / kJerk_)
+           : distance <= ConstantPhaseEndDistance()
+           ? jerk_time_s_ + (ConstexprSqrt(JerkPhaseSpeed() * JerkPhaseSpeed()
+                                           + 2.0 * PeakAcceleration() * (distance - JerkPhaseDistance()))
+                             - JerkPhaseSpeed()) / PeakAcceleration()
+           : distance < Distance()
+           ? Duration_s() - FallingPhaseTime_s(Distance() - distance, (Distance() - distance) / top_speed_, 100)
+           : Duration_s() + (distance - Distance()) / top_speed_;
+  }
+
+  /// @brief Iterate towards the time before the end of the ramp at which a distance remains, in the falling jerk phase,
+  /// i.e., the root r of top * r - jerk * r^3 / 6 = remaining (Newton-Raphson, converging from below).
+  /// @param remaining_distance The distance (microsteps) remaining.
+  /// @param time_s The estimate of the time (s; at or below it).
+  /// @param iterations The most iterations left.
+  /// @return The time (s).
+  constexpr double FallingPhaseTime_s(double remaining_distance, double time_s, uint8_t iterations) const {
+    return iterations == 0 || NextFallingPhaseTime_s(remaining_distance, time_s) <= time_s
+           ? time_s
+           : FallingPhaseTime_s(remaining_distance, NextFallingPhaseTime_s(remaining_distance, time_s), iterations - 1);
+  }
+
+  /// @brief Get the next estimate of the time before the end of the ramp (see FallingPhaseTime_s()).
+  /// @param remaining_distance The distance (microsteps) remaining.
+  /// @param time_s The estimate of the time (s).
+  /// @return The next estimate of the time (s).
+  constexpr double NextFallingPhaseTime_s(double remaining_distance, double time_s) const {
+    return time_s + (remaining_distance - top_speed_ * time_s + kJerk_ * time_s * time_s * time_s / 6.0)
+                    / (top_speed_ - kJerk_ * time_s * time_s / 2.0);
+  }
+
+  /// The peak acceleration (microsteps per second-squared).
+  inline static constexpr double kAcceleration_ = Configuration::kSCurveAcceleration_microsteps_per_s_per_s_;
+  /// The jerk (microsteps per second-cubed).
+  inline static constexpr double kJerk_ = Configuration::kSCurveJerk_microsteps_per_s_per_s_per_s_;
+
+  double top_speed_; ///< The top speed (microsteps per second).
+  double jerk_time_s_; ///< Duration (s) of the rising (and of the falling) jerk phase.
+};
+
+/// @brief Largest no. of entries in an S-curve acceleration ramp lookup table.
+inline constexpr uint16_t kMaxSCurveRampSteps = 4096;
+
+/// @brief Get a speed of the speed lookup table, by entry (row by row).
+/// @param entry The entry (row * Configuration::kSizeOfSpeeds_ + index).
+/// @return The speed (RPM).
+constexpr float TableSpeedRpm(uint8_t entry) {
+  return Configuration::kSpeeds_RPM_[entry / Configuration::kSizeOfSpeeds_][entry % Configuration::kSizeOfSpeeds_];
+}
+
+/// @brief Get the fastest speed in the speed lookup table, from an entry on.
+/// @param entry The first entry to check (see TableSpeedRpm()).
+/// @param max_speed_RPM The fastest speed (RPM) of the entries before it.
+/// @return The speed (RPM).
+constexpr float MaxSpeedRpmFrom(uint8_t entry, float max_speed_RPM) {
+  return entry == 2 * Configuration::kSizeOfSpeeds_
+         ? max_speed_RPM
+         : MaxSpeedRpmFrom(entry + 1, TableSpeedRpm(entry) > max_speed_RPM ? TableSpeedRpm(entry) : max_speed_RPM);
+}
+
+/// @brief Get the fastest speed in the speed lookup table.
+/// @return The speed (RPM).
+constexpr float MaxSpeedRpm() {
+  return MaxSpeedRpmFrom(0, 0.0F);
+}
+
+/// @brief Fastest speed (microsteps per second) the acceleration ramp lookup table reaches.
+inline constexpr float kRampTopSpeed_microsteps_per_s = RpmToMicrostepsPerSecond(MaxSpeedRpm());
+
+/// @brief Fastest explicit speed (RPM, Q16.16) that can be set; the acceleration ramp lookup table reaches no faster,
+/// so a faster speed could only be reached with a jump in speed (which a real motor would not follow).
+inline constexpr Q16 kMaxExplicitSpeed_RPM = ToQ16(MaxSpeedRpm());
+
+/// @brief No. of acceleration ramps in the ramp lookup table. The trapezoidal ramp is shared by all speeds; with the
+/// S-curve profile, each speed of the speed lookup table has a ramp of its own, so the acceleration tapers to zero on
+/// reaching that speed (rather than being cut off part way up the ramp to a faster speed).
+inline constexpr uint8_t kSizeOfRamps
+    = Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve
+    ? 2 * Configuration::kSizeOfSpeeds_
+    : 1;
+
+/// @brief Clamp a step interval to the step timer range, and round it.
+/// @param interval_us The step interval (us).
+/// @return The step interval (us).
+constexpr uint16_t ClampStepInterval_us(float interval_us) {
+  return interval_us < hal::kMinStepTimerInterval_us
+         ? static_cast<uint16_t>(hal::kMinStepTimerInterval_us)
+         : interval_us > hal::kMaxStepTimerInterval_us ? static_cast<uint16_t>(hal::kMaxStepTimerInterval_us)
+                                                       : static_cast<uint16_t>(interval_us + 0.5F);
+}
+
+/// @brief Get the step interval at a speed (clamped to the step timer range).
+/// @param speed_microsteps_per_s The speed (microsteps per second; positive).
+/// @return The step interval (us).
+constexpr uint16_t StepInterval_us(float speed_microsteps_per_s) {
+  return ClampStepInterval_us(1000000.0F / speed_microsteps_per_s);
+}
+
+/// @brief Count the entries of the speed lookup table ranked before an entry, in order of speed (equal speeds in table
+/// order), from an entry on.
+/// @param entry The entry ranked (see TableSpeedRpm()).
+/// @param other The first entry to compare it with.
+/// @return The no. of entries (from other on) ranked before it.
+constexpr uint8_t CountSlowerSpeeds(uint8_t entry, uint8_t other) {
+  return other == 2 * Configuration::kSizeOfSpeeds_
+         ? 0
+         : (TableSpeedRpm(other) < TableSpeedRpm(entry)
+            || (TableSpeedRpm(other) == TableSpeedRpm(entry) && other < entry) ? 1 : 0)
+           + CountSlowerSpeeds(entry, other + 1);
+}
+
+/// @brief Find the entry of the speed lookup table with a rank in order of speed (see CountSlowerSpeeds()), from an
+/// entry on.
+/// @param rank The rank.
+/// @param entry The first entry to check.
+/// @return The entry.
+constexpr uint8_t FindSpeedOfRank(uint8_t rank, uint8_t entry) {
+  return CountSlowerSpeeds(entry, 0) == rank ? entry : FindSpeedOfRank(rank, entry + 1);
+}
+
+/// @brief Get the top speed of an acceleration ramp; ramps are ordered from the slowest top speed to the fastest.
+/// @param ramp The ramp index.
+/// @return The top speed (microsteps per second).
+constexpr float RampTopSpeed(uint8_t ramp) {
+  return kSizeOfRamps == 1 ? kRampTopSpeed_microsteps_per_s
+                           : RpmToMicrostepsPerSecond(TableSpeedRpm(FindSpeedOfRank(ramp, 0)));
+}
+
+/// @brief Get the no. of entries of an acceleration ramp (enough to reach its top speed).
+/// @param ramp The ramp index.
+/// @return The no. of entries.
+constexpr uint16_t RampSize(uint8_t ramp) {
+  return Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve
+         ? SCurveRamp(RampTopSpeed(ramp)).Steps() + 1
+         : RampSteps(RampTopSpeed(ramp), Configuration::kAcceleration_microsteps_per_s_per_s_) + 1;
+}
+
+/// @brief Get the index of the first entry of an acceleration ramp in the ramp lookup table (ramps are back to back).
+/// @param ramp The ramp index.
+/// @return The index.
+constexpr uint16_t RampOffset(uint8_t ramp) {
+  return ramp == 0 ? 0 : RampOffset(ramp - 1) + RampSize(ramp - 1);
+}
+
+/// @brief Acceleration ramps of the ramp lookup table.
+struct RampDirectory {
+  StepAxis::Ramp ramps[kSizeOfRamps]; ///< Ramps, from the slowest top speed to the fastest, back to back.
+  uint16_t top_intervals_us[kSizeOfRamps]; ///< Step interval (us) at the top speed of each ramp.
+};
+
+/// @brief Lay out the acceleration ramps of the ramp lookup table.
+/// @tparam kIndices The ramp indices (0 to kSizeOfRamps - 1).
+/// @return The ramps.
+template <uint16_t... kIndices>
+constexpr RampDirectory MakeRampDirectory(IndexSequence<kIndices...>) {
+  return {{{RampOffset(kIndices), RampSize(kIndices)}...}, {StepInterval_us(RampTopSpeed(kIndices))...}};
+}
+
+/// @brief Acceleration ramps of the ramp lookup table (constant-folded).
+inline constexpr RampDirectory kRamps = MakeRampDirectory(MakeIndexSequence<kSizeOfRamps>());
+
+/// @brief Acceleration ramps of the ramp lookup table (in flash).
+extern const RampDirectory kRampDirectory PROGMEM;
+
+static_assert(kRamps.ramps[kSizeOfRamps - 1].size <= kMaxSCurveRampSteps,
+              "The S-curve acceleration ramp is too long; increase the S-curve acceleration or jerk.");
+
+/// @brief No. of entries in the acceleration ramp lookup table (enough for every ramp to reach its top speed).
+inline constexpr uint16_t kRampTableSize = kRamps.ramps[kSizeOfRamps - 1].offset + kRamps.ramps[kSizeOfRamps - 1].size;
+
+/// @brief Get the step interval along an acceleration ramp, as in the ramp lookup table. With the S-curve profile,
+/// each ramp (see kRamps) rises from rest and tapers to zero acceleration at its top speed (holding the top speed past
+/// it, when the size rounds up).
+/// @param ramp The ramp index.
+/// @param step The no. of microsteps taken along the ramp.
+/// @return The step interval (us).
+constexpr uint16_t RampInterval_us(uint8_t ramp, uint16_t step) {
+  return RoundRampInterval_us(Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve
+                              ? SCurveRamp(RampTopSpeed(ramp)).Interval_us(step)
+                              : TrapezoidalRampInterval_us(Configuration::kAcceleration_microsteps_per_s_per_s_, step));
+}
+
+/// @brief Find the acceleration ramp an entry of the ramp lookup table belongs to, from a ramp on.
+/// @param entry The index of the entry.
+/// @param ramp The first ramp to check.
+/// @return The ramp index.
+constexpr uint8_t FindRamp(uint16_t entry, uint8_t ramp) {
+  return ramp + 1 == kSizeOfRamps || entry < kRamps.ramps[ramp].offset + kRamps.ramps[ramp].size
+         ? ramp
+         : FindRamp(entry, ramp + 1);
+}
+
+/// @brief Get an entry of the acceleration ramp lookup table for the configured acceleration profile.
+/// @param entry The index of the entry.
+/// @return The step interval (us).
+constexpr uint16_t RampTableInterval_us(uint16_t entry) {
+  return RampInterval_us(FindRamp(entry, 0), entry - kRamps.ramps[FindRamp(entry, 0)].offset);
+}
+
+/// @brief Generate the acceleration ramp lookup table for the configured acceleration profile.
+/// @tparam kIndices The entry indices (0 to kRampTableSize - 1).
+/// @return The lookup table.
+template <uint16_t... kIndices>
+constexpr RampTable<sizeof...(kIndices)> MakeRampTable(IndexSequence<kIndices...>) {
+  return {{RampTableInterval_us(kIndices)...}};
+}
+
+/// @brief Select the acceleration ramp for a speed: the ramp to the slowest top speed at or above it.
+/// @param interval_us The step interval (us) at the speed.
+/// @param ramp The first ramp to check.
+/// @return The ramp index.
+constexpr uint8_t SelectRampFrom(uint16_t interval_us, uint8_t ramp) {
+  return ramp + 1 >= kSizeOfRamps || kRamps.top_intervals_us[ramp] <= interval_us
+         ? ramp
+         : SelectRampFrom(interval_us, ramp + 1);
+}
+
+/// @brief Select the acceleration ramp for a speed: the ramp to the slowest top speed at or above it.
+/// @param interval_us The step interval (us) at the speed.
+/// @return The ramp index.
+constexpr uint8_t SelectRamp(uint16_t interval_us) {
+  return SelectRampFrom(interval_us, 0);
+}
+
+/// @brief Find the no. of microsteps along an acceleration ramp to a speed, as StepAxis::FindRampStep() does at
+/// runtime: the first entry (from low, before high) at or faster than the speed (binary search).
+/// @param ramp The ramp index.
+/// @param low The first entry to search.
+/// @param high The entry after the last to search.
+/// @param interval_us The step interval (us) at the speed.
+/// @return The index of the entry (within the ramp), or high if none.
+constexpr uint16_t FindRampStep(uint8_t ramp, uint16_t low, uint16_t high, uint16_t interval_us) {
+  return low >= high
+         ? low
+         : RampInterval_us(ramp, low + (high - low) / 2) > interval_us
+         ? FindRampStep(ramp, low + (high - low) / 2 + 1, high, interval_us)
+         : FindRampStep(ramp, low, low + (high - low) / 2, interval_us);
+}
+
+/// @brief Limit a no. of microsteps to an acceleration ramp.
+/// @param ramp_steps The no. of microsteps.
+/// @param ramp_size The no. of entries of the ramp.
+/// @return The no. of microsteps, at most the last entry of the ramp.
+constexpr uint16_t LimitRampSteps(float ramp_steps, uint16_t ramp_size) {
+  return ramp_steps >= ramp_size ? ramp_size - 1 : static_cast<uint16_t>(ramp_steps);
+}
+
+/// @brief Prepare the speed profile for a speed, along its acceleration ramp.
+/// @param speed_microsteps_per_s The speed (microsteps per second).
+/// @param interval_us The step interval (us) at the speed.
+/// @param ramp The ramp index (see SelectRamp()).
+/// @return The speed profile.
+constexpr StepAxis::SpeedProfile MakeSpeedProfileOnRamp(float speed_microsteps_per_s, uint16_t interval_us,
+                                                        uint8_t ramp) {
+  return {Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve
+              ? FindRampStep(ramp, 0, kRamps.ramps[ramp].size - 1, interval_us)
+              : LimitRampSteps(speed_microsteps_per_s * speed_microsteps_per_s
+                               / (2.0F * Configuration::kAcceleration_microsteps_per_s_per_s_),
+                               kRamps.ramps[ramp].size),
+          interval_us, ramp};
+}
+
+/// @brief Acceleration ramp lookup table (in flash).
+extern const RampTable<kRampTableSize> kRampTable PROGMEM;
+
+/// @brief Prepare the speed profile for a speed.
+/// With the S-curve profile, the ramp is regenerated to find the no. of ramp steps, so this is for constant
+/// expressions only; use MakeSpeedProfileAtRuntime() otherwise.
+/// @param speed_microsteps_per_s The speed (microsteps per second).
+/// @return The speed profile.
+constexpr StepAxis::SpeedProfile MakeSpeedProfile(float speed_microsteps_per_s) {
+  return speed_microsteps_per_s <= 0.0F
+         ? StepAxis::SpeedProfile{0, static_cast<uint16_t>(hal::kMaxStepTimerInterval_us), 0}
+         : MakeSpeedProfileOnRamp(speed_microsteps_per_s, StepInterval_us(speed_microsteps_per_s),
+                                  SelectRamp(StepInterval_us(speed_microsteps_per_s)));
+}
+
+/// @brief Prepare the speed profile for a speed (at runtime; the S-curve ramp steps are looked up in the table).
+/// @param speed_microsteps_per_s The speed (microsteps per second).
+/// @return The speed profile.
+StepAxis::SpeedProfile MakeSpeedProfileAtRuntime(float speed_microsteps_per_s);
+
+/// @brief Prepare the speed profile for a speed, using integer maths only.
+/// @param speed_microsteps_per_s The speed (microsteps per second, Q16.16).
+/// @return The speed profile.
+StepAxis::SpeedProfile MakeSpeedProfileQ16(Q16 speed_microsteps_per_s);
+
+/// @brief Speed profiles for the speed lookup table.
+struct SpeedProfileTable {
+  StepAxis::SpeedProfile profiles[2][Configuration::kSizeOfSpeeds_]; ///< Speed profiles, by speed row and index.
+};
+
+/// @brief Generate the speed profiles for the speed lookup table.
+/// @tparam kIndices The speed indices (0 to Configuration::kSizeOfSpeeds_ - 1).
+/// @return The speed profiles.
+template <uint16_t... kIndices>
+constexpr SpeedProfileTable MakeSpeedProfileTable(IndexSequence<kIndices...>) {
+  return {{{MakeSpeedProfile(RpmToMicrostepsPerSecond(Configuration::kSpeeds_RPM_[0][kIndices]))...},
+           {MakeSpeedProfile(RpmToMicrostepsPerSecond(Configuration::kSpeeds_RPM_[1][kIndices]))...}}};
+}
+
+/// @brief Speed profiles for the speed lookup table (constant-folded).
+inline constexpr SpeedProfileTable kSpeedProfiles
+    = MakeSpeedProfileTable(MakeIndexSequence<Configuration::kSizeOfSpeeds_>());
+
+#if MTSPIN_MICROSTEP_SWITCHING
+/// @brief Microstep band lookup table (see StepAxis::MicrostepBand).
+struct MicrostepBandTable {
+  StepAxis::MicrostepBand bands[Configuration::kSizeOfMicrostepBands_]; ///< Microstep bands, finest first.
+};
+
+/// @brief Check the configuration of the microstep bands from a band on: each band is a power of 2 (up to 128) coarser
+/// than the one before, and is used from a higher speed.
+/// @param band The first band to check (from 1).
+/// @return True if valid.
+constexpr bool AreMicrostepBandsValid(uint8_t band) {
+  return band == Configuration::kSizeOfMicrostepBands_
+         || (Configuration::kMicrostepBandModes_[band] != 0
+             && Configuration::kMicrostepBandModes_[band] < Configuration::kMicrostepBandModes_[band - 1]
+             && Configuration::kMicrostepMode_ % Configuration::kMicrostepBandModes_[band] == 0
+             && ((Configuration::kMicrostepMode_ / Configuration::kMicrostepBandModes_[band])
+                 & (Configuration::kMicrostepMode_ / Configuration::kMicrostepBandModes_[band] - 1)) == 0
+             && Configuration::kMicrostepMode_ / Configuration::kMicrostepBandModes_[band] <= 128
+             && Configuration::kMicrostepBandSpeeds_RPM_[band] > Configuration::kMicrostepBandSpeeds_RPM_[band - 1]
+             && AreMicrostepBandsValid(band + 1));
+}
+
+/// @brief Check the microstep band configuration: each band is a power of 2 coarser than the one before, from
+/// Configuration::kMicrostepMode_, and is used from a higher speed.
+/// @return True if valid.
+constexpr bool IsMicrostepBandConfigurationValid() {
+  return Configuration::kMicrostepBandModes_[0] == Configuration::kMicrostepMode_ && AreMicrostepBandsValid(1);
+}
+
+static_assert(IsMicrostepBandConfigurationValid(),
+              "Microstep bands must start at kMicrostepMode_, with coarser (by powers of 2) modes at higher speeds.");
+
+/// @brief Make a microstep band; the band speed is converted to a microstep interval.
+/// @param band The band index.
+/// @return The microstep band.
+constexpr StepAxis::MicrostepBand MakeMicrostepBand(uint8_t band) {
+  return {static_cast<uint8_t>(Configuration::kMicrostepMode_ / Configuration::kMicrostepBandModes_[band]),
+          band == 0 ? static_cast<uint16_t>(hal::kMaxStepTimerInterval_us)
+                    : static_cast<uint16_t>(1000000.0F / RpmToMicrostepsPerSecond(
+                          Configuration::kMicrostepBandSpeeds_RPM_[band]) + 0.5F)};
+}
+
+/// @brief Generate the microstep band lookup table.
+/// @tparam kIndices The band indices (0 to Configuration::kSizeOfMicrostepBands_ - 1).
+/// @return The lookup table.
+template <uint16_t... kIndices>
+constexpr MicrostepBandTable MakeMicrostepBandTable(IndexSequence<kIndices...>) {
+  return {{MakeMicrostepBand(kIndices)...}};
+}
+
+/// @brief Microstep band lookup table (in flash).
+extern const MicrostepBandTable kMicrostepBandTable PROGMEM;
+#endif
+
+} // namespace mtspin
@@ -0,0 +1,133 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file scheduler.h
+/// @brief Class template for a cooperative scheduler of periodic tasks, with per task timing statistics.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+/// @brief The Scheduler class template.
+/// Tasks run to completion, one per call of RunNext() from the main loop. Each task is released once per period, and
+/// is due to complete by its next release (its deadline); of the tasks released, the one with the earliest deadline
+/// runs first (ties go to the task listed first). A task that falls a whole period behind skips the releases it missed,
+/// rather than running back to back to catch up. Each task also has a budget, the longest it should take per run. Per
+/// task, the scheduler counts runs, overruns (runs over budget) and late runs (started after the deadline), and records
+/// the longest run (the worst-case execution time), so a task that holds up the others shows up directly.
+/// @tparam Owner The class the tasks are member functions of.
+/// @tparam kSizeOfTasks The no. of tasks.
+template <typename Owner, uint8_t kSizeOfTasks>
+class Scheduler {
+ public:
+
+  /// @brief Properties of a task (an entry of the task table, in flash).
+  struct Task {
+    const char* name; ///< The task name (in flash), for reporting.
+    void (Owner::*run)(); ///< The member function that runs the task.
+    uint16_t period_us; ///< Time (us) between releases (and from a release to the deadline).
+    uint16_t budget_us; ///< Longest time (us) a run should take.
+  };
+
+  /// @brief Construct a Scheduler object.
+  /// @param tasks The task table (in flash).
+  explicit Scheduler(const Task (&tasks)[kSizeOfTasks]) : tasks_(tasks) {}
+
+  /// @brief Release all tasks now.
+  void Begin() {
+    uint32_t time_us = hal::Micros();
+    for (uint32_t& release_time_us : release_times_us_) release_time_us = time_us;
+  }
+
+  /// @brief Run the released task with the earliest deadline, if any.
+  /// @param owner The object to run the task on.
+  /// @return True if a task ran, false if none is released (i.e., the loop is idle).
+  bool RunNext(Owner& owner) {
+    uint32_t start_time_us = hal::Micros();
+    uint8_t next_task = kSizeOfTasks;
+    int32_t next_time_to_deadline_us = 0;
+    for (uint8_t task = 0; task < kSizeOfTasks; task++) {
+      int32_t time_since_release_us = static_cast<int32_t>(start_time_us - release_times_us_[task]);
+      if (time_since_release_us < 0) continue;
+      int32_t time_to_deadline_us = static_cast<int32_t>(hal::ReadFlashWord(&tasks_[task].period_us))
+                                    - time_since_release_us;
+      if (next_task == kSizeOfTasks || time_to_deadline_us < next_time_to_deadline_us) {
+        next_task = task;
+        next_time_to_deadline_us = time_to_deadline_us;
+      }
+    }
+
+    if (next_task == kSizeOfTasks) return false;
+
+    Task task = hal::ReadFlashObject(&tasks_[next_task]);
+    (owner.*task.run)();
+    uint32_t run_time_us = hal::Micros() - start_time_us;
+
+    // Release once per period from the previous release (not from now), so the rate does not drift with the run time.
+    uint32_t& release_time_us = release_times_us_[next_task];
+    release_time_us += task.period_us;
+    if (static_cast<int32_t>(start_time_us - release_time_us) >= 0) release_time_us = start_time_us + task.period_us;
+
+    TaskStatistics& statistics = statistics_[next_task];
+    if (statistics.run_count != UINT32_MAX) statistics.run_count++;
+    if (run_time_us > task.budget_us && statistics.overrun_count != UINT16_MAX) statistics.overrun_count++;
+    if (next_time_to_deadline_us < 0 && statistics.late_count != UINT16_MAX) statistics.late_count++;
+    if (run_time_us > statistics.max_run_time_us) statistics.max_run_time_us = run_time_us;
+    return true;
+  }
+
+  /// @brief Report the timing statistics of each task, a line per call (the heading, then a line per task), resetting
+  /// the statistics of each task as its line is printed.
+  /// @param output The output to print the line to.
+  /// @return True if the report continues (call again for the next line), false if it is complete.
+  bool ReportNextLine(Print& output) {
+    if (report_line_ == 0) {
+      output.println(F("Task: runs, overruns, late, max (us), budget (us), period (us)"));
+    }
+    else {
+      Task task = hal::ReadFlashObject(&tasks_[report_line_ - 1]);
+      TaskStatistics& statistics = statistics_[report_line_ - 1];
+      output.print(reinterpret_cast<const __FlashStringHelper*>(task.name));
+      output.print(F(": "));
+      output.print(statistics.run_count);
+      output.print(F(", "));
+      output.print(statistics.overrun_count);
+      output.print(F(", "));
+      output.print(statistics.late_count);
+      output.print(F(", "));
+      output.print(statistics.max_run_time_us);
+      output.print(F(", "));
+      output.print(task.budget_us);
+      output.print(F(", "));
+      output.println(task.period_us);
+      statistics = {};
+    }
+
+    if (++report_line_ <= kSizeOfTasks) return true;
+    report_line_ = 0;
+    return false;
+  }
+
+ private:
+
+  /// @brief Timing statistics of a task.
+  struct TaskStatistics {
+    uint32_t run_count; ///< No. of runs.
+    uint16_t overrun_count; ///< No. of runs over budget.
+    uint16_t late_count; ///< No. of runs started after the deadline.
+    uint32_t max_run_time_us; ///< Longest run time (us), i.e., the worst-case execution time.
+  };
+
+  const Task (&tasks_)[kSizeOfTasks]; ///< The task table (in flash).
+  uint32_t release_times_us_[kSizeOfTasks] = {}; ///< Time (us) each task was (or is next) released.
+  TaskStatistics statistics_[kSizeOfTasks] = {}; ///< Timing statistics of each task, since the last report.
+  uint8_t report_line_ = 0; ///< The next line of the report (0 for the heading, then 1 + the task index).
+};
+
+} // namespace mtspin
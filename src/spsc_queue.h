@@ -0,0 +1,81 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file spsc_queue.h
+/// @brief Class template for a lock-free single-producer/single-consumer queue (e.g., main loop to interrupt).
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace mtspin {
+
+/// @brief The SPSC Queue class template.
+/// The producer only writes the head index and the consumer only writes the tail index, so no locking is needed as
+/// long as each side is confined to a single context (e.g., the main loop and one interrupt) on a single core.
+/// @tparam T The element type.
+/// @tparam kCapacity The maximum no. of elements (a power of two, up to 128).
+template <typename T, uint8_t kCapacity>
+class SpscQueue {
+  static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0 && kCapacity <= 128,
+                "SpscQueue capacity must be a power of two, up to 128.");
+
+ public:
+
+  /// @brief Add an element to the queue (producer side only).
+  /// @param item The element to add.
+  /// @return True if the element was added, false if the queue is full.
+  bool Push(const T& item) {
+    uint8_t head = head_;
+    if (static_cast<uint8_t>(head - tail_) == kCapacity) return false;
+    items_[head & kIndexMask] = item;
+    __asm__ __volatile__("" ::: "memory"); // Publish the element before the index.
+    head_ = head + 1;
+    return true;
+  }
+
+  /// @brief Remove the oldest element from the queue (consumer side only).
+  /// @param item The element removed.
+  /// @return True if an element was removed, false if the queue is empty.
+  bool Pop(T& item) {
+    uint8_t tail = tail_;
+    if (tail == head_) return false;
+    item = items_[tail & kIndexMask];
+    __asm__ __volatile__("" ::: "memory"); // Consume the element before releasing the slot.
+    tail_ = tail + 1;
+    return true;
+  }
+
+  /// @brief Get the oldest element without removing it (consumer side only).
+  /// @return The oldest element (valid until it is removed), or nullptr if the queue is empty.
+  const T* Peek() const {
+    uint8_t tail = tail_;
+    if (tail == head_) return nullptr;
+    __asm__ __volatile__("" ::: "memory"); // Read the index before the element.
+    return &items_[tail & kIndexMask];
+  }
+
+  /// @brief Check if the queue is empty.
+  /// @return True if the queue is empty.
+  bool IsEmpty() const { return head_ == tail_; }
+
+  /// @brief Check if the queue is full.
+  /// @return True if the queue is full.
+  bool IsFull() const { return static_cast<uint8_t>(head_ - tail_) == kCapacity; }
+
+  /// @brief Get the no. of elements in the queue.
+  /// @return The no. of elements.
+  uint8_t Size() const { return static_cast<uint8_t>(head_ - tail_); }
+
+ private:
+
+  static constexpr uint8_t kIndexMask = kCapacity - 1; ///< Mask to wrap the free-running indices.
+
+  T items_[kCapacity]; ///< The queued elements.
+  volatile uint8_t head_ = 0; ///< Free-running index of the next element to write (written by the producer).
+  volatile uint8_t tail_ = 0; ///< Free-running index of the next element to read (written by the consumer).
+};
+
+} // namespace mtspin
@@ -0,0 +1,483 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_axis.cpp
+/// @brief Class that plans the motion (step timing and direction) of a single stepper motor axis.
+
+#include "step_axis.h"
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+void StepAxis::Begin(const uint16_t* ramp_intervals_us, const Ramp* ramps) {
+  ramp_intervals_us_ = ramp_intervals_us;
+  ramps_ = ramps;
+  ramp_ = hal::ReadFlashObject(&ramps_[0]);
+  ramp_index_ = 0;
+  direction_ = 1;
+}
+
+#if MTSPIN_MICROSTEP_SWITCHING
+void StepAxis::BeginMicrostepSwitching(const MicrostepBand* microstep_bands, uint8_t size_of_microstep_bands) {
+  microstep_bands_ = microstep_bands;
+  size_of_microstep_bands_ = size_of_microstep_bands;
+  microstep_band_ = 0;
+  step_size_ = 1;
+}
+#endif
+
+bool StepAxis::SetSpeed(const SpeedProfile& speed) {
+  return commands_.Push({CommandType::kSetSpeed, 0, speed});
+}
+
+bool StepAxis::MoveBy(int32_t microsteps) {
+  return commands_.Push({CommandType::kMoveBy, microsteps, {}});
+}
+
+bool StepAxis::Jog(int8_t direction) {
+  return commands_.Push({CommandType::kJog, direction, {}});
+}
+
+bool StepAxis::SetVelocity(int8_t direction, const SpeedProfile& speed) {
+  return commands_.Push({CommandType::kSetVelocity, direction, speed});
+}
+
+bool StepAxis::Oscillate(int32_t centre, int32_t amplitude) {
+  Command command = {CommandType::kOscillate, centre, {}};
+  command.amplitude = amplitude;
+  return commands_.Push(command);
+}
+
+bool StepAxis::Stop() {
+  return commands_.Push({CommandType::kStop, 0, {}});
+}
+
+bool StepAxis::Halt() {
+  return commands_.Push({CommandType::kHalt, 0, {}});
+}
+
+bool StepAxis::QueueSegment(const Segment& segment) {
+  return segments_.Push(segment);
+}
+
+bool StepAxis::ClearProgram() {
+  return commands_.Push({CommandType::kClearProgram, 0, {}});
+}
+
+bool StepAxis::IsIdle() const {
+  // Check the queues first; a command or segment consumed in between has already updated the motion status.
+  return commands_.IsEmpty() && segments_.IsEmpty() && motion_status_ == MotionStatus::kIdle;
+}
+
+StepAxis::MotionStatus StepAxis::motion_status() const {
+  return motion_status_;
+}
+
+int32_t StepAxis::position() const {
+  hal::InterruptGuard guard; // Multi-byte value written by the interrupt.
+  return position_;
+}
+
+int32_t StepAxis::velocity() const {
+  uint16_t ramp_step;
+  uint16_t cruise_ramp_step;
+  uint16_t ramp_offset;
+  uint16_t cruise_interval_us;
+  int8_t direction;
+  {
+    hal::InterruptGuard guard; // Written by the interrupt.
+    ramp_step = ramp_step_;
+    cruise_ramp_step = cruise_ramp_step_;
+    ramp_offset = ramp_.offset;
+    cruise_interval_us = speed_.interval_us;
+    direction = direction_;
+  }
+
+  if (ramp_step == 0) return 0;
+
+  // On the ramp, the interval is that of the ramp step (within one microstep, whether accelerating or decelerating).
+  uint16_t interval_us = ramp_step == cruise_ramp_step
+                         ? cruise_interval_us
+                         : hal::ReadFlashWord(&ramp_intervals_us_[ramp_offset + ramp_step - 1]);
+  return direction * static_cast<int32_t>(1000000UL / interval_us);
+}
+
+uint16_t StepAxis::FindRampStep(const uint16_t* ramp_intervals_us, uint16_t size, uint16_t interval_us) {
+  // Binary search for the first entry at (or faster than) the speed; the intervals never increase along a ramp.
+  uint16_t low = 0;
+  uint16_t high = size;
+  while (low < high) {
+    uint16_t middle = low + (high - low) / 2;
+    if (hal::ReadFlashWord(&ramp_intervals_us[middle]) > interval_us) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+int8_t StepAxis::direction() const {
+  return direction_;
+}
+
+bool StepAxis::IsActive() const {
+  return mode_ != Mode::kIdle;
+}
+
+#if MTSPIN_MICROSTEP_SWITCHING
+uint8_t StepAxis::microstep_band() const {
+  return microstep_band_;
+}
+#endif
+
+StepAxis::StepAxis() {}
+
+StepAxis::~StepAxis() {}
+
+uint32_t StepAxis::ServiceStep(StepAction& action) {
+  action = StepAction::kNone;
+  Command command;
+  while (commands_.Pop(command)) ApplyCommand(command);
+
+  if (mode_ == Mode::kIdle && !segments_.IsEmpty()) {
+    // Start a motion program from the current position.
+    mode_ = Mode::kProgram;
+    target_position_ = position_;
+  }
+
+  if (mode_ == Mode::kIdle) return kIdlePollInterval_us;
+
+  if (ramp_step_ == 0) {
+    // At rest; start (or restart) motion in the required direction, or finish.
+    if (mode_ == Mode::kProgram && position_ == target_position_ && !StartNextSegment()) {
+      return kIdlePollInterval_us;
+    }
+
+    if (mode_ == Mode::kOscillate) PlanOscillation();
+    if (ramp_index_ != speed_.ramp) FollowSpeedRamp();
+
+    int8_t direction = RequiredDirection();
+    if (direction == 0) {
+      if (mode_ != Mode::kProgram) Finish(); // A motion program continues with the next segment.
+      return kIdlePollInterval_us;
+    }
+
+    if (direction != direction_) {
+      direction_ = direction;
+      action = StepAction::kChangeDirectionAndStep;
+    }
+  }
+
+  // Step (the step engine emits the pulse).
+  if (action == StepAction::kNone) action = StepAction::kStep;
+#if MTSPIN_MICROSTEP_SWITCHING
+  // A step pulse in a coarser band moves several microsteps at once; each is planned as if it were stepped on its own,
+  // so the motion (and position) is exactly that of the finest resolution, and the next pulse is due after all of them.
+  // Coarser bands are only selected well above rest, so the motion cannot end part way through a pulse.
+  uint32_t interval_us = 0;
+  uint32_t microstep_interval_us = 0;
+  for (uint8_t microstep = 0; microstep < step_size_; microstep++) {
+    microstep_interval_us = StepMicrostep();
+    interval_us += microstep_interval_us;
+  }
+
+  SelectMicrostepBand(microstep_interval_us);
+  return interval_us;
+#else
+  return StepMicrostep();
+#endif
+}
+
+uint32_t StepAxis::StepMicrostep() {
+  position_ = position_ + direction_;
+
+  if (mode_ == Mode::kProgram && position_ == target_position_ && ramp_step_ > 0 && dwell_us_ == 0) {
+    // Reached the end of a segment at speed (planned by SegmentExitRampStep()); blend into the next segment.
+    Segment segment;
+    if (segments_.Pop(segment)) LoadSegment(segment);
+  }
+
+  // Plan the next step.
+  if (MustDecelerate()) {
+    if (ramp_step_ > 0) return Decelerate();
+
+    // Came to rest within a single step; finish, or wait a first step interval before reversing.
+    if (mode_ == Mode::kOscillate) PlanOscillation();
+    if (RequiredDirection() == 0) {
+      if (mode_ != Mode::kProgram) Finish(); // A motion program continues with the next segment.
+      return kIdlePollInterval_us;
+    }
+
+    if (ramp_index_ != speed_.ramp) FollowSpeedRamp();
+    return RampInterval(0);
+  }
+
+  if (ramp_index_ != speed_.ramp) FollowSpeedRamp();
+  if (ramp_step_ < cruise_ramp_step_) return Accelerate();
+  if (ramp_step_ > cruise_ramp_step_) return Decelerate();
+  motion_status_ = MotionStatus::kConstantSpeed;
+  return speed_.interval_us;
+}
+
+void StepAxis::ApplyCommand(const Command& command) {
+  switch (command.type) {
+    case CommandType::kSetSpeed: {
+      ChangeSpeed(command.speed);
+      return;
+    }
+    case CommandType::kMoveBy: {
+      target_position_ = position_ + command.value;
+      mode_ = Mode::kPosition;
+      break;
+    }
+    case CommandType::kJog: {
+      jog_direction_ = command.value < 0 ? -1 : 1;
+      mode_ = Mode::kJog;
+      break;
+    }
+    case CommandType::kSetVelocity: {
+      ChangeSpeed(command.speed);
+      if (command.value == 0) {
+        if (mode_ != Mode::kIdle) mode_ = Mode::kStop;
+        return;
+      }
+
+      // From any motion, continue from the current velocity (see MustDecelerate()).
+      jog_direction_ = command.value < 0 ? -1 : 1;
+      mode_ = Mode::kJog;
+      break;
+    }
+    case CommandType::kOscillate: {
+      oscillation_centre_ = command.value;
+      oscillation_amplitude_ = command.amplitude < 0 ? -command.amplitude : command.amplitude;
+      if (oscillation_amplitude_ < 1) oscillation_amplitude_ = 1;
+      if (mode_ != Mode::kOscillate) {
+        oscillation_direction_ = command.amplitude < 0 ? -1 : 1;
+        mode_ = Mode::kOscillate;
+      }
+
+      // Head for the end ahead; if the motor is already past it, it decelerates and PlanOscillation() reverses.
+      target_position_ = oscillation_centre_ + oscillation_direction_ * oscillation_amplitude_;
+      break;
+    }
+    case CommandType::kStop: {
+      if (mode_ != Mode::kIdle) mode_ = Mode::kStop;
+      return;
+    }
+    case CommandType::kHalt: {
+      Finish();
+      DiscardSegments();
+      return;
+    }
+    case CommandType::kClearProgram: {
+      DiscardSegments();
+      if (mode_ == Mode::kProgram) mode_ = Mode::kStop;
+      return;
+    }
+  }
+
+  // Motion commands leave idle immediately so the control loop never observes a stale idle status.
+  if (motion_status_ == MotionStatus::kIdle) motion_status_ = MotionStatus::kAccelerate;
+}
+
+#if MTSPIN_MICROSTEP_SWITCHING
+void StepAxis::SelectMicrostepBand(uint32_t interval_us) {
+  // A pulse in a band moves step_size microsteps down the ramp at most, so the ramp must have at least that many left.
+  // Moving to a finer band is always in phase.
+  while (microstep_band_ > 0) {
+    MicrostepBand band = hal::ReadFlashObject(&microstep_bands_[microstep_band_]);
+    uint32_t exit_interval_us = band.interval_us + band.interval_us / kMicrostepBandHysteresis_;
+    if (interval_us <= exit_interval_us && ramp_step_ >= band.step_size) break;
+    microstep_band_--;
+  }
+
+  // Moving to a coarser band waits for a position in phase with it (within one of its steps).
+  while (microstep_band_ + 1 < size_of_microstep_bands_) {
+    MicrostepBand band = hal::ReadFlashObject(&microstep_bands_[microstep_band_ + 1]);
+    if (interval_us > band.interval_us || ramp_step_ < band.step_size) break;
+    if ((position_ & static_cast<int32_t>(band.step_size - 1)) != 0) break;
+    microstep_band_++;
+  }
+
+  step_size_ = microstep_band_ == 0 ? 1 : hal::ReadFlashObject(&microstep_bands_[microstep_band_]).step_size;
+}
+#endif
+
+int8_t StepAxis::RequiredDirection() const {
+  switch (mode_) {
+    case Mode::kPosition:
+    case Mode::kProgram:
+    case Mode::kOscillate: {
+      int32_t remaining_microsteps = target_position_ - position_;
+      if (remaining_microsteps > 0) return 1;
+      if (remaining_microsteps < 0) return -1;
+      return 0;
+    }
+    case Mode::kJog: {
+      return jog_direction_;
+    }
+    default: {
+      return 0;
+    }
+  }
+}
+
+bool StepAxis::MustDecelerate() const {
+  switch (mode_) {
+    case Mode::kPosition:
+    case Mode::kOscillate: {
+      // Stopping from the current ramp step takes as many microsteps as it took to get there.
+      int32_t remaining_microsteps = (target_position_ - position_) * direction_;
+      return remaining_microsteps <= static_cast<int32_t>(ramp_step_);
+    }
+    case Mode::kProgram: {
+      // As position mode, but only down to the ramp step the next segment can continue from.
+      int32_t remaining_microsteps = (target_position_ - position_) * direction_;
+      if (remaining_microsteps <= 0) return true;
+      return remaining_microsteps <= static_cast<int32_t>(ramp_step_) - static_cast<int32_t>(SegmentExitRampStep());
+    }
+    case Mode::kJog: {
+      return jog_direction_ != direction_;
+    }
+    default: {
+      return true;
+    }
+  }
+}
+
+void StepAxis::ChangeSpeed(const SpeedProfile& speed) {
+  speed_ = speed;
+  // Until the ramp of the speed is taken over (see FollowSpeedRamp()), ramp to the speed along the current ramp.
+  cruise_ramp_step_ = speed.ramp == ramp_index_ ? speed.ramp_steps : FindCurrentRampStep(speed.interval_us);
+}
+
+void StepAxis::FollowSpeedRamp() {
+  Ramp ramp = hal::ReadFlashObject(&ramps_[speed_.ramp]);
+  uint16_t ramp_step = 0;
+  if (ramp_step_ > 0) {
+    // Take the new ramp over at the current speed, once no faster than the speed of the profile (until then, decelerate
+    // along the current ramp).
+    uint16_t interval_us = RampInterval(ramp_step_ - 1);
+    if (interval_us < speed_.interval_us) return;
+    ramp_step = FindRampStep(&ramp_intervals_us_[ramp.offset], speed_.ramp_steps, interval_us);
+  }
+
+  Ramp previous_ramp = ramp_;
+  uint8_t previous_ramp_index = ramp_index_;
+  uint16_t previous_ramp_step = ramp_step_;
+  ramp_ = ramp;
+  ramp_index_ = speed_.ramp;
+  ramp_step_ = ramp_step;
+  if (previous_ramp_step > 0 && ramp_step > previous_ramp_step && MustDecelerate()) {
+    // The new ramp would need further to stop than is left; stay on the current ramp.
+    ramp_ = previous_ramp;
+    ramp_index_ = previous_ramp_index;
+    ramp_step_ = previous_ramp_step;
+    return;
+  }
+
+  cruise_ramp_step_ = speed_.ramp_steps;
+}
+
+uint16_t StepAxis::FindCurrentRampStep(uint16_t interval_us) const {
+  return FindRampStep(&ramp_intervals_us_[ramp_.offset], ramp_.size - 1, interval_us);
+}
+
+uint16_t StepAxis::RampInterval(uint16_t ramp_step) const {
+  return hal::ReadFlashWord(&ramp_intervals_us_[ramp_.offset + ramp_step]);
+}
+
+void StepAxis::PlanOscillation() {
+  target_position_ = oscillation_centre_ + oscillation_direction_ * oscillation_amplitude_;
+  if ((target_position_ - position_) * oscillation_direction_ > 0) return;
+
+  oscillation_direction_ = -oscillation_direction_;
+  target_position_ = oscillation_centre_ + oscillation_direction_ * oscillation_amplitude_;
+}
+
+uint32_t StepAxis::Accelerate() {
+  uint16_t interval_us = RampInterval(ramp_step_);
+  ramp_step_++;
+  motion_status_ = MotionStatus::kAccelerate;
+  return interval_us > speed_.interval_us ? interval_us : speed_.interval_us;
+}
+
+uint32_t StepAxis::Decelerate() {
+  // The ramp is symmetric; decelerating retraces the acceleration intervals in reverse.
+  ramp_step_--;
+  motion_status_ = MotionStatus::kDecelerate;
+  return RampInterval(ramp_step_);
+}
+
+void StepAxis::Finish() {
+  mode_ = Mode::kIdle;
+  ramp_step_ = 0;
+  dwell_us_ = 0;
+  motion_status_ = MotionStatus::kIdle;
+#if MTSPIN_MICROSTEP_SWITCHING
+  microstep_band_ = 0; // Stopped at once (see Halt()), possibly at speed; restart at the finest resolution.
+  step_size_ = 1;
+#endif
+}
+
+bool StepAxis::StartNextSegment() {
+  if (dwell_us_ > 0) {
+    dwell_us_ = dwell_us_ > kIdlePollInterval_us ? dwell_us_ - kIdlePollInterval_us : 0;
+    return false;
+  }
+
+  Segment segment;
+  if (!segments_.Pop(segment)) {
+    Finish(); // Motion program complete.
+    return false;
+  }
+
+  LoadSegment(segment);
+  return true;
+}
+
+void StepAxis::LoadSegment(const Segment& segment) {
+  target_position_ = segment.target_position;
+  ChangeSpeed(segment.speed);
+  dwell_us_ = segment.dwell_ms * 1000UL;
+  if (motion_status_ == MotionStatus::kIdle) motion_status_ = MotionStatus::kAccelerate;
+}
+
+uint16_t StepAxis::SegmentExitRampStep() const {
+  if (dwell_us_ > 0) return 0;
+  const Segment* next_segment = segments_.Peek();
+  if (next_segment == nullptr) return 0;
+
+  // Continue at speed only into a segment in the same direction, and no faster than it allows, or than can still be
+  // stopped within it (in case no further segments follow).
+  int32_t next_segment_microsteps = (next_segment->target_position - target_position_) * direction_;
+  if (next_segment_microsteps <= 0) return 0;
+  uint16_t ramp_step = next_segment->speed.ramp_steps;
+  if (next_segment_microsteps < ramp_step) ramp_step = static_cast<uint16_t>(next_segment_microsteps);
+  if (next_segment->speed.ramp == ramp_index_) return ramp_step;
+
+  // The next segment follows a different ramp; exit at the speed of that ramp step (or slower), on the current ramp.
+  uint16_t interval_us = next_segment->speed.interval_us;
+  if (ramp_step < next_segment->speed.ramp_steps) {
+    Ramp next_ramp = hal::ReadFlashObject(&ramps_[next_segment->speed.ramp]);
+    interval_us = hal::ReadFlashWord(&ramp_intervals_us_[next_ramp.offset + ramp_step - 1]);
+  }
+
+  return FindCurrentRampStep(interval_us);
+}
+
+void StepAxis::DiscardSegments() {
+  Segment segment;
+  while (segments_.Pop(segment)) {}
+  dwell_us_ = 0;
+}
+
+} // namespace mtspin
@@ -0,0 +1,343 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_axis.h
+/// @brief Class that plans the motion (step timing and direction) of a single stepper motor axis.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "spsc_queue.h"
+
+/// @brief Macro to compile in microstep resolution switching by speed band (0 compiles it out completely).
+#ifndef MTSPIN_MICROSTEP_SWITCHING
+#define MTSPIN_MICROSTEP_SWITCHING 0
+#endif
+
+namespace mtspin {
+
+/// @brief The Step Axis class.
+/// The control loop publishes motion commands through a lock-free queue, and the step engine's timer interrupt
+/// consumes them (see ServiceStep()) to decide when each step of the axis is due; the step engine emits the pulses.
+/// Motion segments queued back to back run as a motion program; the interrupt looks ahead one segment, so that
+/// consecutive moves in the same direction blend at speed instead of stopping at each segment boundary.
+/// With MTSPIN_MICROSTEP_SWITCHING, the stepper driver resolution follows the speed (see MicrostepBand); positions,
+/// ramps and speed profiles stay in microsteps of the finest resolution throughout.
+class StepAxis {
+ public:
+
+  /// @brief Enum of motion status.
+  enum class MotionStatus : uint8_t {
+    kIdle = 0,
+    kAccelerate,
+    kConstantSpeed,
+    kDecelerate,
+  };
+
+  /// @brief Enum of step actions, decided by ServiceStep() for the step engine to carry out.
+  enum class StepAction : uint8_t {
+    kNone = 0, ///< No step.
+    kStep, ///< Emit a step in the current direction.
+    kChangeDirectionAndStep, ///< Set the new direction (see direction()), then emit a step.
+  };
+
+  /// @brief Acceleration ramp; a run of entries of the ramp lookup table (see Begin()), from rest to a top speed.
+  struct Ramp {
+    uint16_t offset; ///< Index of the first entry in the ramp lookup table.
+    uint16_t size; ///< No. of entries.
+  };
+
+  /// @brief Speed profile; prepared ahead of time (see ramp_table.h) so the interrupt only needs table lookups.
+  struct SpeedProfile {
+    uint16_t ramp_steps; ///< No. of microsteps needed to accelerate from rest to the speed, along its ramp.
+    uint16_t interval_us; ///< Step interval (us) at the speed.
+    uint8_t ramp; ///< Index of the acceleration ramp (see Ramp) to the speed.
+  };
+
+  /// @brief Motion segment (of a motion program).
+  struct Segment {
+    int32_t target_position; ///< Target position (microsteps, relative to the startup position).
+    SpeedProfile speed; ///< Speed profile.
+    uint16_t dwell_ms; ///< Time (ms) to wait at rest at the target position; 0 allows blending into the next segment.
+  };
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @brief Microstep resolution speed band; bands are ordered from the finest resolution (band 0, a step size of 1) to
+  /// the coarsest. A coarser band is entered once the microstep interval is down to its interval, and left once the
+  /// interval is over it by more than 1/kMicrostepBandHysteresis_ (or the ramp is too close to rest for a whole step
+  /// pulse). A coarser band is only entered at a position that is a whole no. of its steps from the startup position,
+  /// i.e., where the stepper driver indexer is at a valid state of the coarser resolution (the indexer must be at its
+  /// home state at startup), so each step pulse moves exactly step_size microsteps.
+  struct MicrostepBand {
+    uint8_t step_size; ///< Microsteps (of the finest resolution) per step pulse; a power of 2.
+    uint16_t interval_us; ///< Microstep interval (us) at which the band is entered; unused for band 0.
+  };
+#endif
+
+  inline static constexpr uint32_t kIdlePollInterval_us = 1000; ///< Interval (us) to poll for commands when idle.
+
+  /// @brief Construct a Step Axis object.
+  StepAxis();
+
+  /// @brief Destroy the Step Axis object.
+  ~StepAxis();
+
+  /// @brief Initialise the axis.
+  /// @param ramp_intervals_us Acceleration ramp lookup table (in flash); entry n of a ramp is the step interval (us)
+  /// after n microsteps of acceleration. Speed profiles must not ramp beyond the end of their ramp.
+  /// @param ramps Acceleration ramps of the lookup table (in flash), indexed by SpeedProfile::ramp. A speed change
+  /// while moving continues along the current ramp until the ramp of the new speed can be taken over at the same speed
+  /// (without lengthening the distance needed to stop); at rest, the ramp of the speed is taken over at once.
+  void Begin(const uint16_t* ramp_intervals_us,
+             const Ramp* ramps); ///< This must be called only once, before the step timer starts.
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @brief Enable microstep resolution switching; motion starts at the finest resolution (band 0).
+  /// @param microstep_bands Microstep band lookup table (in flash), from the finest resolution to the coarsest.
+  /// @param size_of_microstep_bands No. of entries in the microstep band lookup table.
+  void BeginMicrostepSwitching(const MicrostepBand* microstep_bands,
+                               uint8_t size_of_microstep_bands); ///< This must be called only once, after Begin().
+#endif
+
+  // Commands; published to the step timer interrupt. Each returns false if the command queue is full.
+
+  /// @brief Set the speed used by subsequent (and ongoing) motion.
+  /// @param speed The speed profile.
+  /// @return True if the command was published.
+  bool SetSpeed(const SpeedProfile& speed);
+
+  /// @brief Move by a relative no. of microsteps, accelerating and decelerating as required.
+  /// @param microsteps The no. of microsteps to move by; the sign gives the direction.
+  /// @return True if the command was published.
+  bool MoveBy(int32_t microsteps);
+
+  /// @brief Move indefinitely at the set speed; a change of direction decelerates to rest before reversing.
+  /// @param direction The motion direction (1 for positive, -1 for negative).
+  /// @return True if the command was published.
+  bool Jog(int8_t direction);
+
+  /// @brief Move indefinitely at a signed velocity, set as a direction and a speed in a single command, so the change
+  /// is seen by the interrupt at once. The motor ramps from its current velocity under the acceleration limit; a
+  /// reversal decelerates through zero and accelerates straight back up, without stopping.
+  /// @param direction The motion direction (1 for positive, -1 for negative), or 0 to decelerate to rest.
+  /// @param speed The speed profile.
+  /// @return True if the command was published.
+  bool SetVelocity(int8_t direction, const SpeedProfile& speed);
+
+  /// @brief Oscillate indefinitely between two absolute positions, centre - amplitude and centre + amplitude. Reversals
+  /// are planned by the interrupt (deceleration starts exactly at the stopping distance), so the oscillation never
+  /// waits on the control loop and the centre does not drift. While oscillating, the centre and amplitude (and speed)
+  /// can be changed at any time; the motion continues from its current velocity in its current direction.
+  /// @param centre The centre position (microsteps).
+  /// @param amplitude The amplitude (microsteps, at least 1); when starting to oscillate, the sign gives the initial
+  /// direction.
+  /// @return True if the command was published.
+  bool Oscillate(int32_t centre, int32_t amplitude);
+
+  /// @brief Decelerate to rest; queued segments (if any) run afterwards.
+  /// @return True if the command was published.
+  bool Stop();
+
+  /// @brief Stop immediately, without decelerating (e.g., when the driver is disabled), and discard queued segments.
+  /// @return True if the command was published.
+  bool Halt();
+
+  /// @brief Queue a motion segment; segments run (in order) once any other motion has come to rest.
+  /// @param segment The segment.
+  /// @return True if the segment was queued, false if the segment queue is full.
+  bool QueueSegment(const Segment& segment);
+
+  /// @brief Discard queued segments, and decelerate to rest if a motion program is running.
+  /// @return True if the command was published.
+  bool ClearProgram();
+
+  /// @brief Check if the motor is at rest with no motion commands or segments pending.
+  /// @return True if idle.
+  bool IsIdle() const;
+
+  /// @brief Get the motion status.
+  /// @return The motion status.
+  MotionStatus motion_status() const;
+
+  /// @brief Get the position.
+  /// @return The position (microsteps) relative to the startup position.
+  int32_t position() const;
+
+  /// @brief Get the velocity, from the current step interval (for reporting).
+  /// @return The velocity (microsteps per second); positive for CW, negative for CCW, 0 at rest.
+  int32_t velocity() const;
+
+  // Interrupt context.
+
+  /// @brief Consume pending commands, decide whether a step is due now, and plan the next step (interrupt context).
+  /// @param action The step to emit now.
+  /// @return The interval (us) to the next call.
+  uint32_t ServiceStep(StepAction& action);
+
+  /// @brief Look up how far up an acceleration ramp a speed is reached.
+  /// @param ramp_intervals_us The first entry of the ramp (in flash).
+  /// @param size The no. of ramp entries to search.
+  /// @param interval_us The step interval (us) at the speed.
+  /// @return The no. of leading ramp entries with a longer step interval (i.e., the no. of ramp steps to the speed).
+  static uint16_t FindRampStep(const uint16_t* ramp_intervals_us, uint16_t size, uint16_t interval_us);
+
+  /// @brief Get the direction of the step decided by ServiceStep() (interrupt context).
+  /// @return The direction (1 for positive, -1 for negative).
+  int8_t direction() const;
+
+  /// @brief Check if the axis has motion in progress, including dwells (interrupt context).
+  /// @return True if active.
+  bool IsActive() const;
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @brief Get the microstep band of the next step pulse, as decided by ServiceStep() (interrupt context); select it on
+  /// the stepper driver after the current step pulse.
+  /// @return The microstep band.
+  uint8_t microstep_band() const;
+#endif
+
+ private:
+
+  /// @brief Enum of command types.
+  enum class CommandType : uint8_t {
+    kSetSpeed = 0,
+    kMoveBy,
+    kJog,
+    kSetVelocity,
+    kOscillate,
+    kStop,
+    kHalt,
+    kClearProgram,
+  };
+
+  /// @brief Command published from the control loop to the step timer interrupt.
+  struct Command {
+    CommandType type; ///< The command type.
+    int32_t value; ///< Microsteps (kMoveBy), direction (kJog, kSetVelocity) or centre position (kOscillate).
+    union {
+      SpeedProfile speed; ///< Speed profile (kSetSpeed, kSetVelocity).
+      int32_t amplitude; ///< Signed amplitude (kOscillate).
+    };
+  };
+
+  /// @brief Enum of motion modes (owned by the step timer interrupt).
+  enum class Mode : uint8_t {
+    kIdle = 0,
+    kPosition,
+    kJog,
+    kStop,
+    kProgram,
+    kOscillate,
+  };
+
+  /// @brief Apply a command (interrupt context).
+  /// @param command The command.
+  void ApplyCommand(const Command& command);
+
+  /// @brief Get the direction the current motion mode requires when at rest (interrupt context).
+  /// @return The required direction (1 or -1), or 0 if the motion is complete.
+  int8_t RequiredDirection() const;
+
+  /// @brief Check if the current motion mode requires deceleration (interrupt context).
+  /// @return True if the motor must decelerate.
+  bool MustDecelerate() const;
+
+  /// @brief Move by one microstep in the current direction, and plan the following microstep (interrupt context).
+  /// @return The interval (us) to the following microstep.
+  uint32_t StepMicrostep();
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @brief Select the microstep band of the next step pulse (interrupt context).
+  /// @param interval_us The current microstep interval (us).
+  void SelectMicrostepBand(uint32_t interval_us);
+#endif
+
+  /// @brief Set the target position to the end of the oscillation ahead, reversing at (or beyond) an end (interrupt
+  /// context).
+  void PlanOscillation();
+
+  /// @brief Set the speed profile of subsequent (and ongoing) motion (interrupt context).
+  /// @param speed The speed profile.
+  void ChangeSpeed(const SpeedProfile& speed);
+
+  /// @brief Take over the ramp of the speed profile, if it differs from the current ramp and the motion allows it (see
+  /// Begin(); interrupt context).
+  void FollowSpeedRamp();
+
+  /// @brief Look up how far up the current ramp a speed is reached (interrupt context).
+  /// @param interval_us The step interval (us) at the speed.
+  /// @return The ramp step.
+  uint16_t FindCurrentRampStep(uint16_t interval_us) const;
+
+  /// @brief Get the step interval at a step of the current ramp (interrupt context).
+  /// @param ramp_step The ramp step.
+  /// @return The step interval (us).
+  uint16_t RampInterval(uint16_t ramp_step) const;
+
+  /// @brief Step the ramp up by one microstep (interrupt context).
+  /// @return The interval (us) to the next step.
+  uint32_t Accelerate();
+
+  /// @brief Step the ramp down by one microstep (interrupt context).
+  /// @return The interval (us) to the next step.
+  uint32_t Decelerate();
+
+  /// @brief Finish motion and return to idle (interrupt context).
+  void Finish();
+
+  /// @brief Complete the dwell at the end of the current segment, then start the next segment (interrupt context).
+  /// @return True if a segment was started, false while dwelling or if the motion program is complete.
+  bool StartNextSegment();
+
+  /// @brief Make a segment the current segment (interrupt context).
+  /// @param segment The segment.
+  void LoadSegment(const Segment& segment);
+
+  /// @brief Get the ramp step the current segment may end at, to blend into the next segment (interrupt context).
+  /// @return The ramp step; 0 if the motor must come to rest at the end of the current segment.
+  uint16_t SegmentExitRampStep() const;
+
+  /// @brief Discard queued segments (interrupt context).
+  void DiscardSegments();
+
+  inline static constexpr uint8_t kCommandQueueSize_ = 8; ///< No. of commands that can be pending.
+  inline static constexpr uint8_t kSegmentQueueSize_ = 8; ///< No. of segments that can be pending.
+
+  const uint16_t* ramp_intervals_us_ = nullptr; ///< Acceleration ramp lookup table (in flash).
+  const Ramp* ramps_ = nullptr; ///< Acceleration ramps of the lookup table (in flash).
+
+  SpscQueue<Command, kCommandQueueSize_> commands_; ///< Commands from the control loop to the interrupt.
+  SpscQueue<Segment, kSegmentQueueSize_> segments_; ///< Segments from the control loop to the interrupt.
+
+  // Motion state (owned by the step timer interrupt).
+  Mode mode_ = Mode::kIdle; ///< The motion mode.
+  SpeedProfile speed_ = {0, static_cast<uint16_t>(kIdlePollInterval_us), 0}; ///< The speed profile.
+  Ramp ramp_ = {0, 0}; ///< The current acceleration ramp; that of the speed profile, unless not yet taken over.
+  uint8_t ramp_index_ = 0; ///< Index of the current acceleration ramp.
+  uint16_t cruise_ramp_step_ = 0; ///< The ramp step of the speed profile's speed, along the current ramp.
+  int32_t target_position_ = 0; ///< The target position (microsteps) for position, program and oscillation modes.
+  int32_t oscillation_centre_ = 0; ///< The oscillation centre position (microsteps).
+  int32_t oscillation_amplitude_ = 1; ///< The oscillation amplitude (microsteps).
+  int8_t oscillation_direction_ = 1; ///< The direction towards the oscillation end ahead.
+  uint32_t dwell_us_ = 0; ///< Time (us) left to wait at rest at the end of the current segment.
+  int8_t jog_direction_ = 1; ///< The requested direction for jog mode.
+  int8_t direction_ = 1; ///< The direction currently output on the DIR pin.
+  uint16_t ramp_step_ = 0; ///< No. of microsteps into the acceleration ramp (0 at rest).
+#if MTSPIN_MICROSTEP_SWITCHING
+  inline static constexpr uint8_t kMicrostepBandHysteresis_ = 8; ///< Band exit interval margin (1/n of the interval).
+
+  const MicrostepBand* microstep_bands_ = nullptr; ///< Microstep band lookup table (in flash).
+  uint8_t size_of_microstep_bands_ = 0; ///< No. of entries in the microstep band lookup table.
+  uint8_t microstep_band_ = 0; ///< The microstep band of the next step pulse.
+  uint8_t step_size_ = 1; ///< Microsteps per step pulse in the current microstep band.
+#endif
+
+  // Motion state shared with the control loop.
+  volatile MotionStatus motion_status_ = MotionStatus::kIdle; ///< The motion status.
+  volatile int32_t position_ = 0; ///< The position (microsteps).
+};
+
+} // namespace mtspin
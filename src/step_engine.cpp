@@ -0,0 +1,203 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_engine.cpp
+/// @brief Class that generates stepper driver step pulses for all axes from a hardware timer interrupt.
+
+#include "step_engine.h"
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+StepEngine& StepEngine::GetInstance() {
+  static StepEngine instance;
+  return instance;
+}
+
+#if MTSPIN_MICROSTEP_SWITCHING
+void StepEngine::Begin(const StepOutputConfiguration (&step_outputs)[Configuration::kSizeOfAxes_],
+                       const uint16_t* ramp_intervals_us, const StepAxis::Ramp* ramps,
+                       const StepAxis::MicrostepBand* microstep_bands) {
+#else
+void StepEngine::Begin(const StepOutputConfiguration (&step_outputs)[Configuration::kSizeOfAxes_],
+                       const uint16_t* ramp_intervals_us, const StepAxis::Ramp* ramps) {
+#endif
+  step_outputs_.Begin(step_outputs);
+  for (StepAxis& axis : axes_) axis.Begin(ramp_intervals_us, ramps);
+#if MTSPIN_MICROSTEP_SWITCHING
+  for (uint8_t axis = 0; axis < kSizeOfAxes_; axis++) {
+    axes_[axis].BeginMicrostepSwitching(microstep_bands, Configuration::kSizeOfMicrostepBands_);
+    WriteMicrostepBand(axis, 0);
+  }
+#endif
+  interval_us_ = StepAxis::kIdlePollInterval_us;
+  for (int32_t& remaining_us : remaining_us_) remaining_us = static_cast<int32_t>(interval_us_);
+  hal::BeginStepTimer(OnStepTimer, interval_us_);
+}
+
+StepAxis& StepEngine::axis(uint8_t axis) {
+  return axes_[axis];
+}
+
+AngleTrigger& StepEngine::angle_trigger(uint8_t axis) {
+  return angle_triggers_[axis];
+}
+
+void StepEngine::BeginTriggerOutput(uint8_t axis) {
+  uint8_t mask = static_cast<uint8_t>(1U << axis);
+  if (trigger_outputs_ & mask) return;
+
+  // Latch the inactive state before driving the pin, so it does not glitch active.
+  hal::WritePin(Configuration::kTriggerPins_[axis], kTriggerInactivePinState_);
+  hal::SetPinMode(Configuration::kTriggerPins_[axis], hal::PinMode::kOutput);
+  trigger_outputs_ |= mask;
+}
+
+#if MTSPIN_STEP_TRACE
+bool StepEngine::DumpStepTraceLine(Print& output) {
+  return step_trace_.DumpNextLine(output, kSizeOfAxes_);
+}
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+StepEngine::StepTimingCounts StepEngine::step_timing_counts() const {
+  hal::InterruptGuard guard; // Written by the interrupt.
+  return {late_step_count_, missed_step_count_};
+}
+
+StepEngine::StepTimingCounts StepEngine::TakeStepTimingCounts() {
+  StepTimingCounts counts = step_timing_counts();
+  StepTimingCounts taken = {static_cast<uint16_t>(counts.late_steps - reported_step_timing_counts_.late_steps),
+                            static_cast<uint16_t>(counts.missed_steps - reported_step_timing_counts_.missed_steps)};
+  reported_step_timing_counts_ = counts;
+  return taken;
+}
+#endif
+
+StepEngine::StepEngine() {}
+
+StepEngine::~StepEngine() {}
+
+uint32_t StepEngine::OnStepTimer() {
+#if MTSPIN_INSTRUMENTATION
+  StepEngine& step_engine = GetInstance();
+  step_engine.CheckStepTiming();
+  return step_engine.ServiceSteps();
+#else
+  return GetInstance().ServiceSteps();
+#endif
+}
+
+uint32_t StepEngine::ServiceSteps() {
+  uint8_t stepping_axes = 0;
+  uint8_t reversing_axes = 0;
+  uint8_t triggering_axes = 0;
+  int32_t next_interval_us = static_cast<int32_t>(hal::kMaxStepTimerInterval_us);
+  for (uint8_t axis = 0; axis < kSizeOfAxes_; axis++) {
+    int32_t remaining_us = remaining_us_[axis] - static_cast<int32_t>(interval_us_);
+    if (remaining_us <= kStepTolerance_us_) {
+      // Step due; the next step is timed from when this one was due (not from now), so the error does not accumulate.
+      StepAxis::StepAction action;
+      remaining_us += static_cast<int32_t>(axes_[axis].ServiceStep(action));
+      if (action == StepAxis::StepAction::kChangeDirectionAndStep) {
+        step_outputs_.WriteDirection(axis, axes_[axis].direction());
+        reversing_axes |= static_cast<uint8_t>(1U << axis);
+      }
+
+      if (action != StepAxis::StepAction::kNone) {
+        stepping_axes |= static_cast<uint8_t>(1U << axis);
+        if (angle_triggers_[axis].Advance(axes_[axis].position())) triggering_axes |= static_cast<uint8_t>(1U << axis);
+      }
+
+      if (remaining_us < 0) remaining_us = 0; // Running behind; step again as soon as possible.
+    }
+
+    remaining_us_[axis] = remaining_us;
+    if (remaining_us < next_interval_us) next_interval_us = remaining_us;
+  }
+
+  // Emit the steps of all axes together.
+  if (reversing_axes != 0) step_outputs_.WaitForDirection();
+  if (stepping_axes != 0) step_outputs_.Pulse(stepping_axes);
+  if ((triggering_axes | active_triggers_) != 0) UpdateTriggers(triggering_axes);
+#if MTSPIN_STEP_TRACE
+  if (stepping_axes != 0) step_trace_.Record(hal::Micros(), stepping_axes, reversing_axes);
+#endif
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  // Select the microstep band of each axis' next step pulse; after the pulses, so the setup time before the next pulse
+  // is a whole step interval. Bands change rarely (while ramping through a band speed), and only ever in phase.
+  for (uint8_t axis = 0; axis < kSizeOfAxes_; axis++) {
+    uint8_t band = axes_[axis].microstep_band();
+    if (band != microstep_bands_[axis]) WriteMicrostepBand(axis, band);
+  }
+#endif
+
+  if (next_interval_us < static_cast<int32_t>(hal::kMinStepTimerInterval_us)) {
+    next_interval_us = static_cast<int32_t>(hal::kMinStepTimerInterval_us);
+  }
+
+  interval_us_ = static_cast<uint32_t>(next_interval_us);
+  return interval_us_;
+}
+
+void StepEngine::UpdateTriggers(uint8_t axes) {
+  for (uint8_t axis = 0; axis < kSizeOfAxes_; axis++) {
+    uint8_t mask = static_cast<uint8_t>(1U << axis);
+    if (axes & mask) {
+      // Reached a trigger angle with the step just emitted; (re)start the trigger pulse.
+      hal::WritePin(Configuration::kTriggerPins_[axis], Configuration::kTriggerActivePinState_);
+      trigger_remaining_us_[axis] = static_cast<int32_t>(Configuration::kTriggerPulseWidth_us_);
+      active_triggers_ |= mask;
+    }
+    else if (active_triggers_ & mask) {
+      // The pulse ends at the first step timer call after its width (so it is at least that long).
+      trigger_remaining_us_[axis] -= static_cast<int32_t>(interval_us_);
+      if (trigger_remaining_us_[axis] > 0) continue;
+      hal::WritePin(Configuration::kTriggerPins_[axis], kTriggerInactivePinState_);
+      active_triggers_ &= static_cast<uint8_t>(~mask);
+    }
+  }
+}
+
+#if MTSPIN_MICROSTEP_SWITCHING
+void StepEngine::WriteMicrostepBand(uint8_t axis, uint8_t band) {
+  uint8_t pin_states = Configuration::kMicrostepBandPinStates_[band];
+  for (uint8_t pin = 0; pin < Configuration::kSizeOfMicrostepSelectPins_; pin++) {
+    hal::WritePin(Configuration::kMicrostepSelectPins_[axis][pin],
+                  (pin_states & (1U << pin)) != 0 ? hal::PinState::kHigh : hal::PinState::kLow);
+  }
+
+  microstep_bands_[axis] = band;
+}
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+void StepEngine::CheckStepTiming() {
+  uint32_t time_us = hal::Micros();
+  step_due_time_us_ += interval_us_;
+  bool active = false;
+  for (const StepAxis& axis : axes_) active = active || axis.IsActive();
+  if (!active) {
+    // Only steps are timed; resynchronise while idle, so the interrupt entry latency is not counted as lateness.
+    step_due_time_us_ = time_us;
+    return;
+  }
+
+  int32_t lateness_us = static_cast<int32_t>(time_us - step_due_time_us_);
+  if (lateness_us >= static_cast<int32_t>(interval_us_)) {
+    if (missed_step_count_ != UINT16_MAX) missed_step_count_ = missed_step_count_ + 1;
+    step_due_time_us_ = time_us; // The timer has slipped; time the following steps from now.
+  }
+  else if (lateness_us > kLateStepThreshold_us_) {
+    if (late_step_count_ != UINT16_MAX) late_step_count_ = late_step_count_ + 1;
+  }
+}
+#endif
+
+} // namespace mtspin
@@ -0,0 +1,178 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_engine.h
+/// @brief Class that generates stepper driver step pulses for all axes from a hardware timer interrupt.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "angle_trigger.h"
+#include "configuration.h"
+#include "hal.h"
+#include "instrumentation.h"
+#include "step_axis.h"
+#include "step_output.h"
+#include "step_trace.h"
+
+namespace mtspin {
+
+/// @brief The Step Engine class using the singleton pattern i.e., only a single instance can exist.
+/// A single step timer interrupt schedules the steps of all axes: each axis (see StepAxis) plans its own step
+/// intervals, and the timer is set to the time of the earliest step due on any axis. Steps due (within the shortest
+/// timer interval) on several axes are emitted together, so pulses interleave at each axis' own rate without a timer
+/// per axis, and pulse spacing does not depend on how long the control loop takes.
+class StepEngine {
+ public:
+
+  /// @brief Static method to get the single instance.
+  /// @return The Step Engine instance.
+  static StepEngine& GetInstance();
+
+  /// @brief Delete the copy constructor to prevent copying of the single instance.
+  StepEngine(const StepEngine&) = delete;
+
+  /// @brief Delete the assignment operator to prevent copying of the single instance.
+  StepEngine& operator=(const StepEngine&) = delete;
+
+  /// @brief Initialise the step engine (all axes) and start the step timer.
+  /// @param step_outputs The step/direction output configuration of each axis; with MTSPIN_STATIC_CONFIGURATION, the
+  /// outputs are fixed at compile time to Configuration::kStepOutputConfigurations_ instead.
+  /// @param ramp_intervals_us Acceleration ramp lookup table (in flash), shared by all axes (see StepAxis::Begin()).
+  /// @param ramps Acceleration ramps of the lookup table (in flash), shared by all axes (see StepAxis::Begin()).
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @param microstep_bands Microstep band lookup table (in flash), shared by all axes, with
+  /// Configuration::kSizeOfMicrostepBands_ entries (see StepAxis::MicrostepBand); each band is selected on the
+  /// Configuration::kMicrostepSelectPins_ of an axis as its Configuration::kMicrostepBandPinStates_.
+  void Begin(const StepOutputConfiguration (&step_outputs)[Configuration::kSizeOfAxes_],
+             const uint16_t* ramp_intervals_us,
+             const StepAxis::Ramp* ramps,
+             const StepAxis::MicrostepBand* microstep_bands); ///< This must be called only once.
+#else
+  void Begin(const StepOutputConfiguration (&step_outputs)[Configuration::kSizeOfAxes_],
+             const uint16_t* ramp_intervals_us,
+             const StepAxis::Ramp* ramps); ///< This must be called only once.
+#endif
+
+  /// @brief Get an axis, to publish motion commands to it.
+  /// @param axis The axis index (0 to Configuration::kSizeOfAxes_ - 1).
+  /// @return The axis.
+  StepAxis& axis(uint8_t axis);
+
+  /// @brief Get the angle trigger of an axis, to set its trigger angles; reaching a trigger angle pulses the axis'
+  /// Configuration::kTriggerPins_ right after the step pulse.
+  /// @param axis The axis index (0 to Configuration::kSizeOfAxes_ - 1).
+  /// @return The angle trigger.
+  AngleTrigger& angle_trigger(uint8_t axis);
+
+  /// @brief Set the trigger pin of an axis as an output, at its inactive state (once; later calls have no effect).
+  /// Until then the pin is left as it was at reset (an input), so an axis without trigger angles drives nothing on it.
+  /// @param axis The axis index (0 to Configuration::kSizeOfAxes_ - 1).
+  void BeginTriggerOutput(uint8_t axis);
+
+#if MTSPIN_STEP_TRACE
+  /// @brief Write the step/direction trace (see StepTrace), a line per call, then clear it.
+  /// @param output The output to print the line to.
+  /// @return True if the dump continues (call again for the next line), false if it is complete.
+  bool DumpStepTraceLine(Print& output);
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+  /// @brief Step timing counters.
+  struct StepTimingCounts {
+    uint16_t late_steps; ///< No. of steps emitted later than kLateStepThreshold_us_ after they were due.
+    uint16_t missed_steps; ///< No. of steps emitted a whole step interval (or more) after they were due.
+  };
+
+  /// @brief Get the step timing counters.
+  /// @return The step timing counters since startup (saturating).
+  StepTimingCounts step_timing_counts() const;
+
+  /// @brief Get the step timing counters since the last call (for periodic reports).
+  /// @return The step timing counters since the last call.
+  StepTimingCounts TakeStepTimingCounts();
+#endif
+
+ private:
+
+  /// @brief Private constructor so objects cannot be manually instantiated.
+  StepEngine();
+
+  /// @brief Private destructor so objects cannot be manually instantiated.
+  ~StepEngine();
+
+  /// @brief Step timer callback; forwards to the single instance.
+  /// @return The interval (us) to the next call.
+  static uint32_t OnStepTimer();
+
+  /// @brief Service the axes with a step due, emit their steps, and schedule the next call (interrupt context).
+  /// @return The interval (us) to the next call.
+  uint32_t ServiceSteps();
+
+  /// @brief Set the trigger outputs of a set of axes active, and end the trigger pulses that have lasted long enough
+  /// (interrupt context).
+  /// @param axes The axes that reached a trigger angle (bit n set for axis n).
+  void UpdateTriggers(uint8_t axes);
+
+#if MTSPIN_MICROSTEP_SWITCHING
+  /// @brief Select a microstep band on the stepper driver of an axis.
+  /// @param axis The axis.
+  /// @param band The microstep band.
+  void WriteMicrostepBand(uint8_t axis, uint8_t band);
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+  /// @brief Compare the time a step timer call was due with the time it happened (interrupt context).
+  void CheckStepTiming();
+#endif
+
+  inline static constexpr uint8_t kSizeOfAxes_ = Configuration::kSizeOfAxes_; ///< No. of axes.
+  /// @brief The trigger pin state while no trigger pulse is active.
+  inline static constexpr hal::PinState kTriggerInactivePinState_
+      = Configuration::kTriggerActivePinState_ == hal::PinState::kHigh ? hal::PinState::kLow : hal::PinState::kHigh;
+  /// @brief Time (us) within which a step due on an axis is emitted early, with the steps of the current call, rather
+  /// than scheduling a timer interval too short for the timer.
+  inline static constexpr int32_t kStepTolerance_us_ = hal::kMinStepTimerInterval_us;
+
+  static_assert(kSizeOfAxes_ > 0 && kSizeOfAxes_ <= 8, "The step engine supports 1-8 axes.");
+
+  // Hardware properties.
+#if MTSPIN_STATIC_CONFIGURATION
+  /// Step/direction outputs.
+  StaticStepOutputs<kSizeOfAxes_, Configuration::kStepOutputConfigurations_> step_outputs_;
+#else
+  /// Step/direction outputs.
+  DynamicStepOutputs<kSizeOfAxes_> step_outputs_;
+#endif
+
+  // Scheduling state (owned by the step timer interrupt).
+  StepAxis axes_[kSizeOfAxes_]; ///< The axes.
+  int32_t remaining_us_[kSizeOfAxes_] = {}; ///< Time (us) from the current step timer call to the next call of each axis.
+  uint32_t interval_us_ = StepAxis::kIdlePollInterval_us; ///< Interval (us) scheduled for the next step timer call.
+  AngleTrigger angle_triggers_[kSizeOfAxes_]; ///< The angle trigger of each axis.
+  uint8_t active_triggers_ = 0; ///< The axes with an active trigger output (bit n set for axis n).
+  int32_t trigger_remaining_us_[kSizeOfAxes_] = {}; ///< Time (us) left of the trigger pulse of each axis.
+  uint8_t trigger_outputs_ = 0; ///< The axes with their trigger pin set as an output (bit n set for axis n).
+#if MTSPIN_MICROSTEP_SWITCHING
+  uint8_t microstep_bands_[kSizeOfAxes_] = {}; ///< The microstep band selected on the stepper driver of each axis.
+#endif
+
+#if MTSPIN_STEP_TRACE
+  StepTrace step_trace_; ///< Trace of the steps emitted.
+#endif
+
+#if MTSPIN_INSTRUMENTATION
+  inline static constexpr int32_t kLateStepThreshold_us_ = 8; ///< Lateness (us) above which a step counts as late.
+
+  // Step timing (owned by the step timer interrupt, except the counters).
+  uint32_t step_due_time_us_ = 0; ///< Time (us) the current step timer call was due.
+  volatile uint16_t late_step_count_ = 0; ///< No. of late steps since startup.
+  volatile uint16_t missed_step_count_ = 0; ///< No. of missed steps since startup.
+  StepTimingCounts reported_step_timing_counts_ = {}; ///< Step timing counters already taken by TakeStepTimingCounts().
+#endif
+};
+
+} // namespace mtspin
@@ -0,0 +1,199 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_output.h
+/// @brief Classes that write the stepper driver step (PUL) and direction (DIR) outputs of all axes for the step engine.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+/// @brief Macro to specialise the step outputs at compile time (pins folded into direct port register writes).
+#ifndef MTSPIN_STATIC_CONFIGURATION
+#define MTSPIN_STATIC_CONFIGURATION 0
+#endif
+
+namespace mtspin {
+
+/// @brief Step/direction output configuration.
+struct StepOutputConfiguration {
+  uint8_t pul_pin; ///< Output pin for the stepper driver PUL/STP/CLK (pulse/step) interface.
+  uint8_t dir_pin; ///< Output pin for the stepper driver DIR/CW (direction) interface.
+  hal::PinState positive_direction_pin_state; ///< The DIR pin state for positive (Clockwise (CW)) motion.
+  uint16_t pul_delay_us; ///< Minimum delay (us) for the stepper driver PUL pin.
+  uint16_t dir_delay_us; ///< Minimum delay (us) for the stepper driver DIR pin.
+};
+
+/// @brief Get the DIR pin state for a direction.
+/// @param direction The direction (1 for positive, -1 for negative).
+/// @param positive_direction_pin_state The DIR pin state for positive motion.
+/// @return The DIR pin state.
+constexpr hal::PinState DirectionPinState(int8_t direction, hal::PinState positive_direction_pin_state) {
+  return (direction > 0) == (positive_direction_pin_state == hal::PinState::kHigh) ? hal::PinState::kHigh
+                                                                                    : hal::PinState::kLow;
+}
+
+/// @brief The Dynamic Step Outputs class template; the configurations are set at runtime, and the pins are written
+/// through the Arduino core.
+/// Axes are addressed by index; the steps due at the same time on several axes are emitted as a single pulse (see
+/// Pulse()), so the PUL/DIR delays are waited once per step timer interrupt rather than once per axis.
+/// @tparam kSize No. of axes (up to 8).
+template <uint8_t kSize>
+class DynamicStepOutputs {
+ public:
+
+  static_assert(kSize > 0 && kSize <= 8, "Step outputs support 1-8 axes.");
+
+  /// @brief Initialise the outputs (pulse low, direction positive).
+  /// @param configurations The output configuration of each axis.
+  void Begin(const StepOutputConfiguration (&configurations)[kSize]) {
+    for (uint8_t axis = 0; axis < kSize; axis++) {
+      configurations_[axis] = configurations[axis];
+      if (configurations_[axis].pul_delay_us > pul_delay_us_) pul_delay_us_ = configurations_[axis].pul_delay_us;
+      if (configurations_[axis].dir_delay_us > dir_delay_us_) dir_delay_us_ = configurations_[axis].dir_delay_us;
+      hal::WritePin(configurations_[axis].pul_pin, hal::PinState::kLow);
+      WriteDirection(axis, 1);
+    }
+
+    WaitForDirection();
+  }
+
+  /// @brief Set the direction of an axis; call WaitForDirection() before the next pulse.
+  /// @param axis The axis.
+  /// @param direction The direction (1 for positive, -1 for negative).
+  void WriteDirection(uint8_t axis, int8_t direction) {
+    const StepOutputConfiguration& configuration = configurations_[axis];
+    hal::WritePin(configuration.dir_pin, DirectionPinState(direction, configuration.positive_direction_pin_state));
+  }
+
+  /// @brief Wait for the (longest) DIR delay.
+  void WaitForDirection() {
+    hal::DelayUs(dir_delay_us_);
+  }
+
+  /// @brief Emit a step pulse on a set of axes.
+  /// @param axes The axes (bit n set for axis n).
+  void Pulse(uint8_t axes) {
+    WritePulses(axes, hal::PinState::kHigh);
+    hal::DelayUs(pul_delay_us_);
+    WritePulses(axes, hal::PinState::kLow);
+  }
+
+ private:
+
+  /// @brief Write the PUL pins of a set of axes.
+  /// @param axes The axes (bit n set for axis n).
+  /// @param state The pin state.
+  void WritePulses(uint8_t axes, hal::PinState state) {
+    for (uint8_t axis = 0; axis < kSize; axis++) {
+      if (axes & (1U << axis)) hal::WritePin(configurations_[axis].pul_pin, state);
+    }
+  }
+
+  StepOutputConfiguration configurations_[kSize] = {}; ///< The output configurations.
+  uint16_t pul_delay_us_ = 0; ///< The longest PUL delay (us).
+  uint16_t dir_delay_us_ = 0; ///< The longest DIR delay (us).
+};
+
+/// @brief The Static Step Outputs class template; the configurations are fixed at compile time, so each write folds
+/// into a direct port register write (see hal::OutputPin) and the delays into exact cycle counts.
+/// The per-axis writes are unrolled by recursion over axis tags (see Axis), ending at the tag of axis kSize.
+/// @tparam kSize No. of axes (up to 8).
+/// @tparam kConfigurations The output configuration of each axis.
+template <uint8_t kSize, const StepOutputConfiguration (&kConfigurations)[kSize]>
+class StaticStepOutputs {
+ public:
+
+  static_assert(kSize > 0 && kSize <= 8, "Step outputs support 1-8 axes.");
+
+  /// @brief Initialise the outputs (pulse low, direction positive).
+  /// @param configurations Unused; the configurations are kConfigurations.
+  void Begin(const StepOutputConfiguration (&/*configurations*/)[kSize]) {
+    WritePulses(Axis<0>(), 0xFF, hal::PinState::kLow);
+    for (uint8_t axis = 0; axis < kSize; axis++) WriteDirection(axis, 1);
+    WaitForDirection();
+  }
+
+  /// @brief Set the direction of an axis; call WaitForDirection() before the next pulse.
+  /// @param axis The axis.
+  /// @param direction The direction (1 for positive, -1 for negative).
+  void WriteDirection(uint8_t axis, int8_t direction) {
+    WriteDirection(Axis<0>(), axis, direction);
+  }
+
+  /// @brief Wait for the (longest) DIR delay.
+  void WaitForDirection() {
+    hal::DelayUs<LongestDelay(false, 0, 0)>();
+  }
+
+  /// @brief Emit a step pulse on a set of axes.
+  /// @param axes The axes (bit n set for axis n).
+  void Pulse(uint8_t axes) {
+    WritePulses(Axis<0>(), axes, hal::PinState::kHigh);
+    hal::DelayUs<LongestDelay(true, 0, 0)>();
+    WritePulses(Axis<0>(), axes, hal::PinState::kLow);
+  }
+
+ private:
+
+  /// @brief Tag of an axis, to select the write of that axis at compile time.
+  /// @tparam kAxis The axis (kSize past the last axis).
+  template <uint8_t kAxis>
+  struct Axis {};
+
+  /// @brief Set the direction of an axis, matching it from an axis on.
+  /// @param axis The axis.
+  /// @param direction The direction (1 for positive, -1 for negative).
+  /// @tparam kAxis The first axis to match.
+  template <uint8_t kAxis>
+  static void WriteDirection(Axis<kAxis>, uint8_t axis, int8_t direction) {
+    if (axis == kAxis) {
+      hal::OutputPin<kConfigurations[kAxis].dir_pin>::Write(
+          DirectionPinState(direction, kConfigurations[kAxis].positive_direction_pin_state));
+      return;
+    }
+
+    WriteDirection(Axis<kAxis + 1>(), axis, direction);
+  }
+
+  /// @brief End of the axes (no axis matched).
+  static void WriteDirection(Axis<kSize>, uint8_t /*axis*/, int8_t /*direction*/) {}
+
+  /// @brief Write the PUL pins of a set of axes, from an axis on.
+  /// @param axes The axes (bit n set for axis n).
+  /// @param state The pin state.
+  /// @tparam kAxis The first axis to write.
+  template <uint8_t kAxis>
+  static void WritePulses(Axis<kAxis>, uint8_t axes, hal::PinState state) {
+    if (axes & (1U << kAxis)) hal::OutputPin<kConfigurations[kAxis].pul_pin>::Write(state);
+    WritePulses(Axis<kAxis + 1>(), axes, state);
+  }
+
+  /// @brief End of the axes.
+  static void WritePulses(Axis<kSize>, uint8_t /*axes*/, hal::PinState /*state*/) {}
+
+  /// @brief Get the longest PUL or DIR delay of the axes from an axis on.
+  /// @param pul True for the PUL delay, false for the DIR delay.
+  /// @param axis The first axis.
+  /// @param delay_us The longest delay (us) of the axes before it.
+  /// @return The delay (us).
+  static constexpr uint16_t LongestDelay(bool pul, uint8_t axis, uint16_t delay_us) {
+    return axis == kSize
+           ? delay_us
+           : LongestDelay(pul, axis + 1, AxisDelay(pul, axis) > delay_us ? AxisDelay(pul, axis) : delay_us);
+  }
+
+  /// @brief Get the PUL or DIR delay of an axis.
+  /// @param pul True for the PUL delay, false for the DIR delay.
+  /// @param axis The axis.
+  /// @return The delay (us).
+  static constexpr uint16_t AxisDelay(bool pul, uint8_t axis) {
+    return pul ? kConfigurations[axis].pul_delay_us : kConfigurations[axis].dir_delay_us;
+  }
+};
+
+} // namespace mtspin
@@ -0,0 +1,116 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_trace.cpp
+/// @brief Class to record step and direction output edges in a RAM ring buffer (optional; for motion analysis).
+
+#include "step_trace.h"
+
+#if MTSPIN_STEP_TRACE
+
+#include <Arduino.h>
+
+#include "hal.h"
+
+namespace mtspin {
+
+StepTrace::StepTrace() {}
+
+StepTrace::~StepTrace() {}
+
+void StepTrace::Record(uint32_t time_us, uint8_t step_mask, uint8_t reversed_mask) {
+  directions_ ^= reversed_mask; // Kept up to date even while paused.
+  if (paused_) return;
+
+  uint32_t delta_us = started_ ? time_us - previous_time_us_ : 0;
+  if (delta_us > 0x7FFFFFFFUL) delta_us = 0x7FFFFFFFUL;
+  previous_time_us_ = time_us;
+  started_ = true;
+
+  while (kBufferSize_ - size_ < kMaxRecordSize_) DropOldestRecord();
+  uint32_t value = (delta_us << 1) | (reversed_mask != 0 ? 1U : 0U);
+  while (value >= 0x80) {
+    Write(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+
+  Write(static_cast<uint8_t>(value));
+  Write(step_mask);
+  if (reversed_mask != 0) Write(directions_);
+}
+
+bool StepTrace::DumpNextLine(Print& output, uint8_t size_of_axes) {
+  if (!paused_) {
+    paused_ = true; // The records are read in place.
+    dump_offset_ = 0;
+    output.print(F("Step trace: axes "));
+    output.print(size_of_axes);
+    output.print(F(", directions "));
+    output.print(tail_directions_);
+    output.print(F(", records dropped "));
+    output.print(dropped_count_);
+    output.print(F(", bytes "));
+    output.println(size_);
+    return true;
+  }
+
+  if (dump_offset_ < size_) {
+    // Print hexadecimal digits directly; print(value, HEX) drops leading zeros.
+    static const char kHexDigits[] = "0123456789ABCDEF";
+    uint16_t end_offset = size_ - dump_offset_ > kBytesPerLine_ ? dump_offset_ + kBytesPerLine_ : size_;
+    for (; dump_offset_ < end_offset; dump_offset_++) {
+      uint8_t value = Read(dump_offset_);
+      output.write(kHexDigits[value >> 4]);
+      output.write(kHexDigits[value & 0x0F]);
+    }
+
+    output.println();
+    return true;
+  }
+
+  output.println(F("Step trace end"));
+
+  tail_ = 0;
+  size_ = 0;
+  started_ = false;
+  dropped_count_ = 0;
+  {
+    hal::InterruptGuard guard; // Written by the interrupt, even while paused.
+    tail_directions_ = directions_;
+  }
+
+  paused_ = false;
+  return false;
+}
+
+void StepTrace::Write(uint8_t value) {
+  uint16_t head = tail_ + size_;
+  if (head >= kBufferSize_) head -= kBufferSize_;
+  buffer_[head] = value;
+  size_++;
+}
+
+uint8_t StepTrace::Read(uint16_t offset) const {
+  uint16_t index = tail_ + offset;
+  if (index >= kBufferSize_) index -= kBufferSize_;
+  return buffer_[index];
+}
+
+void StepTrace::DropOldestRecord() {
+  uint16_t length = 0;
+  while (Read(length++) & 0x80) {} // Varint time.
+  bool direction_changed = Read(0) & 0x01;
+  length++; // Step mask.
+  if (direction_changed) tail_directions_ = Read(length++);
+
+  tail_ += length;
+  if (tail_ >= kBufferSize_) tail_ -= kBufferSize_;
+  size_ -= length;
+  if (dropped_count_ != UINT16_MAX) dropped_count_++;
+}
+
+} // namespace mtspin
+
+#endif
@@ -0,0 +1,93 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_trace.h
+/// @brief Class to record step and direction output edges in a RAM ring buffer (optional; for motion analysis).
+
+#pragma once
+
+#include <Arduino.h>
+
+/// @brief Macro to compile in the step/direction trace (0 compiles it out completely).
+#ifndef MTSPIN_STEP_TRACE
+#define MTSPIN_STEP_TRACE 0
+#endif
+
+#if MTSPIN_STEP_TRACE
+
+namespace mtspin {
+
+/// @brief The Step Trace class.
+/// Records each step timer call that emits steps as a compact, delta-encoded binary record, overwriting the oldest
+/// records once the ring buffer is full, so the buffer always holds the most recent motion (e.g., leading up to a
+/// stall). Each record is:
+/// - The time (us) since the previous record, shifted left by one, with bit 0 set if the direction of any axis
+///   changed; as an unsigned LEB128 varint (7 bits per byte, least significant first, bit 7 set on all but the last
+///   byte). Times beyond 2^31 - 1 us saturate.
+/// - The axes stepped (bit n set for axis n).
+/// - Only if the direction of any axis changed; the directions of all axes (bit n set for axis n positive), which apply
+///   to the steps of the record.
+/// DumpNextLine() writes the records (see tools/step_trace_analyser.cpp) as hexadecimal text, so they can be captured
+/// from any serial monitor.
+class StepTrace {
+ public:
+
+  /// @brief Construct a Step Trace object.
+  StepTrace();
+
+  /// @brief Destroy the Step Trace object.
+  ~StepTrace();
+
+  /// @brief Record the steps emitted by a step timer call (interrupt context).
+  /// @param time_us The time (us) of the steps (taken after the direction setup time, like a logic analyser would see).
+  /// @param step_mask The axes stepped (bit n set for axis n).
+  /// @param reversed_mask The axes whose direction changed before the steps (bit n set for axis n).
+  void Record(uint32_t time_us, uint8_t step_mask, uint8_t reversed_mask);
+
+  /// @brief Write the recorded steps, a line per call (the header, the records, then the end), then clear them
+  /// (recording is paused from the first line to the last).
+  /// @param output The output to print the line to.
+  /// @param size_of_axes The no. of axes.
+  /// @return True if the dump continues (call again for the next line), false if it is complete.
+  bool DumpNextLine(Print& output, uint8_t size_of_axes);
+
+ private:
+
+#if defined(ARDUINO_ARCH_AVR)
+  inline static constexpr uint16_t kBufferSize_ = 256; ///< Ring buffer size (bytes); UNO R3 has 2 KB RAM.
+#else
+  inline static constexpr uint16_t kBufferSize_ = 4096; ///< Ring buffer size (bytes).
+#endif
+  inline static constexpr uint8_t kMaxRecordSize_ = 7; ///< Longest record (bytes): 5 byte varint, mask, directions.
+  inline static constexpr uint8_t kBytesPerLine_ = 32; ///< No. of bytes per line of the dump.
+
+  /// @brief Append a byte at the head of the ring buffer (interrupt context).
+  /// @param value The byte.
+  void Write(uint8_t value);
+
+  /// @brief Read the byte at an offset from the tail of the ring buffer.
+  /// @param offset The offset (bytes) from the tail.
+  /// @return The byte.
+  uint8_t Read(uint16_t offset) const;
+
+  /// @brief Discard the oldest record, to make space for a new one (interrupt context).
+  void DropOldestRecord();
+
+  // Ring buffer (owned by the step timer interrupt, except while paused).
+  uint8_t buffer_[kBufferSize_] = {}; ///< Recorded bytes.
+  uint16_t tail_ = 0; ///< Index of the oldest byte.
+  uint16_t size_ = 0; ///< No. of bytes recorded.
+  bool started_ = false; ///< Flag to keep track of whether the previous record time is valid.
+  uint32_t previous_time_us_ = 0; ///< Time (us) of the newest record.
+  uint8_t directions_ = 0xFF; ///< Directions after the newest record (all axes start positive).
+  uint8_t tail_directions_ = 0xFF; ///< Directions before the oldest record.
+  uint16_t dropped_count_ = 0; ///< No. of records overwritten since the last reset.
+  volatile bool paused_ = false; ///< Flag to pause recording while the trace is written out.
+  uint16_t dump_offset_ = 0; ///< Offset (bytes, from the tail) of the next record byte to write out.
+};
+
+} // namespace mtspin
+
+#endif
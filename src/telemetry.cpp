@@ -0,0 +1,98 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file telemetry.cpp
+/// @brief Class that streams periodic binary telemetry frames (state of each axis) over serial.
+
+#include "telemetry.h"
+
+#include <Arduino.h>
+
+#include "command_receiver.h"
+#include "configuration.h"
+#include "hal.h"
+
+namespace mtspin {
+
+Telemetry::Telemetry() {}
+
+Telemetry::~Telemetry() {}
+
+void Telemetry::Toggle() {
+  enabled_ = !enabled_;
+  next_frame_time_ms_ = hal::Millis();
+  next_axis_ = 0;
+  frame_pending_ = false;
+}
+
+bool Telemetry::enabled() const {
+  return enabled_;
+}
+
+bool Telemetry::TakeFrameToSend(uint32_t time_ms, uint8_t& axis) {
+  if (!enabled_) return false;
+
+  if (static_cast<int32_t>(time_ms - next_frame_time_ms_) >= 0) {
+    if (frame_pending_) {
+      // The previous frame never found space; drop it (the receiver sees the gap in the sequence no.).
+      sequence_++;
+      if (dropped_count_ != UINT16_MAX) dropped_count_++;
+    }
+
+    frame_pending_ = true;
+    pending_axis_ = next_axis_;
+    next_axis_ = next_axis_ == Configuration::kSizeOfAxes_ - 1 ? 0 : next_axis_ + 1;
+
+    // Frames are scheduled from when they were due (not from now), so the rate does not drift with the loop time;
+    // after a long delay (e.g., a blocking report), the schedule restarts from now, rather than sending a burst.
+    next_frame_time_ms_ += kFrameInterval_ms_;
+    if (static_cast<int32_t>(time_ms - next_frame_time_ms_) >= 0) next_frame_time_ms_ = time_ms + kFrameInterval_ms_;
+  }
+
+  if (!frame_pending_ || hal::SerialAvailableForWrite() < kFrameSize_) return false;
+  axis = pending_axis_;
+  return true;
+}
+
+void Telemetry::Send(const Sample& sample) {
+  uint8_t frame[kFrameSize_];
+  uint8_t length = 0;
+  Append(frame, length, CommandReceiver::kStartByte, 1);
+  Append(frame, length, sequence_++, 1);
+  Append(frame, length, kFrameType, 1);
+  Append(frame, length, kPayloadSize_, 1);
+  Append(frame, length, sample.time_ms, 4);
+  Append(frame, length, sample.axis, 1);
+  Append(frame, length, static_cast<uint8_t>(sample.control_mode), 1);
+  Append(frame, length, static_cast<uint8_t>(sample.direction), 1);
+  Append(frame, length, static_cast<uint8_t>(sample.motion_status), 1);
+  Append(frame, length, sample.flags, 1);
+  Append(frame, length, static_cast<uint32_t>(sample.position), 4);
+  Append(frame, length, static_cast<uint32_t>(sample.velocity_centi_RPM), 4);
+  Append(frame, length, static_cast<uint32_t>(sample.speed_centi_RPM), 4);
+  Append(frame, length, sample.log_messages_dropped, 2);
+  Append(frame, length, sample.late_steps, 2);
+  Append(frame, length, sample.missed_steps, 2);
+  Append(frame, length, dropped_count_, 2);
+
+  uint8_t crc = 0;
+  for (uint8_t i = 1; i < length; i++) crc = CommandReceiver::UpdateCrc(crc, frame[i]);
+  Append(frame, length, crc, 1);
+  hal::SerialWrite(frame, length);
+  frame_pending_ = false;
+}
+
+bool Telemetry::IsFramePending() const {
+  return frame_pending_;
+}
+
+void Telemetry::Append(uint8_t* frame, uint8_t& length, uint32_t value, uint8_t size) {
+  for (uint8_t i = 0; i < size; i++) {
+    frame[length++] = static_cast<uint8_t>(value);
+    value >>= 8;
+  }
+}
+
+} // namespace mtspin
@@ -0,0 +1,109 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file telemetry.h
+/// @brief Class that streams periodic binary telemetry frames (state of each axis) over serial.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "configuration.h"
+#include "step_axis.h"
+
+namespace mtspin {
+
+/// @brief The Telemetry class.
+/// While enabled, a fixed-size frame with the state of one axis is sent every kFrameInterval_ms_, cycling through the
+/// axes, so each axis is reported every Configuration::kTelemetryPeriod_ms_. Frames have the same form as command
+/// acknowledgements (see CommandReceiver), of type kFrameType:
+///
+///   [0x7E][sequence][0x40][29][payload (29 bytes)][CRC-8 of sequence..payload]
+///
+/// The sequence no. counts every frame due, including frames dropped, so a receiver can detect gaps. A frame is only
+/// written once the serial transmit buffer can take all of it at once, so telemetry never blocks the control loop; it
+/// waits (and log messages are held back meanwhile, see IsFramePending()) until then, or is dropped (and counted) if it
+/// is still waiting when the next frame is due.
+class Telemetry {
+ public:
+
+  /// @brief State of an axis, as sent in a frame (the frame payload, in order; little-endian).
+  struct Sample {
+    uint32_t time_ms; ///< Time (ms) since startup.
+    uint8_t axis; ///< The axis.
+    Configuration::ControlMode control_mode; ///< The control mode.
+    int8_t direction; ///< The motion direction set (1 for CW, -1 for CCW).
+    StepAxis::MotionStatus motion_status; ///< The motion status.
+    uint8_t flags; ///< Bit 0: stepper driver enabled; bit 1: motion start pending (stepper driver starting up).
+    int32_t position; ///< The position (microsteps, relative to the startup position).
+    int32_t velocity_centi_RPM; ///< The current velocity (hundredths of an RPM; negative for CCW).
+    int32_t speed_centi_RPM; ///< The speed set (hundredths of an RPM; 0 if holding at rest).
+    uint16_t log_messages_dropped; ///< No. of log messages dropped since startup.
+    uint16_t late_steps; ///< No. of late steps since startup (0 without MTSPIN_INSTRUMENTATION).
+    uint16_t missed_steps; ///< No. of missed steps since startup (0 without MTSPIN_INSTRUMENTATION).
+    // The frame ends with the no. of telemetry frames dropped since startup (uint16_t), added by Send().
+  };
+
+  inline static constexpr uint8_t kFlagDriverEnabled = 0x01; ///< Sample flag: stepper driver enabled.
+  inline static constexpr uint8_t kFlagMotionStartPending = 0x02; ///< Sample flag: motion start pending.
+  inline static constexpr uint8_t kFrameType = 0x40; ///< Telemetry frame type.
+
+  /// @brief Construct a Telemetry object.
+  Telemetry();
+
+  /// @brief Destroy the Telemetry object.
+  ~Telemetry();
+
+  /// @brief Enable/disable telemetry; the first frame is due at once.
+  void Toggle();
+
+  /// @brief Check if telemetry is enabled.
+  /// @return True if enabled.
+  bool enabled() const;
+
+  /// @brief Check if a frame is ready to send: due, and the serial transmit buffer has space for all of it.
+  /// @param time_ms The current time (ms).
+  /// @param axis The axis to report.
+  /// @return True if a frame is ready to send (see Send()).
+  bool TakeFrameToSend(uint32_t time_ms, uint8_t& axis);
+
+  /// @brief Send the frame ready to send (see TakeFrameToSend()).
+  /// @param sample The state of the axis, sampled now.
+  void Send(const Sample& sample);
+
+  /// @brief Check if a frame is due, but waiting for space in the serial transmit buffer.
+  /// @return True if a frame is waiting.
+  bool IsFramePending() const;
+
+ private:
+
+  inline static constexpr uint8_t kPayloadSize_ = 29; ///< Frame payload size (bytes).
+  inline static constexpr uint8_t kFrameSize_ = kPayloadSize_ + 5; ///< Frame size (bytes), including the framing.
+  inline static constexpr uint16_t kFrameInterval_ms_ = Configuration::kTelemetryPeriod_ms_
+                                                        / Configuration::kSizeOfAxes_; ///< Time (ms) between frames.
+  /// @brief Bytes per second the serial port can send (start, 8 data and stop bits per byte).
+  inline static constexpr uint32_t kSerialBytesPerSecond_ = MTSPIN_BAUD_RATE / 10;
+
+  static_assert(kFrameInterval_ms_ > 0, "The telemetry period must be at least 1 ms per axis.");
+  static_assert(1000UL * kFrameSize_ / kFrameInterval_ms_ <= kSerialBytesPerSecond_ / 2,
+                "Telemetry must take no more than half the serial bandwidth; increase the telemetry period.");
+
+  /// @brief Append a little-endian value to a frame.
+  /// @param frame The frame.
+  /// @param length The length of the frame so far; updated.
+  /// @param value The value.
+  /// @param size The size of the value (bytes).
+  static void Append(uint8_t* frame, uint8_t& length, uint32_t value, uint8_t size);
+
+  bool enabled_ = false; ///< Flag to keep track of whether telemetry is enabled.
+  uint32_t next_frame_time_ms_ = 0; ///< Time (ms) the next frame is due.
+  uint8_t next_axis_ = 0; ///< The axis of the next frame.
+  bool frame_pending_ = false; ///< Flag to keep track of whether a frame is due but not yet sent.
+  uint8_t pending_axis_ = 0; ///< The axis of the frame due.
+  uint8_t sequence_ = 0; ///< Sequence no. of the next frame.
+  uint16_t dropped_count_ = 0; ///< No. of frames dropped since startup.
+};
+
+} // namespace mtspin
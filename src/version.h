@@ -5,17 +5,33 @@
 
 /// @file version.h
 /// @brief Variables to define the firmware name and version.
+/// The name and version are macros (string and integer literals), so the version text is assembled by the
+/// preprocessor (see MTSPIN_VERSION_TEXT), as a literal that can be kept in flash.
 
 #pragma once
 
 #include <Arduino.h>
 
+#define MTSPIN_NAME "mtspin-mcu-firmware" ///< Firmware name.
+#define MTSPIN_VERSION_MAJOR 3 ///< Major version.
+#define MTSPIN_VERSION_MINOR 0 ///< Minor version.
+#define MTSPIN_VERSION_PATCH 0 ///< Patch version.
+#define MTSPIN_VERSION_SUFFIX "" ///< Version suffix (e.g., "rc.1"), or empty.
+
+/// @brief Macros to turn an integer literal macro into a string literal.
+#define MTSPIN_STRINGIFY_LITERAL(literal) #literal
+#define MTSPIN_STRINGIFY(macro) MTSPIN_STRINGIFY_LITERAL(macro)
+
+/// @brief Firmware name and version text without the suffix (e.g., "mtspin-mcu-firmware-3.0.0").
+#define MTSPIN_VERSION_TEXT MTSPIN_NAME "-" MTSPIN_STRINGIFY(MTSPIN_VERSION_MAJOR) "." \
+    MTSPIN_STRINGIFY(MTSPIN_VERSION_MINOR) "." MTSPIN_STRINGIFY(MTSPIN_VERSION_PATCH)
+
 namespace mtspin {
 
-inline constexpr char* kName = "mtspin-mcu-firmware";
-inline constexpr uint16_t kMajor = 3;
-inline constexpr uint16_t kMinor = 0;
-inline constexpr uint16_t kPatch = 0;
-inline constexpr char* kSuffix = "";
+inline constexpr const char* kName = MTSPIN_NAME;
+inline constexpr uint16_t kMajor = MTSPIN_VERSION_MAJOR;
+inline constexpr uint16_t kMinor = MTSPIN_VERSION_MINOR;
+inline constexpr uint16_t kPatch = MTSPIN_VERSION_PATCH;
+inline constexpr const char* kSuffix = MTSPIN_VERSION_SUFFIX;
 
-} // namespace mtspin
\ No newline at end of file
+} // namespace mtspin
@@ -0,0 +1,167 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file button_scanner_test.cpp
+/// @brief Test of the button scanner, through the input scan task: for each button, presses just below and above the
+/// debounce, short press and long press periods are told apart as configured (the scan period does not stretch the
+/// debounce tick); buttons pressed together are timed independently; and a long press is detected while holding.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::SchedulePress;
+using mtspin::host::Simulator;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kScanPeriod_ms = 5; ///< Period (ms) of the input scan task.
+constexpr uint64_t kSettlePeriod_ms = 300; ///< Time (ms) to wait after a release, for the press to be reported.
+
+/// @brief Button under test.
+struct Button {
+  const char* name; ///< The button name.
+  uint8_t pin; ///< The button pin.
+  const char* short_press_text; ///< Log message of a short press.
+  const char* long_press_text; ///< Log message of a long press.
+};
+
+/// @brief Press buttons together (each for its own period), and get the log messages written by the time the presses
+/// have been reported.
+/// @param pins The button pins.
+/// @param periods_ms The time (ms) each button is held.
+/// @return The log text.
+std::string PressButtons(const std::vector<uint8_t>& pins, const std::vector<uint64_t>& periods_ms) {
+  Simulator& simulator = Simulator::GetInstance();
+  size_t output_start = simulator.serial_output().size();
+  uint64_t longest_period_ms = 0;
+  for (size_t index = 0; index < pins.size(); index++) {
+    SchedulePress(pins[index], simulator.time_us() + 1000, periods_ms[index]);
+    if (periods_ms[index] > longest_period_ms) longest_period_ms = periods_ms[index];
+  }
+
+  simulator.Run((longest_period_ms + kSettlePeriod_ms) * 1000);
+  return mtspin::host::LogText(output_start);
+}
+
+/// @brief Count the occurrences of a text in another.
+/// @param text The text.
+/// @param part The text to count.
+/// @return The no. of occurrences.
+size_t Count(const std::string& text, const char* part) {
+  size_t count = 0;
+  for (size_t index = text.find(part); index != std::string::npos; index = text.find(part, index + 1)) count++;
+  return count;
+}
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  const Configuration& configuration = Configuration::GetInstance();
+  simulator.Setup();
+  simulator.Run(configuration.kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(mtspin::host::SendCommand(0, kAction, {'r'}) == kStatusOk); // Log the presses.
+
+  // Presses are sampled a quarter of the debounce period apart, so a press is only registered once 4 samples agree:
+  // always within the debounce period plus a scan period, and never within 3 quarters of it less a scan period. Press
+  // durations are measured to within a sample (plus the scan period), so the short and long press periods are checked
+  // 2 samples either side.
+  const uint64_t tick_ms = configuration.kDebouncePeriod_ms_ / 4;
+  const uint64_t margin_ms = 2 * tick_ms;
+  const uint64_t debounce_below_ms = 3 * tick_ms - 2 * kScanPeriod_ms;
+  const uint64_t debounce_above_ms = configuration.kDebouncePeriod_ms_ + kScanPeriod_ms;
+  const uint64_t short_below_ms = configuration.kShortPressPeriod_ms_ - margin_ms;
+  const uint64_t short_above_ms = configuration.kShortPressPeriod_ms_ + margin_ms;
+  const uint64_t long_below_ms = configuration.kLongPressPeriod_ms_ - margin_ms;
+  const uint64_t long_above_ms = configuration.kLongPressPeriod_ms_ + margin_ms;
+  const Button buttons[] = {
+    {"direction", configuration.kDirectionButtonPin_, "Direction button short press",
+     "Direction or angle button long press"},
+    {"angle", configuration.kAngleButtonPin_, "Angle button short press", "Direction or angle button long press"},
+    {"speed", configuration.kSpeedButtonPin_, "Speed button short press", "Speed button long press"},
+  };
+
+  for (const Button& button : buttons) {
+    // Debounce: a press just shorter is ignored, and one just longer is a short press.
+    std::string debounce_below = PressButtons({button.pin}, {debounce_below_ms});
+    std::string debounce_above = PressButtons({button.pin}, {debounce_above_ms});
+    bool debounce = Count(debounce_below, button.short_press_text) == 0
+                    && Count(debounce_below, button.long_press_text) == 0
+                    && Count(debounce_above, button.short_press_text) == 1;
+
+    // Short press: released just before the short press period is a short press; just after, no press at all (short
+    // of the long press period).
+    std::string short_below = PressButtons({button.pin}, {short_below_ms});
+    std::string short_above = PressButtons({button.pin}, {short_above_ms});
+    bool short_press = Count(short_below, button.short_press_text) == 1
+                       && Count(short_above, button.short_press_text) == 0
+                       && Count(short_above, button.long_press_text) == 0;
+
+    // Long press: held just short of the long press period is no press; just over, a long press.
+    std::string long_below = PressButtons({button.pin}, {long_below_ms});
+    std::string long_above = PressButtons({button.pin}, {long_above_ms});
+    bool long_press = Count(long_below, button.short_press_text) == 0 && Count(long_below, button.long_press_text) == 0
+                      && Count(long_above, button.long_press_text) == 1
+                      && Count(long_above, button.short_press_text) == 0;
+
+    MTSPIN_CHECK(debounce);
+    MTSPIN_CHECK(short_press);
+    MTSPIN_CHECK(long_press);
+    printf("%s button: debounce %s, short press %s, long press %s\n", button.name, debounce ? "ok" : "failed",
+           short_press ? "ok" : "failed", long_press ? "ok" : "failed");
+  }
+
+  // Simultaneous presses: all buttons pressed together are each reported, and buttons released at different times are
+  // each timed from their own press (the direction button a short press, the angle button no press, and the speed
+  // button a long press).
+  std::vector<uint8_t> pins = {buttons[0].pin, buttons[1].pin, buttons[2].pin};
+  std::string together_short = PressButtons(pins, {debounce_above_ms, debounce_above_ms, debounce_above_ms});
+  std::string together_long = PressButtons(pins, {long_above_ms, long_above_ms, long_above_ms});
+  std::string together_mixed = PressButtons(pins, {debounce_above_ms, short_above_ms, long_above_ms});
+  bool together = Count(together_short, buttons[0].short_press_text) == 1
+                  && Count(together_short, buttons[1].short_press_text) == 1
+                  && Count(together_short, buttons[2].short_press_text) == 1
+                  && Count(together_long, buttons[0].long_press_text) == 2 // Shared by the direction and angle buttons.
+                  && Count(together_long, buttons[2].long_press_text) == 1
+                  && Count(together_mixed, buttons[0].short_press_text) == 1
+                  && Count(together_mixed, buttons[1].short_press_text) == 0
+                  && Count(together_mixed, buttons[1].long_press_text) == 0
+                  && Count(together_mixed, buttons[2].long_press_text) == 1
+                  && Count(together_mixed, buttons[2].short_press_text) == 0;
+  MTSPIN_CHECK(together);
+
+  // Detect while holding (the configured long press option): the long press is reported once the long press period
+  // has passed (registered within the debounce latency, plus a scan period), while the button is still held.
+  MTSPIN_CHECK(configuration.kLongPressOption_ == mt::MomentaryButton::LongPressOption::kDetectWhileHolding);
+  const uint64_t hold_period_ms = 2 * configuration.kLongPressPeriod_ms_;
+  size_t output_start = simulator.serial_output().size();
+  uint64_t press_time_us = simulator.time_us() + 1000;
+  SchedulePress(buttons[2].pin, press_time_us, hold_period_ms);
+  simulator.RunUntil([&]() { return Count(mtspin::host::LogText(output_start), buttons[2].long_press_text) > 0; },
+                     hold_period_ms * 1000);
+  double long_press_delay_ms = (simulator.time_us() - press_time_us) / 1e3;
+  MTSPIN_CHECK(Count(mtspin::host::LogText(output_start), buttons[2].long_press_text) == 1);
+  MTSPIN_CHECK(long_press_delay_ms < hold_period_ms); // Still held.
+  MTSPIN_CHECK(long_press_delay_ms >= configuration.kLongPressPeriod_ms_ - margin_ms);
+  MTSPIN_CHECK(long_press_delay_ms < configuration.kLongPressPeriod_ms_ + margin_ms + 4 * tick_ms + kScanPeriod_ms);
+  simulator.Run((hold_period_ms + kSettlePeriod_ms) * 1000);
+  MTSPIN_CHECK(Count(mtspin::host::LogText(output_start), buttons[2].long_press_text) == 1); // Not again on release.
+
+  printf("Press periods (ms, below/above): debounce %llu/%llu, short press %llu/%llu, long press %llu/%llu; buttons "
+         "pressed together %s; long press while holding after %.1f ms\n",
+         static_cast<unsigned long long>(debounce_below_ms), static_cast<unsigned long long>(debounce_above_ms),
+         static_cast<unsigned long long>(short_below_ms), static_cast<unsigned long long>(short_above_ms),
+         static_cast<unsigned long long>(long_below_ms), static_cast<unsigned long long>(long_above_ms),
+         together ? "ok" : "failed", long_press_delay_ms);
+  return mtspin::host::TestResult();
+}
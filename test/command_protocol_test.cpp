@@ -0,0 +1,106 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file command_protocol_test.cpp
+/// @brief Test and benchmark of the framed serial command protocol: acknowledgement status, speed limits, the latency
+/// from a command to motion, and the throughput of a batch of commands sent back to back.
+
+#include <cstdio>
+
+#include "configuration.h"
+#include "ramp_table.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::MakeFrame;
+using mtspin::host::Q16Bytes;
+using mtspin::host::QueueSegment;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetSpeed = 0x02; ///< Frame type of an explicit speed.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint8_t kStatusInvalidCrc = 1; ///< Acknowledgement status: invalid CRC.
+constexpr uint8_t kStatusInvalidType = 2; ///< Acknowledgement status: invalid type.
+constexpr uint8_t kStatusInvalidLength = 3; ///< Acknowledgement status: invalid length.
+constexpr uint8_t kStatusInvalidCommand = 4; ///< Acknowledgement status: invalid command.
+
+constexpr uint16_t kBatchSize = 200; ///< No. of commands in the throughput batch.
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Malformed frames.
+  std::vector<uint8_t> frame = MakeFrame(1, kAction, {'l'});
+  frame.back() ^= 0x01;
+  size_t start_index = simulator.serial_output().size();
+  simulator.SendSerial(frame);
+  simulator.Run(20000);
+  std::vector<mtspin::host::Frame> frames = mtspin::host::FindFrames(start_index);
+  MTSPIN_CHECK(frames.size() == 1 && frames[0].payload.size() == 1 && frames[0].payload[0] == kStatusInvalidCrc);
+  MTSPIN_CHECK(SendCommand(2, 0x30, {}) == kStatusInvalidType);
+  MTSPIN_CHECK(SendCommand(3, kSetSpeed, {0x00, 0x00, 0x0A}) == kStatusInvalidLength);
+
+  // Command to motion latency: from the end of the frame that starts motion to the first step pulse.
+  uint64_t frame_end_ns = simulator.time_ns() + 6 * 10000000000ULL / MTSPIN_BAUD_RATE;
+  MTSPIN_CHECK(SendCommand(4, kAction, {'m'}) == kStatusOk);
+  simulator.RunUntil([&]() { return !step_recorder.steps(0).empty(); }, 100000);
+  MTSPIN_CHECK(!step_recorder.steps(0).empty());
+  double latency_ms = step_recorder.steps(0).empty() ? 0.0 : (step_recorder.steps(0)[0].time_ns - frame_end_ns) / 1e6;
+  MTSPIN_CHECK(latency_ms < 5.0); // Within a period of the serial parse (2 ms) and motion service (1 ms) tasks.
+
+  // Speeds are limited to the fastest speed the acceleration ramp reaches.
+  const double max_speed_RPM = mtspin::MaxSpeedRpm();
+  MTSPIN_CHECK(SendCommand(5, kSetSpeed, Q16Bytes(max_speed_RPM)) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(6, kSetSpeed, Q16Bytes(max_speed_RPM + 1.0 / 65536.0)) == kStatusInvalidCommand);
+  MTSPIN_CHECK(SendCommand(7, kSetSpeed, Q16Bytes(1000.0)) == kStatusInvalidCommand);
+  MTSPIN_CHECK(SendCommand(8, kSetVelocity, Q16Bytes(-max_speed_RPM)) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(9, kSetVelocity, Q16Bytes(-max_speed_RPM - 0.5)) == kStatusInvalidCommand);
+  MTSPIN_CHECK(SendCommand(10, kSetVelocity, Q16Bytes(max_speed_RPM + 0.5)) == kStatusInvalidCommand);
+  MTSPIN_CHECK(SendCommand(11, kSetVelocity, mtspin::host::Int32Bytes(INT32_MIN)) == kStatusInvalidCommand);
+  MTSPIN_CHECK(QueueSegment(12, 90.0, max_speed_RPM + 0.5) == kStatusInvalidCommand);
+  MTSPIN_CHECK(QueueSegment(13, 90.0, max_speed_RPM) == kStatusOk);
+
+  // Throughput: a batch of commands sent back to back is processed (and acknowledged) at the rate it arrives.
+  std::vector<uint8_t> batch;
+  for (uint16_t index = 0; index < kBatchSize; index++) {
+    std::vector<uint8_t> command = MakeFrame(static_cast<uint8_t>(index), kSetSpeed, Q16Bytes(5.0 + index % 50));
+    batch.insert(batch.end(), command.begin(), command.end());
+  }
+
+  start_index = simulator.serial_output().size();
+  uint64_t batch_start_ns = simulator.time_ns();
+  simulator.SendSerial(batch);
+  simulator.RunUntil([&]() { return mtspin::host::FindFrames(start_index).size() >= kBatchSize; }, 2000000);
+  double batch_time_s = (simulator.time_ns() - batch_start_ns) / 1e9;
+  frames = mtspin::host::FindFrames(start_index);
+  uint16_t ok_count = 0;
+  for (uint16_t index = 0; index < frames.size(); index++) {
+    if (frames[index].sequence == static_cast<uint8_t>(index) && frames[index].payload[0] == kStatusOk) ok_count++;
+  }
+
+  MTSPIN_CHECK(ok_count == kBatchSize);
+  MTSPIN_CHECK(simulator.serial_overrun_count() == 0);
+  double commands_per_s = kBatchSize / batch_time_s;
+  double link_commands_per_s = MTSPIN_BAUD_RATE / 10.0 / batch.size() * kBatchSize;
+  MTSPIN_CHECK(commands_per_s > 0.95 * link_commands_per_s);
+
+  printf("Command to first step pulse: %.3f ms\n", latency_ms);
+  printf("Batch of %u commands: %.0f commands/s (link limit %.0f commands/s at %lu baud)\n", kBatchSize,
+         commands_per_s, link_commands_per_s, static_cast<unsigned long>(MTSPIN_BAUD_RATE));
+  return mtspin::host::TestResult();
+}
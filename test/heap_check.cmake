@@ -0,0 +1,28 @@
+# Copyright (C) 2024 Morgritech
+#
+# Licensed under GNU General Public License v3.0 (GPLv3) License.
+# See the LICENSE file in the project root for full license details.
+
+# Check that the firmware objects reference no dynamic allocation (as tools/memory_budget.py does for the target
+# build). Run with cmake -DNM=<nm> -DOBJECTS=<object>;... -P heap_check.cmake.
+
+set(heap_references)
+foreach(object IN LISTS OBJECTS)
+  execute_process(COMMAND ${NM} -C -u ${object} OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${object}")
+  endif()
+  string(REGEX MATCHALL " U (malloc|calloc|realloc|free|operator new|operator delete|String::)[^\n]*" matches
+         "${symbols}")
+  foreach(match IN LISTS matches)
+    get_filename_component(object_name ${object} NAME)
+    list(APPEND heap_references "${object_name}: ${match}")
+  endforeach()
+endforeach()
+
+list(LENGTH OBJECTS size_of_objects)
+if(heap_references)
+  list(JOIN heap_references "\n  " heap_report)
+  message(FATAL_ERROR "Heap referenced by the firmware:\n  ${heap_report}")
+endif()
+message(STATUS "No heap references in ${size_of_objects} firmware objects")
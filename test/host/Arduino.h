@@ -0,0 +1,192 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file Arduino.h
+/// @brief Host (Linux) stand-in for the Arduino AVR core, as used by the firmware; backed by the Simulator.
+/// The firmware is built as for the UNO R3 (ATmega328P at 16 MHz), so the AVR paths of the HAL (Timer1, port input
+/// registers, pin change interrupts, idle sleep) run against simulated registers.
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#define ARDUINO 10819
+#define ARDUINO_ARCH_AVR 1
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+
+#define NOT_A_PORT 0
+
+#define _BV(bit) (1U << (bit))
+
+/// @brief Opaque type of a string in flash (see F()).
+class __FlashStringHelper;
+
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(PSTR(string_literal)))
+
+/// @brief The Print class; text and byte output, as in the Arduino core (which, like this, declares no virtual
+/// destructor, so output classes derived from it reference no operator delete).
+class Print {
+ public:
+
+  /// @brief Write a byte.
+  /// @param byte The byte.
+  /// @return The no. of bytes written.
+  virtual size_t write(uint8_t byte) = 0;
+
+  /// @brief Write bytes.
+  /// @param buffer The bytes.
+  /// @param size The no. of bytes.
+  /// @return The no. of bytes written.
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+  /// @brief Get the no. of bytes that can be written without blocking.
+  /// @return The no. of bytes.
+  virtual int availableForWrite() { return 0; }
+
+  /// @brief Block until all bytes written have been sent.
+  virtual void flush() {}
+
+  size_t write(const char* text) {
+    return text == nullptr ? 0 : write(reinterpret_cast<const uint8_t*>(text), strlen(text));
+  }
+  size_t print(const __FlashStringHelper* text);
+  size_t print(const char* text);
+  size_t print(char character);
+  size_t print(unsigned char value, int base = DEC);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t println(const __FlashStringHelper* text);
+  size_t println(const char* text);
+  size_t println(char character);
+  size_t println(unsigned char value, int base = DEC);
+  size_t println(int value, int base = DEC);
+  size_t println(unsigned int value, int base = DEC);
+  size_t println(long value, int base = DEC);
+  size_t println(unsigned long value, int base = DEC);
+  size_t println();
+
+ private:
+
+  /// @brief Print an unsigned number.
+  /// @param value The number.
+  /// @param base The base (2-36).
+  /// @return The no. of bytes written.
+  size_t PrintNumber(unsigned long value, int base);
+};
+
+/// @brief The Stream class; byte input, as in the Arduino core.
+class Stream : public Print {
+ public:
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+/// @brief The Hardware Serial class; the UART, modelled by the Simulator (baud rate, 64 byte buffers).
+class HardwareSerial : public Stream {
+ public:
+
+  void begin(unsigned long baud_rate);
+  void end() {}
+  int available() override;
+  int read() override;
+  int peek() override;
+  int availableForWrite() override;
+  void flush() override;
+  size_t write(uint8_t byte) override;
+  using Print::write;
+  explicit operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// Digital I/O.
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+// Time.
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long period_ms);
+void delayMicroseconds(unsigned int period_us);
+
+/// @brief Busy wait for a no. of CPU cycles (an AVR compiler built-in).
+/// @param cycles The no. of cycles.
+void __builtin_avr_delay_cycles(unsigned long cycles);
+
+// AVR registers (ATmega328P); the status register and the Timer1 counter are modelled by the Simulator.
+
+/// @brief The Status Register class; holds the global interrupt enable bit (bit 7), as SREG does.
+class StatusRegister {
+ public:
+
+  operator uint8_t() const;
+  StatusRegister& operator=(uint8_t value);
+};
+
+/// @brief The Timer Counter class; TCNT1, which counts with the simulated clock.
+class TimerCounter {
+ public:
+
+  operator uint16_t() const;
+  TimerCounter& operator=(uint16_t value);
+};
+
+extern StatusRegister SREG;
+extern TimerCounter TCNT1;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+
+// Pin to port mapping (UNO R3: D0-D7 are port D, D8-D13 port B, D14-D19 (A0-A5) port C).
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t* portInputRegister(uint8_t port);
+volatile uint8_t* digitalPinToPCMSK(uint8_t pin);
+uint8_t digitalPinToPCMSKbit(uint8_t pin);
+volatile uint8_t* digitalPinToPCICR(uint8_t pin);
+uint8_t digitalPinToPCICRbit(uint8_t pin);
+
+// Sketch entry points (src.ino).
+
+void setup();
+void loop();
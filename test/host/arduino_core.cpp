@@ -0,0 +1,270 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file arduino_core.cpp
+/// @brief Host (Linux) stand-in for the Arduino AVR core, as used by the firmware; backed by the Simulator.
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+
+#include "simulator.h"
+
+using mtspin::host::Simulator;
+
+// Print.
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t count = 0;
+  while (size-- > 0) count += write(*buffer++);
+  return count;
+}
+
+size_t Print::print(const __FlashStringHelper* text) {
+  return write(reinterpret_cast<const char*>(text));
+}
+
+size_t Print::print(const char* text) {
+  return write(text);
+}
+
+size_t Print::print(char character) {
+  return write(static_cast<uint8_t>(character));
+}
+
+size_t Print::print(unsigned char value, int base) {
+  return PrintNumber(value, base);
+}
+
+size_t Print::print(int value, int base) {
+  return print(static_cast<long>(value), base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return PrintNumber(value, base);
+}
+
+size_t Print::print(long value, int base) {
+  if (base == DEC && value < 0) return print('-') + PrintNumber(0UL - static_cast<unsigned long>(value), base);
+  return PrintNumber(static_cast<unsigned long>(value), base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return PrintNumber(value, base);
+}
+
+size_t Print::println(const __FlashStringHelper* text) {
+  return print(text) + println();
+}
+
+size_t Print::println(const char* text) {
+  return print(text) + println();
+}
+
+size_t Print::println(char character) {
+  return print(character) + println();
+}
+
+size_t Print::println(unsigned char value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Print::PrintNumber(unsigned long value, int base) {
+  char text[8 * sizeof(long) + 1];
+  char* digit = &text[sizeof(text) - 1];
+  *digit = '\0';
+  if (base < 2 || base > 36) base = DEC;
+  do {
+    unsigned long remainder = value % static_cast<unsigned long>(base);
+    value /= static_cast<unsigned long>(base);
+    *--digit = static_cast<char>(remainder < 10 ? '0' + remainder : 'A' + remainder - 10);
+  } while (value != 0);
+
+  return write(digit);
+}
+
+// Serial.
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud_rate) {
+  Simulator::GetInstance().BeginSerial(static_cast<uint32_t>(baud_rate));
+}
+
+int HardwareSerial::available() {
+  return Simulator::GetInstance().SerialAvailable();
+}
+
+int HardwareSerial::read() {
+  return Simulator::GetInstance().SerialRead();
+}
+
+int HardwareSerial::peek() {
+  return Simulator::GetInstance().SerialPeek();
+}
+
+int HardwareSerial::availableForWrite() {
+  return Simulator::GetInstance().SerialAvailableForWrite();
+}
+
+void HardwareSerial::flush() {
+  Simulator::GetInstance().SerialFlush();
+}
+
+size_t HardwareSerial::write(uint8_t byte) {
+  Simulator::GetInstance().SerialWrite(byte);
+  return 1;
+}
+
+// Digital I/O.
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  Simulator::GetInstance().SetPinMode(pin, mode == OUTPUT);
+}
+
+int digitalRead(uint8_t pin) {
+  return Simulator::GetInstance().ReadPin(pin) ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  Simulator::GetInstance().WritePin(pin, value != LOW);
+}
+
+// Time.
+
+unsigned long millis() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(Simulator::GetInstance().time_ns() / 1000000));
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(Simulator::GetInstance().time_ns() / 1000));
+}
+
+void delay(unsigned long period_ms) {
+  Simulator::GetInstance().Advance(static_cast<uint64_t>(period_ms) * 1000000);
+}
+
+void delayMicroseconds(unsigned int period_us) {
+  Simulator::GetInstance().Advance(static_cast<uint64_t>(period_us) * 1000);
+}
+
+void __builtin_avr_delay_cycles(unsigned long cycles) {
+  Simulator::GetInstance().Advance(static_cast<uint64_t>(cycles) * 1000000000ULL / F_CPU);
+}
+
+// Interrupts.
+
+void cli() {
+  Simulator::GetInstance().SetInterruptsEnabled(false);
+}
+
+void sei() {
+  Simulator::GetInstance().SetInterruptsEnabled(true);
+}
+
+// Registers.
+
+StatusRegister SREG;
+TimerCounter TCNT1;
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint16_t OCR1A = 0;
+volatile uint8_t PCICR = 0;
+volatile uint8_t PCMSK0 = 0;
+volatile uint8_t PCMSK1 = 0;
+volatile uint8_t PCMSK2 = 0;
+
+StatusRegister::operator uint8_t() const {
+  return Simulator::GetInstance().interrupts_enabled() ? 0x80 : 0x00;
+}
+
+StatusRegister& StatusRegister::operator=(uint8_t value) {
+  Simulator::GetInstance().SetInterruptsEnabled((value & 0x80) != 0);
+  return *this;
+}
+
+TimerCounter::operator uint16_t() const {
+  return Simulator::GetInstance().Timer1Count();
+}
+
+TimerCounter& TimerCounter::operator=(uint16_t value) {
+  Simulator::GetInstance().SetTimer1Count(value);
+  return *this;
+}
+
+// Pin to port mapping.
+
+uint8_t digitalPinToPort(uint8_t pin) {
+  if (pin < 8) return 4; // PD.
+  if (pin < 14) return 2; // PB.
+  if (pin < 20) return 3; // PC.
+  return NOT_A_PORT;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+  if (pin < 8) return static_cast<uint8_t>(_BV(pin));
+  if (pin < 14) return static_cast<uint8_t>(_BV(pin - 8));
+  if (pin < 20) return static_cast<uint8_t>(_BV(pin - 14));
+  return 0;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port) {
+  return Simulator::GetInstance().PortInputRegister(port);
+}
+
+volatile uint8_t* digitalPinToPCMSK(uint8_t pin) {
+  if (pin < 8) return &PCMSK2;
+  if (pin < 14) return &PCMSK0;
+  if (pin < 20) return &PCMSK1;
+  return nullptr;
+}
+
+uint8_t digitalPinToPCMSKbit(uint8_t pin) {
+  if (pin < 8) return pin;
+  if (pin < 14) return static_cast<uint8_t>(pin - 8);
+  return static_cast<uint8_t>(pin - 14);
+}
+
+volatile uint8_t* digitalPinToPCICR(uint8_t pin) {
+  return pin < 20 ? &PCICR : nullptr;
+}
+
+uint8_t digitalPinToPCICRbit(uint8_t pin) {
+  if (pin < 8) return 2;
+  if (pin < 14) return 0;
+  return 1;
+}
+
+// Sleep.
+
+void set_sleep_mode(uint8_t /*mode*/) {}
+
+void sleep_enable() {}
+
+void sleep_disable() {}
+
+void sleep_cpu() {
+  Simulator::GetInstance().Sleep();
+}
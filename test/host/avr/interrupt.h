@@ -0,0 +1,21 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file interrupt.h
+/// @brief Host (Linux) stand-in for avr-libc's interrupt handling; handlers are called by the Simulator.
+
+#pragma once
+
+#define ISR(vector, ...) extern "C" void vector()
+#define EMPTY_INTERRUPT(vector) extern "C" void vector() {}
+
+/// @brief Disable interrupts (clear the global interrupt enable bit of SREG).
+void cli();
+
+/// @brief Enable interrupts (set the global interrupt enable bit of SREG).
+void sei();
+
+#define interrupts() sei()
+#define noInterrupts() cli()
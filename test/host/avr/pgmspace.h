@@ -0,0 +1,24 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file pgmspace.h
+/// @brief Host (Linux) stand-in for avr-libc's program memory (flash) access; flash is ordinary memory on the host.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(string_literal) (string_literal)
+
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t*>(address))
+#define pgm_read_dword(address) (*reinterpret_cast<const uint32_t*>(address))
+#define pgm_read_ptr(address) (*reinterpret_cast<const void* const*>(address))
+
+inline void* memcpy_P(void* destination, const void* source, size_t size) {
+  return memcpy(destination, source, size);
+}
@@ -0,0 +1,19 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file sleep.h
+/// @brief Host (Linux) stand-in for avr-libc's sleep modes; sleeping advances the simulated clock to the next wake-up.
+
+#pragma once
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();
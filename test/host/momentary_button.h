@@ -0,0 +1,39 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file momentary_button.h
+/// @brief Host (Linux) stand-in for the MT-arduino-momentary-button library; the firmware only uses its types.
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace mt {
+
+/// @brief The Momentary Button class (types only).
+class MomentaryButton {
+ public:
+
+  /// @brief Enum of button pin states.
+  enum class PinState {
+    kLow = 0,
+    kHigh,
+  };
+
+  /// @brief Enum of button press types.
+  enum class PressType {
+    kNotApplicable = 0,
+    kShortPress,
+    kLongPress,
+  };
+
+  /// @brief Enum of long press detection options.
+  enum class LongPressOption {
+    kDetectWhileHolding = 0,
+    kDetectAfterRelease,
+  };
+};
+
+} // namespace mt
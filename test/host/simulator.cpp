@@ -0,0 +1,386 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file simulator.cpp
+/// @brief Class that simulates the UNO R3 the firmware runs on (clock, Timer1, UART, pins and sleep) on the host.
+
+#include "simulator.h"
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/// @brief Timer1 compare match A interrupt (see src/hal.cpp).
+extern "C" void TIMER1_COMPA_vect();
+
+namespace mtspin {
+
+namespace host {
+
+namespace {
+
+/// @brief Get the host (wall clock) time.
+/// @return The time (ns).
+uint64_t HostTimeNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+Simulator& Simulator::GetInstance() {
+  static Simulator instance;
+  return instance;
+}
+
+void Simulator::Setup() {
+  setup();
+}
+
+void Simulator::Run(uint64_t period_us) {
+  RunUntil([]() { return false; }, period_us);
+}
+
+bool Simulator::RunUntil(const std::function<bool()>& condition, uint64_t timeout_us) {
+  uint64_t end_time_ns = time_ns_ + timeout_us * 1000;
+  while (time_ns_ < end_time_ns) {
+    uint64_t start_time_ns = time_ns_;
+    uint64_t start_asleep_time_ns = asleep_time_ns_;
+    uint64_t start_host_time_ns = HostTimeNs();
+    loop();
+    uint64_t host_pass_time_ns = HostTimeNs() - start_host_time_ns;
+    Advance(loop_pass_time_ns_);
+    uint64_t pass_time_ns = time_ns_ - start_time_ns - (asleep_time_ns_ - start_asleep_time_ns);
+    loop_statistics_.pass_count++;
+    loop_statistics_.host_time_ns += host_pass_time_ns;
+    if (pass_time_ns > loop_statistics_.max_pass_time_ns) loop_statistics_.max_pass_time_ns = pass_time_ns;
+    if (host_pass_time_ns > loop_statistics_.max_host_pass_time_ns) {
+      loop_statistics_.max_host_pass_time_ns = host_pass_time_ns;
+    }
+
+    if (condition()) return true;
+  }
+
+  return false;
+}
+
+void Simulator::set_loop_pass_time_ns(uint64_t period_ns) {
+  loop_pass_time_ns_ = period_ns;
+}
+
+void Simulator::set_step_timer_isr_time_ns(uint64_t period_ns) {
+  step_timer_isr_time_ns_ = period_ns;
+}
+
+Simulator::LoopStatistics Simulator::loop_statistics() const {
+  return loop_statistics_;
+}
+
+void Simulator::ResetLoopStatistics() {
+  loop_statistics_ = {};
+}
+
+uint64_t Simulator::time_ns() const {
+  return time_ns_;
+}
+
+uint64_t Simulator::time_us() const {
+  return time_ns_ / 1000;
+}
+
+void Simulator::Advance(uint64_t period_ns) {
+  AdvanceTo(time_ns_ + period_ns);
+}
+
+void Simulator::Schedule(uint64_t time_us, std::function<void()> event) {
+  events_.emplace(time_us * 1000, std::move(event));
+}
+
+uint64_t Simulator::asleep_time_ns() const {
+  return asleep_time_ns_;
+}
+
+uint64_t Simulator::step_timer_interrupt_count() const {
+  return step_timer_interrupt_count_;
+}
+
+uint64_t Simulator::step_timer_match_time_ns() const {
+  return step_timer_match_time_ns_;
+}
+
+uint64_t Simulator::max_step_timer_latency_ns() const {
+  return max_step_timer_latency_ns_;
+}
+
+void Simulator::SetInput(uint8_t pin, bool high) {
+  if (pin >= kSizeOfPins || pin_inputs_[pin] == high) return;
+  pin_inputs_[pin] = high;
+  if (!pin_outputs_[pin]) OnPinChange(pin);
+}
+
+bool Simulator::ReadPin(uint8_t pin) const {
+  if (pin >= kSizeOfPins) return false;
+  return pin_outputs_[pin] ? pin_latches_[pin] : pin_inputs_[pin];
+}
+
+bool Simulator::IsOutput(uint8_t pin) const {
+  return pin < kSizeOfPins && pin_outputs_[pin];
+}
+
+void Simulator::set_pin_observer(PinObserver observer) {
+  pin_observer_ = std::move(observer);
+}
+
+void Simulator::SendSerial(const std::vector<uint8_t>& bytes) {
+  uint64_t arrival_time_ns = receive_arrival_times_ns_.empty() ? time_ns_ : receive_arrival_times_ns_.back();
+  if (arrival_time_ns < time_ns_) arrival_time_ns = time_ns_;
+  for (uint8_t byte : bytes) {
+    arrival_time_ns += SerialByteTime();
+    receive_arrival_times_ns_.push_back(arrival_time_ns);
+    receive_pending_.push_back(byte);
+  }
+}
+
+void Simulator::SendSerial(const char* text) {
+  std::vector<uint8_t> bytes;
+  for (const char* character = text; *character != '\0'; character++) bytes.push_back(static_cast<uint8_t>(*character));
+  SendSerial(bytes);
+}
+
+const std::vector<Simulator::SerialByte>& Simulator::serial_output() const {
+  return serial_output_;
+}
+
+uint32_t Simulator::serial_overrun_count() const {
+  return serial_overrun_count_;
+}
+
+void Simulator::SetPinMode(uint8_t pin, bool output) {
+  if (pin >= kSizeOfPins) return;
+  pin_outputs_[pin] = output;
+  OnPinChange(pin);
+}
+
+void Simulator::WritePin(uint8_t pin, bool high) {
+  if (pin >= kSizeOfPins || pin_latches_[pin] == high) return;
+  pin_latches_[pin] = high;
+  if (!pin_outputs_[pin]) return;
+  OnPinChange(pin);
+  if (pin_observer_) pin_observer_(pin, high);
+}
+
+volatile uint8_t* Simulator::PortInputRegister(uint8_t port) {
+  return port < 5 ? &port_input_registers_[port] : nullptr;
+}
+
+void Simulator::BeginSerial(uint32_t baud_rate) {
+  baud_rate_ = baud_rate;
+}
+
+int Simulator::SerialAvailable() const {
+  return static_cast<int>(receive_buffer_.size());
+}
+
+int Simulator::SerialRead() {
+  if (receive_buffer_.empty()) return -1;
+  uint8_t byte = receive_buffer_.front();
+  receive_buffer_.pop_front();
+  return byte;
+}
+
+int Simulator::SerialPeek() const {
+  return receive_buffer_.empty() ? -1 : receive_buffer_.front();
+}
+
+int Simulator::SerialAvailableForWrite() const {
+  uint32_t queued = SerialTransmitQueued();
+  return queued >= kSerialBufferSize - 1 ? 0 : static_cast<int>(kSerialBufferSize - 1 - queued);
+}
+
+void Simulator::SerialWrite(uint8_t byte) {
+  // A full transmit buffer blocks the write until a byte has been sent (interrupts still run meanwhile).
+  while (SerialAvailableForWrite() == 0) {
+    AdvanceTo(transmit_busy_until_ns_ - (kSerialBufferSize - 2) * SerialByteTime());
+  }
+
+  serial_output_.push_back({time_ns_, byte});
+  uint64_t transmit_start_ns = transmit_busy_until_ns_ > time_ns_ ? transmit_busy_until_ns_ : time_ns_;
+  transmit_busy_until_ns_ = transmit_start_ns + SerialByteTime();
+}
+
+void Simulator::SerialFlush() {
+  if (transmit_busy_until_ns_ > time_ns_) AdvanceTo(transmit_busy_until_ns_);
+}
+
+bool Simulator::interrupts_enabled() const {
+  return interrupts_enabled_;
+}
+
+void Simulator::SetInterruptsEnabled(bool enabled) {
+  interrupts_enabled_ = enabled;
+  if (enabled) ServicePendingInterrupts(); // A pending interrupt runs as soon as interrupts are enabled.
+}
+
+uint16_t Simulator::Timer1Count() const {
+  uint64_t tick_time_ns = Timer1TickTime();
+  if (tick_time_ns == 0) return 0; // The count is only modelled while the timer runs.
+  int64_t elapsed_ns = static_cast<int64_t>(time_ns_) - timer1_origin_ns_;
+  int64_t counts = elapsed_ns >= 0 ? elapsed_ns / static_cast<int64_t>(tick_time_ns)
+                                   : -((-elapsed_ns + static_cast<int64_t>(tick_time_ns) - 1)
+                                       / static_cast<int64_t>(tick_time_ns));
+  return static_cast<uint16_t>(counts);
+}
+
+void Simulator::SetTimer1Count(uint16_t count) {
+  uint64_t tick_time_ns = Timer1TickTime();
+  if (tick_time_ns == 0) return; // The count is only modelled while the timer runs.
+  timer1_origin_ns_ = static_cast<int64_t>(time_ns_) - static_cast<int64_t>(count * tick_time_ns);
+}
+
+void Simulator::Sleep() {
+  uint64_t start_time_ns = time_ns_;
+  wake_ = false;
+  while (!wake_) AdvanceTo(NextActivityTime());
+  asleep_time_ns_ += time_ns_ - start_time_ns;
+}
+
+Simulator::Simulator() {}
+
+Simulator::~Simulator() {}
+
+void Simulator::AdvanceTo(uint64_t end_time_ns) {
+  for (;;) {
+    ServicePendingInterrupts();
+    uint64_t next_time_ns = NextActivityTime();
+    if (next_time_ns > end_time_ns) next_time_ns = end_time_ns;
+    if (next_time_ns > time_ns_) time_ns_ = next_time_ns;
+
+    if (NextTimer1MatchTime() == time_ns_) {
+      timer1_last_match_ns_ = time_ns_;
+      timer1_flag_ = true;
+      // In CTC mode, the count clears on the timer clock after the match.
+      if ((TCCR1B & _BV(WGM12)) != 0) timer1_origin_ns_ = static_cast<int64_t>(time_ns_ + Timer1TickTime());
+    }
+
+    while (!receive_arrival_times_ns_.empty() && receive_arrival_times_ns_.front() <= time_ns_) {
+      if (receive_buffer_.size() < kSerialBufferSize - 1) {
+        receive_buffer_.push_back(receive_pending_.front());
+      }
+      else {
+        serial_overrun_count_++;
+      }
+
+      receive_arrival_times_ns_.pop_front();
+      receive_pending_.pop_front();
+      wake_ = true; // USART receive complete interrupt.
+    }
+
+    while (!events_.empty() && events_.begin()->first <= time_ns_) {
+      std::function<void()> event = std::move(events_.begin()->second);
+      events_.erase(events_.begin());
+      event();
+    }
+
+    if (next_clock_tick_ns_ <= time_ns_) {
+      next_clock_tick_ns_ += kClockTickPeriod_ns_;
+      wake_ = true; // Timer0 overflow interrupt (millis()).
+    }
+
+    if (time_ns_ >= end_time_ns) {
+      ServicePendingInterrupts();
+      return;
+    }
+  }
+}
+
+uint64_t Simulator::NextActivityTime() const {
+  uint64_t next_time_ns = next_clock_tick_ns_;
+  uint64_t timer1_match_time_ns = NextTimer1MatchTime();
+  if (timer1_match_time_ns < next_time_ns) next_time_ns = timer1_match_time_ns;
+  if (!receive_arrival_times_ns_.empty() && receive_arrival_times_ns_.front() < next_time_ns) {
+    next_time_ns = receive_arrival_times_ns_.front();
+  }
+
+  if (!events_.empty() && events_.begin()->first < next_time_ns) next_time_ns = events_.begin()->first;
+  return next_time_ns < time_ns_ ? time_ns_ : next_time_ns;
+}
+
+uint64_t Simulator::NextTimer1MatchTime() const {
+  uint64_t tick_time_ns = Timer1TickTime();
+  if (tick_time_ns == 0) return UINT64_MAX;
+  // The next count (from now) equal to the compare value, modulo 2^16; the count wraps from 0xFFFF to 0 in both the
+  // CTC and normal modes if it has passed the compare value.
+  int64_t elapsed_ns = static_cast<int64_t>(time_ns_) - timer1_origin_ns_;
+  int64_t tick = static_cast<int64_t>(tick_time_ns);
+  int64_t first_count = elapsed_ns >= 0 ? (elapsed_ns + tick - 1) / tick : -((-elapsed_ns) / tick);
+  int64_t count = first_count + static_cast<uint16_t>(OCR1A - static_cast<uint16_t>(first_count));
+  uint64_t match_time_ns = static_cast<uint64_t>(timer1_origin_ns_ + count * tick);
+  if (match_time_ns == timer1_last_match_ns_) match_time_ns += 65536 * tick_time_ns;
+  return match_time_ns;
+}
+
+uint64_t Simulator::Timer1TickTime() const {
+  switch (TCCR1B & (_BV(CS12) | _BV(CS11) | _BV(CS10))) {
+    case _BV(CS11): return 8 * 1000000000ULL / F_CPU; // clk/8.
+    case _BV(CS11) | _BV(CS10): return 64 * 1000000000ULL / F_CPU; // clk/64.
+    case _BV(CS12): return 256 * 1000000000ULL / F_CPU; // clk/256.
+    case _BV(CS12) | _BV(CS10): return 1024 * 1000000000ULL / F_CPU; // clk/1024.
+    case 0: return 0; // Stopped.
+    default:
+      fprintf(stderr, "Simulator: unsupported Timer1 clock select (TCCR1B = 0x%02X)\n", TCCR1B);
+      abort();
+  }
+}
+
+void Simulator::ServicePendingInterrupts() {
+  if (!timer1_flag_ || in_isr_ || !interrupts_enabled_ || (TIMSK1 & _BV(OCIE1A)) == 0) return;
+  timer1_flag_ = false;
+  in_isr_ = true;
+  interrupts_enabled_ = false; // Interrupts are disabled on entry, and re-enabled on return.
+  wake_ = true;
+  step_timer_interrupt_count_++;
+  step_timer_match_time_ns_ = timer1_last_match_ns_;
+  uint64_t latency_ns = time_ns_ - timer1_last_match_ns_;
+  if (latency_ns > max_step_timer_latency_ns_) max_step_timer_latency_ns_ = latency_ns;
+  if (step_timer_isr_time_ns_ != 0) AdvanceTo(time_ns_ + step_timer_isr_time_ns_);
+  TIMER1_COMPA_vect();
+  interrupts_enabled_ = true;
+  in_isr_ = false;
+}
+
+void Simulator::OnPinChange(uint8_t pin) {
+  if (pin >= 20) return;
+  bool high = ReadPin(pin);
+  uint8_t port = digitalPinToPort(pin);
+  uint8_t bit_mask = digitalPinToBitMask(pin);
+  if (high) {
+    port_input_registers_[port] |= bit_mask;
+  }
+  else {
+    port_input_registers_[port] &= static_cast<uint8_t>(~bit_mask);
+  }
+
+  if (pin_outputs_[pin]) return;
+  if ((*digitalPinToPCMSK(pin) & _BV(digitalPinToPCMSKbit(pin))) != 0
+      && (*digitalPinToPCICR(pin) & _BV(digitalPinToPCICRbit(pin))) != 0) {
+    wake_ = true; // Pin change interrupt.
+  }
+}
+
+uint64_t Simulator::SerialByteTime() const {
+  return 10 * 1000000000ULL / baud_rate_;
+}
+
+uint32_t Simulator::SerialTransmitQueued() const {
+  if (transmit_busy_until_ns_ <= time_ns_) return 0;
+  uint64_t byte_time_ns = SerialByteTime();
+  return static_cast<uint32_t>((transmit_busy_until_ns_ - time_ns_ + byte_time_ns - 1) / byte_time_ns);
+}
+
+} // namespace host
+
+} // namespace mtspin
@@ -0,0 +1,275 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file simulator.h
+/// @brief Class that simulates the UNO R3 the firmware runs on (clock, Timer1, UART, pins and sleep) on the host.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace mtspin {
+
+namespace host {
+
+/// @brief The Simulator class using the singleton pattern i.e., only a single instance can exist.
+/// The firmware runs against the host Arduino core (test/host/Arduino.h) with a virtual clock: firmware code takes no
+/// time, except for a fixed time per pass of loop() (set_loop_pass_time_ns()) and per step timer interrupt
+/// (set_step_timer_isr_time_ns()), and the time it spends blocked (delays, writes to a full serial transmit buffer,
+/// sleep). While the clock advances, the step timer interrupt (Timer1 compare match A) runs when it is due, as long as
+/// interrupts are enabled (otherwise as soon as they are), serial bytes arrive at the baud rate into a 64 byte receive
+/// buffer, and scheduled events (e.g., button presses) happen. Timer1 counts with the clock in either the clear timer
+/// on compare match (CTC) or the normal (free running) mode, so a compare value written after the counter has passed
+/// it waits for the counter to wrap, as on the real timer.
+class Simulator {
+ public:
+
+  /// @brief Serial byte written by the firmware.
+  struct SerialByte {
+    uint64_t time_ns; ///< Time (ns) the byte was written (into the transmit buffer).
+    uint8_t value; ///< The byte.
+  };
+
+  /// @brief Statistics of the passes of loop().
+  struct LoopStatistics {
+    uint64_t pass_count; ///< No. of passes.
+    uint64_t max_pass_time_ns; ///< Longest pass (ns of simulated time, excluding time asleep).
+    uint64_t host_time_ns; ///< Total host (wall clock) time (ns) spent in loop().
+    uint64_t max_host_pass_time_ns; ///< Longest pass (ns of host time).
+  };
+
+  /// @brief Function called on every change of state of an output pin.
+  /// @param pin The pin.
+  /// @param high The new state.
+  using PinObserver = std::function<void(uint8_t pin, bool high)>;
+
+  inline static constexpr uint8_t kSizeOfPins = 64; ///< No. of pins (D0-D19 are the UNO R3 pins; the rest are extra).
+  inline static constexpr uint8_t kSerialBufferSize = 64; ///< Size of the serial receive and transmit buffers.
+
+  /// @brief Static method to get the single instance.
+  /// @return The Simulator instance.
+  static Simulator& GetInstance();
+
+  /// @brief Delete the copy constructor to prevent copying of the single instance.
+  Simulator(const Simulator&) = delete;
+
+  /// @brief Delete the assignment operator to prevent copying of the single instance.
+  Simulator& operator=(const Simulator&) = delete;
+
+  // Sketch.
+
+  /// @brief Run the firmware's setup().
+  void Setup();
+
+  /// @brief Run passes of the firmware's loop() for a period of (simulated) time.
+  /// @param period_us The period (us).
+  void Run(uint64_t period_us);
+
+  /// @brief Run passes of the firmware's loop() until a condition holds, or a period of (simulated) time elapses.
+  /// @param condition The condition, checked after every pass.
+  /// @param timeout_us The longest period (us) to run for.
+  /// @return True if the condition holds, false on timeout.
+  bool RunUntil(const std::function<bool()>& condition, uint64_t timeout_us);
+
+  /// @brief Set the simulated time taken by each pass of loop() (in addition to any time it is blocked).
+  /// @param period_ns The time (ns).
+  void set_loop_pass_time_ns(uint64_t period_ns);
+
+  /// @brief Set the simulated time from a step timer compare match to the step timer interrupt writing the next
+  /// compare value (interrupt entry plus the callback).
+  /// @param period_ns The time (ns).
+  void set_step_timer_isr_time_ns(uint64_t period_ns);
+
+  /// @brief Get the statistics of the passes of loop() since the last reset.
+  /// @return The statistics.
+  LoopStatistics loop_statistics() const;
+
+  /// @brief Reset the loop statistics.
+  void ResetLoopStatistics();
+
+  // Clock.
+
+  /// @brief Get the simulated time since startup.
+  /// @return The time (ns).
+  uint64_t time_ns() const;
+
+  /// @brief Get the simulated time since startup.
+  /// @return The time (us).
+  uint64_t time_us() const;
+
+  /// @brief Advance the simulated clock (e.g., code taking time), running the interrupts and events due meanwhile.
+  /// @param period_ns The period (ns).
+  void Advance(uint64_t period_ns);
+
+  /// @brief Schedule an event (e.g., a button press) to happen at a time.
+  /// @param time_us The time (us) since startup.
+  /// @param event The event.
+  void Schedule(uint64_t time_us, std::function<void()> event);
+
+  /// @brief Get the total time spent asleep since startup.
+  /// @return The time (ns).
+  uint64_t asleep_time_ns() const;
+
+  // Step timer (Timer1).
+
+  /// @brief Get the no. of step timer interrupts since startup.
+  /// @return The no. of interrupts.
+  uint64_t step_timer_interrupt_count() const;
+
+  /// @brief Get the time of the compare match that raised the latest step timer interrupt.
+  /// @return The time (ns).
+  uint64_t step_timer_match_time_ns() const;
+
+  /// @brief Get the longest time from a compare match to its step timer interrupt (with interrupts disabled).
+  /// @return The time (ns).
+  uint64_t max_step_timer_latency_ns() const;
+
+  // Pins.
+
+  /// @brief Set the external state of an input pin (e.g., a button).
+  /// @param pin The pin.
+  /// @param high The state.
+  void SetInput(uint8_t pin, bool high);
+
+  /// @brief Get the state of a pin, as read by digitalRead().
+  /// @param pin The pin.
+  /// @return True if high.
+  bool ReadPin(uint8_t pin) const;
+
+  /// @brief Check if a pin is set as an output (by pinMode()).
+  /// @param pin The pin.
+  /// @return True if an output.
+  bool IsOutput(uint8_t pin) const;
+
+  /// @brief Set the function called on every change of state of an output pin.
+  /// @param observer The function.
+  void set_pin_observer(PinObserver observer);
+
+  // Serial.
+
+  /// @brief Send bytes to the firmware; they arrive one by one at the baud rate, after any bytes already sent.
+  /// @param bytes The bytes.
+  void SendSerial(const std::vector<uint8_t>& bytes);
+
+  /// @brief Send text to the firmware (see SendSerial()).
+  /// @param text The text.
+  void SendSerial(const char* text);
+
+  /// @brief Get the bytes written by the firmware since startup.
+  /// @return The bytes.
+  const std::vector<SerialByte>& serial_output() const;
+
+  /// @brief Get the no. of bytes lost because the serial receive buffer was full.
+  /// @return The no. of bytes.
+  uint32_t serial_overrun_count() const;
+
+  // Arduino core side (see test/host/arduino_core.cpp).
+
+  void SetPinMode(uint8_t pin, bool output);
+  void WritePin(uint8_t pin, bool high);
+  volatile uint8_t* PortInputRegister(uint8_t port);
+  void BeginSerial(uint32_t baud_rate);
+  int SerialAvailable() const;
+  int SerialRead();
+  int SerialPeek() const;
+  int SerialAvailableForWrite() const;
+  void SerialWrite(uint8_t byte);
+  void SerialFlush();
+  bool interrupts_enabled() const;
+  void SetInterruptsEnabled(bool enabled);
+  uint16_t Timer1Count() const;
+  void SetTimer1Count(uint16_t count);
+  void Sleep();
+
+ private:
+
+  /// @brief Private constructor so objects cannot be manually instantiated.
+  Simulator();
+
+  /// @brief Private destructor so objects cannot be manually instantiated.
+  ~Simulator();
+
+  /// @brief Advance the simulated clock to a time, running the interrupts and events due meanwhile.
+  /// @param end_time_ns The time (ns).
+  void AdvanceTo(uint64_t end_time_ns);
+
+  /// @brief Get the time of the next thing to happen (compare match, serial byte, event or clock tick).
+  /// @return The time (ns).
+  uint64_t NextActivityTime() const;
+
+  /// @brief Get the time of the next Timer1 compare match.
+  /// @return The time (ns), or UINT64_MAX if the timer is stopped.
+  uint64_t NextTimer1MatchTime() const;
+
+  /// @brief Get the duration of a Timer1 count.
+  /// @return The duration (ns), or 0 if the timer is stopped.
+  uint64_t Timer1TickTime() const;
+
+  /// @brief Run the step timer interrupt if it is pending and interrupts are enabled.
+  void ServicePendingInterrupts();
+
+  /// @brief Update the port input registers and wake on an enabled pin change interrupt.
+  /// @param pin The pin that changed.
+  void OnPinChange(uint8_t pin);
+
+  /// @brief Get the duration of a serial byte (10 bits) at the baud rate.
+  /// @return The duration (ns).
+  uint64_t SerialByteTime() const;
+
+  /// @brief Get the no. of bytes in the serial transmit buffer (including the byte being sent).
+  /// @return The no. of bytes.
+  uint32_t SerialTransmitQueued() const;
+
+  inline static constexpr uint64_t kClockTickPeriod_ns_ = 1024000; ///< Timer0 overflow (millis()) period (ns).
+
+  // Clock.
+  uint64_t time_ns_ = 0; ///< Simulated time (ns) since startup.
+  std::multimap<uint64_t, std::function<void()>> events_; ///< Scheduled events, by time (ns).
+  uint64_t next_clock_tick_ns_ = kClockTickPeriod_ns_; ///< Time (ns) of the next Timer0 overflow.
+  bool wake_ = false; ///< Flag to keep track of whether an interrupt happened (waking the CPU).
+  uint64_t asleep_time_ns_ = 0; ///< Total time (ns) asleep.
+
+  // Interrupts.
+  bool interrupts_enabled_ = true; ///< The global interrupt enable bit (SREG).
+  bool in_isr_ = false; ///< Flag to keep track of whether the step timer interrupt is running.
+
+  // Timer1.
+  int64_t timer1_origin_ns_ = 0; ///< Time (ns) Timer1 counted 0 (count = elapsed counts, modulo 2^16).
+  uint64_t timer1_last_match_ns_ = UINT64_MAX; ///< Time (ns) of the latest compare match.
+  bool timer1_flag_ = false; ///< The compare match A interrupt flag (OCF1A).
+  uint64_t step_timer_isr_time_ns_ = 0; ///< Time (ns) from a compare match to the next compare value.
+  uint64_t step_timer_interrupt_count_ = 0; ///< No. of step timer interrupts.
+  uint64_t step_timer_match_time_ns_ = 0; ///< Time (ns) of the compare match of the latest interrupt.
+  uint64_t max_step_timer_latency_ns_ = 0; ///< Longest time (ns) from a compare match to its interrupt.
+
+  // Loop.
+  uint64_t loop_pass_time_ns_ = 10000; ///< Time (ns) per pass of loop().
+  LoopStatistics loop_statistics_ = {}; ///< Statistics of the passes of loop().
+
+  // Pins.
+  bool pin_outputs_[kSizeOfPins] = {}; ///< Flags to keep track of whether each pin is an output.
+  bool pin_latches_[kSizeOfPins] = {}; ///< Output states.
+  bool pin_inputs_[kSizeOfPins] = {}; ///< External input states.
+  volatile uint8_t port_input_registers_[5] = {}; ///< PINB (2), PINC (3) and PIND (4).
+  PinObserver pin_observer_; ///< Function called on every change of an output pin.
+
+  // Serial.
+  uint32_t baud_rate_ = 115200; ///< The serial communication speed.
+  std::deque<uint64_t> receive_arrival_times_ns_; ///< Arrival times (ns) of the bytes on the way to the firmware.
+  std::deque<uint8_t> receive_pending_; ///< Bytes on the way to the firmware.
+  std::deque<uint8_t> receive_buffer_; ///< Serial receive buffer.
+  uint32_t serial_overrun_count_ = 0; ///< No. of bytes lost to a full receive buffer.
+  uint64_t transmit_busy_until_ns_ = 0; ///< Time (ns) the transmit buffer is empty.
+  std::vector<SerialByte> serial_output_; ///< Bytes written by the firmware.
+};
+
+} // namespace host
+
+} // namespace mtspin
@@ -0,0 +1,39 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file stepper_driver.h
+/// @brief Host (Linux) stand-in for the MT-arduino-stepper-driver library; the firmware only uses its types.
+
+#pragma once
+
+#include <Arduino.h>
+
+namespace mt {
+
+/// @brief The Stepper Driver class (types only).
+class StepperDriver {
+ public:
+
+  /// @brief Enum of driver pin states.
+  enum class PinState {
+    kLow = 0,
+    kHigh,
+  };
+
+  /// @brief Enum of motion directions.
+  enum class MotionDirection {
+    kNegative = -1,
+    kNeutral = 0,
+    kPositive = 1,
+  };
+
+  /// @brief Enum of driver power states.
+  enum class PowerState {
+    kEnabled = 0,
+    kDisabled,
+  };
+};
+
+} // namespace mt
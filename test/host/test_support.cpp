@@ -0,0 +1,240 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file test_support.cpp
+/// @brief Checks, serial framing, button presses, step recording and motion segments shared by the host tests and
+/// benchmarks.
+
+#include "test_support.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include "command_receiver.h"
+#include "step_axis.h"
+
+namespace mtspin {
+
+namespace host {
+
+namespace {
+
+uint32_t check_count = 0; ///< No. of checks.
+uint32_t failed_check_count = 0; ///< No. of failed checks.
+
+} // namespace
+
+bool Check(bool passed, const char* expression, const char* file, int line) {
+  check_count++;
+  if (!passed) {
+    failed_check_count++;
+    printf("%s:%d: check failed: %s\n", file, line, expression);
+  }
+
+  return passed;
+}
+
+int TestResult() {
+  printf("%u/%u checks passed\n", check_count - failed_check_count, check_count);
+  return failed_check_count == 0 ? 0 : 1;
+}
+
+std::vector<uint8_t> Q16Bytes(double value) {
+  return Int32Bytes(static_cast<int32_t>(std::lround(value * 65536.0)));
+}
+
+std::vector<uint8_t> Int32Bytes(int32_t value) {
+  uint32_t bits = static_cast<uint32_t>(value);
+  return {static_cast<uint8_t>(bits), static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits >> 16),
+          static_cast<uint8_t>(bits >> 24)};
+}
+
+std::vector<uint8_t> MakeFrame(uint8_t sequence, uint8_t type, const std::vector<uint8_t>& payload) {
+  std::vector<uint8_t> frame;
+  frame.reserve(payload.size() + 5);
+  frame.push_back(CommandReceiver::kStartByte);
+  frame.push_back(sequence);
+  frame.push_back(type);
+  frame.push_back(static_cast<uint8_t>(payload.size()));
+  for (uint8_t byte : payload) frame.push_back(byte);
+  uint8_t crc = 0;
+  for (size_t index = 1; index < frame.size(); index++) crc = CommandReceiver::UpdateCrc(crc, frame[index]);
+  frame.push_back(crc);
+  return frame;
+}
+
+std::vector<Frame> FindFrames(size_t start_index) {
+  const std::vector<Simulator::SerialByte>& output = Simulator::GetInstance().serial_output();
+  std::vector<Frame> frames;
+  size_t index = start_index;
+  while (index + 5 <= output.size()) {
+    if (output[index].value != CommandReceiver::kStartByte) {
+      index++;
+      continue;
+    }
+
+    uint8_t length = output[index + 3].value;
+    if (index + 5 + length > output.size()) break;
+    uint8_t crc = 0;
+    for (size_t byte = index + 1; byte < index + 4 + length; byte++) {
+      crc = CommandReceiver::UpdateCrc(crc, output[byte].value);
+    }
+    if (crc != output[index + 4 + length].value) {
+      index++; // Not a frame (e.g., log text); resynchronise on the next start byte.
+      continue;
+    }
+
+    Frame frame = {output[index].time_ns, output[index + 1].value, output[index + 2].value, {}, index};
+    for (size_t byte = index + 4; byte < index + 4 + length; byte++) frame.payload.push_back(output[byte].value);
+    frames.push_back(frame);
+    index += 5 + length;
+  }
+
+  return frames;
+}
+
+uint8_t SendCommand(uint8_t sequence, uint8_t type, const std::vector<uint8_t>& payload, uint64_t timeout_us) {
+  Simulator& simulator = Simulator::GetInstance();
+  size_t start_index = simulator.serial_output().size();
+  uint8_t status = kNoAcknowledgement;
+  simulator.SendSerial(MakeFrame(sequence, type, payload));
+  simulator.RunUntil([&]() {
+    for (const Frame& frame : FindFrames(start_index)) {
+      if (frame.type == (0x80 | type) && frame.sequence == sequence && frame.payload.size() == 1) {
+        status = frame.payload[0];
+        return true;
+      }
+    }
+
+    return false;
+  }, timeout_us);
+  return status;
+}
+
+std::string SerialText(size_t start_index) {
+  const std::vector<Simulator::SerialByte>& output = Simulator::GetInstance().serial_output();
+  std::string text;
+  for (size_t index = start_index; index < output.size(); index++) text += static_cast<char>(output[index].value);
+  return text;
+}
+
+std::string LogText(size_t start_index) {
+  const std::vector<Simulator::SerialByte>& output = Simulator::GetInstance().serial_output();
+  std::string text;
+  size_t index = start_index;
+  for (const Frame& frame : FindFrames(start_index)) {
+    for (; index < frame.index; index++) text += static_cast<char>(output[index].value);
+    index = frame.index + 5 + frame.payload.size();
+  }
+
+  for (; index < output.size(); index++) text += static_cast<char>(output[index].value);
+  return text;
+}
+
+int32_t ReadInt32(const uint8_t* bytes) {
+  return static_cast<int32_t>(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16)
+                              | (static_cast<uint32_t>(bytes[3]) << 24));
+}
+
+void SchedulePress(uint8_t pin, uint64_t time_us, uint64_t period_ms) {
+  Simulator& simulator = Simulator::GetInstance();
+  bool pressed_high = Configuration::GetInstance().kUnpressedPinState_ == mt::MomentaryButton::PinState::kLow;
+  simulator.Schedule(time_us, [&simulator, pin, pressed_high]() { simulator.SetInput(pin, pressed_high); });
+  simulator.Schedule(time_us + period_ms * 1000, [&simulator, pin, pressed_high]() {
+    simulator.SetInput(pin, !pressed_high);
+  });
+}
+
+StepRecorder::StepRecorder() {
+  Simulator::GetInstance().set_pin_observer([this](uint8_t pin, bool high) { OnPinChange(pin, high); });
+}
+
+StepRecorder::~StepRecorder() {
+  Simulator::GetInstance().set_pin_observer(nullptr);
+}
+
+void StepRecorder::set_pin_observer(Simulator::PinObserver observer) {
+  pin_observer_ = std::move(observer);
+}
+
+const std::vector<StepRecorder::Step>& StepRecorder::steps(uint8_t axis) const {
+  return steps_[axis];
+}
+
+int32_t StepRecorder::position(uint8_t axis) const {
+  return positions_[axis];
+}
+
+void StepRecorder::Clear() {
+  for (std::vector<Step>& steps : steps_) steps.clear();
+}
+
+void StepRecorder::OnPinChange(uint8_t pin, bool high) {
+  const Simulator& simulator = Simulator::GetInstance();
+  for (uint8_t axis = 0; axis < Configuration::kSizeOfAxes_; axis++) {
+    if (pin != Configuration::kPulPins_[axis] || !high) continue;
+    bool energised = simulator.ReadPin(Configuration::kEnaPins_[axis])
+                     == (Configuration::kEnergisedPinState_ == mt::StepperDriver::PinState::kHigh);
+    if (!energised) continue;
+    bool positive = simulator.ReadPin(Configuration::kDirPins_[axis])
+                    == (Configuration::kPositiveDirectionPinState == mt::StepperDriver::PinState::kHigh);
+    uint8_t microsteps = MicrostepsPerPulse(axis);
+    int8_t direction = positive ? 1 : -1;
+    positions_[axis] += direction * microsteps;
+    steps_[axis].push_back({simulator.time_ns(), positions_[axis], direction, microsteps});
+  }
+
+  if (pin_observer_) pin_observer_(pin, high);
+}
+
+uint8_t StepRecorder::MicrostepsPerPulse([[maybe_unused]] uint8_t axis) const {
+#if MTSPIN_MICROSTEP_SWITCHING
+  const Simulator& simulator = Simulator::GetInstance();
+  uint8_t pin_states = 0;
+  for (uint8_t pin = 0; pin < Configuration::kSizeOfMicrostepSelectPins_; pin++) {
+    if (simulator.ReadPin(Configuration::kMicrostepSelectPins_[axis][pin])) {
+      pin_states |= static_cast<uint8_t>(1U << pin);
+    }
+  }
+
+  for (uint8_t band = 0; band < Configuration::kSizeOfMicrostepBands_; band++) {
+    if (Configuration::kMicrostepBandPinStates_[band] == pin_states) {
+      return static_cast<uint8_t>(Configuration::kMicrostepMode_ / Configuration::kMicrostepBandModes_[band]);
+    }
+  }
+
+  Check(false, "microstep select pins match a microstep band", __FILE__, __LINE__);
+  return 1;
+#else
+  return 1;
+#endif
+}
+
+std::vector<uint8_t> MakeSegmentPayload(double angle_degrees, double speed_RPM, int32_t dwell_ms) {
+  std::vector<uint8_t> payload = Q16Bytes(angle_degrees);
+  std::vector<uint8_t> speed = Q16Bytes(speed_RPM);
+  std::vector<uint8_t> dwell = Int32Bytes(dwell_ms);
+  payload.insert(payload.end(), speed.begin(), speed.end());
+  payload.insert(payload.end(), dwell.begin(), dwell.end());
+  return payload;
+}
+
+uint8_t QueueSegment(uint8_t sequence, double angle_degrees, double speed_RPM, int32_t dwell_ms) {
+  return SendCommand(sequence, static_cast<uint8_t>(CommandReceiver::CommandType::kQueueSegment),
+                     MakeSegmentPayload(angle_degrees, speed_RPM, dwell_ms));
+}
+
+void RunUntilStopped(const StepRecorder& step_recorder, uint8_t axis, uint64_t poll_period_us) {
+  Simulator& simulator = Simulator::GetInstance();
+  size_t step_count = 0;
+  do {
+    step_count = step_recorder.steps(axis).size();
+    simulator.Run(poll_period_us);
+  } while (step_recorder.steps(axis).size() != step_count);
+}
+
+} // namespace host
+
+} // namespace mtspin
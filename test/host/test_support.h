@@ -0,0 +1,188 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file test_support.h
+/// @brief Checks, serial framing, button presses, step recording and motion segments shared by the host tests and
+/// benchmarks.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "configuration.h"
+#include "simulator.h"
+
+/// @brief Macro to check a condition; a failure is reported (and the test fails at the end, see TestResult()).
+#define MTSPIN_CHECK(condition) ::mtspin::host::Check((condition), #condition, __FILE__, __LINE__)
+
+namespace mtspin {
+
+namespace host {
+
+/// @brief Record the result of a check, reporting it if it failed.
+/// @param passed The result.
+/// @param expression The condition checked.
+/// @param file The source file of the check.
+/// @param line The source line of the check.
+/// @return The result.
+bool Check(bool passed, const char* expression, const char* file, int line);
+
+/// @brief Report the no. of failed checks.
+/// @return The exit status of the test: 0 if all checks passed, 1 otherwise.
+int TestResult();
+
+// Serial framing (see src/command_receiver.h).
+
+/// @brief Encode a value as Q16.16 fixed-point (little-endian).
+/// @param value The value.
+/// @return The 4 bytes.
+std::vector<uint8_t> Q16Bytes(double value);
+
+/// @brief Encode a 32 bit integer (little-endian).
+/// @param value The value.
+/// @return The 4 bytes.
+std::vector<uint8_t> Int32Bytes(int32_t value);
+
+/// @brief Make a command frame.
+/// @param sequence The sequence no.
+/// @param type The frame type.
+/// @param payload The payload.
+/// @return The frame.
+std::vector<uint8_t> MakeFrame(uint8_t sequence, uint8_t type, const std::vector<uint8_t>& payload);
+
+/// @brief Frame (acknowledgement or telemetry) written by the firmware.
+struct Frame {
+  uint64_t time_ns; ///< Time (ns) the first byte was written.
+  uint8_t sequence; ///< The sequence no.
+  uint8_t type; ///< The frame type.
+  std::vector<uint8_t> payload; ///< The payload.
+  size_t index; ///< Index of the start byte in the serial output.
+};
+
+/// @brief Find the (valid) frames in the serial output of the firmware.
+/// @param start_index Index of the first byte of the serial output to search.
+/// @return The frames.
+std::vector<Frame> FindFrames(size_t start_index = 0);
+
+/// @brief Send a command frame, and run the firmware until it is acknowledged.
+/// @param sequence The sequence no.
+/// @param type The frame type.
+/// @param payload The payload.
+/// @param timeout_us The longest period (us) to wait for the acknowledgement.
+/// @return The acknowledgement status, or kNoAcknowledgement on timeout.
+uint8_t SendCommand(uint8_t sequence, uint8_t type, const std::vector<uint8_t>& payload,
+                    uint64_t timeout_us = 100000);
+
+inline constexpr uint8_t kNoAcknowledgement = 0xFF; ///< Status returned by SendCommand() on timeout.
+
+/// @brief Get the serial output of the firmware as text.
+/// @param start_index Index of the first byte of the serial output.
+/// @return The text.
+std::string SerialText(size_t start_index = 0);
+
+/// @brief Get the serial output of the firmware as text, without the (valid) frames interleaved with it.
+/// @param start_index Index of the first byte of the serial output.
+/// @return The text.
+std::string LogText(size_t start_index = 0);
+
+/// @brief Read a little-endian 32 bit integer.
+/// @param bytes The bytes.
+/// @return The value.
+int32_t ReadInt32(const uint8_t* bytes);
+
+// Buttons.
+
+/// @brief Schedule a press and release of a button.
+/// @param pin The button pin.
+/// @param time_us The time (us) of the press.
+/// @param period_ms The time (ms) the button is held.
+void SchedulePress(uint8_t pin, uint64_t time_us, uint64_t period_ms);
+
+// Step recording.
+
+/// @brief The Step Recorder class; records the step pulses of every axis from the PUL/DIR/ENA pins.
+/// Each step pulse (a PUL edge to high while the driver is enabled) is recorded with the position it moves to, in
+/// microsteps of Configuration::kMicrostepMode_ (a pulse moves several of them in a coarser microstep band, with
+/// MTSPIN_MICROSTEP_SWITCHING).
+class StepRecorder {
+ public:
+
+  /// @brief Step pulse.
+  struct Step {
+    uint64_t time_ns; ///< Time (ns) of the pulse.
+    int32_t position; ///< Position (microsteps) after the pulse.
+    int8_t direction; ///< Direction of the pulse (1 or -1).
+    uint8_t microsteps; ///< No. of microsteps moved by the pulse.
+  };
+
+  /// @brief Construct a Step Recorder object, and observe the pins (replacing any other pin observer).
+  StepRecorder();
+
+  /// @brief Destroy the Step Recorder object.
+  ~StepRecorder();
+
+  /// @brief Set a function to call on every output pin change, after the step recorder.
+  /// @param observer The function.
+  void set_pin_observer(Simulator::PinObserver observer);
+
+  /// @brief Get the step pulses of an axis.
+  /// @param axis The axis.
+  /// @return The step pulses.
+  const std::vector<Step>& steps(uint8_t axis) const;
+
+  /// @brief Get the position of an axis.
+  /// @param axis The axis.
+  /// @return The position (microsteps).
+  int32_t position(uint8_t axis) const;
+
+  /// @brief Clear the step pulses recorded (keeping the positions).
+  void Clear();
+
+ private:
+
+  /// @brief Record a pin change.
+  /// @param pin The pin.
+  /// @param high The new state.
+  void OnPinChange(uint8_t pin, bool high);
+
+  /// @brief Get the no. of microsteps of a step pulse of an axis, from its microstep select pins.
+  /// @param axis The axis.
+  /// @return The no. of microsteps.
+  uint8_t MicrostepsPerPulse(uint8_t axis) const;
+
+  std::vector<Step> steps_[Configuration::kSizeOfAxes_]; ///< Step pulses of each axis.
+  int32_t positions_[Configuration::kSizeOfAxes_] = {}; ///< Position (microsteps) of each axis.
+  Simulator::PinObserver pin_observer_; ///< Function to call on every output pin change.
+};
+
+// Motion segments.
+
+/// @brief Make the payload of a motion segment frame (see CommandReceiver::CommandType::kQueueSegment).
+/// @param angle_degrees The target angle (degrees).
+/// @param speed_RPM The speed (RPM).
+/// @param dwell_ms The dwell time (ms).
+/// @return The payload.
+std::vector<uint8_t> MakeSegmentPayload(double angle_degrees, double speed_RPM, int32_t dwell_ms = 0);
+
+/// @brief Queue a motion segment, and run the firmware until it is acknowledged.
+/// @param sequence The sequence no.
+/// @param angle_degrees The target angle (degrees).
+/// @param speed_RPM The speed (RPM).
+/// @param dwell_ms The dwell time (ms).
+/// @return The acknowledgement status, or kNoAcknowledgement on timeout.
+uint8_t QueueSegment(uint8_t sequence, double angle_degrees, double speed_RPM, int32_t dwell_ms = 0);
+
+/// @brief Run the firmware until an axis has stopped stepping (no step pulse for a poll period).
+/// @param step_recorder The step recorder.
+/// @param axis The axis.
+/// @param poll_period_us The period (us) without a step pulse after which the axis is taken to have stopped.
+void RunUntilStopped(const StepRecorder& step_recorder, uint8_t axis = 0, uint64_t poll_period_us = 200000);
+
+} // namespace host
+
+} // namespace mtspin
@@ -0,0 +1,91 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file idle_sleep_test.cpp
+/// @brief Test of sleeping when idle: the MCU sleeps for most of the time once it has been idle for the idle sleep
+/// delay, and button presses and serial input while it is asleep are handled as when awake.
+
+#include <cstdio>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::MakeFrame;
+using mtspin::host::SchedulePress;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kIdlePeriod_us = 10000000; ///< Period (us) each idle window is measured for.
+constexpr uint64_t kPressPeriod_ms = 200; ///< Time (ms) a button is held for a short press.
+constexpr double kScanPeriod_ms = 5.0; ///< Period (ms) of the input scan task.
+constexpr uint8_t kSizeOfBurst = 8; ///< No. of frames sent back to back while asleep (an even no. of 'd's).
+
+/// @brief Measure the fraction of an idle window spent asleep.
+/// @return The fraction of the time after the idle sleep delay spent asleep.
+double MeasureAsleepFraction() {
+  Simulator& simulator = Simulator::GetInstance();
+  uint64_t start_asleep_time_ns = simulator.asleep_time_ns();
+  simulator.Run(kIdlePeriod_us);
+  double idle_sleep_delay_ns = Configuration::GetInstance().kIdleSleepDelay_ms_ * 1e6;
+  return (simulator.asleep_time_ns() - start_asleep_time_ns) / (kIdlePeriod_us * 1e3 - idle_sleep_delay_ns);
+}
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  const Configuration& configuration = Configuration::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(configuration.kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Only the pin change interrupt of the button port (claimed, see MTSPIN_WAKE_PIN_CHANGE_VECTORS) is enabled.
+  MTSPIN_CHECK(PCICR == MTSPIN_WAKE_PIN_CHANGE_VECTORS);
+
+  // After the idle sleep delay, the MCU sleeps between interrupts (waking ~every 1 ms for the clock tick).
+  double asleep_fraction = MeasureAsleepFraction();
+  MTSPIN_CHECK(asleep_fraction > 0.9);
+
+  // A short press while asleep (starting motion) is debounced and timed as when awake: motion starts on the release.
+  uint64_t press_time_us = simulator.time_us() + 1000;
+  SchedulePress(configuration.kSpeedButtonPin_, press_time_us, kPressPeriod_ms);
+  simulator.RunUntil([&]() { return !step_recorder.steps(0).empty(); }, 1000000);
+  MTSPIN_CHECK(!step_recorder.steps(0).empty());
+  double start_delay_ms = 0.0;
+  if (!step_recorder.steps(0).empty()) start_delay_ms = step_recorder.steps(0)[0].time_ns / 1e6 - press_time_us / 1e3;
+  MTSPIN_CHECK(start_delay_ms >= kPressPeriod_ms);
+  // The release is registered on the 4th sample after it (samples are a quarter of the debounce period apart), at most
+  // a scan period late.
+  const double debounce_latency_ms = 4.0 * (configuration.kDebouncePeriod_ms_ / 4);
+  MTSPIN_CHECK(start_delay_ms < kPressPeriod_ms + debounce_latency_ms + kScanPeriod_ms);
+  MTSPIN_CHECK(mtspin::host::SendCommand(0, kAction, {'m'}) == kStatusOk);
+
+  // Serial frames sent back to back while asleep are all received and acknowledged.
+  double second_asleep_fraction = MeasureAsleepFraction();
+  MTSPIN_CHECK(second_asleep_fraction > 0.9);
+  size_t frame_start = simulator.serial_output().size();
+  for (uint8_t sequence = 1; sequence <= kSizeOfBurst; sequence++) {
+    simulator.SendSerial(MakeFrame(sequence, kAction, {'d'}));
+  }
+
+  simulator.RunUntil([&]() { return mtspin::host::FindFrames(frame_start).size() >= kSizeOfBurst; }, 1000000);
+  std::vector<mtspin::host::Frame> frames = mtspin::host::FindFrames(frame_start);
+  MTSPIN_CHECK(frames.size() == kSizeOfBurst);
+  for (const mtspin::host::Frame& frame : frames) {
+    MTSPIN_CHECK(frame.payload.size() == 1 && frame.payload[0] == kStatusOk);
+  }
+
+  MTSPIN_CHECK(simulator.serial_overrun_count() == 0);
+
+  printf("Asleep: %.1f%% and %.1f%% of the idle windows; motion started %.1f ms after a press while asleep\n",
+         asleep_fraction * 100.0, second_asleep_fraction * 100.0, start_delay_ms);
+  return mtspin::host::TestResult();
+}
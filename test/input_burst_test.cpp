@@ -0,0 +1,94 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file input_burst_test.cpp
+/// @brief Test of the input event queue: presses of all the buttons at once, arriving with a burst of serial commands
+/// (framed and legacy characters) larger than the queue, are all processed, none are lost to the serial receive
+/// buffer, and the loop passes stay short while the burst is worked through.
+
+#include <cstdio>
+#include <string>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::MakeFrame;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kPressPeriod_ms = 200; ///< Time (ms) a button is held for a short press.
+constexpr uint8_t kSizeOfFrameBurst = 4; ///< No. of framed commands in the burst ('d' and 's', alternately).
+constexpr uint8_t kSizeOfLegacyBurst = 3; ///< No. of legacy 'd' characters in the burst.
+constexpr uint64_t kMaxPassTime_ns = 1000000; ///< Longest loop pass allowed while the burst is processed.
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  const Configuration& configuration = Configuration::GetInstance();
+  simulator.Setup();
+  simulator.Run(configuration.kStartupDelay_ms_ * 1000ULL + 100000);
+  uint8_t sequence = 0;
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  simulator.Run(100000);
+
+  // Press all the buttons at once; the serial burst arrives (back to back) while the releases are being debounced
+  // (which takes 3-4 samples, a quarter of the debounce period apart), so the presses and commands are queued together
+  // (more of them than the queue holds).
+  const bool pressed_high = configuration.kUnpressedPinState_ == mt::MomentaryButton::PinState::kLow;
+  const uint8_t kButtonPins[] = {configuration.kDirectionButtonPin_, configuration.kAngleButtonPin_,
+                                 configuration.kSpeedButtonPin_};
+  for (uint8_t pin : kButtonPins) simulator.SetInput(pin, pressed_high);
+  simulator.Run(kPressPeriod_ms * 1000);
+  size_t output_start = simulator.serial_output().size();
+  simulator.ResetLoopStatistics();
+  for (uint8_t pin : kButtonPins) simulator.SetInput(pin, !pressed_high);
+  simulator.Run(configuration.kDebouncePeriod_ms_ * 1000ULL / 2);
+  for (uint8_t index = 0; index < kSizeOfFrameBurst; index++) {
+    simulator.SendSerial(MakeFrame(sequence++, kAction, {static_cast<uint8_t>(index % 2 == 0 ? 'd' : 's')}));
+    if (index < kSizeOfLegacyBurst) simulator.SendSerial("d");
+  }
+
+  simulator.Run(200000);
+  Simulator::LoopStatistics statistics = simulator.loop_statistics();
+  size_t acknowledged = 0;
+  for (const mtspin::host::Frame& frame : mtspin::host::FindFrames(output_start)) {
+    if (frame.payload.size() == 1 && frame.payload[0] == kStatusOk) acknowledged++;
+  }
+
+  // Every press and command took effect once (a lost one would leave a different status): the angle press changes to
+  // oscillation, the direction changes (press, frames and legacy characters) cancel out, and the speed moves on three
+  // (press and frames).
+  size_t status_start = simulator.serial_output().size();
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'r'}) == kStatusOk); // Log output on.
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'l'}) == kStatusOk);
+  simulator.Run(100000);
+  std::string status = mtspin::host::LogText(status_start);
+  char speed_text[32];
+  snprintf(speed_text, sizeof(speed_text), "Speed (RPM): %.2f",
+           Configuration::kSpeeds_RPM_[0][(Configuration::kDefaultSpeedIndex_ + 3) % Configuration::kSizeOfSpeeds_]);
+  bool oscillating = status.find("Control mode: oscillate") != std::string::npos;
+  bool clockwise = status.find("Motion direction: clockwise (CW)") != std::string::npos;
+  bool speed = status.find(speed_text) != std::string::npos;
+
+  MTSPIN_CHECK(oscillating);
+  MTSPIN_CHECK(clockwise);
+  MTSPIN_CHECK(speed);
+  MTSPIN_CHECK(acknowledged == kSizeOfFrameBurst);
+  MTSPIN_CHECK(simulator.serial_overrun_count() == 0);
+  MTSPIN_CHECK(statistics.max_pass_time_ns < kMaxPassTime_ns);
+
+  printf("Burst of 3 presses, %u frames and %u legacy characters: status as expected (mode, direction, speed): %s, "
+         "%s, %s; frames acknowledged %zu; longest loop pass %.1f us (%.1f us host)\n", kSizeOfFrameBurst,
+         kSizeOfLegacyBurst, oscillating ? "yes" : "no", clockwise ? "yes" : "no", speed ? "yes" : "no", acknowledged,
+         statistics.max_pass_time_ns / 1e3, statistics.max_host_pass_time_ns / 1e3);
+  return mtspin::host::TestResult();
+}
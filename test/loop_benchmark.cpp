@@ -0,0 +1,117 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file loop_benchmark.cpp
+/// @brief Benchmark of the control loop and step pulse timing, running the sketch (setup()/loop()) in the simulator.
+///
+/// Runs the continuous (5 RPM), oscillate (45 degree sweep at 5 RPM) and turbo (80 RPM) scenarios in turn, and
+/// reports per scenario:
+/// - loop iterations per second (host time spent in loop());
+/// - the worst-case loop time, in simulated time (each pass takes --loop-pass-time-us, plus any time blocked) and in
+///   host time;
+/// - the step pulse timing error: the worst latency from the step timer compare match to the step pulse, and the
+///   worst deviation of a step interval from the mean at constant speed.
+/// The benchmark fails (exit status 1) if a scenario does not step at the speed set, a step pulse is later than the
+/// step timer interrupt time plus the DIR pin delay (on a reversal), or a step interval at constant speed deviates
+/// from the mean by more than the step timer resolution.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+/// @brief Benchmark scenario.
+struct Scenario {
+  const char* name; ///< The scenario name.
+  const char* commands; ///< Serial messages that start the scenario (from the previous one).
+  float speed_RPM; ///< The speed set.
+  bool constant_speed; ///< True if the motion is at constant speed once settled.
+};
+
+/// @brief The scenarios, run in turn.
+constexpr Scenario kScenarios[] = {
+  {"continuous", "m", Configuration::kSpeeds_RPM_[0][0], true},
+  {"oscillate", "a", Configuration::kSpeeds_RPM_[0][0], false},
+  {"turbo", "dtsss", Configuration::kSpeeds_RPM_[1][3], true},
+};
+
+constexpr uint64_t kSettleTime_us = 2000000; ///< Time (us) from the start of a scenario to its measurement.
+constexpr uint64_t kMeasurementTime_us = 5000000; ///< Duration (us) of the measurement of a scenario.
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Simulator& simulator = Simulator::GetInstance();
+  uint64_t isr_time_ns = 0;
+  for (int index = 1; index + 1 < argc; index += 2) {
+    if (strcmp(argv[index], "--loop-pass-time-us") == 0) {
+      simulator.set_loop_pass_time_ns(strtoull(argv[index + 1], nullptr, 10) * 1000);
+    }
+    else if (strcmp(argv[index], "--isr-time-us") == 0) {
+      isr_time_ns = strtoull(argv[index + 1], nullptr, 10) * 1000;
+      simulator.set_step_timer_isr_time_ns(isr_time_ns);
+    }
+  }
+
+  const uint64_t max_allowed_step_latency_ns =
+      isr_time_ns + static_cast<uint64_t>(Configuration::kDirDelay_us_ + 0.999F) * 1000 + 1000;
+  StepRecorder step_recorder;
+  uint64_t max_step_latency_ns = 0;
+  step_recorder.set_pin_observer([&](uint8_t pin, bool high) {
+    if (pin != Configuration::kPulPins_[0] || !high) return;
+    uint64_t latency_ns = simulator.time_ns() - simulator.step_timer_match_time_ns();
+    if (latency_ns > max_step_latency_ns) max_step_latency_ns = latency_ns;
+  });
+
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  printf("%-11s %9s %12s %14s %14s %16s %14s\n", "Scenario", "Steps/s", "Loops/s", "Max loop (us)",
+         "Max host (us)", "Step latency (us)", "Jitter (us)");
+  for (const Scenario& scenario : kScenarios) {
+    simulator.SendSerial(scenario.commands);
+    simulator.Run(kSettleTime_us);
+
+    step_recorder.Clear();
+    simulator.ResetLoopStatistics();
+    max_step_latency_ns = 0;
+    simulator.Run(kMeasurementTime_us);
+
+    const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+    Simulator::LoopStatistics statistics = simulator.loop_statistics();
+    double step_rate = steps.size() / (kMeasurementTime_us / 1e6);
+    double loop_rate = statistics.host_time_ns == 0 ? 0.0 : statistics.pass_count / (statistics.host_time_ns / 1e9);
+    double max_jitter_us = 0.0;
+    if (scenario.constant_speed && steps.size() > 2) {
+      double mean_interval_ns = static_cast<double>(steps.back().time_ns - steps.front().time_ns) / (steps.size() - 1);
+      for (size_t index = 1; index < steps.size(); index++) {
+        double jitter_us = std::fabs((steps[index].time_ns - steps[index - 1].time_ns) - mean_interval_ns) / 1000.0;
+        if (jitter_us > max_jitter_us) max_jitter_us = jitter_us;
+      }
+
+      double expected_step_rate = mtspin::RpmToMicrostepsPerSecond(scenario.speed_RPM);
+      MTSPIN_CHECK(std::fabs(step_rate - expected_step_rate) < 0.01 * expected_step_rate);
+      MTSPIN_CHECK(max_jitter_us <= 1.0); // Step intervals are whole microseconds.
+    }
+
+    MTSPIN_CHECK(!steps.empty());
+    MTSPIN_CHECK(max_step_latency_ns <= max_allowed_step_latency_ns);
+    printf("%-11s %9.0f %12.0f %14.1f %14.1f %16.1f %14.1f\n", scenario.name, step_rate, loop_rate,
+           statistics.max_pass_time_ns / 1000.0, statistics.max_host_pass_time_ns / 1000.0,
+           max_step_latency_ns / 1000.0, max_jitter_us);
+  }
+
+  return mtspin::host::TestResult();
+}
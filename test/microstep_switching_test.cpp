@@ -0,0 +1,119 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file microstep_switching_test.cpp
+/// @brief Test of microstep resolution switching (built with MTSPIN_MICROSTEP_SWITCHING): through a motion program
+/// and velocity changes crossing the speed bands, the resolution changes both ways, a coarser resolution is only
+/// selected at a whole step of it, and the position reached (from the step pulses and microstep select pins, and as
+/// reported by the firmware) is exact.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::QueueSegment;
+using mtspin::host::RunUntilStopped;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kTelemetry = 0x40; ///< Frame type of telemetry.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kJogTime_us = 1000000; ///< Time (us) each velocity is run for.
+
+uint8_t sequence = 0; ///< Sequence no. of the next command.
+
+/// @brief Segment of the motion program.
+struct Segment {
+  double angle_degrees; ///< The target angle (degrees).
+  double speed_RPM; ///< The speed (RPM).
+};
+
+/// @brief Get the position of the axis reported by the firmware (in the latest telemetry frame).
+/// @param start_index Index of the first byte of the serial output to search.
+/// @return The position (microsteps), or INT32_MIN if no telemetry frame was found.
+int32_t ReportedPosition(size_t start_index) {
+  int32_t position = INT32_MIN;
+  for (const mtspin::host::Frame& frame : mtspin::host::FindFrames(start_index)) {
+    if (frame.type == kTelemetry && frame.payload.size() > 12) position = mtspin::host::ReadInt32(&frame.payload[9]);
+  }
+
+  return position;
+}
+
+} // namespace
+
+int main() {
+  const uint8_t kCoarsestMicrosteps = Configuration::kMicrostepMode_
+                                      / Configuration::kMicrostepBandModes_[Configuration::kSizeOfMicrostepBands_ - 1];
+  const double top_speed_RPM = Configuration::kSpeeds_RPM_[1][Configuration::kSizeOfSpeeds_ - 1];
+  const double low_speed_RPM = Configuration::kSpeeds_RPM_[0][0];
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+
+  // A motion program alternating between the speed bands, to targets that are not whole steps of the coarsest band.
+  const Segment kProgram[] = {
+    {720.0, top_speed_RPM}, {812.25, low_speed_RPM}, {1800.45, top_speed_RPM}, {-33.75, top_speed_RPM * 3 / 4},
+    {0.0, low_speed_RPM},
+  };
+  int32_t expected_position = 0;
+  bool reached = true;
+  for (const Segment& segment : kProgram) {
+    MTSPIN_CHECK(QueueSegment(sequence++, segment.angle_degrees, segment.speed_RPM) == kStatusOk);
+    RunUntilStopped(step_recorder);
+    expected_position = mtspin::DegreesToMicrosteps(static_cast<float>(segment.angle_degrees));
+    reached = reached && step_recorder.position(0) == expected_position;
+  }
+
+  MTSPIN_CHECK(reached);
+
+  // Velocity changes crossing the speed bands (a reversal through both), then a stop part way through a coarse step.
+  const double kVelocities_RPM[] = {top_speed_RPM, -top_speed_RPM, low_speed_RPM, top_speed_RPM};
+  for (double velocity_RPM : kVelocities_RPM) {
+    MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, mtspin::host::Q16Bytes(velocity_RPM)) == kStatusOk);
+    simulator.Run(kJogTime_us);
+  }
+
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  RunUntilStopped(step_recorder);
+  size_t output_start = simulator.serial_output().size();
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'b'}) == kStatusOk);
+  simulator.Run(Configuration::kTelemetryPeriod_ms_ * 2000ULL);
+  int32_t reported_position = ReportedPosition(output_start);
+
+  // Each pulse of a coarser band starts from a whole step of it, and both resolutions were used.
+  size_t fine_pulses = 0;
+  size_t coarse_pulses = 0;
+  size_t misaligned_pulses = 0;
+  for (const StepRecorder::Step& step : step_recorder.steps(0)) {
+    int32_t start_position = step.position - step.direction * step.microsteps;
+    if (step.microsteps == 1) fine_pulses++;
+    if (step.microsteps == kCoarsestMicrosteps) coarse_pulses++;
+    if (start_position % step.microsteps != 0) misaligned_pulses++;
+  }
+
+  MTSPIN_CHECK(fine_pulses > 0);
+  MTSPIN_CHECK(coarse_pulses > 0);
+  MTSPIN_CHECK(misaligned_pulses == 0);
+  MTSPIN_CHECK(reported_position == step_recorder.position(0));
+
+  printf("Program targets reached exactly: %s; %zu fine and %zu coarse (1/%u) pulses, %zu not at a whole step; "
+         "position %d (reported %d)\n", reached ? "yes" : "no", fine_pulses, coarse_pulses,
+         Configuration::kMicrostepBandModes_[Configuration::kSizeOfMicrostepBands_ - 1], misaligned_pulses,
+         step_recorder.position(0), reported_position);
+  return mtspin::host::TestResult();
+}
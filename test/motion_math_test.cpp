@@ -0,0 +1,102 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file motion_math_test.cpp
+/// @brief Test of the motion unit conversions: the fixed-point (Q16.16) forms against the floating-point ones, and the
+/// step counts of moves to explicit angles (built with MTSPIN_FIXED_POINT_MOTION set to 1 and to 0, the step counts
+/// must be the same).
+
+#include <cmath>
+#include <cstdio>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "ramp_table.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::QueueSegment;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kToggleMotion = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status of an accepted command.
+
+/// @brief Check the fixed-point conversions give the same results as the floating-point ones.
+void CheckConversions() {
+  uint32_t angle_mismatch_count = 0;
+  for (int32_t quarter_degrees = -2880; quarter_degrees <= 2880; quarter_degrees++) {
+    float angle_degrees = quarter_degrees / 4.0F;
+    if (mtspin::DegreesQ16ToMicrosteps(mtspin::ToQ16(angle_degrees)) != mtspin::DegreesToMicrosteps(angle_degrees)) {
+      angle_mismatch_count++;
+    }
+  }
+
+  MTSPIN_CHECK(angle_mismatch_count == 0);
+  for (uint8_t index = 0; index < Configuration::kSizeOfSweepAngles_; index++) {
+    float angle_degrees = Configuration::kSweepAngles_degrees_[index];
+    int32_t sweep_angle = mtspin::kSweepAngles.microsteps[index];
+    MTSPIN_CHECK(mtspin::DegreesQ16ToMicrosteps(mtspin::ToQ16(angle_degrees)) == sweep_angle);
+  }
+
+  for (uint8_t row = 0; row < 2; row++) {
+    for (uint8_t index = 0; index < Configuration::kSizeOfSpeeds_; index++) {
+      float speed_RPM = Configuration::kSpeeds_RPM_[row][index];
+      mtspin::StepAxis::SpeedProfile fixed_point = mtspin::MakeSpeedProfileQ16(
+          mtspin::RpmQ16ToMicrostepsPerSecondQ16(mtspin::ToQ16(speed_RPM)));
+      mtspin::StepAxis::SpeedProfile floating_point = mtspin::MakeSpeedProfileAtRuntime(
+          mtspin::RpmToMicrostepsPerSecond(speed_RPM));
+      MTSPIN_CHECK(fixed_point.interval_us == floating_point.interval_us);
+      MTSPIN_CHECK(fixed_point.ramp_steps == floating_point.ramp_steps);
+      MTSPIN_CHECK(fixed_point.interval_us == mtspin::kSpeedProfiles.profiles[row][index].interval_us);
+      MTSPIN_CHECK(fixed_point.ramp_steps == mtspin::kSpeedProfiles.profiles[row][index].ramp_steps);
+    }
+  }
+}
+
+/// @brief Move to an angle, and check the position reached (in microsteps) is the angle converted in floating-point.
+/// @param sequence The sequence no. of the command.
+/// @param angle_degrees The target angle (degrees).
+/// @param speed_RPM The speed (RPM).
+/// @param step_recorder The step recorder.
+void CheckMove(uint8_t sequence, double angle_degrees, double speed_RPM, const StepRecorder& step_recorder) {
+  MTSPIN_CHECK(QueueSegment(sequence, angle_degrees, speed_RPM) == kStatusOk);
+
+  // The angle sent is rounded to Q16.16, so convert the same value.
+  float sent_angle_degrees = static_cast<float>(mtspin::host::ReadInt32(mtspin::host::Q16Bytes(angle_degrees).data())
+                                                / 65536.0);
+  int32_t target = mtspin::DegreesToMicrosteps(sent_angle_degrees);
+  Simulator& simulator = Simulator::GetInstance();
+  simulator.RunUntil([&]() { return step_recorder.position(0) == target; }, 60000000);
+  simulator.Run(500000); // Nothing should move past the target.
+  if (!MTSPIN_CHECK(step_recorder.position(0) == target)) {
+    printf("Move to %.4f degrees: position %d microsteps, expected %d\n", angle_degrees, step_recorder.position(0),
+           target);
+  }
+}
+
+} // namespace
+
+int main() {
+  CheckConversions();
+
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(1, kToggleMotion, {'m'}) == kStatusOk);
+
+  uint8_t sequence = 2;
+  const double kMoves[][2] = {{90.0, 20.0}, {-45.25, 80.0}, {370.5, 65.0}, {12.3456, 5.0}, {-0.1, 10.0},
+                              {0.0, 35.0}, {720.0, 80.0}, {-359.99, 50.0}};
+  for (const auto& move : kMoves) CheckMove(sequence++, move[0], move[1], step_recorder);
+
+  printf("Built with MTSPIN_FIXED_POINT_MOTION=%d\n", MTSPIN_FIXED_POINT_MOTION);
+  return mtspin::host::TestResult();
+}
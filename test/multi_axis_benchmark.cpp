@@ -0,0 +1,92 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file multi_axis_benchmark.cpp
+/// @brief Benchmark of the step engine with several axes (one build per no. of axes), each jogging at its own speed.
+///
+/// Reports the aggregate step rate, the no. of steps emitted per step timer interrupt (steps due at the same time on
+/// several axes share an interrupt) and the worst step timing error. The benchmark fails (exit status 1) if an axis
+/// does not step at its own speed, or a step interval deviates from the mean by more than the time within which steps
+/// due on several axes are coalesced into one interrupt.
+
+#include <cmath>
+#include <cstdio>
+
+#include "hal.h"
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kSettleTime_us = 2000000; ///< Time (us) from setting the speeds to the measurement.
+constexpr uint64_t kMeasurementTime_us = 5000000; ///< Duration (us) of the measurement.
+
+/// @brief Get the speed an axis jogs at (the turbo speeds, from the fastest).
+/// @param axis The axis.
+/// @return The speed (RPM).
+double AxisSpeed(uint8_t axis) {
+  return Configuration::kSpeeds_RPM_[1][Configuration::kSizeOfSpeeds_ - 1 - axis % Configuration::kSizeOfSpeeds_];
+}
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Start every axis, each at its own speed (the trailing payload byte addresses the axis).
+  uint8_t sequence = 0;
+  for (uint8_t axis = 0; axis < Configuration::kSizeOfAxes_; axis++) {
+    std::vector<uint8_t> velocity = mtspin::host::Q16Bytes(AxisSpeed(axis));
+    velocity.push_back(axis);
+    MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m', axis}) == kStatusOk);
+    MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, velocity) == kStatusOk);
+  }
+
+  simulator.Run(kSettleTime_us);
+  step_recorder.Clear();
+  uint64_t start_interrupt_count = simulator.step_timer_interrupt_count();
+  simulator.Run(kMeasurementTime_us);
+  uint64_t interrupt_count = simulator.step_timer_interrupt_count() - start_interrupt_count;
+
+  printf("Axis  Speed (RPM)  Steps/s  Expected steps/s  Jitter (us)\n");
+  size_t total_steps = 0;
+  double max_jitter_us = 0.0;
+  for (uint8_t axis = 0; axis < Configuration::kSizeOfAxes_; axis++) {
+    const std::vector<StepRecorder::Step>& steps = step_recorder.steps(axis);
+    if (!MTSPIN_CHECK(steps.size() > 2)) continue;
+    double step_rate = steps.size() / (kMeasurementTime_us / 1e6);
+    double expected_step_rate = mtspin::RpmToMicrostepsPerSecond(AxisSpeed(axis));
+    double mean_interval_ns = static_cast<double>(steps.back().time_ns - steps.front().time_ns) / (steps.size() - 1);
+    double axis_jitter_us = 0.0;
+    for (size_t index = 1; index < steps.size(); index++) {
+      double jitter_us = std::fabs((steps[index].time_ns - steps[index - 1].time_ns) - mean_interval_ns) / 1000.0;
+      axis_jitter_us = std::fmax(axis_jitter_us, jitter_us);
+    }
+
+    MTSPIN_CHECK(std::fabs(step_rate - expected_step_rate) < 0.002 * expected_step_rate + 1.0);
+    MTSPIN_CHECK(axis_jitter_us <= mtspin::hal::kMinStepTimerInterval_us + 1.0);
+    total_steps += steps.size();
+    max_jitter_us = std::fmax(max_jitter_us, axis_jitter_us);
+    printf("%4u  %11.1f  %7.0f  %16.0f  %11.1f\n", axis, AxisSpeed(axis), step_rate, expected_step_rate,
+           axis_jitter_us);
+  }
+
+  printf("Axes: %u; %.0f steps/s aggregate, %.2f steps/interrupt, worst step timing error %.1f us\n",
+         Configuration::kSizeOfAxes_, total_steps / (kMeasurementTime_us / 1e6),
+         interrupt_count == 0 ? 0.0 : static_cast<double>(total_steps) / interrupt_count, max_jitter_us);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,150 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file oscillation_test.cpp
+/// @brief Test of oscillation over a long run with a jittery control loop (0.1-3 ms per pass): the centre of the
+/// oscillation does not drift, through sweep angle and speed changes, and the period of each cycle is the same while
+/// the settings are unchanged.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kRunTime_us = 600000000; ///< Time (us) of the run.
+constexpr uint64_t kAngleChangePeriod_us = 140000000; ///< Time (us) between sweep angle changes.
+constexpr uint64_t kSpeedChangePeriod_us = 220000000; ///< Time (us) between speed changes.
+constexpr size_t kSettleCycles = 2; ///< No. of cycles after a change of settings excluded from the period stability.
+
+/// @brief Turning point of the oscillation (where the direction of the steps changes).
+struct TurningPoint {
+  uint64_t time_ns; ///< Time (ns) of the last step before the turn.
+  int32_t position; ///< Position (microsteps) of the turn.
+  int8_t direction; ///< Direction of the motion into the turn.
+};
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Oscillate at the second speed, and at the first sweep angle.
+  uint8_t sequence = 0;
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'s'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'a'}) == kStatusOk);
+
+  // Run with a jittery control loop (a pseudo-random pass time), changing the sweep angle and speed now and then.
+  uint32_t random_state = 12345;
+  auto jitter = [&]() {
+    random_state = random_state * 1103515245U + 12345U;
+    simulator.set_loop_pass_time_ns(100000 + (random_state >> 8) % 2900000);
+    return false;
+  };
+  std::vector<uint64_t> change_times_ns;
+  const uint64_t kEndTime_us = simulator.time_us() + kRunTime_us;
+  uint64_t next_angle_change_us = simulator.time_us() + kAngleChangePeriod_us;
+  uint64_t next_speed_change_us = simulator.time_us() + kSpeedChangePeriod_us;
+  while (simulator.time_us() < kEndTime_us) {
+    uint64_t next_change_us = std::min(std::min(next_angle_change_us, next_speed_change_us), kEndTime_us);
+    simulator.RunUntil(jitter, next_change_us - simulator.time_us());
+    if (simulator.time_us() >= kEndTime_us) break;
+    simulator.set_loop_pass_time_ns(10000);
+    if (simulator.time_us() >= next_angle_change_us) {
+      MTSPIN_CHECK(SendCommand(sequence++, kAction, {'a'}) == kStatusOk);
+      next_angle_change_us += kAngleChangePeriod_us;
+    }
+
+    if (simulator.time_us() >= next_speed_change_us) {
+      MTSPIN_CHECK(SendCommand(sequence++, kAction, {'s'}) == kStatusOk);
+      next_speed_change_us += kSpeedChangePeriod_us;
+    }
+
+    change_times_ns.push_back(simulator.time_ns());
+  }
+
+  // Find the turning points.
+  const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+  std::vector<TurningPoint> turning_points;
+  for (size_t index = 1; index < steps.size(); index++) {
+    if (steps[index].direction == steps[index - 1].direction) continue;
+    turning_points.push_back({steps[index - 1].time_ns, steps[index - 1].position, steps[index - 1].direction});
+  }
+
+  // The centre (midway between consecutive turning points) stays where the oscillation started (motion starts at one
+  // end, from the position the axis was at). A sweep during which the sweep angle changed runs from an old end to a
+  // new one, so it is skipped.
+  int32_t max_centre_drift = 0;
+  if (MTSPIN_CHECK(turning_points.size() > 10)) {
+    int32_t centre_x2 = turning_points[0].position + turning_points[1].position;
+    size_t change = 0;
+    for (size_t index = 2; index < turning_points.size(); index++) {
+      bool changed = false;
+      while (change < change_times_ns.size() && change_times_ns[change] <= turning_points[index].time_ns) {
+        changed = changed || change_times_ns[change] > turning_points[index - 1].time_ns;
+        change++;
+      }
+
+      if (changed) continue;
+      int32_t drift_x2 = turning_points[index - 1].position + turning_points[index].position - centre_x2;
+      max_centre_drift = std::max(max_centre_drift, std::abs(drift_x2) / 2);
+    }
+  }
+
+  // The period (between turns at the positive end) is steady between changes of settings.
+  double max_period_deviation_ms = 0.0;
+  size_t cycle_count = 0;
+  size_t change = 0;
+  std::vector<uint64_t> periods_ns;
+  uint64_t previous_turn_ns = 0;
+  auto check_periods = [&]() {
+    if (periods_ns.size() <= kSettleCycles + 1) return;
+    double mean_ns = 0.0;
+    for (size_t index = kSettleCycles; index < periods_ns.size(); index++) mean_ns += periods_ns[index];
+    mean_ns /= periods_ns.size() - kSettleCycles;
+    for (size_t index = kSettleCycles; index < periods_ns.size(); index++) {
+      max_period_deviation_ms = std::fmax(max_period_deviation_ms, std::fabs(periods_ns[index] - mean_ns) / 1e6);
+    }
+
+    cycle_count += periods_ns.size() - kSettleCycles;
+  };
+  for (const TurningPoint& turning_point : turning_points) {
+    if (turning_point.direction != 1) continue;
+    if (change < change_times_ns.size() && turning_point.time_ns > change_times_ns[change]) {
+      check_periods();
+      periods_ns.clear();
+      previous_turn_ns = 0;
+      while (change < change_times_ns.size() && turning_point.time_ns > change_times_ns[change]) change++;
+    }
+
+    if (previous_turn_ns != 0) periods_ns.push_back(turning_point.time_ns - previous_turn_ns);
+    previous_turn_ns = turning_point.time_ns;
+  }
+
+  check_periods();
+  MTSPIN_CHECK(cycle_count > 100);
+  MTSPIN_CHECK(max_centre_drift == 0);
+  MTSPIN_CHECK(max_period_deviation_ms < 0.01);
+  printf("%zu turning points, %zu settings changes: worst centre drift %d microsteps; worst period deviation %.3f ms "
+         "(over %zu cycles)\n", turning_points.size(), change_times_ns.size(), max_centre_drift,
+         max_period_deviation_ms, cycle_count);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,142 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file ramp_table_test.cpp
+/// @brief Test of the compile-time acceleration ramp table and speed profiles (trapezoidal profile), and a benchmark
+/// of the cost per ramp step of the table lookup against the division recurrence it replaced.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "configuration.h"
+#include "hal.h"
+#include "motion_math.h"
+#include "ramp_table.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::kRampTable;
+using mtspin::kRampTableSize;
+
+namespace {
+
+constexpr uint32_t kBenchmarkRamps = 20000; ///< No. of ramps (up and down) to time.
+
+/// @brief Step interval recurrence that the ramp table replaced (D. Austin, 2005; Q24.8 fixed-point, us).
+class RampRecurrence {
+ public:
+
+  /// @brief Construct a Ramp Recurrence object.
+  /// @param acceleration_microsteps_per_s_per_s The acceleration (microsteps per second-squared).
+  explicit RampRecurrence(float acceleration_microsteps_per_s_per_s) {
+    float initial_interval_us = 0.676F * sqrtf(2.0F / acceleration_microsteps_per_s_per_s) * 1000000.0F;
+    initial_interval_q8_ = static_cast<uint32_t>(initial_interval_us * 256.0F);
+    interval_q8_ = initial_interval_q8_;
+  }
+
+  /// @brief Advance one microstep of acceleration.
+  /// @return The step interval (us).
+  uint32_t Accelerate() {
+    ramp_step_++;
+    interval_q8_ -= (2 * interval_q8_) / (4 * ramp_step_ + 1);
+    return interval_q8_ >> 8;
+  }
+
+  /// @brief Advance one microstep of deceleration.
+  /// @return The step interval (us).
+  uint32_t Decelerate() {
+    interval_q8_ += (2 * interval_q8_) / (4 * ramp_step_ - 1);
+    ramp_step_--;
+    if (ramp_step_ == 0) interval_q8_ = initial_interval_q8_;
+    return interval_q8_ >> 8;
+  }
+
+ private:
+
+  uint32_t initial_interval_q8_ = 0; ///< First step interval (us, Q24.8).
+  uint32_t interval_q8_ = 0; ///< Step interval (us, Q24.8) at the current ramp step.
+  uint32_t ramp_step_ = 0; ///< No. of microsteps of acceleration.
+};
+
+/// @brief Get the nanoseconds elapsed since a start time.
+/// @param start The start time.
+/// @return The time (ns).
+double ElapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main() {
+  const double acceleration = Configuration::kAcceleration_microsteps_per_s_per_s_;
+  const double top_speed = mtspin::RpmToMicrostepsPerSecond(mtspin::MaxSpeedRpm());
+
+  // The table reaches the fastest speed, and each entry is the exact constant acceleration step time (rounded to 1 us).
+  MTSPIN_CHECK(kRampTableSize == static_cast<uint16_t>(top_speed * top_speed / (2.0 * acceleration)) + 1);
+  uint32_t mismatch_count = 0;
+  bool non_increasing = true;
+  for (uint16_t n = 0; n < kRampTableSize; n++) {
+    double exact_us = std::sqrt(2.0 / acceleration) * 1e6 * (std::sqrt(n + 1.0) - std::sqrt(n));
+    uint16_t interval_us = mtspin::hal::ReadFlashWord(&kRampTable.intervals_us[n]);
+    if (std::fabs(interval_us - exact_us) > 0.5 + 1e-6) mismatch_count++;
+    if (n > 0 && interval_us > mtspin::hal::ReadFlashWord(&kRampTable.intervals_us[n - 1])) non_increasing = false;
+  }
+
+  MTSPIN_CHECK(mismatch_count == 0);
+  MTSPIN_CHECK(non_increasing);
+  MTSPIN_CHECK(kRampTable.intervals_us[kRampTableSize - 1] <= std::lround(1e6 / top_speed));
+
+  // Each speed profile ramps for v^2 / 2a microsteps, taking v / a (to within a microstep), to the cruise interval.
+  for (uint8_t row = 0; row < 2; row++) {
+    for (uint8_t index = 0; index < Configuration::kSizeOfSpeeds_; index++) {
+      double speed = mtspin::RpmToMicrostepsPerSecond(Configuration::kSpeeds_RPM_[row][index]);
+      const mtspin::StepAxis::SpeedProfile& profile = mtspin::kSpeedProfiles.profiles[row][index];
+      MTSPIN_CHECK(profile.interval_us == std::lround(1e6 / speed));
+      MTSPIN_CHECK(profile.ramp_steps == static_cast<uint16_t>(speed * speed / (2.0 * acceleration)));
+      double ramp_time_s = 0.0;
+      for (uint16_t n = 0; n < profile.ramp_steps; n++) ramp_time_s += kRampTable.intervals_us[n] / 1e6;
+      MTSPIN_CHECK(std::fabs(ramp_time_s - speed / acceleration) < 1.0 / speed);
+    }
+  }
+
+  // Cost per ramp step: table lookup against the recurrence (both accelerate to the top speed and back).
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t ramp = 0; ramp < kBenchmarkRamps; ramp++) {
+    uint32_t total_us = 0;
+    for (uint16_t n = 0; n < kRampTableSize; n++) total_us += mtspin::hal::ReadFlashWord(&kRampTable.intervals_us[n]);
+    for (uint16_t n = kRampTableSize; n > 0; n--) {
+      total_us += mtspin::hal::ReadFlashWord(&kRampTable.intervals_us[n - 1]);
+    }
+
+    sink = sink + total_us;
+  }
+
+  double table_ns = ElapsedNs(start) / (2.0 * kRampTableSize * kBenchmarkRamps);
+  double max_recurrence_error_us = 0.0;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t ramp = 0; ramp < kBenchmarkRamps; ramp++) {
+    RampRecurrence recurrence(Configuration::kAcceleration_microsteps_per_s_per_s_);
+    uint32_t total_us = 0;
+    for (uint16_t n = 1; n < kRampTableSize; n++) {
+      uint32_t interval_us = recurrence.Accelerate();
+      total_us += interval_us;
+      if (ramp == 0) {
+        double error_us = std::fabs(static_cast<double>(interval_us) - kRampTable.intervals_us[n]);
+        if (error_us > max_recurrence_error_us) max_recurrence_error_us = error_us;
+      }
+    }
+
+    for (uint16_t n = kRampTableSize; n > 1; n--) total_us += recurrence.Decelerate();
+    sink = sink + total_us;
+  }
+
+  double recurrence_ns = ElapsedNs(start) / (2.0 * (kRampTableSize - 1) * kBenchmarkRamps);
+  printf("Ramp table: %u entries to %.0f microsteps/s\n", kRampTableSize, top_speed);
+  printf("Host time per ramp step: table %.2f ns, recurrence %.2f ns\n", table_ns, recurrence_ns);
+  printf("Largest recurrence step interval error (vs the exact step time): %.0f us\n", max_recurrence_error_us);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,199 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file report_test.cpp
+/// @brief Test of the reports (built with MTSPIN_INSTRUMENTATION and MTSPIN_STEP_TRACE): the version, statistics,
+/// step trace and task reports, requested together while jogging with telemetry on and the log saturating the serial
+/// link, are each written out in full, a line at a time, without blocking the loop (no long loop passes, no task
+/// overruns, and telemetry on time); and commands sent meanwhile are all acknowledged, never inside a line.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+#include "version.h"
+
+using mtspin::Configuration;
+using mtspin::host::MakeFrame;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kTelemetry = 0x40; ///< Frame type of telemetry.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kLogPeriod_us = 1000; ///< Time (us) between 'l' messages, while saturating the serial link.
+constexpr unsigned kFramedLogInterval = 10; ///< Every how many 'l' messages one is sent in a frame (acknowledged).
+constexpr uint64_t kTimeout_us = 3000000; ///< Longest time (us) the reports may take to be written.
+constexpr uint64_t kMinRunTime_us = 1000000; ///< Shortest time (us) the loop and telemetry are measured for.
+constexpr uint64_t kMaxPassTime_ns = 200000; ///< Longest loop pass allowed while the reports are written.
+const char* const kTaskNames[] = {"Motion service", "Input scan", "Serial parse", "Log drain", "Telemetry"};
+
+/// @brief Task line of the task report.
+struct TaskLine {
+  bool found = false; ///< Flag to keep track of whether the line was found.
+  unsigned long run_count = 0; ///< No. of runs.
+  unsigned overrun_count = 0; ///< No. of runs over budget.
+  unsigned late_count = 0; ///< No. of runs started after their deadline.
+};
+
+/// @brief Find the line of a task in the (latest) task report.
+/// @param text The log text.
+/// @param name The task name.
+/// @return The line.
+TaskLine FindTaskLine(const std::string& text, const char* name) {
+  TaskLine task_line;
+  size_t report = text.rfind("Task: runs");
+  if (report == std::string::npos) return task_line;
+  size_t line = text.find(std::string("\n") + name + ": ", report);
+  if (line == std::string::npos) return task_line;
+  task_line.found = sscanf(text.c_str() + line + 1 + strlen(name), ": %lu, %u, %u", &task_line.run_count,
+                           &task_line.overrun_count, &task_line.late_count) == 3;
+  return task_line;
+}
+
+/// @brief Check if the (latest) task report is complete.
+/// @param text The log text.
+/// @return True if complete.
+bool IsTaskReportComplete(const std::string& text) {
+  return std::all_of(std::begin(kTaskNames), std::end(kTaskNames), [&](const char* name) {
+    return FindTaskLine(text, name).found;
+  });
+}
+
+/// @brief Count the bytes of the step trace dump, from its hexadecimal lines (other lines, e.g., interleaved log
+/// messages, are skipped).
+/// @param text The log text.
+/// @param header_bytes Set to the no. of bytes given by the header, or 0 if there is no complete dump.
+/// @return The no. of bytes.
+size_t CountTraceBytes(const std::string& text, unsigned& header_bytes) {
+  header_bytes = 0;
+  size_t header = text.find("Step trace: ");
+  size_t end = text.find("Step trace end");
+  if (header == std::string::npos || end == std::string::npos || end < header) return 0;
+  unsigned values[3] = {};
+  sscanf(text.c_str() + header, "Step trace: axes %u, directions %u, records dropped %u, bytes %u", &values[0],
+         &values[1], &values[2], &header_bytes);
+  size_t byte_count = 0;
+  std::istringstream lines(text.substr(header, end - header));
+  std::string line;
+  std::getline(lines, line); // Header.
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty() && line.size() % 2 == 0 && line.find_first_not_of("0123456789ABCDEF") == std::string::npos) {
+      byte_count += line.size() / 2;
+    }
+  }
+
+  return byte_count;
+}
+
+} // namespace
+
+int main() {
+  const double top_speed_RPM = Configuration::kSpeeds_RPM_[1][Configuration::kSizeOfSpeeds_ - 1];
+  const double period_ms = Configuration::kTelemetryPeriod_ms_;
+  Simulator& simulator = Simulator::GetInstance();
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Jog at the top speed (filling the step trace), with telemetry and log output on; then reset the task statistics.
+  uint8_t sequence = 0;
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, mtspin::host::Q16Bytes(top_speed_RPM)) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'b'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'r'}) == kStatusOk);
+  simulator.Run(1000000);
+  size_t output_start = simulator.serial_output().size();
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'k'}) == kStatusOk);
+  simulator.RunUntil([&]() { return IsTaskReportComplete(mtspin::host::LogText(output_start)); }, kTimeout_us);
+
+  // Request all the reports at once, while saturating the serial link with log messages (for several telemetry
+  // periods, however soon the reports are complete).
+  output_start = simulator.serial_output().size();
+  simulator.ResetLoopStatistics();
+  for (uint8_t character : {'v', 'p', 'c', 'k'}) simulator.SendSerial(MakeFrame(sequence++, kAction, {character}));
+  uint64_t time_us = 0;
+  uint64_t report_time_us = kTimeout_us;
+  size_t framed_count = 4;
+  std::string text;
+  for (unsigned count = 1; time_us < std::max(report_time_us, kMinRunTime_us) && time_us < kTimeout_us; count++) {
+    if (count % kFramedLogInterval == 0) {
+      simulator.SendSerial(MakeFrame(sequence++, kAction, {'l'}));
+      framed_count++;
+    }
+    else {
+      simulator.SendSerial("l");
+    }
+
+    simulator.Run(kLogPeriod_us);
+    time_us += kLogPeriod_us;
+    text = mtspin::host::LogText(output_start);
+    if (report_time_us == kTimeout_us && IsTaskReportComplete(text)) report_time_us = time_us;
+  }
+
+  Simulator::LoopStatistics statistics = simulator.loop_statistics();
+  size_t acknowledged = 0;
+  size_t mid_line_acknowledgements = 0;
+  double max_gap_ms = 0.0;
+  const mtspin::host::Frame* previous = nullptr;
+  const std::vector<Simulator::SerialByte>& output = simulator.serial_output();
+  size_t previous_end = output_start;
+  bool previous_at_line_start = true;
+  std::vector<mtspin::host::Frame> frames = mtspin::host::FindFrames(output_start);
+  for (const mtspin::host::Frame& frame : frames) {
+    // A frame is at the start of a line if it follows a line end, or another frame at the start of a line.
+    bool at_line_start = frame.index == previous_end ? previous_at_line_start : output[frame.index - 1].value == '\n';
+    previous_end = frame.index + 5 + frame.payload.size();
+    previous_at_line_start = at_line_start;
+    if (frame.payload.size() == 1 && frame.payload[0] == kStatusOk) acknowledged++;
+    if ((frame.type & 0x80) != 0 && !at_line_start) mid_line_acknowledgements++;
+    if (frame.type != kTelemetry) continue;
+    if (previous != nullptr) max_gap_ms = std::max(max_gap_ms, (frame.time_ns - previous->time_ns) / 1e6);
+    previous = &frame;
+  }
+
+  // Every report is complete: the version, the statistics (through the control action heading), every byte of the
+  // step trace, and a line per task.
+  bool version = text.find(std::string(mtspin::kName) + "-") != std::string::npos;
+  bool statistics_report = text.find("Loop time max (us): ") != std::string::npos
+                           && text.find("Missed steps: ") != std::string::npos
+                           && text.find("Control action: count") != std::string::npos;
+  unsigned trace_header_bytes = 0;
+  size_t trace_bytes = CountTraceBytes(text, trace_header_bytes);
+  bool task_report = IsTaskReportComplete(text);
+  unsigned overrun_count = 0;
+  for (const char* name : kTaskNames) overrun_count += FindTaskLine(text, name).overrun_count;
+
+  MTSPIN_CHECK(acknowledged == framed_count);
+  MTSPIN_CHECK(mid_line_acknowledgements == 0);
+  MTSPIN_CHECK(version);
+  MTSPIN_CHECK(statistics_report);
+  MTSPIN_CHECK(trace_header_bytes > 0);
+  MTSPIN_CHECK(trace_bytes == trace_header_bytes);
+  MTSPIN_CHECK(task_report);
+  MTSPIN_CHECK(overrun_count == 0);
+  MTSPIN_CHECK(statistics.max_pass_time_ns < kMaxPassTime_ns);
+  MTSPIN_CHECK(report_time_us < kTimeout_us);
+  MTSPIN_CHECK(max_gap_ms > 0.0);
+  MTSPIN_CHECK(max_gap_ms <= period_ms + 2.0);
+  MTSPIN_CHECK(simulator.serial_overrun_count() == 0);
+
+  printf("Reports complete (version, statistics, step trace, tasks): %s, %s, %s (%zu of %u bytes), %s in %.0f ms; "
+         "task overruns %u; longest loop pass %.1f us (%.1f us host); longest telemetry gap %.1f ms; acknowledged %zu "
+         "of %zu commands (%zu inside a line)\n",
+         version ? "yes" : "no", statistics_report ? "yes" : "no", trace_bytes == trace_header_bytes ? "yes" : "no",
+         trace_bytes, trace_header_bytes, task_report ? "yes" : "no", report_time_us / 1e3, overrun_count,
+         statistics.max_pass_time_ns / 1e3, statistics.max_host_pass_time_ns / 1e3, max_gap_ms, acknowledged,
+         framed_count, mid_line_acknowledgements);
+  return mtspin::host::TestResult();
+}
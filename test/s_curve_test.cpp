@@ -0,0 +1,204 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file s_curve_test.cpp
+/// @brief Test of the S-curve (jerk-limited) acceleration profile: the ramp to each speed of the speed lookup table
+/// tapers to zero acceleration on reaching it, within the acceleration and jerk limits, and speed changes while moving
+/// (and motion programs at several speeds) stay within the acceleration limit. Built with the S-curve profile.
+
+#include <cmath>
+#include <cstdio>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "ramp_table.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::Q16Bytes;
+using mtspin::host::QueueSegment;
+using mtspin::host::RunUntilStopped;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+
+constexpr double kSampleTime_s = 0.01; ///< Time between motion samples (finite differences of the position).
+constexpr size_t kMinSampledSteps = 20; ///< No. of microsteps into a ramp from which it is sampled.
+
+static_assert(Configuration::kAccelerationProfile_ == Configuration::AccelerationProfile::kSCurve,
+              "Build with the S-curve acceleration profile.");
+
+uint8_t sequence = 0; ///< Sequence no. of the next command.
+
+/// @brief Motion measured from step pulses (finite differences of the position, sampled every kSampleTime_s).
+struct Motion {
+  double max_acceleration = 0.0; ///< Largest acceleration (microsteps per second-squared, magnitude).
+  double max_jerk = 0.0; ///< Largest jerk (microsteps per second-cubed, magnitude).
+};
+
+/// @brief Get the position at a time, interpolated between step pulses.
+/// @param steps The step pulses.
+/// @param time_s The time (s).
+/// @return The position (microsteps).
+double PositionAt(const std::vector<StepRecorder::Step>& steps, double time_s) {
+  size_t low = 0;
+  size_t high = steps.size() - 1;
+  if (time_s <= steps[low].time_ns / 1e9) return steps[low].position;
+  if (time_s >= steps[high].time_ns / 1e9) return steps[high].position;
+  while (high - low > 1) {
+    size_t middle = (low + high) / 2;
+    if (steps[middle].time_ns / 1e9 <= time_s) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  double fraction = (time_s - steps[low].time_ns / 1e9) / ((steps[high].time_ns - steps[low].time_ns) / 1e9);
+  return steps[low].position + fraction * (steps[high].position - steps[low].position);
+}
+
+/// @brief Get the acceleration at a time (second difference of the position).
+/// @param steps The step pulses.
+/// @param time_s The time (s).
+/// @return The acceleration (microsteps per second-squared).
+double AccelerationAt(const std::vector<StepRecorder::Step>& steps, double time_s) {
+  return (PositionAt(steps, time_s + kSampleTime_s) - 2.0 * PositionAt(steps, time_s)
+          + PositionAt(steps, time_s - kSampleTime_s)) / (kSampleTime_s * kSampleTime_s);
+}
+
+/// @brief Measure the motion of step pulses between two times.
+/// @param steps The step pulses.
+/// @param start_s The start time (s).
+/// @param end_s The end time (s).
+/// @return The motion.
+Motion Measure(const std::vector<StepRecorder::Step>& steps, double start_s, double end_s) {
+  Motion motion;
+  double previous_acceleration = AccelerationAt(steps, start_s);
+  for (double time_s = start_s + kSampleTime_s; time_s <= end_s; time_s += kSampleTime_s) {
+    double acceleration = AccelerationAt(steps, time_s);
+    double jerk = (acceleration - previous_acceleration) / kSampleTime_s;
+    motion.max_acceleration = std::fmax(motion.max_acceleration, std::fabs(acceleration));
+    motion.max_jerk = std::fmax(motion.max_jerk, std::fabs(jerk));
+    previous_acceleration = acceleration;
+  }
+
+  return motion;
+}
+
+/// @brief Set the velocity.
+/// @param velocity_RPM The velocity (RPM).
+/// @return The acknowledgement status.
+uint8_t SetVelocity(double velocity_RPM) {
+  return SendCommand(sequence++, kSetVelocity, Q16Bytes(velocity_RPM));
+}
+
+} // namespace
+
+int main() {
+  const double acceleration = Configuration::kSCurveAcceleration_microsteps_per_s_per_s_;
+  const double jerk = Configuration::kSCurveJerk_microsteps_per_s_per_s_per_s_;
+
+  // Each speed of the speed lookup table has a ramp of its own, ending at its speed.
+  for (uint8_t row = 0; row < 2; row++) {
+    for (uint8_t index = 0; index < Configuration::kSizeOfSpeeds_; index++) {
+      const mtspin::StepAxis::SpeedProfile& profile = mtspin::kSpeedProfiles.profiles[row][index];
+      const mtspin::StepAxis::Ramp& ramp = mtspin::kRamps.ramps[profile.ramp];
+      MTSPIN_CHECK(mtspin::kRamps.top_intervals_us[profile.ramp] == profile.interval_us);
+      MTSPIN_CHECK(mtspin::kRampTable.intervals_us[ramp.offset + ramp.size - 1] <= profile.interval_us + 1);
+      mtspin::StepAxis::SpeedProfile runtime_profile = mtspin::MakeSpeedProfileQ16(
+          mtspin::RpmQ16ToMicrostepsPerSecondQ16(mtspin::ToQ16(Configuration::kSpeeds_RPM_[row][index])));
+      MTSPIN_CHECK(runtime_profile.ramp == profile.ramp && runtime_profile.ramp_steps == profile.ramp_steps);
+    }
+  }
+
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+
+  // From rest to each speed: the acceleration rises and falls within the jerk limit, and is close to zero on arrival
+  // (a ramp cut off part way up would arrive at up to the peak acceleration).
+  printf("Speed (RPM)  Time to speed (s)  Trapezoidal (s)  Peak acceleration  Peak jerk  Acceleration on arrival\n");
+  for (uint8_t row = 0; row < 2; row++) {
+    for (uint8_t index = 0; index < Configuration::kSizeOfSpeeds_; index++) {
+      double speed_RPM = Configuration::kSpeeds_RPM_[row][index];
+      double speed = mtspin::RpmToMicrostepsPerSecond(speed_RPM);
+      const mtspin::StepAxis::SpeedProfile& profile = mtspin::kSpeedProfiles.profiles[row][index];
+      step_recorder.Clear();
+      MTSPIN_CHECK(SetVelocity(speed_RPM) == kStatusOk);
+      simulator.Run(600000);
+      MTSPIN_CHECK(SetVelocity(0.0) == kStatusOk);
+      RunUntilStopped(step_recorder);
+
+      const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+      size_t arrival = 1;
+      while (arrival < steps.size()
+             && steps[arrival].time_ns - steps[arrival - 1].time_ns > profile.interval_us * 1000ULL) {
+        arrival++;
+      }
+
+      if (!MTSPIN_CHECK(arrival > 1 && arrival + 1 < steps.size())) continue;
+      double start_s = steps[0].time_ns / 1e9;
+      double arrival_s = steps[arrival - 1].time_ns / 1e9;
+      double time_to_speed_s = arrival_s - start_s;
+      double expected_time_s = speed >= acceleration * acceleration / jerk ? speed / acceleration + acceleration / jerk
+                                                                           : 2.0 * std::sqrt(speed / jerk);
+      // Sample from kMinSampledSteps into the ramp; before that, the position changes by too few whole microsteps
+      // between samples to give the acceleration (the slowest ramps are over within a few samples).
+      Motion motion = Measure(steps, steps[kMinSampledSteps].time_ns / 1e9 + kSampleTime_s, arrival_s + 0.1);
+      double arrival_acceleration = AccelerationAt(steps, arrival_s);
+      MTSPIN_CHECK(std::fabs(time_to_speed_s - expected_time_s) < 0.05 * expected_time_s + 0.005);
+      MTSPIN_CHECK(motion.max_acceleration < 1.05 * acceleration);
+      MTSPIN_CHECK(motion.max_jerk < 1.2 * jerk);
+      MTSPIN_CHECK(std::fabs(arrival_acceleration) < 0.1 * acceleration);
+      printf("%11.0f  %17.3f  %15.3f  %17.0f  %9.0f  %23.0f\n", speed_RPM, time_to_speed_s,
+             speed / Configuration::kAcceleration_microsteps_per_s_per_s_, motion.max_acceleration, motion.max_jerk,
+             arrival_acceleration);
+    }
+  }
+
+  // Speed changes and a reversal while moving: the velocity stays continuous (within the acceleration limit).
+  step_recorder.Clear();
+  for (double velocity_RPM : {80.0, 20.0, 65.0, 12.5, -35.0, 50.0}) {
+    MTSPIN_CHECK(SetVelocity(velocity_RPM) == kStatusOk);
+    simulator.Run(500000);
+  }
+
+  MTSPIN_CHECK(SetVelocity(0.0) == kStatusOk);
+  RunUntilStopped(step_recorder);
+  const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+  Motion speed_changes = Measure(steps, steps.front().time_ns / 1e9, steps.back().time_ns / 1e9);
+  MTSPIN_CHECK(speed_changes.max_acceleration < 1.05 * acceleration);
+
+  // A motion program at several speeds blends between them, and reaches its target without overshooting.
+  step_recorder.Clear();
+  int32_t start_position = step_recorder.position(0);
+  double start_degrees = start_position * 360.0 / mtspin::kMicrostepsPerRevolution;
+  MTSPIN_CHECK(QueueSegment(sequence++, start_degrees + 450.0, 20.0) == kStatusOk);
+  MTSPIN_CHECK(QueueSegment(sequence++, start_degrees + 630.0, 80.0) == kStatusOk);
+  MTSPIN_CHECK(QueueSegment(sequence++, start_degrees + 720.0, 35.0) == kStatusOk);
+  RunUntilStopped(step_recorder);
+  int32_t target = mtspin::DegreesToMicrosteps(static_cast<float>(start_degrees + 720.0));
+  bool forward_only = true;
+  for (const StepRecorder::Step& step : steps) forward_only = forward_only && step.direction == 1;
+  MTSPIN_CHECK(step_recorder.position(0) == target);
+  MTSPIN_CHECK(forward_only);
+  Motion program = Measure(steps, steps.front().time_ns / 1e9, steps.back().time_ns / 1e9);
+  MTSPIN_CHECK(program.max_acceleration < 1.05 * acceleration);
+
+  printf("Speed changes: peak acceleration %.0f; motion program: peak acceleration %.0f\n",
+         speed_changes.max_acceleration, program.max_acceleration);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,153 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file segment_queue_test.cpp
+/// @brief Test of the motion segment queue: angle conversion over the whole Q16.16 range, moves to large angles, and
+/// velocity continuity across blended segments.
+
+#include <cstdio>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "ramp_table.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::QueueSegment;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+
+uint8_t sequence = 0; ///< Sequence no. of the next command.
+
+/// @brief Convert a Q16.16 angle to microsteps, with 128 bit intermediates (reference for DegreesQ16ToMicrosteps()).
+/// @param angle_degrees The angle (degrees, Q16.16).
+/// @return The no. of microsteps (rounded to nearest).
+int32_t ReferenceDegreesQ16ToMicrosteps(mtspin::Q16 angle_degrees) {
+  const __int128 kMicrostepsPerDegree_q32 = static_cast<int64_t>(mtspin::kMicrostepsPerRevolution / 360.0
+                                                                 * 4294967296.0 + 0.5);
+  __int128 microsteps_q48 = static_cast<__int128>(angle_degrees) * kMicrostepsPerDegree_q32
+                            + (static_cast<__int128>(1) << 47);
+  return static_cast<int32_t>(microsteps_q48 >> 48);
+}
+
+/// @brief Run until an axis reaches a position, and stays there.
+/// @param target The position (microsteps).
+/// @param step_recorder The step recorder.
+/// @return True if the position was reached.
+bool RunToPosition(int32_t target, const StepRecorder& step_recorder) {
+  Simulator& simulator = Simulator::GetInstance();
+  simulator.RunUntil([&]() { return step_recorder.position(0) == target; }, 600000000);
+  simulator.Run(200000);
+  return step_recorder.position(0) == target;
+}
+
+/// @brief Get the step intervals of a run of step pulses.
+/// @param steps The step pulses.
+/// @param first The index of the first step pulse.
+/// @param last The index of the last step pulse.
+/// @return The longest interval (us) between consecutive pulses.
+double MaxInterval(const std::vector<StepRecorder::Step>& steps, size_t first, size_t last) {
+  double max_interval_us = 0.0;
+  for (size_t index = first + 1; index <= last; index++) {
+    double interval_us = (steps[index].time_ns - steps[index - 1].time_ns) / 1000.0;
+    if (interval_us > max_interval_us) max_interval_us = interval_us;
+  }
+
+  return max_interval_us;
+}
+
+} // namespace
+
+int main() {
+  // The conversion is exact (against 128 bit maths) over the whole Q16.16 range, including angles that overflowed 64
+  // bit intermediates (above ~7372 degrees).
+  uint32_t mismatch_count = 0;
+  for (int64_t angle = INT32_MIN; angle <= INT32_MAX; angle += 9973) {
+    if (mtspin::DegreesQ16ToMicrosteps(static_cast<mtspin::Q16>(angle))
+        != ReferenceDegreesQ16ToMicrosteps(static_cast<mtspin::Q16>(angle))) {
+      mismatch_count++;
+    }
+  }
+
+  MTSPIN_CHECK(mismatch_count == 0);
+  for (mtspin::Q16 angle : {INT32_MIN, INT32_MIN + 1, -1, 0, 1, INT32_MAX, mtspin::ToQ16(7372.0F),
+                            mtspin::ToQ16(7373.0F), mtspin::ToQ16(-7373.0F), mtspin::ToQ16(32767.9F)}) {
+    MTSPIN_CHECK(mtspin::DegreesQ16ToMicrosteps(angle) == ReferenceDegreesQ16ToMicrosteps(angle));
+  }
+
+  MTSPIN_CHECK(mtspin::DegreesQ16ToMicrosteps(mtspin::ToQ16(10000.0F)) == mtspin::DegreesToMicrosteps(10000.0F));
+  MTSPIN_CHECK(mtspin::DegreesQ16ToMicrosteps(mtspin::ToQ16(-30000.0F)) == mtspin::DegreesToMicrosteps(-30000.0F));
+
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+
+  // Moves to large angles.
+  MTSPIN_CHECK(QueueSegment(sequence++, 9000.0, 80.0) == kStatusOk);
+  MTSPIN_CHECK(RunToPosition(mtspin::DegreesToMicrosteps(9000.0F), step_recorder));
+  MTSPIN_CHECK(QueueSegment(sequence++, -8000.5, 80.0) == kStatusOk);
+  MTSPIN_CHECK(RunToPosition(mtspin::DegreesToMicrosteps(-8000.5F), step_recorder));
+  MTSPIN_CHECK(QueueSegment(sequence++, 0.0, 80.0) == kStatusOk);
+  MTSPIN_CHECK(RunToPosition(0, step_recorder));
+
+  // Segments in the same direction at the same speed, with no dwell, blend at speed: no step interval between the end
+  // of the first acceleration ramp and the start of the last deceleration ramp is longer than the cruise interval.
+  const double kSpeed_RPM = 65.0;
+  const mtspin::StepAxis::SpeedProfile profile = mtspin::MakeSpeedProfileQ16(
+      mtspin::RpmQ16ToMicrostepsPerSecondQ16(mtspin::ToQ16(kSpeed_RPM)));
+  step_recorder.Clear();
+  for (double angle_degrees : {90.0, 180.0, 270.0, 360.0}) {
+    MTSPIN_CHECK(QueueSegment(sequence++, angle_degrees, kSpeed_RPM) == kStatusOk);
+  }
+
+  MTSPIN_CHECK(RunToPosition(mtspin::DegreesToMicrosteps(360.0F), step_recorder));
+  const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+  MTSPIN_CHECK(steps.size() == static_cast<size_t>(mtspin::DegreesToMicrosteps(360.0F)));
+  size_t cruise_start = profile.ramp_steps;
+  size_t cruise_end = steps.size() - profile.ramp_steps - 1;
+  double max_cruise_interval_us = MaxInterval(steps, cruise_start, cruise_end);
+  double max_interval_change_us = 0.0;
+  for (size_t index = cruise_start + 2; index <= cruise_end; index++) {
+    double interval_us = (steps[index].time_ns - steps[index - 1].time_ns) / 1000.0;
+    double previous_interval_us = (steps[index - 1].time_ns - steps[index - 2].time_ns) / 1000.0;
+    double change_us = interval_us > previous_interval_us ? interval_us - previous_interval_us
+                                                          : previous_interval_us - interval_us;
+    if (change_us > max_interval_change_us) max_interval_change_us = change_us;
+  }
+
+  MTSPIN_CHECK(max_cruise_interval_us <= profile.interval_us + 1.0);
+  MTSPIN_CHECK(max_interval_change_us <= 1.0);
+
+  // Segments at different speeds blend by accelerating (or decelerating) between them, without stopping: the step
+  // interval never exceeds that of the slowest segment by more than a ramp step (the ramp steps of a speed are rounded
+  // down, so accelerating on from its cruise speed starts one ramp step below it).
+  const double kSpeeds_RPM[] = {20.0, 80.0, 35.0};
+  step_recorder.Clear();
+  MTSPIN_CHECK(QueueSegment(sequence++, 450.0, kSpeeds_RPM[0]) == kStatusOk);
+  MTSPIN_CHECK(QueueSegment(sequence++, 630.0, kSpeeds_RPM[1]) == kStatusOk);
+  MTSPIN_CHECK(QueueSegment(sequence++, 720.0, kSpeeds_RPM[2]) == kStatusOk);
+  MTSPIN_CHECK(RunToPosition(mtspin::DegreesToMicrosteps(720.0F), step_recorder));
+  const mtspin::StepAxis::SpeedProfile slowest = mtspin::MakeSpeedProfileQ16(
+      mtspin::RpmQ16ToMicrostepsPerSecondQ16(mtspin::ToQ16(kSpeeds_RPM[0])));
+  const mtspin::StepAxis::SpeedProfile last = mtspin::MakeSpeedProfileQ16(
+      mtspin::RpmQ16ToMicrostepsPerSecondQ16(mtspin::ToQ16(kSpeeds_RPM[2])));
+  double max_blend_interval_us = MaxInterval(steps, slowest.ramp_steps, steps.size() - last.ramp_steps - 1);
+  MTSPIN_CHECK(max_blend_interval_us <= mtspin::kRampTable.intervals_us[slowest.ramp_steps]);
+
+  printf("Blended segments at %.0f RPM: longest interval %.0f us (cruise %u us), largest interval change %.0f us\n",
+         kSpeed_RPM, max_cruise_interval_us, profile.interval_us, max_interval_change_us);
+  printf("Blended segments at 20/80/35 RPM: longest interval %.0f us (20 RPM cruise %u us)\n", max_blend_interval_us,
+         slowest.interval_us);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,75 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file startup_test.cpp
+/// @brief Test of the startup state machine: commands are acknowledged from the first loop after reset, while the
+/// stepper driver is only enabled (and motion only starts) once the startup time has elapsed.
+
+#include <cstdio>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::MakeFrame;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kQueueSegment = 0x04; ///< Frame type of a motion segment.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint8_t kStatusBusy = 5; ///< Acknowledgement status: busy.
+
+/// @brief Check if the stepper driver of an axis is enabled.
+/// @param axis The axis.
+/// @return True if enabled.
+bool IsDriverEnabled(uint8_t axis) {
+  bool energised_high = Configuration::kEnergisedPinState_ == mt::StepperDriver::PinState::kHigh;
+  return Simulator::GetInstance().ReadPin(Configuration::kEnaPins_[axis]) == energised_high;
+}
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  const uint64_t kStartupDelay_us = Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL;
+  simulator.Setup();
+  simulator.Run(1000);
+
+  // A command sent 1 ms after reset is acknowledged at once, rather than after the startup time.
+  std::vector<uint8_t> frame = MakeFrame(1, kAction, {'m'});
+  uint64_t frame_end_ns = simulator.time_ns() + frame.size() * 10000000000ULL / MTSPIN_BAUD_RATE;
+  size_t start_index = simulator.serial_output().size();
+  simulator.SendSerial(frame);
+  simulator.RunUntil([&]() { return !mtspin::host::FindFrames(start_index).empty(); }, kStartupDelay_us);
+  std::vector<mtspin::host::Frame> frames = mtspin::host::FindFrames(start_index);
+  MTSPIN_CHECK(frames.size() == 1 && frames[0].payload.size() == 1 && frames[0].payload[0] == kStatusOk);
+  double acknowledgement_ms = frames.empty() ? 0.0 : (frames[0].time_ns - frame_end_ns) / 1e6;
+  MTSPIN_CHECK(acknowledgement_ms < 5.0);
+
+  // Segments are refused (so the host resends them) while the start of motion is held off.
+  std::vector<uint8_t> segment = mtspin::host::MakeSegmentPayload(90.0, 20.0);
+  MTSPIN_CHECK(SendCommand(2, kQueueSegment, segment) == kStatusBusy);
+
+  // The stepper driver is enabled, and motion starts, only once the startup time has elapsed.
+  simulator.RunUntil([&]() { return IsDriverEnabled(0); }, kStartupDelay_us + 100000);
+  uint64_t enabled_ms = simulator.time_us() / 1000;
+  MTSPIN_CHECK(enabled_ms >= Configuration::GetInstance().kStartupDelay_ms_);
+  MTSPIN_CHECK(enabled_ms <= Configuration::GetInstance().kStartupDelay_ms_ + 10U);
+  simulator.Run(100000);
+  MTSPIN_CHECK(mtspin::host::SerialText().find("...Setup complete...") != std::string::npos);
+  MTSPIN_CHECK(!step_recorder.steps(0).empty());
+  MTSPIN_CHECK(step_recorder.steps(0).empty() || step_recorder.steps(0)[0].time_ns >= kStartupDelay_us * 1000);
+  MTSPIN_CHECK(SendCommand(3, kQueueSegment, segment) == kStatusOk);
+
+  printf("First acknowledgement: %.3f ms after the command (sent 1 ms after reset); driver enabled at %lu ms\n",
+         acknowledgement_ms, static_cast<unsigned long>(enabled_ms));
+  return mtspin::host::TestResult();
+}
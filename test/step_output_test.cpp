@@ -0,0 +1,99 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_output_test.cpp
+/// @brief Test of the step outputs: a motion program (with reversals) gives the exact step count, and every pulse
+/// meets the PUL/DIR delays of the stepper driver. Built with the dynamic (default) and the static
+/// (MTSPIN_STATIC_CONFIGURATION) step outputs, which must give the same result.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::QueueSegment;
+using mtspin::host::RunUntilStopped;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr double kSpeed_RPM = 60.0; ///< Speed of the motion program.
+constexpr double kTargets_degrees[] = {450.0, 90.0, 270.0, -180.0}; ///< Targets of the motion program.
+
+/// @brief Timing of the PUL/DIR outputs, observed from the pin changes.
+struct OutputTiming {
+  uint64_t pulse_count = 0; ///< No. of PUL edges to high.
+  uint64_t min_pulse_width_ns = UINT64_MAX; ///< Shortest time PUL was high.
+  uint64_t min_direction_setup_ns = UINT64_MAX; ///< Shortest time from a DIR change to the next PUL edge to high.
+  uint64_t pulse_start_ns = 0; ///< Time (ns) of the latest PUL edge to high.
+  uint64_t direction_change_ns = 0; ///< Time (ns) of the latest DIR change.
+  bool direction_changed = false; ///< Flag to keep track of whether DIR changed since the latest pulse.
+};
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  OutputTiming timing;
+  step_recorder.set_pin_observer([&simulator, &timing](uint8_t pin, bool high) {
+    uint64_t time_ns = simulator.time_ns();
+    if (pin == Configuration::kDirPins_[0]) {
+      timing.direction_change_ns = time_ns;
+      timing.direction_changed = true;
+    }
+    else if (pin == Configuration::kPulPins_[0] && high) {
+      timing.pulse_count++;
+      timing.pulse_start_ns = time_ns;
+      if (timing.direction_changed) {
+        timing.min_direction_setup_ns = std::min(timing.min_direction_setup_ns, time_ns - timing.direction_change_ns);
+      }
+
+      timing.direction_changed = false;
+    }
+    else if (pin == Configuration::kPulPins_[0]) {
+      timing.min_pulse_width_ns = std::min(timing.min_pulse_width_ns, time_ns - timing.pulse_start_ns);
+    }
+  });
+
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(0, kAction, {'m'}) == kStatusOk);
+
+  // A motion program with reversals.
+  uint8_t sequence = 1;
+  uint64_t expected_steps = 0;
+  int32_t position = 0;
+  for (double target_degrees : kTargets_degrees) {
+    MTSPIN_CHECK(QueueSegment(sequence++, target_degrees, kSpeed_RPM) == kStatusOk);
+    int32_t target = mtspin::DegreesToMicrosteps(static_cast<float>(target_degrees));
+    expected_steps += target > position ? target - position : position - target;
+    position = target;
+  }
+
+  RunUntilStopped(step_recorder);
+
+  const uint64_t kPulDelay_ns = Configuration::kStepOutputConfigurations_[0].pul_delay_us * 1000ULL;
+  const uint64_t kDirDelay_ns = Configuration::kStepOutputConfigurations_[0].dir_delay_us * 1000ULL;
+  MTSPIN_CHECK(step_recorder.position(0) == position);
+  MTSPIN_CHECK(step_recorder.steps(0).size() == expected_steps);
+  MTSPIN_CHECK(timing.pulse_count == expected_steps);
+  MTSPIN_CHECK(timing.min_pulse_width_ns >= kPulDelay_ns);
+  MTSPIN_CHECK(timing.min_direction_setup_ns >= kDirDelay_ns);
+
+  printf("%s step outputs: %lu steps (expected %lu); shortest pulse %.1f us; shortest DIR setup %.1f us\n",
+         MTSPIN_STATIC_CONFIGURATION ? "Static" : "Dynamic", static_cast<unsigned long>(timing.pulse_count),
+         static_cast<unsigned long>(expected_steps), timing.min_pulse_width_ns / 1e3,
+         timing.min_direction_setup_ns / 1e3);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,103 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_timer_test.cpp
+/// @brief Test of the step timer (hal::BeginStepTimer()): interrupt intervals, and recovery from a callback that runs
+/// past the next interval.
+
+#include <vector>
+
+#include "hal.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::host::Simulator;
+
+namespace {
+
+uint32_t callback_interval_us = 0; ///< Interval (us) the callback returns.
+std::vector<uint64_t> match_times_ns; ///< Compare match time (ns) of each interrupt.
+
+/// @brief Step timer callback; records the compare match of the interrupt.
+/// @return The interval (us) to the next call.
+uint32_t RecordInterrupt() {
+  match_times_ns.push_back(Simulator::GetInstance().step_timer_match_time_ns());
+  return callback_interval_us;
+}
+
+/// @brief Run the step timer for a period, recording the interrupts.
+/// @param interval_us The interval (us) the callback returns.
+/// @param isr_time_us The time (us) the interrupt takes to write the next compare value.
+/// @param period_us The period (us).
+void RunStepTimer(uint32_t interval_us, uint32_t isr_time_us, uint64_t period_us) {
+  Simulator& simulator = Simulator::GetInstance();
+  simulator.set_step_timer_isr_time_ns(isr_time_us * 1000ULL);
+  callback_interval_us = interval_us;
+  simulator.Advance(period_us * 1000); // Let the interval of the previous run elapse.
+  match_times_ns.clear();
+  simulator.Advance(period_us * 1000);
+}
+
+/// @brief Get the longest interval between the compare matches recorded.
+/// @return The interval (ns).
+uint64_t MaxMatchInterval() {
+  uint64_t max_interval_ns = 0;
+  for (size_t index = 1; index < match_times_ns.size(); index++) {
+    uint64_t interval_ns = match_times_ns[index] - match_times_ns[index - 1];
+    if (interval_ns > max_interval_ns) max_interval_ns = interval_ns;
+  }
+
+  return max_interval_ns;
+}
+
+/// @brief Get the shortest interval between the compare matches recorded.
+/// @return The interval (ns).
+uint64_t MinMatchInterval() {
+  uint64_t min_interval_ns = UINT64_MAX;
+  for (size_t index = 1; index < match_times_ns.size(); index++) {
+    uint64_t interval_ns = match_times_ns[index] - match_times_ns[index - 1];
+    if (interval_ns < min_interval_ns) min_interval_ns = interval_ns;
+  }
+
+  return min_interval_ns;
+}
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  sei();
+  callback_interval_us = 500;
+  mtspin::hal::BeginStepTimer(RecordInterrupt, 1000);
+  simulator.Advance(999000);
+  MTSPIN_CHECK(match_times_ns.empty());
+  simulator.Advance(1000);
+  MTSPIN_CHECK(match_times_ns.size() == 1 && match_times_ns[0] == 1000000);
+
+  // Intervals are timed from match to match, so the time the interrupt takes does not add to them.
+  RunStepTimer(500, 0, 100000);
+  MTSPIN_CHECK(match_times_ns.size() == 200);
+  MTSPIN_CHECK(MinMatchInterval() == 500000 && MaxMatchInterval() == 500000);
+  RunStepTimer(500, 100, 100000);
+  MTSPIN_CHECK(match_times_ns.size() == 200);
+  MTSPIN_CHECK(MinMatchInterval() == 500000 && MaxMatchInterval() == 500000);
+
+  // The longest interval, and clamping to it.
+  RunStepTimer(mtspin::hal::kMaxStepTimerInterval_us, 0, 1000000);
+  MTSPIN_CHECK(MinMatchInterval() == mtspin::hal::kMaxStepTimerInterval_us * 1000ULL);
+  MTSPIN_CHECK(MaxMatchInterval() == mtspin::hal::kMaxStepTimerInterval_us * 1000ULL);
+  RunStepTimer(100000, 0, 1000000);
+  MTSPIN_CHECK(MaxMatchInterval() == mtspin::hal::kMaxStepTimerInterval_us * 1000ULL);
+
+  // An interrupt that runs past the next interval: the next one follows shortly after, rather than after the counter
+  // wraps around (~32 ms).
+  RunStepTimer(mtspin::hal::kMinStepTimerInterval_us, 30, 100000);
+  MTSPIN_CHECK(match_times_ns.size() > 2500);
+  MTSPIN_CHECK(MaxMatchInterval() <= 35000);
+  RunStepTimer(20, 15, 100000);
+  MTSPIN_CHECK(MinMatchInterval() == 20000 && MaxMatchInterval() <= 25000);
+
+  return mtspin::host::TestResult();
+}
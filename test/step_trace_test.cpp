@@ -0,0 +1,162 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_trace_test.cpp
+/// @brief Test of the step/direction trace (built with MTSPIN_STEP_TRACE) and the offline analyser
+/// (tools/step_trace_analyser.cpp): a trace dumped after a reversal, once the ring buffer has wrapped, decodes to the
+/// steps emitted on the pins, and the analyser flags an acceleration limit only when it is exceeded.
+///
+/// Usage: step_trace_test <path of step_trace_analyser>
+
+#include <sys/wait.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr const char* kCapturePath = "step_trace_capture.txt"; ///< Path the serial capture is saved to.
+constexpr const char* kCsvPath = "step_trace_capture.csv"; ///< Path the analyser writes the decoded steps to.
+constexpr uint64_t kMaxTimeError_ns = 2000; ///< Largest difference of a traced step time (whole microseconds).
+
+/// @brief Step decoded by the analyser.
+struct TracedStep {
+  double time_s; ///< Time (s) from the record before the first (dropped, if the ring buffer wrapped).
+  long long position; ///< Position (microsteps) relative to the position before the first record.
+};
+
+/// @brief Run the analyser on the serial capture.
+/// @param analyser_path The path of the analyser.
+/// @param options The options.
+/// @return The exit status of the analyser, or -1 if it could not be run.
+int RunAnalyser(const std::string& analyser_path, const std::string& options) {
+  std::string command = analyser_path + " " + options + " " + kCapturePath + " > /dev/null";
+  int status = std::system(command.c_str());
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/// @brief Read the steps decoded by the analyser.
+/// @return The steps.
+std::vector<TracedStep> ReadCsv() {
+  std::vector<TracedStep> steps;
+  std::ifstream input(kCsvPath);
+  std::string line;
+  std::getline(input, line); // Header.
+  while (std::getline(input, line)) {
+    unsigned trace = 0;
+    TracedStep step = {0.0, 0};
+    unsigned axis = 0;
+    if (std::sscanf(line.c_str(), "%u,%lf,%u,%lld", &trace, &step.time_s, &axis, &step.position) == 4) {
+      steps.push_back(step);
+    }
+  }
+
+  return steps;
+}
+
+/// @brief Check if the traced steps match the steps emitted on the pins, from a step on.
+/// @param traced The traced steps.
+/// @param steps The steps emitted on the pins.
+/// @param first Index of the step (of steps) matching the first traced step.
+/// @return True if they match.
+bool Matches(const std::vector<TracedStep>& traced, const std::vector<StepRecorder::Step>& steps, size_t first) {
+  if (first == 0 || first + traced.size() > steps.size()) return false;
+  int32_t origin = steps[first - 1].position;
+  for (size_t index = 0; index < traced.size(); index++) {
+    const StepRecorder::Step& step = steps[first + index];
+    double traced_time_ns = (traced[index].time_s - traced[0].time_s) * 1e9;
+    double time_error_ns = std::fabs((step.time_ns - steps[first].time_ns) - traced_time_ns);
+    if (step.position - origin != traced[index].position || time_error_ns > kMaxTimeError_ns) return false;
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <path of step_trace_analyser>\n", argv[0]);
+    return 2;
+  }
+
+  const std::string analyser_path = argv[1];
+  const double acceleration = Configuration::kAcceleration_microsteps_per_s_per_s_;
+  const double top_speed_RPM = Configuration::kSpeeds_RPM_[1][Configuration::kSizeOfSpeeds_ - 1];
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Reverse from the top speed, and dump the trace just after the reversal.
+  uint8_t sequence = 0;
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, mtspin::host::Q16Bytes(top_speed_RPM)) == kStatusOk);
+  simulator.Run(1500000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'d'}) == kStatusOk);
+  simulator.Run(450000);
+  size_t output_start = simulator.serial_output().size();
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'c'}) == kStatusOk);
+  simulator.RunUntil([&]() {
+    return mtspin::host::SerialText(output_start).find("Step trace end") != std::string::npos;
+  }, 1000000);
+
+  std::string capture = mtspin::host::SerialText(output_start);
+  unsigned size_of_axes = 0;
+  unsigned directions = 0;
+  unsigned dropped_records = 0;
+  size_t header = capture.find("Step trace: ");
+  MTSPIN_CHECK(header != std::string::npos && capture.find("Step trace end") != std::string::npos);
+  if (header != std::string::npos) {
+    sscanf(capture.c_str() + header, "Step trace: axes %u, directions %u, records dropped %u", &size_of_axes,
+           &directions, &dropped_records);
+  }
+
+  MTSPIN_CHECK(size_of_axes == Configuration::kSizeOfAxes_);
+  MTSPIN_CHECK(dropped_records > 0); // The ring buffer wrapped.
+  std::ofstream(kCapturePath) << capture;
+
+  // The decoded steps match the steps on the pins (the latest before the dump), through the reversal.
+  MTSPIN_CHECK(RunAnalyser(analyser_path, std::string("--csv ") + kCsvPath) == 0);
+  std::vector<TracedStep> traced = ReadCsv();
+  const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+  bool matched = false;
+  for (size_t first = 1; !matched && first < steps.size(); first++) matched = Matches(traced, steps, first);
+  bool reversed = false;
+  for (size_t index = 2; index < traced.size(); index++) {
+    reversed = reversed || (traced[index].position - traced[index - 1].position)
+                           != (traced[index - 1].position - traced[index - 2].position);
+  }
+
+  MTSPIN_CHECK(traced.size() > 10);
+  MTSPIN_CHECK(matched);
+  MTSPIN_CHECK(reversed);
+
+  // The acceleration limit is flagged (exit status 1) only when it is below the acceleration of the motion.
+  int within_limit = RunAnalyser(analyser_path, "--max-acceleration " + std::to_string(1.1 * acceleration));
+  int over_limit = RunAnalyser(analyser_path, "--max-acceleration " + std::to_string(0.5 * acceleration));
+  MTSPIN_CHECK(within_limit == 0);
+  MTSPIN_CHECK(over_limit == 1);
+
+  printf("Trace of %zu steps (%u records dropped before it) matched the pins: %s; analyser exit status %d within "
+         "and %d over the acceleration limit\n", traced.size(), dropped_records, matched ? "yes" : "no", within_limit,
+         over_limit);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,153 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file telemetry_test.cpp
+/// @brief Test of telemetry streaming: frames arrive with valid CRCs every telemetry period, report the position and
+/// velocity of the axis, and keep arriving on time (with none dropped) while log messages saturate the serial link.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::Frame;
+using mtspin::host::ReadInt32;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kTelemetry = 0x40; ///< Frame type of telemetry.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint8_t kPayloadSize = 29; ///< Telemetry payload size (bytes).
+constexpr double kVelocity_RPM = 50.0; ///< Velocity of the axis.
+constexpr uint64_t kRunTime_us = 5000000; ///< Time (us) telemetry is measured for (each part of the test).
+constexpr uint64_t kLogPeriod_us = 1000; ///< Time (us) between 'l' messages, while saturating the serial link.
+
+/// @brief Result of checking the telemetry frames.
+struct TelemetryStream {
+  size_t frame_count = 0; ///< No. of telemetry frames.
+  double min_gap_ms = 1e9; ///< Shortest time between frames.
+  double max_gap_ms = 0.0; ///< Longest time between frames.
+  int32_t max_position_error = 0; ///< Largest difference of the position from the steps on the pins (microsteps).
+  int32_t max_velocity_error_centi_RPM = 0; ///< Largest difference of the velocity from the velocity set.
+  bool sequential = true; ///< Flag to keep track of whether the sequence nos. are consecutive.
+  uint16_t dropped_count = 0; ///< No. of frames dropped, as reported by the latest frame.
+};
+
+/// @brief Get the position of the axis at a time, from the steps on the pins.
+/// @param steps The step pulses.
+/// @param time_ns The time (ns).
+/// @return The position (microsteps).
+int32_t PositionAt(const std::vector<StepRecorder::Step>& steps, uint64_t time_ns) {
+  int32_t position = 0;
+  for (const StepRecorder::Step& step : steps) {
+    if (step.time_ns > time_ns) break;
+    position = step.position;
+  }
+
+  return position;
+}
+
+/// @brief Check the telemetry frames written since an index of the serial output.
+/// @param start_index Index of the first byte of the serial output.
+/// @param steps The step pulses.
+/// @return The result.
+TelemetryStream CheckStream(size_t start_index, const std::vector<StepRecorder::Step>& steps) {
+  const int32_t expected_velocity_centi_RPM = static_cast<int32_t>(kVelocity_RPM * 100.0);
+  TelemetryStream stream;
+  const Frame* previous = nullptr;
+  std::vector<Frame> frames = mtspin::host::FindFrames(start_index);
+  for (const Frame& frame : frames) {
+    if (frame.type != kTelemetry) continue;
+    if (!MTSPIN_CHECK(frame.payload.size() == kPayloadSize)) continue;
+    stream.frame_count++;
+    int32_t position = ReadInt32(&frame.payload[9]);
+    int32_t velocity_centi_RPM = ReadInt32(&frame.payload[13]);
+    int32_t position_error = std::abs(position - PositionAt(steps, frame.time_ns));
+    int32_t velocity_error_centi_RPM = std::abs(velocity_centi_RPM - expected_velocity_centi_RPM);
+    stream.max_position_error = std::max(stream.max_position_error, position_error);
+    stream.max_velocity_error_centi_RPM = std::max(stream.max_velocity_error_centi_RPM, velocity_error_centi_RPM);
+    stream.dropped_count = frame.payload[27] | (frame.payload[28] << 8);
+    if (previous != nullptr) {
+      double gap_ms = (frame.time_ns - previous->time_ns) / 1e6;
+      stream.min_gap_ms = std::min(stream.min_gap_ms, gap_ms);
+      stream.max_gap_ms = std::max(stream.max_gap_ms, gap_ms);
+      stream.sequential = stream.sequential && frame.sequence == static_cast<uint8_t>(previous->sequence + 1);
+    }
+
+    previous = &frame;
+  }
+
+  return stream;
+}
+
+/// @brief Print the result of checking the telemetry frames.
+/// @param name The name of the part of the test.
+/// @param stream The result.
+void PrintStream(const char* name, const TelemetryStream& stream) {
+  printf("%-10s %6zu %13.1f %13.1f %21d %25.2f %8u\n", name, stream.frame_count, stream.min_gap_ms,
+         stream.max_gap_ms, stream.max_position_error, stream.max_velocity_error_centi_RPM / 100.0,
+         stream.dropped_count);
+}
+
+} // namespace
+
+int main() {
+  const double period_ms = Configuration::kTelemetryPeriod_ms_;
+  const size_t expected_frame_count = kRunTime_us / 1000 / Configuration::kTelemetryPeriod_ms_;
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // Jog at constant velocity, then stream.
+  uint8_t sequence = 0;
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, mtspin::host::Q16Bytes(kVelocity_RPM)) == kStatusOk);
+  simulator.Run(1000000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'b'}) == kStatusOk);
+  size_t output_start = simulator.serial_output().size();
+  simulator.Run(kRunTime_us);
+  TelemetryStream quiet = CheckStream(output_start, step_recorder.steps(0));
+
+  // Saturate the serial link with log messages: telemetry still arrives on time, and the log drops messages instead.
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'r'}) == kStatusOk);
+  output_start = simulator.serial_output().size();
+  for (uint64_t time_us = 0; time_us < kRunTime_us; time_us += kLogPeriod_us) {
+    simulator.SendSerial("l");
+    simulator.Run(kLogPeriod_us);
+  }
+
+  TelemetryStream saturated = CheckStream(output_start, step_recorder.steps(0));
+  bool log_dropped = mtspin::host::SerialText(output_start).find("Log messages dropped") != std::string::npos;
+  double link_load = (simulator.serial_output().size() - output_start) / (kRunTime_us / 1e6 * MTSPIN_BAUD_RATE / 10);
+
+  printf("Part       Frames  Min gap (ms)  Max gap (ms)  Max position error  Max velocity error (RPM)  Dropped\n");
+  PrintStream("Quiet", quiet);
+  PrintStream("Saturated", saturated);
+  printf("Serial link load while saturated: %.0f%%; log messages dropped: %s\n", link_load * 100.0,
+         log_dropped ? "yes" : "no");
+  for (const TelemetryStream& stream : {quiet, saturated}) {
+    MTSPIN_CHECK(stream.frame_count + 1 >= expected_frame_count);
+    MTSPIN_CHECK(stream.min_gap_ms >= period_ms - 2.0);
+    MTSPIN_CHECK(stream.max_gap_ms <= period_ms + 2.0);
+    MTSPIN_CHECK(stream.max_position_error <= 1);
+    MTSPIN_CHECK(stream.max_velocity_error_centi_RPM <= 1);
+    MTSPIN_CHECK(stream.sequential);
+    MTSPIN_CHECK(stream.dropped_count == 0);
+  }
+
+  MTSPIN_CHECK(link_load > 0.9);
+  MTSPIN_CHECK(log_dropped);
+  return mtspin::host::TestResult();
+}
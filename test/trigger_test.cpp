@@ -0,0 +1,164 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file trigger_test.cpp
+/// @brief Test of angle-synchronised trigger outputs: the trigger pin is left as an input until a trigger angle is
+/// added, and then, at every speed (in continuous and oscillate modes), it is pulsed at each trigger angle reached,
+/// within a few microseconds of the step pulse reaching it, and at no other position.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "angle_trigger.h"
+#include "configuration.h"
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::AngleTrigger;
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetSpeed = 0x02; ///< Frame type of a speed.
+constexpr uint8_t kSetSweepAngle = 0x03; ///< Frame type of a sweep angle.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kAddTriggerAngle = 0x06; ///< Frame type of a trigger angle.
+constexpr uint8_t kClearTriggerAngles = 0x07; ///< Frame type to clear the trigger angles.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr double kTriggerAngleStep_degrees = 45.0; ///< Angle between trigger angles (a whole no. of microsteps).
+constexpr double kSweepAngle_degrees = 180.0; ///< Sweep angle of the oscillation.
+constexpr uint64_t kSettleTime_us = 1000000; ///< Time (us) from a speed change to the measurement.
+constexpr uint64_t kMaxTriggerDelay_ns = 10000; ///< Longest time allowed from a step pulse to its trigger pulse.
+
+uint8_t sequence = 0; ///< Sequence no. of the next command.
+
+/// @brief Trigger pulses observed while measuring at one speed.
+struct Measurement {
+  size_t trigger_count = 0; ///< No. of trigger pulses.
+  size_t missed_count = 0; ///< No. of trigger angles reached without a trigger pulse.
+  size_t spurious_count = 0; ///< No. of trigger pulses without a trigger angle reached.
+  uint64_t max_delay_ns = 0; ///< Longest time from the step pulse reaching a trigger angle to the trigger pulse.
+  int32_t max_position_error = 0; ///< Largest distance (microsteps) of the position at a trigger pulse from an angle.
+};
+
+/// @brief Get the distance of a position from the nearest trigger angle.
+/// @param position The position (microsteps).
+/// @return The distance (microsteps, within a revolution).
+int32_t TriggerDistance(int32_t position) {
+  const int32_t kRevolution = AngleTrigger::kMicrostepsPerRevolution;
+  const int32_t kStep = mtspin::DegreesToMicrosteps(static_cast<float>(kTriggerAngleStep_degrees));
+  int32_t remainder = ((position % kRevolution) + kRevolution) % kRevolution % kStep;
+  return std::min(remainder, kStep - remainder);
+}
+
+/// @brief Send a command with a Q16 payload.
+/// @param type The frame type.
+/// @param value The value.
+void SendQ16(uint8_t type, double value) {
+  MTSPIN_CHECK(SendCommand(sequence++, type, mtspin::host::Q16Bytes(value)) == kStatusOk);
+}
+
+/// @brief Print a measurement.
+/// @param mode The control mode.
+/// @param speed_RPM The speed (RPM).
+/// @param measurement The measurement.
+void PrintMeasurement(const char* mode, double speed_RPM, const Measurement& measurement) {
+  printf("%-10s %11.1f %8zu %6zu %8zu %14.2f %24d\n", mode, speed_RPM, measurement.trigger_count,
+         measurement.missed_count, measurement.spurious_count, measurement.max_delay_ns / 1e3,
+         measurement.max_position_error);
+}
+
+/// @brief Check a measurement.
+/// @param measurement The measurement.
+void CheckMeasurement(const Measurement& measurement) {
+  MTSPIN_CHECK(measurement.trigger_count > 0);
+  MTSPIN_CHECK(measurement.missed_count == 0);
+  MTSPIN_CHECK(measurement.spurious_count == 0);
+  MTSPIN_CHECK(measurement.max_delay_ns <= kMaxTriggerDelay_ns);
+  MTSPIN_CHECK(measurement.max_position_error == 0);
+}
+
+} // namespace
+
+int main() {
+  const uint8_t kTriggerPin = Configuration::kTriggerPins_[0];
+  const bool kActiveHigh = Configuration::kTriggerActivePinState_ == mtspin::hal::PinState::kHigh;
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  Measurement measurement;
+  uint64_t step_time_ns = 0;
+  bool reach_pending = false;
+  step_recorder.set_pin_observer([&](uint8_t pin, bool high) {
+    if (pin == Configuration::kPulPins_[0] && high) {
+      // A trigger angle reached by the previous step pulse must have been triggered by now.
+      if (reach_pending) measurement.missed_count++;
+      step_time_ns = simulator.time_ns();
+      reach_pending = TriggerDistance(step_recorder.position(0)) == 0;
+      if (reach_pending && simulator.ReadPin(kTriggerPin) == kActiveHigh) reach_pending = false; // Pulse extended.
+    }
+    else if (pin == kTriggerPin && high == kActiveHigh) {
+      measurement.trigger_count++;
+      if (!reach_pending) measurement.spurious_count++;
+      reach_pending = false;
+      measurement.max_delay_ns = std::max(measurement.max_delay_ns, simulator.time_ns() - step_time_ns);
+      measurement.max_position_error = std::max(measurement.max_position_error,
+                                                TriggerDistance(step_recorder.position(0)));
+    }
+  });
+
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  // The trigger pin is left alone until a trigger angle is added.
+  bool output_before = simulator.IsOutput(kTriggerPin);
+  for (double angle = 0.0; angle < 360.0; angle += kTriggerAngleStep_degrees) SendQ16(kAddTriggerAngle, angle);
+  bool output_after = simulator.IsOutput(kTriggerPin);
+  bool inactive_after = simulator.ReadPin(kTriggerPin) != kActiveHigh;
+  MTSPIN_CHECK(!output_before);
+  MTSPIN_CHECK(output_after);
+  MTSPIN_CHECK(inactive_after);
+
+  // Every speed, jogging (for half a revolution) and then oscillating (for a cycle, i.e., a revolution).
+  printf("Mode       Speed (RPM)  Triggers  Missed  Spurious  Max delay (us)  Max position error (microsteps)\n");
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  for (bool oscillate : {false, true}) {
+    if (oscillate) {
+      SendQ16(kSetSweepAngle, kSweepAngle_degrees);
+      MTSPIN_CHECK(SendCommand(sequence++, kAction, {'a'}) == kStatusOk);
+    }
+
+    for (const auto& speeds_RPM : Configuration::kSpeeds_RPM_) {
+      for (double speed_RPM : speeds_RPM) {
+        SendQ16(oscillate ? kSetSpeed : kSetVelocity, speed_RPM);
+        simulator.Run(kSettleTime_us);
+        measurement = {};
+        reach_pending = false;
+        double revolutions = oscillate ? 1.0 : 0.5;
+        simulator.Run(static_cast<uint64_t>(revolutions / (speed_RPM / 60.0) * 1e6));
+        PrintMeasurement(oscillate ? "Oscillate" : "Continuous", speed_RPM, measurement);
+        CheckMeasurement(measurement);
+      }
+    }
+  }
+
+  // Once cleared, no more trigger pulses.
+  MTSPIN_CHECK(SendCommand(sequence++, kClearTriggerAngles, {}) == kStatusOk);
+  measurement = {};
+  reach_pending = false;
+  simulator.Run(kSettleTime_us);
+  size_t triggers_after_clear = measurement.trigger_count;
+  MTSPIN_CHECK(triggers_after_clear == 0);
+
+  printf("Trigger pin an output before/after the first trigger angle: %s/%s; trigger pulses after clearing: %zu\n",
+         output_before ? "yes" : "no", output_after ? "yes" : "no", triggers_after_clear);
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,160 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file velocity_test.cpp
+/// @brief Test of velocity changes in continuous mode: a reversal (from the direction button action or a velocity
+/// frame) ramps straight through zero without stopping, and each change settles at the new velocity in the minimum
+/// time the acceleration limit allows, with the velocity continuous throughout.
+
+#include <cmath>
+#include <cstdio>
+
+#include "configuration.h"
+#include "motion_math.h"
+#include "simulator.h"
+#include "test_support.h"
+
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+using mtspin::host::StepRecorder;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kSetVelocity = 0x05; ///< Frame type of a velocity.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+constexpr uint64_t kChangeTime_us = 1500000; ///< Time (us) each velocity change is run for.
+constexpr double kSampleTime_s = 0.05; ///< Time between motion samples (finite differences of the position).
+
+uint8_t sequence = 0; ///< Sequence no. of the next command.
+
+/// @brief Velocity change.
+struct VelocityChange {
+  const char* name; ///< The name.
+  double from_RPM; ///< The velocity (RPM) before the change.
+  double to_RPM; ///< The velocity (RPM) after the change.
+  bool direction_action; ///< True to make the change with the direction action, rather than a velocity frame.
+};
+
+/// @brief Result of a velocity change.
+struct Change {
+  double settle_time_s; ///< Time from the command to the last step off the new velocity.
+  double reversal_interval_s; ///< Longest interval between steps, around the reversal (if any).
+  double max_acceleration; ///< Largest acceleration (microsteps per second-squared, magnitude).
+};
+
+/// @brief Get the position at a time, interpolated between step pulses.
+/// @param steps The step pulses.
+/// @param time_s The time (s).
+/// @return The position (microsteps).
+double PositionAt(const std::vector<StepRecorder::Step>& steps, double time_s) {
+  size_t index = 1;
+  while (index < steps.size() - 1 && steps[index].time_ns / 1e9 < time_s) index++;
+  const StepRecorder::Step& previous = steps[index - 1];
+  const StepRecorder::Step& next = steps[index];
+  double fraction = (time_s - previous.time_ns / 1e9) / ((next.time_ns - previous.time_ns) / 1e9);
+  fraction = std::fmin(std::fmax(fraction, 0.0), 1.0);
+  return previous.position + fraction * (next.position - previous.position);
+}
+
+/// @brief Run a velocity change, and measure it from the step pulses.
+/// @param command Function that sends the command making the change.
+/// @param velocity The new velocity (microsteps per second).
+/// @param step_recorder The step recorder.
+/// @return The result.
+template <typename Command>
+Change RunChange(Command command, double velocity, StepRecorder& step_recorder) {
+  Simulator& simulator = Simulator::GetInstance();
+  step_recorder.Clear();
+  double command_time_s = simulator.time_ns() / 1e9;
+  command();
+  simulator.Run(kChangeTime_us);
+
+  // The velocity has settled from the step after which every interval is the new one (to the microsecond).
+  const std::vector<StepRecorder::Step>& steps = step_recorder.steps(0);
+  Change change = {0.0, 0.0, 0.0};
+  if (!MTSPIN_CHECK(steps.size() > 2)) return change;
+  int8_t direction = velocity > 0 ? 1 : -1;
+  double interval_s = 1.0 / std::fabs(velocity);
+  size_t settled = steps.size() - 1;
+  while (settled > 0 && steps[settled].direction == direction
+         && std::fabs((steps[settled].time_ns - steps[settled - 1].time_ns) / 1e9 - interval_s) <= 1.5e-6) {
+    settled--;
+  }
+
+  change.settle_time_s = steps[settled].time_ns / 1e9 - command_time_s;
+  double reversal_s = -1.0;
+  for (size_t index = 1; index < steps.size(); index++) {
+    if (steps[index].direction == steps[index - 1].direction) continue;
+    change.reversal_interval_s = (steps[index].time_ns - steps[index - 1].time_ns) / 1e9;
+    reversal_s = steps[index].time_ns / 1e9;
+  }
+
+  // Samples spanning the reversal are skipped: there, a single microstep either way is all there is to interpolate
+  // (the reversal interval is checked instead).
+  double start_s = steps.front().time_ns / 1e9 + kSampleTime_s;
+  double end_s = steps.back().time_ns / 1e9 - kSampleTime_s;
+  for (double time_s = start_s; time_s <= end_s; time_s += kSampleTime_s) {
+    if (std::fabs(time_s - reversal_s) <= 1.5 * kSampleTime_s) continue;
+    double acceleration = (PositionAt(steps, time_s + kSampleTime_s) - 2.0 * PositionAt(steps, time_s)
+                           + PositionAt(steps, time_s - kSampleTime_s)) / (kSampleTime_s * kSampleTime_s);
+    change.max_acceleration = std::fmax(change.max_acceleration, std::fabs(acceleration));
+  }
+
+  return change;
+}
+
+/// @brief Set the velocity.
+/// @param velocity_RPM The velocity (RPM).
+void SetVelocity(double velocity_RPM) {
+  MTSPIN_CHECK(SendCommand(sequence++, kSetVelocity, mtspin::host::Q16Bytes(velocity_RPM)) == kStatusOk);
+}
+
+} // namespace
+
+int main() {
+  const double acceleration = Configuration::kAcceleration_microsteps_per_s_per_s_;
+  const double top_speed_RPM = Configuration::kSpeeds_RPM_[1][Configuration::kSizeOfSpeeds_ - 1];
+  Simulator& simulator = Simulator::GetInstance();
+  StepRecorder step_recorder;
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+  MTSPIN_CHECK(SendCommand(sequence++, kAction, {'m'}) == kStatusOk);
+  SetVelocity(top_speed_RPM);
+  simulator.Run(kChangeTime_us);
+
+  // From the top speed: the direction button action, then velocity frames. Reversals go straight through zero, without
+  // stopping (the interval around zero is at most the time to accelerate one microstep from rest, and back).
+  const VelocityChange kChanges[] = {
+    {"Direction action", top_speed_RPM, -top_speed_RPM, true},
+    {"Velocity frame (reverse)", -top_speed_RPM, top_speed_RPM / 2, false},
+    {"Velocity frame (faster)", top_speed_RPM / 2, top_speed_RPM * 3 / 4, false},
+    {"Velocity frame (reverse)", top_speed_RPM * 3 / 4, -top_speed_RPM / 4, false},
+  };
+  printf("Change                   Settle time (s)  Minimum (s)  Reversal interval (ms)  Peak acceleration\n");
+  for (const VelocityChange& entry : kChanges) {
+    double velocity = mtspin::RpmToMicrostepsPerSecond(entry.to_RPM);
+    double minimum_time_s = std::fabs(velocity - mtspin::RpmToMicrostepsPerSecond(entry.from_RPM)) / acceleration;
+    Change change = RunChange([&]() {
+      if (entry.direction_action) {
+        MTSPIN_CHECK(SendCommand(sequence++, kAction, {'d'}) == kStatusOk);
+      }
+      else {
+        SetVelocity(entry.to_RPM);
+      }
+    }, velocity, step_recorder);
+    bool reversal = (velocity > 0) != (entry.from_RPM > 0);
+    MTSPIN_CHECK(change.settle_time_s > 0.97 * minimum_time_s);
+    MTSPIN_CHECK(change.settle_time_s < 1.03 * minimum_time_s + 0.005);
+    MTSPIN_CHECK(!reversal || (change.reversal_interval_s > 0.0
+                              && change.reversal_interval_s < 2.0 * std::sqrt(2.0 / acceleration)));
+    MTSPIN_CHECK(change.max_acceleration < 1.05 * acceleration);
+    printf("%-24s %15.3f %12.3f %23.1f %18.0f\n", entry.name, change.settle_time_s, minimum_time_s,
+           change.reversal_interval_s * 1e3, change.max_acceleration);
+  }
+
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,46 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file version_test.cpp
+/// @brief Test of the firmware version report: the 'v' message prints the name and version defined in version.h.
+
+#include <cstdio>
+#include <string>
+
+#include "configuration.h"
+#include "simulator.h"
+#include "test_support.h"
+#include "version.h"
+
+using mtspin::Configuration;
+using mtspin::host::SendCommand;
+using mtspin::host::Simulator;
+
+namespace {
+
+constexpr uint8_t kAction = 0x01; ///< Frame type of a message character.
+constexpr uint8_t kStatusOk = 0; ///< Acknowledgement status: OK.
+
+} // namespace
+
+int main() {
+  Simulator& simulator = Simulator::GetInstance();
+  simulator.Setup();
+  simulator.Run(Configuration::GetInstance().kStartupDelay_ms_ * 1000ULL + 100000);
+
+  std::string expected_text = std::string(mtspin::kName) + "-" + std::to_string(mtspin::kMajor) + "."
+                              + std::to_string(mtspin::kMinor) + "." + std::to_string(mtspin::kPatch);
+  if (mtspin::kSuffix[0] != '\0') expected_text += std::string("-") + mtspin::kSuffix;
+  expected_text += "\r\n";
+
+  size_t output_start = simulator.serial_output().size();
+  MTSPIN_CHECK(SendCommand(0, kAction, {'v'}) == kStatusOk);
+  simulator.Run(100000);
+  std::string text = mtspin::host::SerialText(output_start);
+  MTSPIN_CHECK(text.find(expected_text) != std::string::npos);
+
+  printf("Version report: %s", expected_text.c_str());
+  return mtspin::host::TestResult();
+}
@@ -0,0 +1,486 @@
+#!/usr/bin/env python3
+# Copyright (C) 2024 Morgritech
+#
+# Licensed under GNU General Public License v3.0 (GPLv3) License.
+# See the LICENSE file in the project root for full license details.
+
+"""Report the flash, static RAM and worst-case stack usage of the firmware, and check them against a budget.
+
+Builds the sketch with arduino-cli (with -fstack-usage and a linker map), then reports:
+- Flash and static RAM per module (sketch source file, library, core or toolchain library), from the linker map.
+- Worst-case stack depth of the main loop and of the interrupts, from the per-function stack usage (.su files) and the
+  call graph (disassembly). Calls through function pointers are only followed where listed in INDIRECT_CALLS.
+- Any dynamic allocation (heap) referenced by the sketch sources.
+- With --compare-flags, the flash, static RAM and step pulse cost (code size and instruction count of the step timer
+  interrupt and the functions it calls, from the disassembly) of the build with and without the given flags, e.g., to
+  compare the step outputs specialised at compile time (MTSPIN_STATIC_CONFIGURATION) with the default ones.
+Exits with status 1 if the budget of the board (see BOARDS, or the command line options) is exceeded, or the sketch
+references the heap.
+
+Usage: tools/memory_budget.py [--fqbn arduino:avr:uno] [--extra-flags="-DMTSPIN_INSTRUMENTATION=1"]
+       [--compare-flags="-DMTSPIN_STATIC_CONFIGURATION=1"]
+Run with --help for all options.
+"""
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# Board properties and default budgets.
+# - ram/flash: Sizes (bytes) available to the sketch (UNO R3 flash excludes the bootloader).
+# - min_free_ram: RAM (bytes) that must remain free with the static RAM in use and the stack at its deepest.
+# - stack_sections: Sections reserving the stack (if the linker script reserves one); the stack must fit in them.
+# - interrupt_roots: Functions entered by interrupts (regular expression).
+BOARDS = {
+    "arduino:avr:uno": {
+        "tool_prefix": "avr-",
+        "ram": 2048,
+        "flash": 32256,
+        "min_free_ram": 256,
+        "stack_sections": [],
+        "interrupt_roots": r"^__vector_\d+$",
+    },
+    "arduino:renesas_uno:minima": {
+        "tool_prefix": "arm-none-eabi-",
+        "ram": 32768,
+        "flash": 262144,
+        "min_free_ram": 4096,
+        "stack_sections": [".stack_dummy", ".stack"],
+        "interrupt_roots": r"(_isr|_IRQHandler|_Handler)$|^mtspin::hal::StepTimerIsr$",
+    },
+}
+
+# Calls through function pointers (caller, callee), which the disassembly cannot follow.
+INDIRECT_CALLS = [
+    ("__vector_11", "mtspin::StepEngine::OnStepTimer"), # TIMER1_COMPA (UNO R3): step_timer_callback().
+    ("mtspin::hal::StepTimerIsr", "mtspin::StepEngine::OnStepTimer"), # Step timer (UNO R4): step_timer_callback().
+]
+
+# Function that emits the step pulses (entered by the step timer interrupt through INDIRECT_CALLS).
+STEP_PULSE_FUNCTION = "mtspin::StepEngine::OnStepTimer"
+
+# Symbols that only dynamic allocation references.
+HEAP_SYMBOLS = re.compile(r"^(malloc|calloc|realloc|free|operator new|operator delete|String::)")
+
+# Sections that are not loaded into flash or RAM.
+IGNORED_SECTIONS = re.compile(r"^\.(eeprom|fuse|lock|signature|user_signatures|comment|debug|stab|note|ARM\.attributes)")
+
+
+def run(command):
+    """Run a command and return its standard output."""
+    return subprocess.run(command, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def find_tool(prefix, name):
+    """Find a toolchain program on the PATH, or in the toolchains installed by arduino-cli."""
+    program = prefix + name
+    if shutil.which(program):
+        return program
+
+    patterns = [os.path.expanduser("~/.arduino15/packages/*/tools/*/*/bin/" + program)]
+    for pattern in patterns:
+        matches = sorted(glob.glob(pattern))
+        if matches:
+            return matches[-1]
+
+    sys.exit("Cannot find " + program + "; add the toolchain's bin directory to the PATH.")
+
+
+def normalise(name):
+    """Reduce a function name (from a .su file or the demangled disassembly) to a comparable form.
+
+    Drops the return type, parameters and template arguments, e.g. "void ns::Class<3>::Function(int) [with ...]"
+    becomes "ns::Class::Function".
+    """
+    name = name.replace("(anonymous namespace)", "anon").replace("{anonymous}", "anon")
+    stripped = ""
+    depth = 0
+    for character in name:
+        if character == "<":
+            depth += 1
+        elif character == ">" and depth > 0:
+            depth -= 1
+        elif depth == 0:
+            if character == "(" and stripped.strip():
+                break
+            stripped += character
+
+    tokens = stripped.split()
+    return tokens[-1] if tokens else name
+
+
+def compile_sketch(fqbn, sketch, build_path, extra_flags):
+    """Build the sketch with arduino-cli, with per-function stack usage and a linker map (firmware.map)."""
+    os.makedirs(build_path, exist_ok=True)
+    run(["arduino-cli", "compile", "--fqbn", fqbn, "--build-path", build_path,
+         "--build-property", "compiler.cpp.extra_flags=-fstack-usage " + extra_flags,
+         "--build-property", "compiler.c.extra_flags=-fstack-usage",
+         "--build-property", "compiler.c.elf.extra_flags=-Wl,-Map," + os.path.join(build_path, "firmware.map"),
+         sketch])
+
+
+def find_elf(build_path):
+    """Find the ELF file of a build."""
+    elfs = glob.glob(os.path.join(build_path, "*.elf"))
+    if len(elfs) != 1:
+        sys.exit("Expected one .elf file in " + build_path)
+
+    return elfs[0]
+
+
+def read_sections(readelf, elf):
+    """Read the allocated sections of the ELF: name -> (size, in flash, in RAM)."""
+    sections = {}
+    for line in run([readelf, "-S", "-W", elf]).splitlines():
+        match = re.match(r"\s*\[\s*\d+\]\s+(\S+)\s+(\S+)\s+[0-9a-f]+\s+[0-9a-f]+\s+([0-9a-f]+)\s+\S+\s+(\S*)", line)
+        if not match:
+            continue
+
+        name, section_type, size, flags = match.group(1), match.group(2), int(match.group(3), 16), match.group(4)
+        if "A" not in flags or IGNORED_SECTIONS.match(name):
+            continue
+
+        writable = "W" in flags
+        loaded = section_type != "NOBITS"
+        sections[name] = (size, loaded, writable)
+
+    return sections
+
+
+def module_name(path):
+    """Name the module an object file belongs to."""
+    path = path.replace("\\", "/")
+    member = re.match(r"(.*)\((.*)\)$", path)
+    archive = member.group(1) if member else ""
+    if re.search(r"(^|/)sketch/", path):
+        return re.sub(r"\.o$", "", os.path.basename(path))
+
+    library = re.search(r"/libraries/([^/]+)/", path)
+    if library:
+        return "library " + library.group(1)
+
+    if re.search(r"(^|/)core/", path) or archive.endswith("core.a"):
+        return "core"
+
+    return os.path.basename(archive or path)
+
+
+def read_map(map_path, sections):
+    """Attribute the sections in the linker map to modules: module -> [flash bytes, RAM bytes]."""
+    modules = {}
+    in_memory_map = False
+    output_section = None
+    pending_name = None
+    with open(map_path) as map_file:
+        for line in map_file:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                in_memory_map = True
+                continue
+
+            if not in_memory_map:
+                continue
+
+            output = re.match(r"^(\.\S+|\S+)(\s|$)", line)
+            if output and not line.startswith(" "):
+                output_section = output.group(1)
+                pending_name = None
+                continue
+
+            contribution = re.match(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$", line)
+            continuation = re.match(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$", line)
+            if contribution:
+                size, path = int(contribution.group(3), 16), contribution.group(4)
+            elif continuation and pending_name:
+                size, path = int(continuation.group(2), 16), continuation.group(3)
+            else:
+                pending_name = line.strip() if re.match(r"^ [.\w]\S*$", line) else None
+                continue
+
+            pending_name = None
+            if size == 0 or output_section not in sections or path.startswith("load address"):
+                continue
+
+            _, loaded, writable = sections[output_section]
+            usage = modules.setdefault(module_name(path), [0, 0])
+            if loaded:
+                usage[0] += size
+            if writable:
+                usage[1] += size
+
+    return modules
+
+
+def read_stack_usage(build_path):
+    """Read the stack usage of each function from the .su files: normalised name -> (bytes, bounded)."""
+    usage = {}
+    for path in glob.glob(os.path.join(build_path, "**", "*.su"), recursive=True):
+        with open(path) as su_file:
+            for line in su_file:
+                fields = line.rstrip("\n").split("\t")
+                if len(fields) != 3:
+                    continue
+
+                name = normalise(fields[0].split(":", 3)[-1])
+                size = int(fields[1])
+                bounded = fields[2] in ("static", "dynamic,bounded")
+                previous = usage.get(name, (0, True))
+                usage[name] = (max(size, previous[0]), bounded and previous[1])
+
+    return usage
+
+
+def read_call_graph(objdump, elf, sizes=None):
+    """Read the functions and the calls between them from the disassembly: name -> set of callee names.
+
+    If sizes is given, it is filled in with the code size of each function: name -> [bytes, instructions].
+    """
+    graph = {}
+    starts = {}
+    lines = run([objdump, "-d", "-C", elf]).splitlines()
+    for line in lines:
+        header = re.match(r"^([0-9a-f]+) <(.*)>:$", line)
+        if header:
+            starts[int(header.group(1), 16)] = normalise(header.group(2))
+
+    current = None
+    for line in lines:
+        header = re.match(r"^([0-9a-f]+) <(.*)>:$", line)
+        if header:
+            current = starts[int(header.group(1), 16)]
+            graph.setdefault(current, set())
+            continue
+
+        if current is None:
+            continue
+
+        instruction = line.split("\t")
+        if sizes is not None and len(instruction) >= 3 and re.match(r"^\s*[0-9a-f]+:$", instruction[0]):
+            size = sizes.setdefault(current, [0, 0])
+            size[0] += len(instruction[1].split())
+            size[1] += 1
+
+        targets = re.findall(r"(?:0x)?([0-9a-f]+) <", line)
+        if not targets or "\t" not in line:
+            continue
+
+        callee = starts.get(int(targets[-1], 16))
+        if callee is not None and callee != current:
+            graph[current].add(callee)
+
+    return graph
+
+
+def worst_stack(root, graph, stack_usage, unknown, recursive):
+    """Find the deepest call chain from a function: (bytes, chain)."""
+    memo = {}
+
+    def visit(function, active):
+        if function in memo:
+            return memo[function]
+
+        if function in active:
+            recursive.add(function)
+            return 0, []
+
+        if function not in stack_usage:
+            unknown.add(function)
+
+        own = stack_usage.get(function, (0, True))[0]
+        deepest = (0, [])
+        active.add(function)
+        for callee in graph.get(function, ()):
+            depth = visit(callee, active)
+            if depth[0] > deepest[0]:
+                deepest = depth
+
+        active.discard(function)
+        memo[function] = (own + deepest[0], [function] + deepest[1])
+        return memo[function]
+
+    return visit(root, set())
+
+
+def reachable_functions(root, graph):
+    """Find the functions a function calls, directly or not (including itself)."""
+    reached = set()
+    pending = [root]
+    while pending:
+        function = pending.pop()
+        if function not in reached:
+            reached.add(function)
+            pending.extend(graph.get(function, ()))
+
+    return reached
+
+
+def measure(readelf, objdump, elf, indirect_calls):
+    """Measure a build: (flash bytes, static RAM bytes, step pulse bytes, step pulse instructions).
+
+    The step pulse cost is the code of STEP_PULSE_FUNCTION and of every function it calls (e.g., the pin writes and
+    delays when they are not inlined).
+    """
+    sections = read_sections(readelf, elf)
+    flash = sum(size for size, loaded, _ in sections.values() if loaded)
+    static_ram = sum(size for size, _, writable in sections.values() if writable)
+    sizes = {}
+    graph = read_call_graph(objdump, elf, sizes)
+    for caller, callee in indirect_calls:
+        if caller in graph:
+            graph[caller].add(callee)
+
+    step_pulse = reachable_functions(STEP_PULSE_FUNCTION, graph) if STEP_PULSE_FUNCTION in graph else set()
+    step_pulse_bytes = sum(sizes.get(function, [0, 0])[0] for function in step_pulse)
+    step_pulse_instructions = sum(sizes.get(function, [0, 0])[1] for function in step_pulse)
+    return flash, static_ram, step_pulse_bytes, step_pulse_instructions
+
+
+def find_heap_references(nm, build_path):
+    """Find references to dynamic allocation from the sketch objects: object -> [symbols]."""
+    references = {}
+    for path in sorted(glob.glob(os.path.join(build_path, "sketch", "*.o"))):
+        for line in run([nm, "-u", "-C", path]).splitlines():
+            symbol = line.split(None, 1)[-1].strip()
+            if HEAP_SYMBOLS.match(symbol):
+                references.setdefault(os.path.basename(path), []).append(symbol)
+
+    return references
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--fqbn", default="arduino:avr:uno", choices=sorted(BOARDS), help="board to build for")
+    parser.add_argument("--sketch", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"),
+                        help="sketch directory")
+    parser.add_argument("--build-path", default=None, help="build directory (default: in the system temporary directory)")
+    parser.add_argument("--extra-flags", default="", help="extra compiler flags (e.g., build option macros)")
+    parser.add_argument("--compare-flags", default=None,
+                        help="also build with these extra compiler flags, and compare the flash, RAM and step pulse "
+                             "cost of the two builds (e.g., -DMTSPIN_STATIC_CONFIGURATION=1)")
+    parser.add_argument("--skip-compile", action="store_true", help="analyse an existing build in --build-path")
+    parser.add_argument("--tool-prefix", default=None, help="toolchain program prefix (e.g., avr-)")
+    parser.add_argument("--max-flash", type=int, default=None, help="flash budget (bytes)")
+    parser.add_argument("--min-free-ram", type=int, default=None, help="RAM (bytes) that must remain free")
+    parser.add_argument("--interrupt-roots", default=None, help="functions entered by interrupts (regular expression)")
+    parser.add_argument("--indirect-call", action="append", default=[], metavar="CALLER=CALLEE",
+                        help="call through a function pointer to follow (repeatable)")
+    arguments = parser.parse_args()
+
+    board = BOARDS[arguments.fqbn]
+    build_path = arguments.build_path or os.path.join(tempfile.gettempdir(), "mtspin-memory-budget",
+                                                      arguments.fqbn.replace(":", "."))
+    build_path = os.path.abspath(build_path)
+    map_path = os.path.join(build_path, "firmware.map")
+    compare_build_path = build_path + "-compare"
+    if not arguments.skip_compile:
+        compile_sketch(arguments.fqbn, arguments.sketch, build_path, arguments.extra_flags)
+        if arguments.compare_flags is not None:
+            compile_sketch(arguments.fqbn, arguments.sketch, compare_build_path,
+                           arguments.extra_flags + " " + arguments.compare_flags)
+
+    elfs = [find_elf(build_path)]
+
+    prefix = board["tool_prefix"] if arguments.tool_prefix is None else arguments.tool_prefix
+    readelf, objdump, nm = (find_tool(prefix, name) for name in ("readelf", "objdump", "nm"))
+    max_flash = board["flash"] if arguments.max_flash is None else arguments.max_flash
+    min_free_ram = board["min_free_ram"] if arguments.min_free_ram is None else arguments.min_free_ram
+    interrupt_roots = re.compile(arguments.interrupt_roots or board["interrupt_roots"])
+    indirect_calls = INDIRECT_CALLS + [tuple(call.split("=", 1)) for call in arguments.indirect_call]
+
+    # Flash and static RAM, in total and per module.
+    sections = read_sections(readelf, elfs[0])
+    flash = sum(size for size, loaded, _ in sections.values() if loaded)
+    static_ram = sum(size for size, _, writable in sections.values() if writable)
+    stack_reserved = sum(sections[name][0] for name in board["stack_sections"] if name in sections)
+    print("Module                            Flash     RAM")
+    if os.path.exists(map_path):
+        modules = read_map(map_path, sections)
+        for name, (module_flash, module_ram) in sorted(modules.items(), key=lambda item: -item[1][0]):
+            print("{:<30} {:>8} {:>7}".format(name, module_flash, module_ram))
+    else:
+        print("(no linker map in the build directory; totals only)")
+
+    print("{:<30} {:>8} {:>7}".format("Total", flash, static_ram))
+
+    # Worst-case stack depth.
+    stack_usage = read_stack_usage(build_path)
+    graph = read_call_graph(objdump, elfs[0])
+    for caller, callee in indirect_calls:
+        if caller in graph:
+            graph[caller].add(callee)
+
+    unknown = set()
+    recursive = set()
+    main_depth = worst_stack("main", graph, stack_usage, unknown, recursive)
+    interrupt_depth = (0, [])
+    for function in graph:
+        if interrupt_roots.search(function):
+            depth = worst_stack(function, graph, stack_usage, unknown, recursive)
+            if depth[0] > interrupt_depth[0]:
+                interrupt_depth = depth
+
+    # Interrupts are assumed not to nest (as on UNO R3), so the stack is deepest when the deepest interrupt interrupts
+    # the deepest call chain of the main loop.
+    stack = main_depth[0] + interrupt_depth[0]
+    print()
+    print("Worst-case stack: {} bytes".format(stack))
+    print("  main: {} bytes: {}".format(main_depth[0], " -> ".join(main_depth[1])))
+    print("  interrupt: {} bytes: {}".format(interrupt_depth[0], " -> ".join(interrupt_depth[1]) or "none"))
+    path_functions = set(main_depth[1] + interrupt_depth[1])
+    unknown_on_path = sorted(path_functions & unknown)
+    if unknown_on_path:
+        print("  no stack usage data (counted as 0) for: " + ", ".join(unknown_on_path))
+    if recursive:
+        print("  recursion (counted once) in: " + ", ".join(sorted(recursive)))
+    unbounded = sorted(name for name in path_functions if not stack_usage.get(name, (0, True))[1])
+    if unbounded:
+        print("  dynamic stack usage in: " + ", ".join(unbounded))
+
+    # Budget.
+    failures = []
+    if flash > max_flash:
+        failures.append("flash {} > {} bytes".format(flash, max_flash))
+
+    if stack_reserved > 0:
+        free_ram = board["ram"] - static_ram
+        if stack > stack_reserved:
+            failures.append("stack {} > {} bytes reserved".format(stack, stack_reserved))
+    else:
+        free_ram = board["ram"] - static_ram - stack
+
+    if free_ram < min_free_ram:
+        failures.append("free RAM {} < {} bytes".format(free_ram, min_free_ram))
+
+    heap_references = find_heap_references(nm, build_path)
+    for path, symbols in heap_references.items():
+        failures.append("heap referenced by {}: {}".format(path, ", ".join(sorted(set(symbols)))))
+
+    print()
+    print("Flash: {} of {} bytes budgeted".format(flash, max_flash))
+    print("RAM: {} static + {} stack of {} bytes; {} free (budget: at least {})".format(
+        static_ram, stack, board["ram"], free_ram, min_free_ram))
+    print("Heap: " + ("referenced" if heap_references else "not referenced by the sketch"))
+
+    # Comparison with the build with the extra flags (not budgeted).
+    if arguments.compare_flags is not None:
+        print()
+        print("Comparison with " + arguments.compare_flags + " (step pulse: " + STEP_PULSE_FUNCTION + " and its callees)")
+        print("Build                             Flash     RAM  Step pulse bytes  Step pulse instructions")
+        for name, elf in (("without", elfs[0]), ("with", find_elf(compare_build_path))):
+            print("{:<30} {:>8} {:>7} {:>17} {:>24}".format(name, *measure(readelf, objdump, elf, indirect_calls)))
+
+    if failures:
+        print("\nBudget exceeded:\n  " + "\n  ".join(failures))
+        return 1
+
+    print("\nWithin budget.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
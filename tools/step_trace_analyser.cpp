@@ -0,0 +1,353 @@
+// Copyright (C) 2024 Morgritech
+//
+// Licensed under GNU General Public License v3.0 (GPLv3) License.
+// See the LICENSE file in the project root for full license details.
+
+/// @file step_trace_analyser.cpp
+/// @brief Command line tool to analyse step/direction traces (see src/step_trace.h) captured from serial.
+///
+/// Build (Linux): g++ -std=c++17 -O2 -o step_trace_analyser tools/step_trace_analyser.cpp
+///
+/// Reconstructs the position, velocity and acceleration of each axis over time, and flags intervals where the
+/// velocity or acceleration exceed the given limits. Run with --help for the options.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// @brief Analysis options.
+struct Options {
+  int axis = -1; ///< Axis to analyse (-1 for all).
+  int window = 4; ///< No. of steps per velocity estimate.
+  double max_velocity = 0; ///< Velocity limit (microsteps/s); 0 for none.
+  double max_acceleration = 0; ///< Acceleration limit (microsteps/s^2); 0 for none.
+  const char* csv_path = nullptr; ///< Path to write per-step samples to (CSV), or nullptr.
+  const char* input_path = nullptr; ///< Path of the serial capture, or nullptr for standard input.
+};
+
+/// @brief Trace (one dump) read from a serial capture.
+struct Trace {
+  unsigned size_of_axes = 0; ///< No. of axes.
+  unsigned directions = 0; ///< Directions before the first record (bit n set for axis n positive).
+  unsigned dropped_records = 0; ///< No. of records overwritten before the dump.
+  std::vector<uint8_t> bytes; ///< Recorded bytes.
+};
+
+/// @brief Step of an axis.
+struct Step {
+  uint64_t time_us; ///< Time (us) from the first record.
+  int direction; ///< Direction (1 or -1).
+  int64_t position; ///< Position (microsteps) after the step, relative to the position before the first record.
+  double velocity; ///< Velocity (microsteps/s) over the window ending at the step; NAN if undefined.
+  double acceleration; ///< Acceleration (microsteps/s^2) over the two windows ending at the step; NAN if undefined.
+};
+
+/// @brief Run of consecutive steps exceeding a limit.
+struct Violation {
+  uint64_t start_time_us; ///< Time (us) of the first step exceeding the limit.
+  uint64_t end_time_us; ///< Time (us) of the last step exceeding the limit.
+  double worst; ///< Largest magnitude in the run.
+  unsigned count; ///< No. of steps in the run.
+};
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options] [capture file]\n"
+            << "Analyse step/direction traces (dumped with the 'c' message) in a serial capture (or standard input).\n"
+            << "  --axis N              Analyse axis N only (default: all axes).\n"
+            << "  --window N            No. of steps per velocity estimate (default: 4); larger values reduce the\n"
+            << "                        error of the estimates near rest and at high step rates (1 us resolution).\n"
+            << "  --max-velocity V      Flag steps faster than V microsteps/s.\n"
+            << "  --max-acceleration A  Flag steps accelerating faster than A microsteps/s^2.\n"
+            << "  --csv FILE            Write time (s), axis, position, velocity and acceleration of each step.\n"
+            << "Exit status: 0 if no limit was exceeded, 1 if a limit was exceeded, 2 on error.\n";
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+  for (int index = 1; index < argc; index++) {
+    std::string argument = argv[index];
+    bool has_value = index + 1 < argc;
+    if (argument == "--axis" && has_value) {
+      options.axis = std::atoi(argv[++index]);
+    }
+    else if (argument == "--window" && has_value) {
+      options.window = std::atoi(argv[++index]);
+    }
+    else if (argument == "--max-velocity" && has_value) {
+      options.max_velocity = std::atof(argv[++index]);
+    }
+    else if (argument == "--max-acceleration" && has_value) {
+      options.max_acceleration = std::atof(argv[++index]);
+    }
+    else if (argument == "--csv" && has_value) {
+      options.csv_path = argv[++index];
+    }
+    else if (argument[0] != '-' && options.input_path == nullptr) {
+      options.input_path = argv[index];
+    }
+    else {
+      return false;
+    }
+  }
+
+  return options.window >= 1;
+}
+
+int HexValue(char character) {
+  if (character >= '0' && character <= '9') return character - '0';
+  if (character >= 'A' && character <= 'F') return character - 'A' + 10;
+  if (character >= 'a' && character <= 'f') return character - 'a' + 10;
+  return -1;
+}
+
+/// @brief Read all traces from a serial capture; other lines (e.g., log messages) are ignored.
+std::vector<Trace> ReadTraces(std::istream& input) {
+  std::vector<Trace> traces;
+  std::string line;
+  bool in_trace = false;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    std::size_t header = line.find("Step trace: ");
+    if (header != std::string::npos) {
+      Trace trace;
+      unsigned size_of_bytes = 0;
+      if (std::sscanf(line.c_str() + header, "Step trace: axes %u, directions %u, records dropped %u, bytes %u",
+                      &trace.size_of_axes, &trace.directions, &trace.dropped_records, &size_of_bytes) != 4) {
+        std::cerr << "Ignoring malformed trace header: " << line << "\n";
+        continue;
+      }
+
+      trace.bytes.reserve(size_of_bytes);
+      traces.push_back(trace);
+      in_trace = true;
+      continue;
+    }
+
+    if (!in_trace) continue;
+    if (line.find("Step trace end") != std::string::npos) {
+      in_trace = false;
+      continue;
+    }
+
+    for (std::size_t index = 0; index + 1 < line.size(); index += 2) {
+      int high = HexValue(line[index]);
+      int low = HexValue(line[index + 1]);
+      if (high < 0 || low < 0) break; // Not trace data (e.g., an interleaved log message).
+      traces.back().bytes.push_back(static_cast<uint8_t>((high << 4) | low));
+    }
+  }
+
+  return traces;
+}
+
+/// @brief Decode a trace into the steps of each axis.
+bool DecodeTrace(const Trace& trace, std::vector<std::vector<Step>>& steps) {
+  steps.assign(trace.size_of_axes, {});
+  std::vector<int64_t> positions(trace.size_of_axes, 0);
+  unsigned directions = trace.directions;
+  uint64_t time_us = 0;
+  std::size_t index = 0;
+  const std::vector<uint8_t>& bytes = trace.bytes;
+  while (index < bytes.size()) {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    while (true) {
+      if (index >= bytes.size() || shift > 28) return false;
+      uint8_t byte = bytes[index++];
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      shift += 7;
+      if ((byte & 0x80) == 0) break;
+    }
+
+    bool direction_changed = (value & 1) != 0;
+    time_us += value >> 1;
+    if (index >= bytes.size()) return false;
+    uint8_t step_mask = bytes[index++];
+    if (direction_changed) {
+      if (index >= bytes.size()) return false;
+      directions = bytes[index++];
+    }
+
+    for (unsigned axis = 0; axis < trace.size_of_axes; axis++) {
+      if ((step_mask & (1U << axis)) == 0) continue;
+      int direction = (directions & (1U << axis)) != 0 ? 1 : -1;
+      positions[axis] += direction;
+      steps[axis].push_back({time_us, direction, positions[axis], NAN, NAN});
+    }
+  }
+
+  return true;
+}
+
+/// @brief Estimate the velocity and acceleration at each step of an axis.
+/// The velocity at a step is the mean over the window of steps ending at it, and is undefined if the direction changes
+/// within the window; the acceleration compares it with the velocity of the preceding window, so it is not estimated
+/// across a reversal (where the motor passes through rest between steps).
+void EstimateMotion(std::vector<Step>& steps, int window) {
+  std::size_t size = static_cast<std::size_t>(window);
+  for (std::size_t index = size; index < steps.size(); index++) {
+    bool same_direction = true;
+    for (std::size_t previous = index - size + 1; previous <= index; previous++) {
+      same_direction = same_direction && steps[previous].direction == steps[index].direction;
+    }
+
+    if (!same_direction) continue;
+    double duration_s = (steps[index].time_us - steps[index - size].time_us) / 1e6;
+    if (duration_s <= 0) continue;
+    steps[index].velocity = steps[index].direction * window / duration_s;
+    if (index < 2 * size || !(steps[index - size].velocity * steps[index].velocity > 0)) continue; // Reversal.
+    double span_s = (steps[index].time_us - steps[index - 2 * size].time_us) / 2e6; // Between window midpoints.
+    steps[index].acceleration = (steps[index].velocity - steps[index - size].velocity) / span_s;
+  }
+}
+
+/// @brief Find runs of consecutive steps whose value exceeds a limit.
+template <typename Value>
+std::vector<Violation> FindViolations(const std::vector<Step>& steps, double limit, Value value) {
+  std::vector<Violation> violations;
+  bool in_run = false;
+  for (const Step& step : steps) {
+    double magnitude = std::fabs(value(step));
+    if (std::isnan(magnitude) || magnitude <= limit) {
+      in_run = false;
+      continue;
+    }
+
+    if (!in_run) violations.push_back({step.time_us, step.time_us, 0, 0});
+    in_run = true;
+    Violation& violation = violations.back();
+    violation.end_time_us = step.time_us;
+    if (magnitude > violation.worst) violation.worst = magnitude;
+    violation.count++;
+  }
+
+  return violations;
+}
+
+void ReportViolations(const char* quantity, const char* unit, double limit,
+                      const std::vector<Violation>& violations) {
+  static constexpr std::size_t kMaxReported = 20;
+  std::printf("  %s limit %.0f %s: %zu interval(s) exceeded\n", quantity, limit, unit, violations.size());
+  for (std::size_t index = 0; index < violations.size() && index < kMaxReported; index++) {
+    const Violation& violation = violations[index];
+    std::printf("    %.6f s to %.6f s: %u step(s), worst %.0f %s\n", violation.start_time_us / 1e6,
+                violation.end_time_us / 1e6, violation.count, violation.worst, unit);
+  }
+
+  if (violations.size() > kMaxReported) std::printf("    ...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Trace> traces;
+  if (options.input_path == nullptr) {
+    traces = ReadTraces(std::cin);
+  }
+  else {
+    std::ifstream input(options.input_path);
+    if (!input) {
+      std::cerr << "Cannot open " << options.input_path << "\n";
+      return 2;
+    }
+
+    traces = ReadTraces(input);
+  }
+
+  if (traces.empty()) {
+    std::cerr << "No step trace found.\n";
+    return 2;
+  }
+
+  std::FILE* csv = nullptr;
+  if (options.csv_path != nullptr) {
+    csv = std::fopen(options.csv_path, "w");
+    if (csv == nullptr) {
+      std::cerr << "Cannot write " << options.csv_path << "\n";
+      return 2;
+    }
+
+    std::fprintf(csv, "trace,time_s,axis,position,velocity,acceleration\n");
+  }
+
+  bool exceeded = false;
+  for (std::size_t trace_index = 0; trace_index < traces.size(); trace_index++) {
+    const Trace& trace = traces[trace_index];
+    std::printf("Trace %zu: %u axes, %zu bytes, %u records dropped before the first\n", trace_index + 1,
+                trace.size_of_axes, trace.bytes.size(), trace.dropped_records);
+    std::vector<std::vector<Step>> steps;
+    if (!DecodeTrace(trace, steps)) {
+      std::cerr << "Trace " << trace_index + 1 << " is truncated or corrupt.\n";
+      if (csv != nullptr) std::fclose(csv);
+      return 2;
+    }
+
+    for (unsigned axis = 0; axis < trace.size_of_axes; axis++) {
+      if (options.axis >= 0 && static_cast<unsigned>(options.axis) != axis) continue;
+      std::vector<Step>& axis_steps = steps[axis];
+      EstimateMotion(axis_steps, options.window);
+
+      int64_t min_position = 0;
+      int64_t max_position = 0;
+      unsigned reversals = 0;
+      double max_velocity = 0;
+      double max_acceleration = 0;
+      for (std::size_t index = 0; index < axis_steps.size(); index++) {
+        const Step& step = axis_steps[index];
+        if (step.position < min_position) min_position = step.position;
+        if (step.position > max_position) max_position = step.position;
+        if (index > 0 && step.direction != axis_steps[index - 1].direction) reversals++;
+        if (!std::isnan(step.velocity)) max_velocity = std::fmax(max_velocity, std::fabs(step.velocity));
+        if (!std::isnan(step.acceleration)) {
+          max_acceleration = std::fmax(max_acceleration, std::fabs(step.acceleration));
+        }
+
+        if (csv != nullptr) {
+          std::fprintf(csv, "%zu,%.6f,%u,%lld,", trace_index + 1, step.time_us / 1e6, axis,
+                       static_cast<long long>(step.position));
+          if (!std::isnan(step.velocity)) std::fprintf(csv, "%.1f", step.velocity);
+          std::fprintf(csv, ",");
+          if (!std::isnan(step.acceleration)) std::fprintf(csv, "%.1f", step.acceleration);
+          std::fprintf(csv, "\n");
+        }
+      }
+
+      double duration_s = axis_steps.empty() ? 0 : axis_steps.back().time_us / 1e6;
+      std::printf("Axis %u: %zu steps over %.6f s, %u reversals\n", axis, axis_steps.size(), duration_s, reversals);
+      std::printf("  position: final %lld, range %lld to %lld microsteps\n",
+                  static_cast<long long>(axis_steps.empty() ? 0 : axis_steps.back().position),
+                  static_cast<long long>(min_position), static_cast<long long>(max_position));
+      std::printf("  peak velocity %.0f microsteps/s, peak acceleration %.0f microsteps/s^2\n", max_velocity,
+                  max_acceleration);
+      if (options.max_velocity > 0) {
+        std::vector<Violation> violations = FindViolations(axis_steps, options.max_velocity,
+                                                           [](const Step& step) { return step.velocity; });
+        ReportViolations("velocity", "microsteps/s", options.max_velocity, violations);
+        exceeded = exceeded || !violations.empty();
+      }
+
+      if (options.max_acceleration > 0) {
+        std::vector<Violation> violations = FindViolations(axis_steps, options.max_acceleration,
+                                                           [](const Step& step) { return step.acceleration; });
+        ReportViolations("acceleration", "microsteps/s^2", options.max_acceleration, violations);
+        exceeded = exceeded || !violations.empty();
+      }
+    }
+  }
+
+  if (csv != nullptr) std::fclose(csv);
+  return exceeded ? 1 : 0;
+}